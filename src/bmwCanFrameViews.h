@@ -0,0 +1,53 @@
+#ifndef BMWCANFRAMEVIEWS_H
+#define BMWCANFRAMEVIEWS_H
+
+#include <Arduino.h>
+
+/* ======================================================================
+   E46 PT-CAN frame views
+   ====================================================================== */
+// Each view wraps the received frame buffer without copying it and decodes fields on demand, so the cost per frame is
+// a handful of shifts regardless of how many fields we use. Layouts are from the E46 CAN matrix as collated at
+// https://www.bimmerforums.com/forum/showthread.php?1887229-E46-Can-bus-project
+
+// 0x153 ASC1 - DSC / ASC status and torque intervention requests to the DME
+struct bmwAsc1FrameView {
+  const unsigned char *buf;
+
+  bool ascRequestActive() const { return buf[0] & 0x01; }
+  bool msrRequestActive() const { return buf[0] & 0x02; }
+  bool ascPassive() const { return buf[0] & 0x04; }
+  bool brakeLightSwitch() const { return buf[0] & 0x10; }
+  float torqueInterventionPercent() const { return buf[3] * 0.390625; }     // MD_IND_ASC, fast intervention
+  float msrTorqueInterventionPercent() const { return buf[4] * 0.390625; }  // MD_IND_MSR, drag torque control
+  float slowTorqueInterventionPercent() const { return buf[6] * 0.390625; } // MD_IND_ASC_LM, slow intervention
+};
+
+// 0x1F3 ASC3 - Lateral acceleration, signed 16 bit little endian in 0.01 m/s2
+struct bmwAsc3FrameView {
+  const unsigned char *buf;
+
+  float lateralAccelerationMs2() const { return (int16_t)(buf[0] | (buf[1] << 8)) * 0.01; }
+};
+
+// 0x1F5 LWS1 - Steering angle and rate, 15 bit magnitude with a sign bit in 0.045 degree steps
+struct bmwSteeringAngleFrameView {
+  const unsigned char *buf;
+
+  static float decodeSignMagnitude(unsigned char low, unsigned char high) {
+    float magnitude = (((high & 0x7F) << 8) | low) * 0.045;
+    return (high & 0x80) ? -magnitude : magnitude;
+  }
+
+  float steeringAngleDegrees() const { return decodeSignMagnitude(buf[0], buf[1]); }
+  float steeringRateDegreesPerSecond() const { return decodeSignMagnitude(buf[2], buf[3]); }
+};
+
+// 0x1F8 ASC4 - Brake pressure in bar
+struct bmwBrakePressureFrameView {
+  const unsigned char *buf;
+
+  float brakePressureBar() const { return buf[2]; }
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "functions_alarms.h"
+#include "functions_config.h"
+
+/*****************************************************
+ *
+ * Alarm rule table
+ *
+ ****************************************************/
+// Thresholds point into the config so calibration changes take effect without touching the table. Minimum oil
+// pressure rises with RPM, 10psi is fine at idle but not at 6000 RPM so it uses a curve.
+const int engineRunningRpm = 500; // RPM above which we consider the engine to be running
+
+alarmRule alarmRules[] = {
+    // name, signal, comparator, threshold, curve, curve points, debounce, priority, pattern, engine running
+    {"oilPressure", ALARM_SIGNAL_OIL_PRESSURE, ALARM_WHEN_BELOW, NULL, config.alarmOilPressureCurve, 5, 300, 3, ALARM_PATTERN_CONTINUOUS, true, 0, false},
+    {"engineTemp", ALARM_SIGNAL_ENGINE_TEMP, ALARM_WHEN_ABOVE, &config.alarmEngineTemp, NULL, 0, 1000, 2, ALARM_PATTERN_FAST_BEEP, true, 0, false},
+    {"oilTemp", ALARM_SIGNAL_OIL_TEMP_ECM, ALARM_WHEN_ABOVE, &config.alarmOilTemp, NULL, 0, 1000, 2, ALARM_PATTERN_FAST_BEEP, true, 0, false},
+    {"fuelPressureLow", ALARM_SIGNAL_FUEL_PRESSURE, ALARM_WHEN_BELOW, &config.alarmFuelPressureLow, NULL, 0, 1000, 2, ALARM_PATTERN_SLOW_BEEP, true, 0, false},
+    {"fuelPressureHigh", ALARM_SIGNAL_FUEL_PRESSURE, ALARM_WHEN_ABOVE, &config.alarmFuelPressureHigh, NULL, 0, 1000, 1, ALARM_PATTERN_SLOW_BEEP, true, 0, false},
+    {"crankCaseVacuum", ALARM_SIGNAL_CRANK_CASE_VACUUM, ALARM_WHEN_BELOW, &config.alarmCrankCaseVacuum, NULL, 0, 1000, 1, ALARM_PATTERN_SLOW_BEEP, true, 0, false},
+};
+
+const int numberOfAlarmRules = sizeof(alarmRules) / sizeof(alarmRules[0]);
+
+/*****************************************************
+ *
+ * Function - Get the threshold for a rule at the current RPM
+ *
+ ****************************************************/
+float getAlarmRuleThreshold(const alarmRule *rule, int rpm) {
+  if (rule->thresholdCurve == NULL || rule->thresholdCurvePoints == 0) {
+    return *rule->threshold;
+  }
+
+  const alarmThresholdPoint *curve = rule->thresholdCurve;
+  int lastPoint = rule->thresholdCurvePoints - 1;
+
+  if (rpm <= curve[0].rpm) {
+    return curve[0].threshold;
+  } else if (rpm >= curve[lastPoint].rpm) {
+    return curve[lastPoint].threshold;
+  }
+
+  int i;
+  for (i = 0; i < lastPoint - 1; ++i) {
+    if (curve[i + 1].rpm >= rpm) {
+      break;
+    }
+  }
+
+  float x0 = curve[i].rpm;
+  float x1 = curve[i + 1].rpm;
+  float y0 = curve[i].threshold;
+  float y1 = curve[i + 1].threshold;
+
+  return y0 + (y1 - y0) * (rpm - x0) / (x1 - x0);
+}
+
+/*****************************************************
+ *
+ * Function - Evaluate all rules for a signal as soon as a new value for it is available
+ *
+ ****************************************************/
+bool activeAlarmListChanged = false;
+
+void updateAlarmSignal(alarmSignal signal, float value, int rpm) {
+  for (int i = 0; i < numberOfAlarmRules; i++) {
+    alarmRule *rule = &alarmRules[i];
+    if (rule->signal != signal) {
+      continue;
+    }
+
+    float threshold = getAlarmRuleThreshold(rule, rpm);
+    bool inCondition = (rule->comparator == ALARM_WHEN_ABOVE) ? value > threshold : value < threshold;
+
+    if (rule->requiresEngineRunning && rpm <= engineRunningRpm) {
+      inCondition = false;
+    }
+
+    if (inCondition) {
+      if (rule->conditionStartMillis == 0) {
+        rule->conditionStartMillis = millis();
+      }
+    } else {
+      rule->conditionStartMillis = 0;
+      if (rule->active) {
+        rule->active = false;
+        activeAlarmListChanged = true;
+      }
+    }
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Raise debounced alarms and drive the buzzer with the highest priority pattern
+ *
+ ****************************************************/
+bool alarmBuzzerOn = false;
+
+void serviceAlarms(int alarmBuzzerPin, int engineRpm) {
+  alarmRule *highestPriorityRule = NULL;
+
+  for (int i = 0; i < numberOfAlarmRules; i++) {
+    alarmRule *rule = &alarmRules[i];
+
+    // Drop alarms which need the engine running as soon as it stops rather than waiting for the next sample
+    if (rule->requiresEngineRunning && engineRpm <= engineRunningRpm) {
+      rule->conditionStartMillis = 0;
+      if (rule->active) {
+        rule->active = false;
+        activeAlarmListChanged = true;
+      }
+    }
+
+    if (!rule->active && rule->conditionStartMillis != 0 &&
+        millis() - rule->conditionStartMillis >= rule->debounceMs) {
+      rule->active = true;
+      activeAlarmListChanged = true;
+    }
+
+    if (rule->active && (highestPriorityRule == NULL || rule->priority > highestPriorityRule->priority)) {
+      highestPriorityRule = rule;
+    }
+  }
+
+  // Work out if the buzzer should currently be sounding for the selected pattern
+  bool buzzerShouldBeOn = false;
+  if (highestPriorityRule != NULL) {
+    switch (highestPriorityRule->pattern) {
+    case ALARM_PATTERN_CONTINUOUS:
+      buzzerShouldBeOn = true;
+      break;
+    case ALARM_PATTERN_FAST_BEEP:
+      buzzerShouldBeOn = (millis() % 200) < 100;
+      break;
+    case ALARM_PATTERN_SLOW_BEEP:
+      buzzerShouldBeOn = (millis() % 1000) < 500;
+      break;
+    }
+  }
+
+  // Only touch the buzzer on a change so other users of the pin are not stomped on every loop
+  if (buzzerShouldBeOn && !alarmBuzzerOn) {
+    tone(alarmBuzzerPin, 4000);
+  } else if (!buzzerShouldBeOn && alarmBuzzerOn) {
+    noTone(alarmBuzzerPin);
+  }
+  alarmBuzzerOn = buzzerShouldBeOn;
+}
+
+/*****************************************************
+ *
+ * Functions - Report on the state of active alarms
+ *
+ ****************************************************/
+bool isAlarmBuzzerOn() { return alarmBuzzerOn; }
+
+bool isAlarmActive() {
+  for (int i = 0; i < numberOfAlarmRules; i++) {
+    if (alarmRules[i].active) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool hasActiveAlarmListChanged() {
+  bool changed = activeAlarmListChanged;
+  activeAlarmListChanged = false;
+  return changed;
+}
+
+// Built in a fixed buffer, every rule's name and a comma between each fits with room to spare
+const char *getActiveAlarmList() {
+  static char alarmList[128];
+  int length = 0;
+  alarmList[0] = '\0';
+  for (int i = 0; i < numberOfAlarmRules; i++) {
+    if (alarmRules[i].active) {
+      length += snprintf(alarmList + length, sizeof(alarmList) - length, "%s%s", length > 0 ? "," : "",
+                         alarmRules[i].name);
+      length = min(length, (int)sizeof(alarmList) - 1);
+    }
+  }
+  return alarmList;
+}
@@ -0,0 +1,58 @@
+#ifndef FUNCTIONS_ALARMS_H
+#define FUNCTIONS_ALARMS_H
+
+#include <Arduino.h>
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+// The input signals which alarm rules can be evaluated against
+enum alarmSignal {
+  ALARM_SIGNAL_OIL_TEMP_ECM,
+  ALARM_SIGNAL_ENGINE_TEMP,
+  ALARM_SIGNAL_OIL_PRESSURE,
+  ALARM_SIGNAL_CRANK_CASE_VACUUM,
+  ALARM_SIGNAL_FUEL_PRESSURE,
+  ALARM_SIGNAL_COUNT
+};
+
+enum alarmComparator { ALARM_WHEN_ABOVE, ALARM_WHEN_BELOW };
+
+enum alarmBuzzerPattern { ALARM_PATTERN_CONTINUOUS, ALARM_PATTERN_FAST_BEEP, ALARM_PATTERN_SLOW_BEEP };
+
+// A point on an RPM indexed threshold curve, values between points are linearly interpolated
+struct alarmThresholdPoint {
+  int rpm;
+  float threshold;
+};
+
+struct alarmRule {
+  const char *name;                          // Short name used in the active alarm list over MQTT
+  alarmSignal signal;                        // The signal this rule is evaluated against
+  alarmComparator comparator;                // Alarm when the signal is above or below the threshold
+  const float *threshold;                    // Fixed threshold in the config, used when there is no curve
+  const alarmThresholdPoint *thresholdCurve; // Optional RPM indexed threshold curve
+  byte thresholdCurvePoints;                 // Number of points in the curve
+  unsigned long debounceMs;                  // How long the condition must hold before the alarm is raised
+  byte priority;                             // Higher priority alarms choose the buzzer pattern
+  alarmBuzzerPattern pattern;                // Buzzer pattern to sound while this alarm is the highest priority
+  bool requiresEngineRunning;                // Only raise the alarm while the engine is running
+  unsigned long conditionStartMillis;        // When the condition was first seen, 0 when not in condition
+  bool active;                               // Has the alarm been raised
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void updateAlarmSignal(alarmSignal, float, int);
+void serviceAlarms(int, int);
+bool isAlarmActive();
+bool isAlarmBuzzerOn();
+bool hasActiveAlarmListChanged();
+const char *getActiveAlarmList();
+
+#endif
@@ -0,0 +1,60 @@
+#include "functions_boot.h"
+#include "functions_log.h"
+
+/*****************************************************
+ *
+ * Function - Run at most one boot task step per call so no single loop is held up
+ *
+ ****************************************************/
+void serviceBootTasks(bootTask *tasks, int taskCount) {
+  unsigned long nowMillis = millis();
+
+  for (int i = 0; i < taskCount; i++) {
+    bootTask *task = &tasks[i];
+    if (task->done || task->failed) {
+      continue;
+    }
+    if (task->attempts > 0 && nowMillis - task->lastRunMillis < task->intervalMs) {
+      continue;
+    }
+
+    task->lastRunMillis = nowMillis;
+    if (task->attempts < 255) {
+      task->attempts++;
+    }
+
+    if (task->step()) {
+      task->done = true;
+      task->completedMillis = millis();
+    } else if (task->maxAttempts != 0 && task->attempts >= task->maxAttempts) {
+      task->failed = true;
+      LOG_ERROR(LOG_MODULE_GENERAL, "Boot task %s failed", task->name);
+    }
+    return;
+  }
+}
+
+bool areBootTasksComplete(const bootTask *tasks, int taskCount) {
+  for (int i = 0; i < taskCount; i++) {
+    if (!tasks[i].done && !tasks[i].failed) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*****************************************************
+ *
+ * Function - Report when each boot task finished
+ *
+ ****************************************************/
+void reportBootTasks(const bootTask *tasks, int taskCount) {
+  for (int i = 0; i < taskCount; i++) {
+    if (tasks[i].failed) {
+      LOG_ERROR(LOG_MODULE_GENERAL, "Boot task %s failed", tasks[i].name);
+    } else {
+      LOG_INFO(LOG_MODULE_GENERAL, "Boot task %s done at %lu ms after %lu attempts", tasks[i].name,
+               tasks[i].completedMillis, (unsigned long)tasks[i].attempts);
+    }
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef FUNCTIONS_BOOT_H
+#define FUNCTIONS_BOOT_H
+
+#include <Arduino.h>
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+// A piece of start up work run in the background from the loop so setup can return as soon as the cluster is fed.
+// The step returns true once the task has finished, it is called every intervalMs until then.
+struct bootTask {
+  const char *name;
+  bool (*step)();
+  unsigned long intervalMs;
+  byte maxAttempts;                  // Give up after this many calls, 0 to keep going until the step finishes
+  byte attempts = 0;
+  bool done = false;
+  bool failed = false;
+  unsigned long lastRunMillis = 0;
+  unsigned long completedMillis = 0; // Time since power on when the task finished
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void serviceBootTasks(bootTask *, int);
+bool areBootTasksComplete(const bootTask *, int);
+void reportBootTasks(const bootTask *, int);
+
+#endif
@@ -0,0 +1,298 @@
+#include "functions_can_filters.h"
+#include "functions_log.h"
+
+/*****************************************************
+ *
+ * Variables - MCP2515 acceptance filter layout
+ *
+ ****************************************************/
+const unsigned long standardIdMask = 0x7FF;
+const int maxStandardIds = 2048;
+const int filtersPerMask[2] = {2, 4};
+const int maxFilterClusters = 6;
+const int maxBusFalseAcceptRate = 0x7FFFFFFF; // Worse than any plan, so the first one scored against a capture wins
+
+// A group of IDs covered by one filter, only the bits set in careMask have to match value
+struct canFilterCluster {
+  unsigned long value;
+  unsigned long careMask;
+};
+
+/*****************************************************
+ *
+ * Function - Check whether the hardware would accept an ID with a given plan
+ *
+ ****************************************************/
+bool canFilterPlanAccepts(const canFilterPlan *plan, unsigned long canId) {
+  for (int i = 0; i < 6; i++) {
+    unsigned long mask = plan->masks[i < 2 ? 0 : 1];
+    if ((canId & mask) == (plan->filters[i] & mask)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*****************************************************
+ *
+ * Function - Count the standard IDs a plan accepts without trying each of them
+ *
+ ****************************************************/
+// A filter accepts 2^(bits its mask ignores) IDs. Two filters in one bank share a mask so they are either the same set
+// or disjoint, a filter from each bank overlaps the other in 2^(bits neither mask cares about) IDs if they agree on the
+// bits both care about. No ID can be in more than one filter per bank, so subtracting the pairwise overlaps is exact.
+bool isRepeatedCanFilter(const canFilterPlan *plan, int filter) {
+  int firstFilter = filter < 2 ? 0 : 2;
+  unsigned long mask = plan->masks[filter < 2 ? 0 : 1] & standardIdMask;
+  for (int i = firstFilter; i < filter; i++) {
+    if (((plan->filters[i] ^ plan->filters[filter]) & mask) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int countCanFilterPlanAccepts(const canFilterPlan *plan) {
+  unsigned long maskZero = plan->masks[0] & standardIdMask;
+  unsigned long maskOne = plan->masks[1] & standardIdMask;
+  int acceptedCount = 0;
+
+  for (int i = 0; i < 6; i++) {
+    if (isRepeatedCanFilter(plan, i)) {
+      continue;
+    }
+    unsigned long mask = i < 2 ? maskZero : maskOne;
+    acceptedCount += 1 << (11 - __builtin_popcount(mask));
+
+    for (int j = 0; i >= 2 && j < 2; j++) {
+      if (!isRepeatedCanFilter(plan, j) && ((plan->filters[i] ^ plan->filters[j]) & maskZero & maskOne) == 0) {
+        acceptedCount -= 1 << (11 - __builtin_popcount(maskZero | maskOne));
+      }
+    }
+  }
+  return acceptedCount;
+}
+
+bool isConsumedCanId(const unsigned long *ids, int idCount, unsigned long canId) {
+  for (int i = 0; i < idCount; i++) {
+    if ((ids[i] & standardIdMask) == canId) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int countCanFilterPlanFalseAccepts(const canFilterPlan *plan, const unsigned long *ids, int idCount) {
+  // Don't count duplicate wanted IDs twice
+  int wantedCount = 0;
+  for (int i = 0; i < idCount; i++) {
+    if (!isConsumedCanId(ids, i, ids[i] & standardIdMask)) {
+      wantedCount++;
+    }
+  }
+  return countCanFilterPlanAccepts(plan) - wantedCount;
+}
+
+// Each captured ID costs the frames per second it was seen at, an ID seen in the capture always costs at least one.
+// Without rates every ID counts as one
+int getCanFilterBusIdRate(const uint16_t *busIdRates, int i) {
+  if (busIdRates == NULL || busIdRates[i] == 0) {
+    return 1;
+  }
+  return busIdRates[i];
+}
+
+// Frames per second from captured IDs a merged cluster would let through which nothing consumes
+int countCanFilterClusterBusFalseAccepts(unsigned long value, unsigned long careMask, const unsigned long *ids,
+                                         int idCount, const uint16_t *busIds, const uint16_t *busIdRates,
+                                         int busIdCount) {
+  int falseAcceptRate = 0;
+  for (int i = 0; i < busIdCount; i++) {
+    if (((busIds[i] ^ value) & careMask) == 0 && !isConsumedCanId(ids, idCount, busIds[i])) {
+      falseAcceptRate += getCanFilterBusIdRate(busIdRates, i);
+    }
+  }
+  return falseAcceptRate;
+}
+
+// Frames per second from a capture of the bus which the plan lets through but nothing consumes, every one of them is
+// an interrupt and a read the loop pays for, so a 100 Hz ID outweighs several that are sent once a second
+int countCanFilterPlanBusFalseAccepts(const canFilterPlan *plan, const unsigned long *ids, int idCount,
+                                      const uint16_t *busIds, const uint16_t *busIdRates, int busIdCount) {
+  int falseAcceptRate = 0;
+  for (int i = 0; i < busIdCount; i++) {
+    if (canFilterPlanAccepts(plan, busIds[i]) && !isConsumedCanId(ids, idCount, busIds[i])) {
+      falseAcceptRate += getCanFilterBusIdRate(busIdRates, i);
+    }
+  }
+  return falseAcceptRate;
+}
+
+/*****************************************************
+ *
+ * Function - Build a plan for one assignment of clusters to the two masks
+ *
+ ****************************************************/
+canFilterPlan buildCanFilterPlan(const canFilterCluster *clusters, int clusterCount, int bankOneClusters) {
+  canFilterPlan plan;
+
+  for (int bank = 0; bank < 2; bank++) {
+    unsigned long bankMask = standardIdMask;
+    int firstFilter = (bank == 0) ? 0 : 2;
+    int filterCount = 0;
+
+    for (int i = 0; i < clusterCount; i++) {
+      bool inBankOne = bankOneClusters & (1 << i);
+      if (inBankOne == (bank == 1)) {
+        bankMask &= clusters[i].careMask;
+        plan.filters[firstFilter + filterCount++] = clusters[i].value;
+      }
+    }
+
+    // An empty bank just repeats a filter from the other bank with an exact mask so it accepts nothing extra
+    if (filterCount == 0) {
+      plan.filters[firstFilter] = clusters[0].value;
+      for (int i = 0; i < clusterCount; i++) {
+        if ((bool)(bankOneClusters & (1 << i)) != (bank == 1)) {
+          plan.filters[firstFilter] = clusters[i].value;
+          break;
+        }
+      }
+      filterCount = 1;
+    }
+
+    // Unused filters repeat the first one in the bank
+    for (int i = filterCount; i < filtersPerMask[bank]; i++) {
+      plan.filters[firstFilter + i] = plan.filters[firstFilter];
+    }
+    plan.masks[bank] = bankMask;
+  }
+
+  return plan;
+}
+
+/*****************************************************
+ *
+ * Function - Compute the mask and filter assignment which accepts the IDs with the fewest false accepts
+ *
+ ****************************************************/
+// Up to six IDs each get an exact filter. Beyond that the closest clusters (the ones whose merge frees the fewest
+// ID bits) are merged until six remain, then every split of those clusters across the two masks is scored. With a
+// capture of the IDs actually on the bus and their rates (see captureCanSniffIds) the merges and split letting the
+// fewest of their frames through win, ties and plans without a capture go to the fewest false accepts over the whole
+// standard ID space. busIdRates may be NULL to weight every captured ID the same.
+canFilterPlan planCanFilters(const unsigned long *ids, int idCount, const uint16_t *busIds, const uint16_t *busIdRates,
+                             int busIdCount) {
+  canFilterCluster clusters[32];
+  int clusterCount = 0;
+
+  for (int i = 0; i < idCount && clusterCount < 32; i++) {
+    bool duplicate = false;
+    for (int j = 0; j < clusterCount; j++) {
+      duplicate |= (clusters[j].value == (ids[i] & standardIdMask));
+    }
+    if (!duplicate) {
+      clusters[clusterCount].value = ids[i] & standardIdMask;
+      clusters[clusterCount].careMask = standardIdMask;
+      clusterCount++;
+    }
+  }
+
+  // Nothing to receive, accept only ID 0 which is never used on either bus
+  if (clusterCount == 0) {
+    clusters[0].value = 0;
+    clusters[0].careMask = standardIdMask;
+    clusterCount = 1;
+  }
+
+  while (clusterCount > maxFilterClusters) {
+    int bestI = 0;
+    int bestJ = 1;
+    int bestCareBits = -1;
+    int bestBusFalseAccepts = maxBusFalseAcceptRate;
+
+    for (int i = 0; i < clusterCount; i++) {
+      for (int j = i + 1; j < clusterCount; j++) {
+        unsigned long mergedMask = clusters[i].careMask & clusters[j].careMask & ~(clusters[i].value ^ clusters[j].value);
+        int careBits = __builtin_popcount(mergedMask);
+        int busFalseAccepts = countCanFilterClusterBusFalseAccepts(clusters[i].value, mergedMask, ids, idCount, busIds,
+                                                                   busIdRates, busIdCount);
+        if (busFalseAccepts < bestBusFalseAccepts ||
+            (busFalseAccepts == bestBusFalseAccepts && careBits > bestCareBits)) {
+          bestBusFalseAccepts = busFalseAccepts;
+          bestCareBits = careBits;
+          bestI = i;
+          bestJ = j;
+        }
+      }
+    }
+
+    clusters[bestI].careMask &= clusters[bestJ].careMask & ~(clusters[bestI].value ^ clusters[bestJ].value);
+    clusters[bestJ] = clusters[--clusterCount];
+  }
+
+  canFilterPlan bestPlan = buildCanFilterPlan(clusters, clusterCount, 0);
+  bestPlan.falseAcceptCount = maxStandardIds;
+  bestPlan.busFalseAcceptCount = busIdCount > 0 ? maxBusFalseAcceptRate : -1;
+
+  for (int bankOneClusters = 0; bankOneClusters < (1 << clusterCount); bankOneClusters++) {
+    int bankOneCount = __builtin_popcount(bankOneClusters);
+    if (bankOneCount > filtersPerMask[1] || clusterCount - bankOneCount > filtersPerMask[0]) {
+      continue;
+    }
+
+    canFilterPlan plan = buildCanFilterPlan(clusters, clusterCount, bankOneClusters);
+    plan.falseAcceptCount = countCanFilterPlanFalseAccepts(&plan, ids, idCount);
+    plan.busFalseAcceptCount = -1;
+    if (busIdCount > 0) {
+      plan.busFalseAcceptCount =
+          countCanFilterPlanBusFalseAccepts(&plan, ids, idCount, busIds, busIdRates, busIdCount);
+    }
+
+    bool fewerOnBus = plan.busFalseAcceptCount < bestPlan.busFalseAcceptCount;
+    bool sameOnBus = plan.busFalseAcceptCount == bestPlan.busFalseAcceptCount;
+    if (fewerOnBus || (sameOnBus && plan.falseAcceptCount < bestPlan.falseAcceptCount)) {
+      bestPlan = plan;
+    }
+  }
+
+  return bestPlan;
+}
+
+/*****************************************************
+ *
+ * Function - Write a plan to a shield
+ *
+ ****************************************************/
+void applyCanFilterPlan(mcp2515_can can, const canFilterPlan *plan) {
+  can.init_Mask(0, 0, plan->masks[0]);
+  can.init_Filt(0, 0, plan->filters[0]);
+  can.init_Filt(1, 0, plan->filters[1]);
+
+  can.init_Mask(1, 0, plan->masks[1]);
+  for (int i = 2; i < 6; i++) {
+    can.init_Filt(i, 0, plan->filters[i]);
+  }
+}
+
+void printCanFilterPlan(const canFilterPlan *plan, const char *name) {
+  serialConsole.print("INFO - ");
+  serialConsole.print(name);
+  serialConsole.print(" CAN filters, masks 0x");
+  serialConsole.print(plan->masks[0], HEX);
+  serialConsole.print(" / 0x");
+  serialConsole.print(plan->masks[1], HEX);
+  serialConsole.print(", filters");
+  for (int i = 0; i < 6; i++) {
+    serialConsole.print(" 0x");
+    serialConsole.print(plan->filters[i], HEX);
+  }
+  serialConsole.print(", false accepts ");
+  serialConsole.print(plan->falseAcceptCount);
+  if (plan->busFalseAcceptCount >= 0) {
+    serialConsole.print(", letting through ");
+    serialConsole.print(plan->busFalseAcceptCount);
+    serialConsole.print(" frames/s seen on the bus");
+  }
+  serialConsole.println();
+}
@@ -0,0 +1,31 @@
+#ifndef FUNCTIONS_CAN_FILTERS_H
+#define FUNCTIONS_CAN_FILTERS_H
+
+#include <Arduino.h>
+#include <mcp2515_can.h> // Used for Seeed shields
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+// Mask 0 applies to filters 0 and 1, mask 1 applies to filters 2 to 5
+struct canFilterPlan {
+  unsigned long masks[2];
+  unsigned long filters[6];
+  int falseAcceptCount;    // Standard IDs the hardware will accept which the firmware does not consume
+  int busFalseAcceptCount; // Frames per second of those IDs seen on the bus in the last capture, -1 without a capture
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+canFilterPlan planCanFilters(const unsigned long *, int, const uint16_t *, const uint16_t *, int);
+bool canFilterPlanAccepts(const canFilterPlan *, unsigned long);
+int countCanFilterPlanAccepts(const canFilterPlan *);
+void applyCanFilterPlan(mcp2515_can, const canFilterPlan *);
+void printCanFilterPlan(const canFilterPlan *, const char *);
+
+#endif
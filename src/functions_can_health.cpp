@@ -0,0 +1,294 @@
+#include "functions_can_health.h"
+#include "functions_log.h"
+#include "functions_mqtt.h"
+#include <SPI.h>
+
+/*****************************************************
+ *
+ * Variables - MCP2515 registers and bus constants
+ *
+ ****************************************************/
+// The Seeed driver does not expose the error counters so we read the registers directly over SPI
+const byte mcp2515InstructionRead = 0x03;
+const byte mcp2515InstructionBitModify = 0x05;
+const byte mcp2515RegisterTec = 0x1C;
+const byte mcp2515RegisterRec = 0x1D;
+const byte mcp2515RegisterEflg = 0x2D;
+const byte mcp2515RegisterCanstat = 0x0E;
+const byte mcp2515RegisterCanctrl = 0x0F;
+
+// Operation mode, OPMOD in CANSTAT and REQOP in CANCTRL
+const byte mcp2515ModeMask = 0xE0;
+const byte mcp2515ModeConfiguration = 0x80;
+
+const byte eflgRx1Overflow = 0x80;
+const byte eflgRx0Overflow = 0x40;
+const byte eflgBusOff = 0x20;
+const byte eflgTxErrorPassive = 0x10;
+const byte eflgRxErrorPassive = 0x08;
+const byte eflgErrorWarning = 0x01;
+
+const unsigned long canBitRate = 500000;
+
+canBusHealth canBusHealthStates[CAN_BUS_COUNT];
+
+/*****************************************************
+ *
+ * Functions - Direct MCP2515 register access
+ *
+ ****************************************************/
+byte readMcp2515Register(byte csPin, byte address) {
+  SPI.beginTransaction(SPISettings(10000000, MSBFIRST, SPI_MODE0));
+  digitalWrite(csPin, LOW);
+  SPI.transfer(mcp2515InstructionRead);
+  SPI.transfer(address);
+  byte value = SPI.transfer(0x00);
+  digitalWrite(csPin, HIGH);
+  SPI.endTransaction();
+  return value;
+}
+
+void modifyMcp2515Register(byte csPin, byte address, byte mask, byte data) {
+  SPI.beginTransaction(SPISettings(10000000, MSBFIRST, SPI_MODE0));
+  digitalWrite(csPin, LOW);
+  SPI.transfer(mcp2515InstructionBitModify);
+  SPI.transfer(address);
+  SPI.transfer(mask);
+  SPI.transfer(data);
+  digitalWrite(csPin, HIGH);
+  SPI.endTransaction();
+}
+
+/*****************************************************
+ *
+ * Function - Set up health monitoring for a bus
+ *
+ ****************************************************/
+void initialiseCanBusHealth(canBus bus, byte csPin, canTxQueue *txQueue) {
+  canBusHealthStates[bus].csPin = csPin;
+  canBusHealthStates[bus].txQueue = txQueue;
+}
+
+// Only frames the hardware filters let through are ever seen, so the load is the whole bus only while they are open
+void setCanBusFiltersOpen(canBus bus, bool open) { canBusHealthStates[bus].filtersOpen = open; }
+
+/*****************************************************
+ *
+ * Function - Count a received frame against its ID
+ *
+ ****************************************************/
+// Standard frames carry 47 bits of framing plus the payload, allow roughly one stuff bit in five on top
+unsigned long estimateCanFrameBits(byte len) { return 47 + 8 * len + (34 + 8 * len) / 5; }
+
+void canHealthRecordRxFrame(canBus bus, unsigned long canId, byte len) {
+  canBusHealth *health = &canBusHealthStates[bus];
+  health->lastRxMillis = millis();
+  health->rxFrames++;
+  health->rxBits += estimateCanFrameBits(len);
+
+  for (int i = 0; i < health->idCount; i++) {
+    if (health->ids[i].canId == canId) {
+      health->ids[i].frames++;
+      health->ids[i].bytes += len;
+      return;
+    }
+  }
+
+  if (health->idCount < maxCanIdStats) {
+    health->ids[health->idCount].canId = canId;
+    health->ids[health->idCount].frames = 1;
+    health->ids[health->idCount].bytes = len;
+    health->idCount++;
+  } else {
+    health->untrackedFrames++;
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Sample the error registers and count overflow and error state transitions
+ *
+ ****************************************************/
+void sampleCanBusHealth(canBus bus) {
+  canBusHealth *health = &canBusHealthStates[bus];
+  byte previousErrorFlags = health->errorFlags;
+
+  health->errorFlags = readMcp2515Register(health->csPin, mcp2515RegisterEflg);
+  health->transmitErrorCount = readMcp2515Register(health->csPin, mcp2515RegisterTec);
+  health->receiveErrorCount = readMcp2515Register(health->csPin, mcp2515RegisterRec);
+
+  // Overflow flags latch until cleared so count and clear them each sample
+  if (health->errorFlags & (eflgRx0Overflow | eflgRx1Overflow)) {
+    health->rxOverflowCount++;
+    modifyMcp2515Register(health->csPin, mcp2515RegisterEflg, eflgRx0Overflow | eflgRx1Overflow, 0x00);
+  }
+
+  byte errorPassiveFlags = eflgTxErrorPassive | eflgRxErrorPassive;
+  if ((health->errorFlags & errorPassiveFlags) && !(previousErrorFlags & errorPassiveFlags)) {
+    health->errorPassiveCount++;
+  }
+  if ((health->errorFlags & eflgBusOff) && !(previousErrorFlags & eflgBusOff)) {
+    health->busOffCount++;
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Optionally report bus health over serial and return a compact JSON summary for MQTT
+ *
+ ****************************************************/
+unsigned long canBusHealthPreviousReportMillis[CAN_BUS_COUNT];
+
+const char *getCanBusErrorState(byte errorFlags) {
+  if (errorFlags & eflgBusOff) {
+    return "busOff";
+  } else if (errorFlags & (eflgTxErrorPassive | eflgRxErrorPassive)) {
+    return "passive";
+  } else if (errorFlags & eflgErrorWarning) {
+    return "warning";
+  }
+  return "active";
+}
+
+// The summary is formatted into a buffer per bus which stays valid until that bus is reported again
+const char *reportCanBusHealth(canBus bus, const char *name, bool printToSerial) {
+  canBusHealth *health = &canBusHealthStates[bus];
+  float elapsedSeconds = (millis() - canBusHealthPreviousReportMillis[bus]) / 1000.0;
+  canBusHealthPreviousReportMillis[bus] = millis();
+  if (elapsedSeconds <= 0) {
+    elapsedSeconds = 1;
+  }
+
+  // All frames we transmit are 8 bytes long
+  unsigned long txSentCount = health->txQueue != NULL ? health->txQueue->sentCount : 0;
+  unsigned long txFrames = txSentCount - health->previousTxSentCount;
+  health->previousTxSentCount = txSentCount;
+
+  // Load from the frames we received and sent, frames rejected by the filters never reach us so with the filters
+  // applied this is the accepted load and the real bus load is higher
+  unsigned long totalBits = health->rxBits + txFrames * estimateCanFrameBits(8);
+  float acceptedLoadPercent = (totalBits / elapsedSeconds) / canBitRate * 100;
+  float rxFramesPerSecond = health->rxFrames / elapsedSeconds;
+  float txFramesPerSecond = txFrames / elapsedSeconds;
+  const char *errorState = getCanBusErrorState(health->errorFlags);
+
+  if (printToSerial) {
+    serialConsole.print("CAN health ");
+    serialConsole.print(name);
+    serialConsole.print(health->filtersOpen ? " bus load %: " : " accepted load %: ");
+    serialConsole.print(acceptedLoadPercent);
+    serialConsole.print(" rx/s: ");
+    serialConsole.print(rxFramesPerSecond);
+    serialConsole.print(" tx/s: ");
+    serialConsole.print(txFramesPerSecond);
+    serialConsole.print(" TEC: ");
+    serialConsole.print(health->transmitErrorCount);
+    serialConsole.print(" REC: ");
+    serialConsole.print(health->receiveErrorCount);
+    serialConsole.print(" overflows: ");
+    serialConsole.print(health->rxOverflowCount);
+    serialConsole.print(" state: ");
+    serialConsole.println(errorState);
+
+    for (int i = 0; i < health->idCount; i++) {
+      serialConsole.print("\t0x");
+      serialConsole.print(health->ids[i].canId, HEX);
+      serialConsole.print(" frames/s: ");
+      serialConsole.print(health->ids[i].frames / elapsedSeconds);
+      serialConsole.print(" bytes/s: ");
+      serialConsole.println(health->ids[i].bytes / elapsedSeconds);
+    }
+    if (health->untrackedFrames > 0) {
+      serialConsole.print("\tuntracked frames/s: ");
+      serialConsole.println(health->untrackedFrames / elapsedSeconds);
+    }
+  }
+
+  for (int i = 0; i < health->idCount; i++) {
+    health->ids[i].frames = 0;
+    health->ids[i].bytes = 0;
+  }
+  health->untrackedFrames = 0;
+
+  char acceptedLoad[16], rx[16], tx[16];
+  formatMqttValue(acceptedLoad, sizeof(acceptedLoad), acceptedLoadPercent, 2);
+  formatMqttValue(rx, sizeof(rx), rxFramesPerSecond, 2);
+  formatMqttValue(tx, sizeof(tx), txFramesPerSecond, 2);
+
+  static char summaries[CAN_BUS_COUNT][160];
+  char *summary = summaries[bus];
+  snprintf(summary, sizeof(summaries[bus]),
+           "{\"acceptedLoad\":%s,\"filtersOpen\":%s,\"rx\":%s,\"tx\":%s,\"tec\":%u,\"rec\":%u,\"ovr\":%lu,"
+           "\"state\":\"%s\"}",
+           acceptedLoad, health->filtersOpen ? "true" : "false", rx, tx, (unsigned)health->transmitErrorCount,
+           (unsigned)health->receiveErrorCount, health->rxOverflowCount, errorState);
+
+  health->rxFrames = 0;
+  health->rxBits = 0;
+  return summary;
+}
+
+/*****************************************************
+ *
+ * Function - Read back the mode registers to tell a quiet bus from a controller that has stopped answering
+ *
+ ****************************************************/
+// A chip that has dropped off SPI reads back 0xFF, one that has reset itself sits in configuration mode, and either way
+// the mode it reports no longer matches the mode requested when it was initialised
+bool isCanControllerResponding(canBus bus) {
+  byte csPin = canBusHealthStates[bus].csPin;
+  byte canstat = readMcp2515Register(csPin, mcp2515RegisterCanstat);
+  byte canctrl = readMcp2515Register(csPin, mcp2515RegisterCanctrl);
+
+  if (canstat == 0xFF || canctrl == 0xFF) {
+    return false;
+  }
+  byte mode = canstat & mcp2515ModeMask;
+  return mode == (canctrl & mcp2515ModeMask) && mode != mcp2515ModeConfiguration;
+}
+
+/*****************************************************
+ *
+ * Function - Decide if a shield is still working from the last health sample and its traffic
+ *
+ ****************************************************/
+// A bus is treated as wedged when it has gone bus off, frames have been waiting to go out for the timeout without any
+// of them leaving, or nothing has been received for the timeout and the controller no longer reads back its mode. A
+// quiet bus with the ignition off and a healthy controller is left alone rather than re-initialised every retry
+bool isCanBusAlive(canBus bus, unsigned long timeoutMs) {
+  canBusHealth *health = &canBusHealthStates[bus];
+  unsigned long nowMillis = millis();
+
+  if (health->errorFlags & eflgBusOff) {
+    return false;
+  }
+  if (nowMillis - health->lastRxMillis > timeoutMs && !isCanControllerResponding(bus)) {
+    return false;
+  }
+
+  if (health->txQueue != NULL) {
+    int waitingFrames = 0;
+    for (int priority = 0; priority < CAN_TX_PRIORITY_COUNT; priority++) {
+      waitingFrames += health->txQueue->count[priority];
+    }
+    if (waitingFrames == 0 || health->txQueue->sentCount != health->txProgressSentCount) {
+      health->txProgressSentCount = health->txQueue->sentCount;
+      health->lastTxProgressMillis = nowMillis;
+    } else if (nowMillis - health->lastTxProgressMillis > timeoutMs) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Called once a shield has been initialised so it gets a full timeout to show it is working
+void resetCanBusLiveness(canBus bus) {
+  canBusHealth *health = &canBusHealthStates[bus];
+  health->errorFlags = 0;
+  health->lastRxMillis = millis();
+  health->lastTxProgressMillis = millis();
+  if (health->txQueue != NULL) {
+    health->txProgressSentCount = health->txQueue->sentCount;
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef FUNCTIONS_CAN_HEALTH_H
+#define FUNCTIONS_CAN_HEALTH_H
+
+#include <Arduino.h>
+
+#include "functions_can_tx_queue.h"
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+enum canBus { CAN_BUS_BMW, CAN_BUS_NISSAN, CAN_BUS_COUNT };
+
+struct canIdStats {
+  unsigned long canId;
+  unsigned long frames; // Frames received since the last report
+  unsigned long bytes;  // Payload bytes received since the last report
+};
+
+const int maxCanIdStats = 16; // IDs tracked per bus, anything beyond this is counted as untracked
+
+struct canBusHealth {
+  byte csPin = 0;                      // Slave select pin used for direct register reads
+  canTxQueue *txQueue = NULL;          // Transmit queue for the bus, used to count frames we send
+  byte errorFlags = 0;                 // Last EFLG register value
+  byte transmitErrorCount = 0;         // Last TEC register value
+  byte receiveErrorCount = 0;          // Last REC register value
+  unsigned long rxOverflowCount = 0;   // RX0OVR / RX1OVR events since boot
+  unsigned long errorPassiveCount = 0; // Transitions into error passive since boot
+  unsigned long busOffCount = 0;       // Transitions into bus off since boot
+  bool filtersOpen = false;            // Masks open, so received frames are the whole bus and not just what is accepted
+  unsigned long rxFrames = 0;          // Frames received since the last report
+  unsigned long rxBits = 0;            // Estimated bits on the wire received since the last report
+  unsigned long previousTxSentCount = 0;
+  unsigned long lastRxMillis = 0;         // When a frame was last received, used by the supervisor liveness check
+  unsigned long lastTxProgressMillis = 0; // When the transmit queue was last seen empty or moving
+  unsigned long txProgressSentCount = 0;  // Transmit queue sent count at that time
+  canIdStats ids[maxCanIdStats];
+  int idCount = 0;
+  unsigned long untrackedFrames = 0;
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void initialiseCanBusHealth(canBus, byte, canTxQueue *);
+void setCanBusFiltersOpen(canBus, bool);
+void canHealthRecordRxFrame(canBus, unsigned long, byte);
+void sampleCanBusHealth(canBus);
+const char *reportCanBusHealth(canBus, const char *, bool);
+bool isCanControllerResponding(canBus);
+bool isCanBusAlive(canBus, unsigned long);
+void resetCanBusLiveness(canBus);
+
+#endif
@@ -0,0 +1,71 @@
+#include "functions_can_output.h"
+#include "functions_log.h"
+
+/*****************************************************
+ *
+ * Function - Send a frame if the payload has changed or the refresh floor has expired
+ *
+ ****************************************************/
+const int maxCanOutputFrames = 8;
+canOutputFrame *canOutputFrames[maxCanOutputFrames]; // Frames we have seen, used for stats reporting
+int canOutputFrameCount = 0;
+
+bool canOutputSend(canTxQueue *queue, canOutputFrame *frame, const unsigned char *payload) {
+  if (!frame->registered && canOutputFrameCount < maxCanOutputFrames) {
+    canOutputFrames[canOutputFrameCount++] = frame;
+    frame->registered = true;
+  }
+
+  bool payloadChanged = memcmp(frame->lastPayload, payload, 8) != 0;
+  bool refreshDue = millis() - frame->lastSentMillis >= frame->minRefreshMs;
+
+  if (frame->everSent && !payloadChanged && !refreshDue) {
+    return false;
+  }
+
+  if (!canTxQueueSubmit(queue, frame->canId, 8, payload, frame->priority)) {
+    return false;
+  }
+
+  frame->queue = queue;
+  memcpy(frame->lastPayload, payload, 8);
+  frame->lastSentMillis = millis();
+  frame->everSent = true;
+  frame->sentCount++;
+  return true;
+}
+
+/*****************************************************
+ *
+ * Function - Report frames sent and SPI time saved per CAN ID compared to the old fixed rate
+ *
+ ****************************************************/
+unsigned long canOutputStatsPreviousMillis;
+
+void reportCanOutputStats() {
+  float elapsedSeconds = (millis() - canOutputStatsPreviousMillis) / 1000.0;
+  canOutputStatsPreviousMillis = millis();
+  if (elapsedSeconds <= 0) {
+    return;
+  }
+
+  for (int i = 0; i < canOutputFrameCount; i++) {
+    canOutputFrame *frame = canOutputFrames[i];
+    float averageSendMicros = frame->queue != NULL ? getCanTxQueueAverageSendMicros(frame->queue) : 0;
+    float sentPerSecond = frame->sentCount / elapsedSeconds;
+    float savedPerSecond = (frame->legacyPeriodMs > 0) ? (1000.0 / frame->legacyPeriodMs) - sentPerSecond : 0;
+
+    serialConsole.print("CAN output 0x");
+    serialConsole.print(frame->canId, HEX);
+    serialConsole.print(" sent/s: ");
+    serialConsole.print(sentPerSecond);
+    serialConsole.print(" saved/s: ");
+    serialConsole.print(savedPerSecond);
+    serialConsole.print(" avg send us: ");
+    serialConsole.print(averageSendMicros);
+    serialConsole.print(" SPI us/s saved: ");
+    serialConsole.println(savedPerSecond * averageSendMicros);
+
+    frame->sentCount = 0;
+  }
+}
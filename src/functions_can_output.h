@@ -0,0 +1,44 @@
+#ifndef FUNCTIONS_CAN_OUTPUT_H
+#define FUNCTIONS_CAN_OUTPUT_H
+
+#include <Arduino.h>
+#include "functions_can_tx_queue.h"
+
+/****************************************************
+ *
+ * Refresh floors
+ *
+ ****************************************************/
+// Frames are sent straight away on change, otherwise repeated at these periods. The cluster drops the needles and
+// lights the warning lamps if it stops hearing the DME frames so keep this well inside its timeout.
+const unsigned long canOutputClusterRefreshMs = 50;
+const unsigned long canOutputEcmRefreshMs = 20;
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+// Tracks the last payload sent for a CAN ID so we only transmit on change or when the refresh floor expires
+struct canOutputFrame {
+  unsigned long canId = 0;
+  unsigned long minRefreshMs = 0;       // Maximum time between frames when the payload is not changing
+  unsigned long legacyPeriodMs = 0;     // The fixed period this frame used to be sent at, used to report savings
+  canTxPriority priority = CAN_TX_PRIORITY_HIGH;
+  canTxQueue *queue = NULL;             // The queue this frame was last submitted to
+  unsigned char lastPayload[8] = {0};   // The payload last put on the bus
+  unsigned long lastSentMillis = 0;     // When the payload was last put on the bus
+  bool everSent = false;                // Has this frame been sent since boot
+  bool registered = false;              // Has this frame been added to the stats table
+  unsigned long sentCount = 0;          // Frames sent since the last stats report
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+bool canOutputSend(canTxQueue *, canOutputFrame *, const unsigned char *);
+void reportCanOutputStats();
+
+#endif
@@ -0,0 +1,335 @@
+#include "functions_can_sniff.h"
+#include "functions_config.h"
+#include "functions_mqtt.h"
+#include "functions_log.h"
+
+/*****************************************************
+ *
+ * Variables - Sniff mode state and ID table
+ *
+ ****************************************************/
+const int canSniffTableSize = 64; // Must be a power of two, both buses together rarely carry more than 40 IDs
+canSniffEntry canSniffTable[canSniffTableSize];
+int canSniffTableCount = 0;
+unsigned long canSniffTableFullCount = 0; // Frames with a new ID which could not be added
+unsigned long canSniffLawicelDropped = 0; // Frames not streamed as the serial transmit buffer was full
+
+canSniffMode currentCanSniffMode = CAN_SNIFF_OFF;
+unsigned long canSniffStartMillis = 0; // When the table was last cleared, the captured rates are over this session
+bool lawicelTimestampsEnabled = false;
+
+// Both buses share the one LAWICEL stream, so each frame goes out as an extended frame with the bus in the digit above
+// the standard ID. CANHacker shows BMW 0x1F0 as 000011F0 and Nissan 0x23D as 0000223D
+const unsigned long canSniffBusMarker[CAN_BUS_COUNT] = {0x1000, 0x2000};
+
+// The MQTT summary goes out a few IDs per loop from a cursor into the table rather than all at once
+const int canSniffReportEntriesPerLoop = 2;
+int canSniffReportIndex = canSniffTableSize; // At the end of the table when no report is in progress
+bool canSniffReportToSerial = false;
+
+bool isCanSniffActive() { return currentCanSniffMode != CAN_SNIFF_OFF; }
+canSniffMode getCanSniffMode() { return currentCanSniffMode; }
+
+/*****************************************************
+ *
+ * Function - Keep the IDs seen on each bus in the configuration for planning the hardware filters
+ *
+ ****************************************************/
+// Only a session which saw traffic replaces the last capture, sniffing with the ignition off would otherwise wipe it.
+// Each ID's rate is its frame count over the whole session rounded up, so one seen only once still weighs something
+void captureCanSniffIds() {
+  if (canSniffTableCount == 0) {
+    return;
+  }
+
+  int maxCapturedIds = sizeof(config.canCapturedIds[0]) / sizeof(config.canCapturedIds[0][0]);
+  unsigned long sessionMillis = max(millis() - canSniffStartMillis, 1UL);
+  for (int bus = 0; bus < CAN_BUS_COUNT; bus++) {
+    config.canCapturedIdCount[bus] = 0;
+  }
+  for (int i = 0; i < canSniffTableSize; i++) {
+    uint16_t key = canSniffTable[i].key;
+    int bus = key >> 11;
+    if (key != 0xFFFF && config.canCapturedIdCount[bus] < maxCapturedIds) {
+      unsigned long framesPerSecond = (canSniffTable[i].count * 1000 + sessionMillis - 1) / sessionMillis;
+      config.canCapturedIds[bus][config.canCapturedIdCount[bus]] = key & 0x7FF;
+      config.canCapturedIdRates[bus][config.canCapturedIdCount[bus]] = min(framesPerSecond, 0xFFFFUL);
+      config.canCapturedIdCount[bus]++;
+    }
+  }
+  saveConfig();
+}
+
+/*****************************************************
+ *
+ * Function - Change sniff mode, returns true if the filters need reconfiguring
+ *
+ ****************************************************/
+// Leaving sniff mode captures the IDs seen, so the caller should plan the filters again before applying them
+bool setCanSniffMode(canSniffMode mode) {
+  bool filtersChanged = (mode == CAN_SNIFF_OFF) != (currentCanSniffMode == CAN_SNIFF_OFF);
+
+  if (currentCanSniffMode != CAN_SNIFF_OFF && mode == CAN_SNIFF_OFF) {
+    captureCanSniffIds();
+  }
+
+  // Start with a clean table each time sniffing is enabled
+  if (currentCanSniffMode == CAN_SNIFF_OFF && mode != CAN_SNIFF_OFF) {
+    for (int i = 0; i < canSniffTableSize; i++) {
+      canSniffTable[i] = canSniffEntry();
+    }
+    canSniffTableCount = 0;
+    canSniffTableFullCount = 0;
+    canSniffLawicelDropped = 0;
+    canSniffStartMillis = millis();
+  }
+
+  currentCanSniffMode = mode;
+
+  // Nothing else may write to the port while CANHacker is reading frames from it
+  setSerialConsoleMuted(mode == CAN_SNIFF_LAWICEL);
+  return filtersChanged;
+}
+
+/*****************************************************
+ *
+ * Function - Format a frame in LAWICEL format (tiiildd..[tttt]\r), returns the length written
+ *
+ ****************************************************/
+// IDs above the 11 bit range go out as extended frames (Tiiiiiiiildd..[tttt]\r)
+const char hexDigits[] = "0123456789ABCDEF";
+
+int formatLawicelFrame(char *output, unsigned long canId, byte len, const unsigned char *buf, bool withTimestamp) {
+  int position = 0;
+  if (canId > 0x7FF) {
+    output[position++] = 'T';
+    for (int shift = 28; shift >= 0; shift -= 4) {
+      output[position++] = hexDigits[(canId >> shift) & (shift == 28 ? 0x01 : 0x0F)];
+    }
+  } else {
+    output[position++] = 't';
+    output[position++] = hexDigits[(canId >> 8) & 0x07];
+    output[position++] = hexDigits[(canId >> 4) & 0x0F];
+    output[position++] = hexDigits[canId & 0x0F];
+  }
+  output[position++] = hexDigits[len & 0x0F];
+  for (int i = 0; i < len; i++) {
+    output[position++] = hexDigits[buf[i] >> 4];
+    output[position++] = hexDigits[buf[i] & 0x0F];
+  }
+  if (withTimestamp) {
+    unsigned int timestamp = millis() % 60000; // LAWICEL timestamps wrap every minute
+    output[position++] = hexDigits[(timestamp >> 12) & 0x0F];
+    output[position++] = hexDigits[(timestamp >> 8) & 0x0F];
+    output[position++] = hexDigits[(timestamp >> 4) & 0x0F];
+    output[position++] = hexDigits[timestamp & 0x0F];
+  }
+  output[position++] = '\r';
+  return position;
+}
+
+/*****************************************************
+ *
+ * Function - Record a received frame in the ID table and stream it if required
+ *
+ ****************************************************/
+void canSniffRecordFrame(canBus bus, unsigned long canId, byte len, const unsigned char *buf) {
+  if (currentCanSniffMode == CAN_SNIFF_OFF) {
+    return;
+  }
+
+  // Multiplicative hash with linear probing
+  uint16_t key = (bus << 11) | (canId & 0x7FF);
+  int slot = ((key * 40503u) >> 6) & (canSniffTableSize - 1);
+  canSniffEntry *entry = NULL;
+
+  for (int probe = 0; probe < canSniffTableSize; probe++) {
+    canSniffEntry *candidate = &canSniffTable[(slot + probe) & (canSniffTableSize - 1)];
+    if (candidate->key == key) {
+      entry = candidate;
+      break;
+    }
+    if (candidate->key == 0xFFFF) {
+      // Keep a couple of slots free so probing for unseen IDs always terminates quickly
+      if (canSniffTableCount >= canSniffTableSize - 2) {
+        break;
+      }
+      entry = candidate;
+      entry->key = key;
+      entry->firstSeenMillis = millis();
+      entry->len = len;
+      memcpy(entry->lastPayload, buf, len);
+      canSniffTableCount++;
+      break;
+    }
+  }
+
+  if (entry == NULL) {
+    canSniffTableFullCount++;
+  } else {
+    for (int i = 0; i < len; i++) {
+      if (entry->lastPayload[i] != buf[i]) {
+        entry->changedBytes |= (1 << i);
+      }
+    }
+    memcpy(entry->lastPayload, buf, len);
+    entry->len = len;
+    entry->count++;
+    entry->lastSeenMillis = millis();
+  }
+
+  // Stream the raw frame for CANHacker, never blocking the loop if the serial buffer is full
+  if (currentCanSniffMode == CAN_SNIFF_LAWICEL) {
+    char lawicelFrame[32];
+    int lawicelFrameLength =
+        formatLawicelFrame(lawicelFrame, canSniffBusMarker[bus] | canId, len, buf, lawicelTimestampsEnabled);
+    if (Serial.availableForWrite() >= lawicelFrameLength) {
+      Serial.write((const uint8_t *)lawicelFrame, lawicelFrameLength);
+    } else {
+      canSniffLawicelDropped++;
+    }
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Reply to the LAWICEL commands which do not change state, a bell for anything unsupported
+ *
+ ****************************************************/
+const char *getLawicelResponse(char command) {
+  switch (command) {
+  case 'V':
+    return "V1013\r";
+  case 'N':
+    return "NE46Z\r";
+  case 'F':
+    return "F00\r";
+  case 'S': // Bit rate is fixed at 500 kbit/s on both buses, acknowledge and carry on
+  case 's':
+  case 'M':
+  case 'm':
+    return "\r";
+  default:
+    return "\a";
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Handle LAWICEL commands from CANHacker, returns true if the filters need reconfiguring
+ *
+ ****************************************************/
+// Only the commands CANHacker needs to open a channel are handled, 'X' is our own command to toggle summary mode
+char lawicelCommand[16];
+int lawicelCommandLength = 0;
+
+bool processCanSniffSerialCommands() {
+  bool filtersChanged = false;
+
+  while (Serial.available() > 0) {
+    char received = Serial.read();
+    if (received != '\r') {
+      if (lawicelCommandLength < (int)sizeof(lawicelCommand) - 1) {
+        lawicelCommand[lawicelCommandLength++] = received;
+      }
+      continue;
+    }
+
+    lawicelCommand[lawicelCommandLength] = '\0';
+    const char *response = "\r";
+
+    switch (lawicelCommand[0]) {
+    case 'O': // Open the channel, stream every frame
+      filtersChanged |= setCanSniffMode(CAN_SNIFF_LAWICEL);
+      break;
+    case 'C': // Close the channel
+      filtersChanged |= setCanSniffMode(CAN_SNIFF_OFF);
+      break;
+    case 'X': // Toggle summary sniffing without streaming
+      filtersChanged |= setCanSniffMode(currentCanSniffMode == CAN_SNIFF_OFF ? CAN_SNIFF_SUMMARY : CAN_SNIFF_OFF);
+      break;
+    case 'Z': // Timestamps on or off
+      lawicelTimestampsEnabled = lawicelCommand[1] == '1';
+      break;
+    default:
+      response = getLawicelResponse(lawicelCommand[0]);
+      break;
+    }
+
+    Serial.print(response);
+    lawicelCommandLength = 0;
+  }
+
+  return filtersChanged;
+}
+
+/*****************************************************
+ *
+ * Functions - Summarise the ID table over serial (when not streaming) and MQTT
+ *
+ ****************************************************/
+// Starts a report, serviceCanSniffSummary then sends it a few IDs per loop so up to 62 publishes do not land in one loop
+void reportCanSniffSummary(bool printToSerial) {
+  if (currentCanSniffMode == CAN_SNIFF_OFF) {
+    return;
+  }
+
+  // Serial output would corrupt the LAWICEL stream so only MQTT is used in that mode
+  canSniffReportToSerial = printToSerial && currentCanSniffMode == CAN_SNIFF_SUMMARY;
+  canSniffReportIndex = 0;
+
+  if (canSniffReportToSerial) {
+    serialConsole.print("CAN sniff IDs: ");
+    serialConsole.print(canSniffTableCount);
+    serialConsole.print(" table full drops: ");
+    serialConsole.print(canSniffTableFullCount);
+    serialConsole.print(" stream drops: ");
+    serialConsole.println(canSniffLawicelDropped);
+  }
+}
+
+void serviceCanSniffSummary() {
+  int reported = 0;
+
+  while (canSniffReportIndex < canSniffTableSize && reported < canSniffReportEntriesPerLoop) {
+    canSniffEntry *entry = &canSniffTable[canSniffReportIndex++];
+    if (entry->key == 0xFFFF || currentCanSniffMode == CAN_SNIFF_OFF) {
+      continue;
+    }
+    reported++;
+
+    unsigned long canId = entry->key & 0x7FF;
+    int bus = entry->key >> 11;
+    unsigned long elapsedMillis = entry->lastSeenMillis - entry->firstSeenMillis;
+    float rateHz = elapsedMillis > 0 ? (entry->count - 1) * 1000.0 / elapsedMillis : 0;
+
+    char payloadHex[17];
+    for (int j = 0; j < entry->len; j++) {
+      payloadHex[j * 2] = hexDigits[entry->lastPayload[j] >> 4];
+      payloadHex[j * 2 + 1] = hexDigits[entry->lastPayload[j] & 0x0F];
+    }
+    payloadHex[entry->len * 2] = '\0';
+
+    char changedHex[3] = {hexDigits[entry->changedBytes >> 4], hexDigits[entry->changedBytes & 0x0F], '\0'};
+
+    if (canSniffReportToSerial) {
+      serialConsole.print(bus == CAN_BUS_BMW ? "\tBMW 0x" : "\tNissan 0x");
+      serialConsole.print(canId, HEX);
+      serialConsole.print(" count: ");
+      serialConsole.print(entry->count);
+      serialConsole.print(" Hz: ");
+      serialConsole.print(rateHz);
+      serialConsole.print(" changed: ");
+      serialConsole.print(changedHex);
+      serialConsole.print(" data: ");
+      serialConsole.println(payloadHex);
+    }
+
+    char rate[16];
+    formatMqttValue(rate, sizeof(rate), rateHz, 2);
+    char payload[96];
+    snprintf(payload, sizeof(payload), "{\"bus\":%d,\"id\":%lu,\"n\":%lu,\"hz\":%s,\"chg\":\"%s\",\"data\":\"%s\"}",
+             bus, canId, entry->count, rate, changedHex, payloadHex);
+    publishMqttPayload("canSniff", payload);
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef FUNCTIONS_CAN_SNIFF_H
+#define FUNCTIONS_CAN_SNIFF_H
+
+#include <Arduino.h>
+
+#include "functions_can_health.h"
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+enum canSniffMode {
+  CAN_SNIFF_OFF,     // Normal operation with hardware filters applied
+  CAN_SNIFF_SUMMARY, // Filters open, per ID statistics table summarised over serial and MQTT
+  CAN_SNIFF_LAWICEL  // Filters open, every frame also streamed over serial in LAWICEL format for CANHacker
+};
+
+// One entry in the open addressing table of every ID seen while sniffing
+struct canSniffEntry {
+  uint16_t key = 0xFFFF;           // Bus in bit 11 and CAN ID in bits 0 - 10, 0xFFFF when the slot is empty
+  unsigned long count = 0;         // Frames seen
+  unsigned long firstSeenMillis = 0;
+  unsigned long lastSeenMillis = 0;
+  unsigned char lastPayload[8] = {0};
+  byte len = 0;
+  byte changedBytes = 0; // Bit mask of payload bytes which have changed since the ID was first seen
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+bool isCanSniffActive();
+canSniffMode getCanSniffMode();
+bool setCanSniffMode(canSniffMode);
+void canSniffRecordFrame(canBus, unsigned long, byte, const unsigned char *);
+bool processCanSniffSerialCommands();
+void reportCanSniffSummary(bool);
+void serviceCanSniffSummary();
+int formatLawicelFrame(char *, unsigned long, byte, const unsigned char *, bool);
+const char *getLawicelResponse(char);
+
+#endif
@@ -0,0 +1,205 @@
+#include "functions_can_stream.h"
+#include "functions_can_sniff.h"
+#include "functions_config.h"
+#include "functions_log.h"
+
+#include <Ethernet.h>
+
+/*****************************************************
+ *
+ * Variables - Raw CAN streaming over TCP
+ *
+ ****************************************************/
+// Each bus has its own port speaking slcan (LAWICEL over a byte stream), so a Linux host can turn each one into a
+// SocketCAN interface with socat and slcand and watch both buses at once. See README
+const uint16_t canStreamPorts[CAN_BUS_COUNT] = {5010, 5011}; // BMW, Nissan
+const int canStreamBufferSize = 256;      // Frames are batched into one TCP write per flush
+const int canStreamMaxFrameLength = 26;   // tiiil, 8 data bytes, timestamp and \r
+const unsigned long canStreamFlushIntervalMs = 10;
+
+struct canStreamChannel {
+  EthernetServer server;
+  EthernetClient client;
+  bool listening = false;
+  bool open = false; // The client has sent 'O'
+  bool timestamps = false;
+  char command[16];
+  int commandLength = 0;
+  char buffer[canStreamBufferSize];
+  int bufferLength = 0;
+  unsigned long lastFlushMillis = 0;
+  float tokens = 0; // Rate limit bucket, refilled at canStreamMaxFramesPerSecond up to a tenth of a second's worth
+  unsigned long tokensMillis = 0;
+  unsigned long streamedCount = 0;    // Frames since the last stats report
+  unsigned long filteredCount = 0;    // Did not match the ID filter
+  unsigned long rateLimitedCount = 0; // Dropped by the rate limit
+  unsigned long overflowCount = 0;    // Dropped as the client was not keeping up
+
+  canStreamChannel(uint16_t port) : server(port) {}
+};
+
+canStreamChannel canStreamChannels[CAN_BUS_COUNT] = {canStreamChannel(canStreamPorts[CAN_BUS_BMW]),
+                                                     canStreamChannel(canStreamPorts[CAN_BUS_NISSAN])};
+const char *canStreamBusNames[CAN_BUS_COUNT] = {"BMW", "Nissan"};
+unsigned long canStreamStatsPreviousMillis = 0;
+
+bool isCanStreamOpen(canBus bus) { return canStreamChannels[bus].open; }
+
+/*****************************************************
+ *
+ * Function - Queue a received frame for the bus's client if it passes the filter and rate limit
+ *
+ ****************************************************/
+void canStreamRecordFrame(canBus bus, unsigned long canId, byte len, const unsigned char *buf) {
+  canStreamChannel *channel = &canStreamChannels[bus];
+  if (!channel->open) {
+    return;
+  }
+
+  uint16_t mask = config.canStreamIdMask[bus];
+  if ((canId & mask) != (config.canStreamIdFilter[bus] & mask)) {
+    channel->filteredCount++;
+    return;
+  }
+
+  // The gauges come first, a busy bus is thinned out here rather than letting the stream take the loop's time
+  unsigned long nowMillis = millis();
+  float framesPerSecond = config.canStreamMaxFramesPerSecond[bus];
+  channel->tokens += (nowMillis - channel->tokensMillis) * framesPerSecond / 1000.0;
+  channel->tokens = min(channel->tokens, max(framesPerSecond / 10, 1.0f));
+  channel->tokensMillis = nowMillis;
+  if (channel->tokens < 1) {
+    channel->rateLimitedCount++;
+    return;
+  }
+
+  if (channel->bufferLength + canStreamMaxFrameLength > canStreamBufferSize) {
+    channel->overflowCount++;
+    return;
+  }
+
+  channel->tokens -= 1;
+  channel->bufferLength +=
+      formatLawicelFrame(channel->buffer + channel->bufferLength, canId, len, buf, channel->timestamps);
+  channel->streamedCount++;
+}
+
+/*****************************************************
+ *
+ * Function - Accept clients, answer commands and flush frames, returns true if the filters need reconfiguring
+ *
+ ****************************************************/
+// Call only once the ethernet shield is up, the server starts listening again by itself after the W5500 is reset
+bool serviceCanStream(canBus bus) {
+  canStreamChannel *channel = &canStreamChannels[bus];
+  bool wasOpen = channel->open;
+
+  if (!config.canStreamEnabled) {
+    if (channel->client) {
+      channel->client.stop();
+    }
+    channel->open = false;
+    return wasOpen;
+  }
+
+  if (!channel->listening) {
+    channel->server.begin();
+    channel->listening = true;
+  }
+
+  // A new connection replaces the old one, slcand reconnecting after a restart should not have to wait for a timeout
+  EthernetClient incoming = channel->server.accept();
+  if (incoming) {
+    if (channel->client) {
+      channel->client.stop();
+    }
+    channel->client = incoming;
+    channel->open = false;
+    channel->commandLength = 0;
+    channel->bufferLength = 0;
+  }
+
+  if (channel->client && !channel->client.connected()) {
+    channel->client.stop();
+    channel->open = false;
+  }
+
+  while (channel->client && channel->client.available() > 0) {
+    char received = channel->client.read();
+    if (received != '\r') {
+      if (channel->commandLength < (int)sizeof(channel->command) - 1) {
+        channel->command[channel->commandLength++] = received;
+      }
+      continue;
+    }
+
+    channel->command[channel->commandLength] = '\0';
+    const char *response = "\r";
+
+    switch (channel->command[0]) {
+    case 'O': // Open the channel
+      channel->open = true;
+      channel->bufferLength = 0;
+      channel->tokens = max(config.canStreamMaxFramesPerSecond[bus] / 10, 1);
+      channel->tokensMillis = millis();
+      break;
+    case 'C': // Close the channel
+      channel->open = false;
+      break;
+    case 'Z': // Timestamps on or off
+      channel->timestamps = channel->command[1] == '1';
+      break;
+    default:
+      response = getLawicelResponse(channel->command[0]);
+      break;
+    }
+
+    channel->client.write((const uint8_t *)response, strlen(response));
+    channel->commandLength = 0;
+  }
+
+  // Batch frames into as few TCP segments as possible, keeping them if the socket has no room yet
+  bool flushDue = channel->bufferLength > canStreamBufferSize / 2 ||
+                  millis() - channel->lastFlushMillis >= canStreamFlushIntervalMs;
+  if (channel->open && channel->bufferLength > 0 && flushDue &&
+      channel->client.availableForWrite() >= channel->bufferLength) {
+    channel->client.write((const uint8_t *)channel->buffer, channel->bufferLength);
+    channel->bufferLength = 0;
+    channel->lastFlushMillis = millis();
+  }
+
+  return channel->open != wasOpen;
+}
+
+/*****************************************************
+ *
+ * Function - Report per bus stream rates and drops over serial
+ *
+ ****************************************************/
+void reportCanStreamStats() {
+  float elapsedSeconds = (millis() - canStreamStatsPreviousMillis) / 1000.0;
+  canStreamStatsPreviousMillis = millis();
+  if (elapsedSeconds <= 0 || !config.canStreamEnabled) {
+    return;
+  }
+
+  for (int i = 0; i < CAN_BUS_COUNT; i++) {
+    canStreamChannel *channel = &canStreamChannels[i];
+    serialConsole.print("CAN stream ");
+    serialConsole.print(canStreamBusNames[i]);
+    serialConsole.print(channel->open ? " open" : " closed");
+    serialConsole.print(" frames/s: ");
+    serialConsole.print(channel->streamedCount / elapsedSeconds);
+    serialConsole.print(" filtered: ");
+    serialConsole.print(channel->filteredCount);
+    serialConsole.print(" rate limited: ");
+    serialConsole.print(channel->rateLimitedCount);
+    serialConsole.print(" overflow: ");
+    serialConsole.println(channel->overflowCount);
+
+    channel->streamedCount = 0;
+    channel->filteredCount = 0;
+    channel->rateLimitedCount = 0;
+    channel->overflowCount = 0;
+  }
+}
@@ -0,0 +1,18 @@
+#ifndef FUNCTIONS_CAN_STREAM_H
+#define FUNCTIONS_CAN_STREAM_H
+
+#include <Arduino.h>
+
+#include "functions_can_health.h"
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+bool isCanStreamOpen(canBus);
+void canStreamRecordFrame(canBus, unsigned long, byte, const unsigned char *);
+bool serviceCanStream(canBus);
+void reportCanStreamStats();
+
+#endif
@@ -0,0 +1,101 @@
+#include "functions_can_tx_queue.h"
+#include "functions_log.h"
+#include <mcp2515_can.h> // Used for Seeed shields
+
+/*****************************************************
+ *
+ * Function - Add a frame to the queue without blocking, returns false if it had to be dropped
+ *
+ ****************************************************/
+bool canTxQueueSubmit(canTxQueue *queue, unsigned long canId, byte len, const unsigned char *payload,
+                      canTxPriority priority) {
+  // High priority frames carry state (gauge values etc) so if the ID is already waiting just update its payload, the
+  // newest value is the only one worth sending. Other classes carry requests which must all go out.
+  for (int i = 0; priority == CAN_TX_PRIORITY_HIGH && i < queue->count[priority]; i++) {
+    canTxFrame *frame = &queue->frames[priority][(queue->head[priority] + i) % canTxQueueDepth];
+    if (frame->canId == canId) {
+      frame->len = len;
+      memcpy(frame->payload, payload, len);
+      queue->replacedCount++;
+      return true;
+    }
+  }
+
+  if (queue->count[priority] >= canTxQueueDepth) {
+    queue->droppedCount++;
+    return false;
+  }
+
+  canTxFrame *frame = &queue->frames[priority][(queue->head[priority] + queue->count[priority]) % canTxQueueDepth];
+  frame->canId = canId;
+  frame->len = len;
+  memcpy(frame->payload, payload, len);
+  queue->count[priority]++;
+  queue->queuedCount++;
+  return true;
+}
+
+/*****************************************************
+ *
+ * Function - Load waiting frames into any free hardware transmit buffers
+ *
+ ****************************************************/
+// The MCP2515 transmits the highest numbered buffer first when the TXP priority bits are equal (the Seeed driver
+// leaves them at zero). TXB2 is reserved for the high priority class so cluster frames never wait behind a queried
+// metric request, the other classes share TXB1 and TXB0.
+const byte highPriorityTxBuffers[] = {2, 1, 0};
+const byte standardPriorityTxBuffers[] = {1, 0};
+
+void serviceCanTxQueue(canTxQueue *queue) {
+  for (int priority = 0; priority < CAN_TX_PRIORITY_COUNT; priority++) {
+    const byte *txBuffers = (priority == CAN_TX_PRIORITY_HIGH) ? highPriorityTxBuffers : standardPriorityTxBuffers;
+    int txBufferCount = (priority == CAN_TX_PRIORITY_HIGH) ? sizeof(highPriorityTxBuffers) : sizeof(standardPriorityTxBuffers);
+
+    while (queue->count[priority] > 0) {
+      canTxFrame *frame = &queue->frames[priority][queue->head[priority]];
+      bool loaded = false;
+
+      unsigned long sendStartMicros = micros();
+      for (int i = 0; i < txBufferCount && !loaded; i++) {
+        loaded = queue->can->trySendMsgBuf(frame->canId, 0, 0, frame->len, frame->payload, txBuffers[i]) == CAN_OK;
+      }
+      queue->sendMicrosTotal += micros() - sendStartMicros;
+
+      // Hardware is busy, leave the frame at the head of its class and try again next loop. Lower classes can only
+      // use a subset of the buffers we just tried so there is no point carrying on.
+      if (!loaded) {
+        queue->retriedCount++;
+        return;
+      }
+
+      queue->head[priority] = (queue->head[priority] + 1) % canTxQueueDepth;
+      queue->count[priority]--;
+      queue->sentCount++;
+    }
+  }
+}
+
+/*****************************************************
+ *
+ * Functions - Report queue statistics
+ *
+ ****************************************************/
+float getCanTxQueueAverageSendMicros(canTxQueue *queue) {
+  unsigned long attempts = queue->sentCount + queue->retriedCount;
+  return attempts > 0 ? queue->sendMicrosTotal / (float)attempts : 0;
+}
+
+void reportCanTxQueueStats(canTxQueue *queue, const char *name) {
+  serialConsole.print("CAN TX queue ");
+  serialConsole.print(name);
+  serialConsole.print(" queued: ");
+  serialConsole.print(queue->queuedCount);
+  serialConsole.print(" replaced: ");
+  serialConsole.print(queue->replacedCount);
+  serialConsole.print(" sent: ");
+  serialConsole.print(queue->sentCount);
+  serialConsole.print(" retried: ");
+  serialConsole.print(queue->retriedCount);
+  serialConsole.print(" dropped: ");
+  serialConsole.println(queue->droppedCount);
+}
@@ -0,0 +1,47 @@
+#ifndef FUNCTIONS_CAN_TX_QUEUE_H
+#define FUNCTIONS_CAN_TX_QUEUE_H
+
+#include <Arduino.h>
+#include <mcp2515_can.h> // Used for Seeed shields
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+// Priority classes, cluster gauges first then ECM session traffic and finally queried data
+enum canTxPriority { CAN_TX_PRIORITY_HIGH, CAN_TX_PRIORITY_MEDIUM, CAN_TX_PRIORITY_LOW, CAN_TX_PRIORITY_COUNT };
+
+struct canTxFrame {
+  unsigned long canId;
+  byte len;
+  unsigned char payload[8];
+};
+
+const int canTxQueueDepth = 8; // Frames held per priority class
+
+// A software transmit queue for one shield, frames are loaded into the hardware buffers as they become free
+struct canTxQueue {
+  mcp2515_can *can = NULL;
+  canTxFrame frames[CAN_TX_PRIORITY_COUNT][canTxQueueDepth];
+  byte head[CAN_TX_PRIORITY_COUNT] = {0};  // Index of the oldest frame in each class
+  byte count[CAN_TX_PRIORITY_COUNT] = {0}; // Number of frames waiting in each class
+  unsigned long queuedCount = 0;           // Frames accepted into the queue
+  unsigned long replacedCount = 0;         // Frames which updated the payload of one already waiting
+  unsigned long sentCount = 0;             // Frames loaded into a hardware buffer
+  unsigned long retriedCount = 0;          // Service attempts where no suitable hardware buffer was free
+  unsigned long droppedCount = 0;          // Frames rejected as their class was full
+  unsigned long sendMicrosTotal = 0;       // Time spent loading hardware buffers, used to estimate SPI cost
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+bool canTxQueueSubmit(canTxQueue *, unsigned long, byte, const unsigned char *, canTxPriority);
+void serviceCanTxQueue(canTxQueue *);
+float getCanTxQueueAverageSendMicros(canTxQueue *);
+void reportCanTxQueueStats(canTxQueue *, const char *);
+
+#endif
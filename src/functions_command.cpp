@@ -0,0 +1,327 @@
+#include "functions_command.h"
+#include "functions_config.h"
+#include "functions_log.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*****************************************************
+ *
+ * Variables - Tunable parameters exposed over the command topic
+ *
+ ****************************************************/
+// Commands are plain text with an optional id which is echoed back so the sender can match replies and time them
+//   [#id] get <name>
+//   [#id] set <name> <value>[,<value>...]     Arrays take every element
+//   [#id] set <name>[<index>] <value>         Or a single element
+//   [#id] save                                Persist the running config to data flash
+//   [#id] reset                               Return to the compiled in defaults (not persisted until saved)
+enum configParameterType { CONFIG_PARAMETER_FLOAT, CONFIG_PARAMETER_UINT16 };
+
+struct configParameter {
+  const char *name;
+  configParameterType type;
+  size_t offset;     // Offset of the first element in configData
+  byte count;        // Number of elements
+  size_t stride;     // Distance between elements
+  float minValue;
+  float maxValue;
+};
+
+const configParameter configParameters[] = {
+    {"speedScaleFactor", CONFIG_PARAMETER_FLOAT, offsetof(configData, speedScaleFactor), 1, sizeof(float), 0.8, 1.3},
+    {"wheelSizeInches", CONFIG_PARAMETER_UINT16, offsetof(configData, wheelSizeInches), 1, sizeof(uint16_t), 13, 22},
+    {"tyreWidth", CONFIG_PARAMETER_UINT16, offsetof(configData, tyreWidth), 1, sizeof(uint16_t), 155, 355},
+    {"tyreProfile", CONFIG_PARAMETER_UINT16, offsetof(configData, tyreProfile), 1, sizeof(uint16_t), 25, 80},
+    {"gearRatios", CONFIG_PARAMETER_FLOAT, offsetof(configData, gearRatios), 6, sizeof(float), 0.3, 6},
+    {"finalDriveRatio", CONFIG_PARAMETER_FLOAT, offsetof(configData, finalDriveRatio), 1, sizeof(float), 2, 5},
+    {"rpmMultipliers", CONFIG_PARAMETER_FLOAT, offsetof(configData, rpmMultipliers), 8, sizeof(float), 3, 8},
+    {"alarmEngineTemp", CONFIG_PARAMETER_FLOAT, offsetof(configData, alarmEngineTemp), 1, sizeof(float), 90, 130},
+    {"alarmOilTemp", CONFIG_PARAMETER_FLOAT, offsetof(configData, alarmOilTemp), 1, sizeof(float), 90, 150},
+    {"alarmFuelPressureLow", CONFIG_PARAMETER_FLOAT, offsetof(configData, alarmFuelPressureLow), 1, sizeof(float), 0, 100},
+    {"alarmFuelPressureHigh", CONFIG_PARAMETER_FLOAT, offsetof(configData, alarmFuelPressureHigh), 1, sizeof(float), 0, 100},
+    {"alarmCrankCaseVacuum", CONFIG_PARAMETER_FLOAT, offsetof(configData, alarmCrankCaseVacuum), 1, sizeof(float), -20, 5},
+    {"alarmOilPressureCurve", CONFIG_PARAMETER_FLOAT,
+     offsetof(configData, alarmOilPressureCurve) + offsetof(alarmThresholdPoint, threshold), 5, sizeof(alarmThresholdPoint), 0, 80},
+    {"fanTargetEngineTemperature", CONFIG_PARAMETER_FLOAT, offsetof(configData, fanTargetEngineTemperature), 1, sizeof(float), 75, 105},
+    {"fanTargetRadiatorOutletTemperature", CONFIG_PARAMETER_FLOAT, offsetof(configData, fanTargetRadiatorOutletTemperature), 1, sizeof(float), 60, 100},
+    {"fanAfterRunEngineTemperature", CONFIG_PARAMETER_FLOAT, offsetof(configData, fanAfterRunEngineTemperature), 1, sizeof(float), 80, 115},
+    {"udpTelemetryEnabled", CONFIG_PARAMETER_UINT16, offsetof(configData, udpTelemetryEnabled), 1, sizeof(uint16_t), 0, 1},
+    {"udpTelemetryPort", CONFIG_PARAMETER_UINT16, offsetof(configData, udpTelemetryPort), 1, sizeof(uint16_t), 1024, 65535},
+    {"udpTelemetryPeriodMs", CONFIG_PARAMETER_UINT16, offsetof(configData, udpTelemetryPeriodMs), 1, sizeof(uint16_t), 10, 1000},
+    {"canStreamEnabled", CONFIG_PARAMETER_UINT16, offsetof(configData, canStreamEnabled), 1, sizeof(uint16_t), 0, 1},
+    {"canStreamMaxFramesPerSecond", CONFIG_PARAMETER_UINT16, offsetof(configData, canStreamMaxFramesPerSecond), 2, sizeof(uint16_t), 10, 4000},
+    {"canStreamIdFilter", CONFIG_PARAMETER_UINT16, offsetof(configData, canStreamIdFilter), 2, sizeof(uint16_t), 0, 0x7FF},
+    {"canStreamIdMask", CONFIG_PARAMETER_UINT16, offsetof(configData, canStreamIdMask), 2, sizeof(uint16_t), 0, 0x7FF},
+};
+const int configParameterCount = sizeof(configParameters) / sizeof(configParameters[0]);
+
+// Changes are made to a pending copy in the MQTT callback and swapped in at the top of the next loop, so nothing ever
+// sees a half applied array
+enum pendingCommandAction { PENDING_COMMAND_NONE, PENDING_COMMAND_REPLY, PENDING_COMMAND_APPLY, PENDING_COMMAND_SAVE };
+
+configData pendingConfig;
+pendingCommandAction pendingAction = PENDING_COMMAND_NONE;
+unsigned long pendingCommandMicros = 0;
+char commandReply[160];
+int commandReplyLength = 0;
+int commandReplyIdLength = 0; // Length of the echoed id at the start of the reply
+
+/*****************************************************
+ *
+ * Functions - Build the reply in a fixed buffer
+ *
+ ****************************************************/
+void appendCommandReply(const char *text, int length) {
+  int space = (int)sizeof(commandReply) - 1 - commandReplyLength;
+  if (length > space) {
+    length = space;
+  }
+  memcpy(commandReply + commandReplyLength, text, length);
+  commandReplyLength += length;
+  commandReply[commandReplyLength] = '\0';
+}
+
+void appendCommandReply(const char *text) { appendCommandReply(text, strlen(text)); }
+
+void appendCommandReplyValue(float value) {
+  char formatted[24]; // Sign, a whole long on a 64 bit host, the point, three decimals and the terminator
+  // Avoid printf %f which is not in the default newlib nano build
+  long scaled = value < 0 ? (long)(value * 1000 - 0.5) : (long)(value * 1000 + 0.5);
+  long whole = labs(scaled) / 1000;
+  snprintf(formatted, sizeof(formatted), "%s%ld.%03ld", scaled < 0 ? "-" : "", whole, labs(scaled) % 1000);
+  appendCommandReply(formatted);
+}
+
+/*****************************************************
+ *
+ * Functions - Tokenise the payload in place, tokens are pointer and length pairs into the receive buffer
+ *
+ ****************************************************/
+struct commandToken {
+  const char *text = NULL;
+  int length = 0;
+};
+
+commandToken nextCommandToken(const char **cursor, const char *end, char separator) {
+  commandToken token;
+  while (*cursor < end && (**cursor == ' ' || **cursor == separator)) {
+    (*cursor)++;
+  }
+  token.text = *cursor;
+  while (*cursor < end && **cursor != ' ' && **cursor != separator) {
+    (*cursor)++;
+  }
+  token.length = *cursor - token.text;
+  return token;
+}
+
+bool commandTokenEquals(commandToken token, const char *text) {
+  return token.length == (int)strlen(text) && strncmp(token.text, text, token.length) == 0;
+}
+
+bool parseCommandNumber(commandToken token, float *value) {
+  char number[16];
+  if (token.length == 0 || token.length >= (int)sizeof(number)) {
+    return false;
+  }
+  memcpy(number, token.text, token.length);
+  number[token.length] = '\0';
+
+  char *parsedEnd;
+  *value = strtod(number, &parsedEnd);
+  return parsedEnd == number + token.length;
+}
+
+// Splits name or name[index], index is -1 when the whole parameter is addressed
+const configParameter *findConfigParameter(commandToken token, int *index) {
+  int nameLength = token.length;
+  *index = -1;
+
+  const char *bracket = (const char *)memchr(token.text, '[', token.length);
+  if (bracket != NULL) {
+    nameLength = bracket - token.text;
+    if (token.text[token.length - 1] != ']') {
+      return NULL;
+    }
+    *index = atoi(bracket + 1);
+  }
+
+  for (int i = 0; i < configParameterCount; i++) {
+    if ((int)strlen(configParameters[i].name) == nameLength &&
+        strncmp(configParameters[i].name, token.text, nameLength) == 0) {
+      if (*index >= configParameters[i].count) {
+        return NULL;
+      }
+      return &configParameters[i];
+    }
+  }
+  return NULL;
+}
+
+/*****************************************************
+ *
+ * Functions - Read and write parameter elements in a config struct
+ *
+ ****************************************************/
+float readConfigParameter(const configData *data, const configParameter *parameter, int element) {
+  const uint8_t *address = (const uint8_t *)data + parameter->offset + element * parameter->stride;
+  if (parameter->type == CONFIG_PARAMETER_UINT16) {
+    uint16_t value;
+    memcpy(&value, address, sizeof(value));
+    return value;
+  }
+  float value;
+  memcpy(&value, address, sizeof(value));
+  return value;
+}
+
+void writeConfigParameter(configData *data, const configParameter *parameter, int element, float value) {
+  uint8_t *address = (uint8_t *)data + parameter->offset + element * parameter->stride;
+  if (parameter->type == CONFIG_PARAMETER_UINT16) {
+    uint16_t rounded = value + 0.5;
+    memcpy(address, &rounded, sizeof(rounded));
+  } else {
+    memcpy(address, &value, sizeof(value));
+  }
+}
+
+void appendParameterValues(const configData *data, const configParameter *parameter, int index) {
+  int first = index < 0 ? 0 : index;
+  int last = index < 0 ? parameter->count - 1 : index;
+  for (int element = first; element <= last; element++) {
+    if (element > first) {
+      appendCommandReply(",");
+    }
+    appendCommandReplyValue(readConfigParameter(data, parameter, element));
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Parse a command from the MQTT callback, validated changes are staged for the next loop
+ *
+ ****************************************************/
+void handleConfigCommand(char *payload, unsigned int length) {
+  if (pendingAction != PENDING_COMMAND_NONE) {
+    LOG_WARN(LOG_MODULE_GENERAL, "Config command dropped, previous command still pending");
+    return;
+  }
+
+  const char *cursor = payload;
+  const char *end = payload + length;
+  pendingCommandMicros = micros();
+  commandReplyLength = 0;
+  commandReply[0] = '\0';
+
+  commandToken token = nextCommandToken(&cursor, end, ' ');
+  if (token.length > 0 && token.text[0] == '#') {
+    appendCommandReply(token.text, token.length);
+    appendCommandReply(" ");
+    token = nextCommandToken(&cursor, end, ' ');
+  }
+  commandReplyIdLength = commandReplyLength;
+
+  pendingAction = PENDING_COMMAND_REPLY;
+
+  if (commandTokenEquals(token, "save")) {
+    pendingConfig = config;
+    pendingAction = PENDING_COMMAND_SAVE;
+    appendCommandReply("ok save");
+    return;
+  }
+
+  if (commandTokenEquals(token, "reset")) {
+    pendingConfig = configData();
+    pendingAction = PENDING_COMMAND_APPLY;
+    appendCommandReply("ok reset");
+    return;
+  }
+
+  bool isSet = commandTokenEquals(token, "set");
+  if (!isSet && !commandTokenEquals(token, "get")) {
+    appendCommandReply("error unknown command");
+    return;
+  }
+
+  commandToken nameToken = nextCommandToken(&cursor, end, ' ');
+  int index;
+  const configParameter *parameter = findConfigParameter(nameToken, &index);
+  if (parameter == NULL) {
+    appendCommandReply("error unknown parameter ");
+    appendCommandReply(nameToken.text, nameToken.length);
+    return;
+  }
+
+  if (!isSet) {
+    appendCommandReply("ok get ");
+    appendCommandReply(nameToken.text, nameToken.length);
+    appendCommandReply(" ");
+    appendParameterValues(&config, parameter, index);
+    return;
+  }
+
+  // Validate every value before any of them are staged
+  pendingConfig = config;
+  int first = index < 0 ? 0 : index;
+  int expected = index < 0 ? parameter->count : 1;
+  int received = 0;
+
+  while (cursor < end) {
+    commandToken valueToken = nextCommandToken(&cursor, end, ',');
+    if (valueToken.length == 0) {
+      break;
+    }
+
+    float value;
+    if (received >= expected || !parseCommandNumber(valueToken, &value) || value < parameter->minValue ||
+        value > parameter->maxValue) {
+      appendCommandReply("error invalid value for ");
+      appendCommandReply(parameter->name);
+      return;
+    }
+
+    writeConfigParameter(&pendingConfig, parameter, first + received, value);
+    received++;
+  }
+
+  if (received != expected) {
+    appendCommandReply("error expected values for ");
+    appendCommandReply(parameter->name);
+    return;
+  }
+
+  pendingAction = PENDING_COMMAND_APPLY;
+  appendCommandReply("ok set ");
+  appendCommandReply(nameToken.text, nameToken.length);
+  appendCommandReply(" ");
+  appendParameterValues(&pendingConfig, parameter, index);
+}
+
+/*****************************************************
+ *
+ * Function - Apply a staged command between loop iterations, returns true when there is a reply to publish
+ *
+ ****************************************************/
+bool applyPendingConfigCommand() {
+  if (pendingAction == PENDING_COMMAND_NONE) {
+    return false;
+  }
+
+  if (pendingAction == PENDING_COMMAND_APPLY) {
+    config = pendingConfig;
+  } else if (pendingAction == PENDING_COMMAND_SAVE && !saveConfig()) {
+    commandReplyLength = commandReplyIdLength;
+    appendCommandReply("error save failed");
+  }
+
+  // Report how long the change took from arriving to being in effect
+  char latency[24];
+  snprintf(latency, sizeof(latency), " in %luus", micros() - pendingCommandMicros);
+  appendCommandReply(latency);
+
+  pendingAction = PENDING_COMMAND_NONE;
+  return true;
+}
+
+const char *getConfigCommandReply() { return commandReply; }
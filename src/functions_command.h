@@ -0,0 +1,23 @@
+#ifndef FUNCTIONS_COMMAND_H
+#define FUNCTIONS_COMMAND_H
+
+#include <Arduino.h>
+
+/****************************************************
+ *
+ * Command topics
+ *
+ ****************************************************/
+const char commandTopic[] = "command";
+const char commandReplyTopic[] = "commandReply";
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void handleConfigCommand(char *, unsigned int);
+bool applyPendingConfigCommand();
+const char *getConfigCommandReply();
+
+#endif
@@ -0,0 +1,234 @@
+#include "functions_config.h"
+#include "functions_log.h"
+#include <stddef.h>
+
+#if defined(ARDUINO)
+#include <EEPROM.h>
+#else
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*****************************************************
+ *
+ * Variables - Configuration and record layout
+ *
+ ****************************************************/
+configData config;
+
+// Each save goes into the next slot of a ring so the data flash wears evenly, the newest valid record wins on load
+struct configRecordHeader {
+  uint16_t magic;
+  uint16_t layoutVersion;
+  uint16_t length;     // Size of the config data that follows, lets appended fields load from older records
+  uint16_t reserved;
+  uint32_t sequence;   // Incremented on every save
+  uint32_t crc;        // CRC32 of the header up to this field and the config data
+};
+
+// The slot size is fixed rather than derived from configData so appending a field moves neither the slots nor the
+// records kept after them (the reset log), it leaves room for configData to grow to just under 500 bytes
+const uint16_t configRecordMagic = 0xC0F6;
+const int configSlotSize = 512;
+const int configMaxSlots = 8;
+
+static_assert(sizeof(configRecordHeader) + sizeof(configData) <= configSlotSize,
+              "configData has outgrown its slot, raise configSlotSize and bump configLayoutVersion");
+
+int configSlotCount = 0;
+int configCurrentSlot = -1;
+uint32_t configCurrentSequence = 0;
+
+/*****************************************************
+ *
+ * Functions - Storage backends, RA4M1 data flash through the EEPROM library or a memory mapped file on a host
+ *
+ ****************************************************/
+#if defined(ARDUINO)
+int configStorageBegin() { return EEPROM.length(); }
+
+void configStorageRead(int address, void *data, int length) {
+  uint8_t *bytes = (uint8_t *)data;
+  for (int i = 0; i < length; i++) {
+    bytes[i] = EEPROM.read(address + i);
+  }
+}
+
+void configStorageWrite(int address, const void *data, int length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (int i = 0; i < length; i++) {
+    EEPROM.update(address + i, bytes[i]);
+  }
+}
+#else
+// Host builds keep the data flash image in a file so save and load can be exercised across runs
+const int configHostStorageSize = 8192;
+uint8_t *configHostStorage = NULL;
+
+int configStorageBegin() {
+  if (configHostStorage != NULL) {
+    return configHostStorageSize;
+  }
+
+  const char *path = getenv("CONFIG_STORAGE_FILE");
+  int fd = open(path != NULL ? path : "config_storage.bin", O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return 0;
+  }
+
+  bool created = lseek(fd, 0, SEEK_END) < configHostStorageSize;
+  if (created && ftruncate(fd, configHostStorageSize) != 0) {
+    close(fd);
+    return 0;
+  }
+
+  void *mapped = mmap(NULL, configHostStorageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return 0;
+  }
+
+  configHostStorage = (uint8_t *)mapped;
+  if (created) {
+    memset(configHostStorage, 0xFF, configHostStorageSize); // Erased flash reads as 0xFF
+  }
+  return configHostStorageSize;
+}
+
+void configStorageRead(int address, void *data, int length) { memcpy(data, configHostStorage + address, length); }
+
+void configStorageWrite(int address, const void *data, int length) {
+  memcpy(configHostStorage + address, data, length);
+  msync(configHostStorage, configHostStorageSize, MS_SYNC);
+}
+#endif
+
+/*****************************************************
+ *
+ * Function - CRC32 over the header and config data of a record
+ *
+ ****************************************************/
+uint32_t updateConfigCrc(uint32_t crc, const void *data, int length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (int i = 0; i < length; i++) {
+    crc ^= bytes[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return crc;
+}
+
+uint32_t calculateConfigRecordCrc(const configRecordHeader *header, const void *data) {
+  uint32_t crc = updateConfigCrc(0xFFFFFFFF, header, offsetof(configRecordHeader, crc));
+  return ~updateConfigCrc(crc, data, header->length);
+}
+
+/*****************************************************
+ *
+ * Function - Load the newest valid record into RAM, falling back to defaults
+ *
+ ****************************************************/
+void loadConfig() {
+  config = configData();
+
+  int storageLength = configStorageBegin();
+  configSlotCount = min(storageLength / configSlotSize, configMaxSlots);
+  configCurrentSlot = -1;
+  configCurrentSequence = 0;
+
+  if (configSlotCount == 0) {
+    LOG_ERROR(LOG_MODULE_GENERAL, "No storage available for configuration, using defaults");
+    return;
+  }
+
+  static uint8_t recordData[sizeof(configData)];
+
+  for (int slot = 0; slot < configSlotCount; slot++) {
+    configRecordHeader header;
+    int address = slot * configSlotSize;
+    configStorageRead(address, &header, sizeof(header));
+
+    if (header.magic != configRecordMagic || header.layoutVersion != configLayoutVersion ||
+        header.length == 0 || header.length > sizeof(configData)) {
+      continue;
+    }
+
+    configStorageRead(address + sizeof(header), recordData, header.length);
+    if (calculateConfigRecordCrc(&header, recordData) != header.crc) {
+      LOG_WARN(LOG_MODULE_GENERAL, "Configuration slot %d failed CRC check", slot);
+      continue;
+    }
+
+    if (configCurrentSlot < 0 || (int32_t)(header.sequence - configCurrentSequence) > 0) {
+      configCurrentSlot = slot;
+      configCurrentSequence = header.sequence;
+      config = configData();
+      memcpy(&config, recordData, header.length);
+    }
+  }
+
+  if (configCurrentSlot < 0) {
+    LOG_INFO(LOG_MODULE_GENERAL, "No saved configuration, using defaults");
+  } else {
+    LOG_INFO(LOG_MODULE_GENERAL, "Loaded configuration from slot %d sequence %lu", configCurrentSlot,
+             (unsigned long)configCurrentSequence);
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Save the RAM configuration into the next slot
+ *
+ ****************************************************/
+bool saveConfig() {
+  if (configSlotCount == 0) {
+    LOG_ERROR(LOG_MODULE_GENERAL, "No storage available for configuration");
+    return false;
+  }
+
+  int slot = (configCurrentSlot + 1) % configSlotCount;
+  int address = slot * configSlotSize;
+
+  configRecordHeader header;
+  header.magic = configRecordMagic;
+  header.layoutVersion = configLayoutVersion;
+  header.length = sizeof(configData);
+  header.reserved = 0;
+  header.sequence = configCurrentSequence + 1;
+  header.crc = calculateConfigRecordCrc(&header, &config);
+
+  // Data first and header last so a power loss part way through leaves the previous record as the newest valid one
+  configStorageWrite(address + sizeof(header), &config, sizeof(configData));
+  configStorageWrite(address, &header, sizeof(header));
+
+  configRecordHeader check;
+  configStorageRead(address, &check, sizeof(check));
+  if (check.crc != header.crc || check.sequence != header.sequence) {
+    LOG_ERROR(LOG_MODULE_GENERAL, "Configuration write could not be verified");
+    return false;
+  }
+
+  configCurrentSlot = slot;
+  configCurrentSequence = header.sequence;
+  LOG_INFO(LOG_MODULE_GENERAL, "Saved configuration to slot %d sequence %lu", slot,
+           (unsigned long)configCurrentSequence);
+  return true;
+}
+
+/*****************************************************
+ *
+ * Function - First byte of storage after the configuration slots
+ *
+ ****************************************************/
+int getConfigStorageEnd() { return configMaxSlots * configSlotSize; }
+
+/*****************************************************
+ *
+ * Function - Return to the compiled in defaults, these are only persisted once saved
+ *
+ ****************************************************/
+void resetConfig() { config = configData(); }
@@ -0,0 +1,95 @@
+#ifndef FUNCTIONS_CONFIG_H
+#define FUNCTIONS_CONFIG_H
+
+#include <Arduino.h>
+#include "functions_alarms.h"
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+// Bump the layout version when fields are reordered, resized or removed. New fields may be appended without a bump,
+// records saved by an older build then load with the defaults for the appended fields. Each record has a fixed 512
+// byte slot (see functions_config.cpp), the build fails if appending a field would overflow it.
+const uint16_t configLayoutVersion = 1;
+
+// Every tunable lives here and is read straight from RAM at runtime, the defaults are used until a valid record has
+// been saved to data flash
+struct configData {
+  // Vehicle and drivetrain
+  float speedScaleFactor = 1.06;
+  uint16_t wheelSizeInches = 18;
+  uint16_t tyreWidth = 255;
+  uint16_t tyreProfile = 35;
+  float gearRatios[6] = {3.794, 2.324, 1.624, 1.271, 1.0, 0.794};
+  float finalDriveRatio = 3.38;
+
+  // Cluster tachometer multipliers at 1000 - 8000 RPM, see functions_write
+  float rpmMultipliers[8] = {5.9, 5.4, 5.2, 5.15, 5.1, 5.05, 5.0, 5.0};
+
+  // Alarm thresholds, see functions_alarms
+  float alarmEngineTemp = 110;
+  float alarmOilTemp = 120;
+  float alarmFuelPressureLow = 48;
+  float alarmFuelPressureHigh = 57;
+  float alarmCrankCaseVacuum = -5;
+  alarmThresholdPoint alarmOilPressureCurve[5] = {{1000, 8}, {2000, 12}, {3000, 18}, {4000, 24}, {6000, 32}};
+
+  // Radiator fan temperatures, see functions_do
+  float fanTargetEngineTemperature = 92;
+  float fanTargetRadiatorOutletTemperature = 85;
+  float fanAfterRunEngineTemperature = 95;
+
+  // Network
+  uint8_t ethernetMac[6] = {0xA8, 0x61, 0x0A, 0xAE, 0xAB, 0x8D};
+  uint8_t ethernetIp[4] = {192, 168, 11, 3};
+  uint8_t mqttServerIp[4] = {192, 168, 11, 2};
+  uint16_t mqttPort = 1883;
+
+  // Binary UDP telemetry to the MQTT server host, see functions_telemetry_udp
+  uint16_t udpTelemetryEnabled = 0;
+  uint16_t udpTelemetryPort = 5005;
+  uint16_t udpTelemetryPeriodMs = 20;
+
+  // Raw frames from both buses over TCP in slcan form, indexed by canBus, see functions_can_stream. Appended within
+  // layout version 1, records saved before these existed load them with the defaults (stream disabled)
+  uint16_t canStreamEnabled = 0;
+  uint16_t canStreamMaxFramesPerSecond[2] = {1000, 1000};
+  uint16_t canStreamIdFilter[2] = {0, 0}; // A frame is streamed when (id & mask) == (filter & mask)
+  uint16_t canStreamIdMask[2] = {0, 0};
+
+  // Standard IDs seen on each bus the last time sniff mode was left, indexed by canBus. The hardware filters are
+  // planned against these so the IDs they let through by mistake are ones that are not actually on the bus
+  uint16_t canCapturedIdCount[2] = {0, 0};
+  uint16_t canCapturedIds[2][32] = {{0}};
+
+  // Frames per second each of canCapturedIds was seen at, so the planner weighs an ID by the load it would add.
+  // Appended within layout version 1, records saved before these existed load zeros and every ID weighs the same
+  uint16_t canCapturedIdRates[2][32] = {{0}};
+};
+
+/****************************************************
+ *
+ * Global configuration
+ *
+ ****************************************************/
+extern configData config;
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void loadConfig();
+bool saveConfig();
+void resetConfig();
+
+// Storage shared with other small persistent records, which live after the configuration slots
+int configStorageBegin();
+void configStorageRead(int, void *, int);
+void configStorageWrite(int, const void *, int);
+int getConfigStorageEnd();
+uint32_t updateConfigCrc(uint32_t, const void *, int);
+
+#endif
@@ -1,4 +1,5 @@
 #include "functions_do.h"
+#include "functions_config.h"
 
 /* ======================================================================
    ISR: Update the RPM counter and time via interrupt
@@ -22,6 +23,11 @@ int calculateRpm() {
   unsigned long deltaMicros = latestRpmPulseTime - previousRpmPulseTime;
   unsigned long deltaRpmPulseCounter = latestRpmPulseCounter - previousRpmPulseCounter;
 
+  // No pulses since the last call means the engine is stopped, dividing by the zero count is undefined
+  if (deltaRpmPulseCounter == 0) {
+    return 0;
+  }
+
   float microsPerPulse = deltaMicros / deltaRpmPulseCounter;
 
   float pulsesPerMinute = 60000000 / microsPerPulse;
@@ -38,63 +44,152 @@ int calculateRpm() {
 /* ======================================================================
    FUNCTION: Calculate and set radiator fan output
    ====================================================================== */
-const float fanMinimumEngineTemperature = 90; // Temperature in celcius when fan will begin opperation
-const float fanMaximumEngineTemperature = 95; // Temperature in celcius when fan will be opperating at maximum power
-float fanPercentageOutput = 0.0;              // Will store the current fan output percentage
-int fanMinimumPercentageOutput = 40;          // A reasonable minimum fan speed to avoid running it too slow
-int fanPwmPinValue = 0;                       // Will store the PWM pin value from 0 - 255 to interface with the motor driver board
-
-int setRadiatorFanOutput(int engineTemp, int engineRpm, byte signalPin) {
-  if (engineTemp >= fanMaximumEngineTemperature) {
-    fanPercentageOutput = 100;
-  } else if (engineTemp > fanMinimumEngineTemperature) {
-    int degreesAboveMinimum = engineTemp - fanMinimumEngineTemperature;
-    fanPercentageOutput = (degreesAboveMinimum / (fanMaximumEngineTemperature - fanMinimumEngineTemperature)) * 100;
-    if (fanPercentageOutput < fanMinimumPercentageOutput) {
-      fanPercentageOutput = fanMinimumPercentageOutput;
+// PID loop on coolant temperature with a secondary proportional term on the radiator outlet temperature. This is run
+// at a faster tick than the old open loop ramp so the integral and soft start behave sensibly.
+// The coolant and radiator outlet targets come from the config (fanTargetEngineTemperature and
+// fanTargetRadiatorOutletTemperature)
+const float fanKp = 15.0;                            // Percent output per degree of coolant error
+const float fanKi = 0.5;                             // Percent output per degree second of coolant error
+const float fanKd = 20.0;                            // Percent output per degree per second of filtered coolant rise
+const float fanDerivativeFilterSeconds = 10.0;       // Time constant of the coolant filter the derivative is taken on
+const float fanKpRadiatorOutlet = 4.0;               // Percent output per degree of radiator outlet error
+const float fanIntegralMaximum = 60.0;               // Clamp on the integral contribution for anti-windup
+
+// Feed forward terms so we react to load and airflow before the coolant temperature moves
+const float fanFeedForwardRpmPerPercent = 200.0;  // Adds 1% output per 200 RPM above idle (heat input)
+const int fanFeedForwardIdleRpm = 800;            // RPM below which no feed forward for engine load is applied
+const float fanFeedForwardRamAirSpeed = 80.0;     // Vehicle speed in km/h above which ram air alone is sufficient
+const float fanFeedForwardLowSpeedPercent = 15.0; // Output added when stationary, tapering to 0 at ram air speed
+const float fanFeedForwardIntakeTempBase = 30.0;  // Intake air temperature in celcius above which we add fan
+const float fanFeedForwardIntakeTempGain = 1.5;   // Percent output per degree of intake air above the base
+
+const float fanMinimumPercentageOutput = 40.0; // A reasonable minimum fan speed to avoid running it too slow
+const float fanDemandThreshold = 10.0;         // Demand below which the fan is switched off rather than held at minimum
+const float fanStartDemandThreshold = 25.0;    // Demand needed to start a stopped fan, the gap to the above is hysteresis
+const unsigned long fanOffDelayMillis = 60000; // Demand has to stay below the threshold this long before the fan stops
+const float fanSoftStartPercentPerSecond = 25; // Maximum rate of output increase to limit motor inrush current
+
+// After run keeps the fan going for a while once the engine stops to prevent heat soak
+// The coolant temperature at shut down to enable after run comes from the config (fanAfterRunEngineTemperature)
+const float fanAfterRunPercentageOutput = 50.0;        // Output used during after run
+const unsigned long fanAfterRunMaximumMillis = 120000; // Maximum after run duration
+
+float fanPercentageOutput = 0.0;          // Will store the current fan output percentage
+float fanIntegral = 0.0;                  // Will store the accumulated integral term
+float fanFilteredEngineTemp = 0.0;        // Will store the filtered coolant temperature for the derivative term
+unsigned long fanPreviousMillis = 0;      // Will store the previous execution time
+unsigned long fanAfterRunStartMillis = 0; // Will store when after run began, 0 when not active
+unsigned long fanLastDemandMillis = 0;    // Will store when the demand was last at or above the threshold
+bool fanEngineWasRunning = false;         // Will store if the engine was running on the previous execution
+int fanPwmPinValue = 0;                   // Will store the PWM pin value from 0 - 255 to interface with the motor driver board
+
+int setRadiatorFanOutput(float engineTemp, float radiatorOutletTemp, float vehicleSpeed, int airIntakeTemp,
+                         int engineRpm, byte signalPin) {
+  unsigned long nowMillis = millis();
+  float deltaSeconds = (fanPreviousMillis == 0) ? 0 : (nowMillis - fanPreviousMillis) / 1000.0;
+  fanPreviousMillis = nowMillis;
+
+  bool engineRunning = engineRpm > 500;
+  float targetOutput = 0;
+
+  if (engineRunning) {
+    fanAfterRunStartMillis = 0;
+
+    // Proportional term on coolant. The ECM reports whole degrees so the derivative is taken on a low pass filtered
+    // copy, a single step of the sensor then adds at most Kd / filter seconds (2%) instead of swinging the output
+    // by 100%. It is skipped on the first execution while the filter starts from the current reading.
+    float error = engineTemp - config.fanTargetEngineTemperature;
+    float derivative = 0;
+    if (deltaSeconds > 0 && fanEngineWasRunning) {
+      float filterStep = (engineTemp - fanFilteredEngineTemp) * min(deltaSeconds / fanDerivativeFilterSeconds, 1.0f);
+      fanFilteredEngineTemp += filterStep;
+      derivative = filterStep / deltaSeconds;
+    } else {
+      fanFilteredEngineTemp = engineTemp;
     }
-  } else {
-    fanPercentageOutput = 0;
-  }
 
-  // Here we will actually set the external PWM control based on calculated percentage output, but only if the engine is
-  // running
-  if (fanPercentageOutput != 0 && engineRpm > 500) {
-    fanPwmPinValue = fanPercentageOutput * 2.55;
-  } else {
-    fanPwmPinValue = 0;
-  }
+    // Secondary proportional term on the radiator outlet which only ever adds fan
+    float radiatorOutletError = radiatorOutletTemp - config.fanTargetRadiatorOutletTemperature;
+    if (radiatorOutletError < 0) {
+      radiatorOutletError = 0;
+    }
 
-  // Write out the actual pin value, the pin will maintain this output until the next update
-  analogWrite(signalPin, fanPwmPinValue);
+    // Feed forward from engine load, lack of ram air and hot intake air
+    float feedForward = 0;
+    if (engineRpm > fanFeedForwardIdleRpm) {
+      feedForward += (engineRpm - fanFeedForwardIdleRpm) / fanFeedForwardRpmPerPercent;
+    }
+    if (vehicleSpeed < fanFeedForwardRamAirSpeed) {
+      feedForward += fanFeedForwardLowSpeedPercent * (1.0 - vehicleSpeed / fanFeedForwardRamAirSpeed);
+    }
+    if (airIntakeTemp > fanFeedForwardIntakeTempBase) {
+      feedForward += (airIntakeTemp - fanFeedForwardIntakeTempBase) * fanFeedForwardIntakeTempGain;
+    }
 
-  return fanPercentageOutput;
-}
+    // Feed forward only matters once we are near the target, otherwise a cold engine would run the fan
+    if (error < -5) {
+      feedForward = 0;
+    }
 
-/* ======================================================================
-   FUNCTION: Sound the alarm (but only after a delay) !!
-   ====================================================================== */
-unsigned long inAlarmDuration = 0;
-unsigned long firstAlarmCallTime = 0;
+    float unclampedOutput =
+        fanKp * error + fanIntegral + fanKd * derivative + fanKpRadiatorOutlet * radiatorOutletError + feedForward;
 
-void alarmEnable(int alarmBuzzerPin, int engineRpm) {
-  if (firstAlarmCallTime == 0) {
-    firstAlarmCallTime = millis();
+    // Anti-windup via conditional integration, only integrate when it moves the output away from saturation
+    bool saturatedHigh = unclampedOutput >= 100 && error > 0;
+    bool saturatedLow = unclampedOutput <= 0 && error < 0;
+    if (!saturatedHigh && !saturatedLow) {
+      fanIntegral += fanKi * error * deltaSeconds;
+      fanIntegral = constrain(fanIntegral, -fanIntegralMaximum, fanIntegralMaximum);
+    }
+
+    // Once running the fan is held at minimum through a dip in demand and only stops when it has stayed low for the
+    // off delay, so a coolant reading dropping by a degree does not cycle the motor. A stopped fan waits for more
+    // demand before it starts again, which stretches each off period at idle
+    targetOutput = constrain(unclampedOutput, 0.0f, 100.0f);
+    if (targetOutput >= fanDemandThreshold) {
+      fanLastDemandMillis = nowMillis;
+    }
+    bool belowDemand = fanPercentageOutput == 0 ? targetOutput < fanStartDemandThreshold
+                                                : targetOutput < fanDemandThreshold;
+    if (belowDemand && (fanPercentageOutput == 0 || nowMillis - fanLastDemandMillis >= fanOffDelayMillis)) {
+      targetOutput = 0;
+    } else if (targetOutput < fanMinimumPercentageOutput) {
+      targetOutput = fanMinimumPercentageOutput;
+    }
+  } else {
+    fanIntegral = 0;
+
+    // Engine has just stopped, decide if after run is needed
+    if (fanEngineWasRunning && engineTemp >= config.fanAfterRunEngineTemperature) {
+      fanAfterRunStartMillis = nowMillis;
+    }
+
+    if (fanAfterRunStartMillis != 0) {
+      if (nowMillis - fanAfterRunStartMillis < fanAfterRunMaximumMillis && engineTemp > config.fanTargetEngineTemperature) {
+        targetOutput = fanAfterRunPercentageOutput;
+      } else {
+        fanAfterRunStartMillis = 0;
+      }
+    }
   }
 
-  inAlarmDuration = millis() - firstAlarmCallTime;
+  fanEngineWasRunning = engineRunning;
 
-  if (engineRpm > 500 && inAlarmDuration > 1000) {
-    tone(alarmBuzzerPin, 4000);
-  } else if (engineRpm == 0) {
-    alarmDisable(alarmBuzzerPin);
+  // Soft start by limiting the rate of increase, decreases are applied straight away
+  if (targetOutput > fanPercentageOutput) {
+    float maximumStep = fanSoftStartPercentPerSecond * deltaSeconds;
+    if (targetOutput - fanPercentageOutput > maximumStep) {
+      fanPercentageOutput += maximumStep;
+    } else {
+      fanPercentageOutput = targetOutput;
+    }
+  } else {
+    fanPercentageOutput = targetOutput;
   }
-}
 
-/* ======================================================================
-   FUNCTION: Disable the alarm please thanks
-   ====================================================================== */
-void alarmDisable(int alarmBuzzerPin) {
-  noTone(alarmBuzzerPin);
-  firstAlarmCallTime = 0;
+  // Write out the actual pin value, the pin will maintain this output until the next update
+  fanPwmPinValue = fanPercentageOutput * 2.55;
+  analogWrite(signalPin, fanPwmPinValue);
+
+  return fanPercentageOutput;
 }
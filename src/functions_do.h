@@ -10,8 +10,6 @@
  ****************************************************/
 int calculateRpm();
 void updateRpmPulse();
-int setRadiatorFanOutput(int, int, byte);
-void alarmEnable(int, int);
-void alarmDisable(int);
+int setRadiatorFanOutput(float, float, float, int, int, byte);
 
 #endif
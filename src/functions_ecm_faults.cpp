@@ -0,0 +1,289 @@
+#include "functions_ecm_faults.h"
+#include "functions_log.h"
+
+/*****************************************************
+ *
+ * Variables - Fault request and response handling
+ *
+ ****************************************************/
+// The ECM answers the KWP style 0x17 request (positive response 0x57). If it ever rejects that with a negative
+// response we fall back to the UDS 0x19 ReadDTCInformation request (positive response 0x59).
+const byte ecmFaultServiceKwp = 0x17;
+const byte ecmFaultServiceUds = 0x19;
+const byte ecmNegativeResponse = 0x7F;
+byte ecmFaultService = ecmFaultServiceKwp;
+
+const unsigned long ecmPhysicalRequestId = 0x7E0; // Flow control frames are sent to the ECM's physical address
+const unsigned long bootCheckLightMillis = 8000;  // Hard set of MIL after boot so the bulb check is visible
+
+// ISO-TP reassembly buffer for multi frame responses. A longer response is refused with an overflow flow control
+// rather than truncated, and one whose next consecutive frame is later than N_Cr is abandoned.
+const int maxEcmFaultResponseLength = 64;
+const unsigned long ecmConsecutiveFrameTimeoutMs = 1000; // N_Cr in ISO 15765-2
+unsigned char ecmFaultResponse[maxEcmFaultResponseLength];
+int ecmFaultResponseLength = 0;   // Total length announced in the first frame
+int ecmFaultResponseReceived = 0; // Bytes received so far
+byte ecmFaultNextSequence = 0;    // Expected sequence number of the next consecutive frame
+unsigned long ecmFaultLastFrameMillis = 0;
+
+// Cached fault list and the differences from the previous list
+const int maxEcmFaultCodes = 16;
+ecmFaultCode ecmFaultCodes[maxEcmFaultCodes];
+int ecmFaultCodeCount = 0;
+uint16_t newEcmFaultCodes[maxEcmFaultCodes];
+int newEcmFaultCodeCount = 0;
+uint16_t clearedEcmFaultCodes[maxEcmFaultCodes];
+int clearedEcmFaultCodeCount = 0;
+
+// Formatted lists for publishing, each has its own buffer so all three can go out from one change. A full list is 16
+// five character codes with a comma between each
+const int ecmFaultCodeListSize = maxEcmFaultCodes * 6;
+char ecmFaultCodeList[ecmFaultCodeListSize];
+char newEcmFaultCodeList[ecmFaultCodeListSize];
+char clearedEcmFaultCodeList[ecmFaultCodeListSize];
+
+bool ecmFaultListChanged = false;
+bool ecmFaultPollCompleted = false; // A full response was decoded since hasEcmFaultPollCompleted was last asked
+bool ecmMilRequested = false;
+
+// The MIL is only trusted while the ECM keeps answering, after this many polls without a response it goes out
+const int ecmMilMaxMissedPolls = 3;
+int ecmFaultPollsUnanswered = 0;
+
+/*****************************************************
+ *
+ * Function - Request the fault list from the ECM
+ *
+ ****************************************************/
+void requestEcmFaults(canTxQueue *queue) {
+  if (ecmFaultPollsUnanswered < ecmMilMaxMissedPolls) {
+    ecmFaultPollsUnanswered++;
+  } else if (ecmMilRequested) {
+    LOG_WARN(LOG_MODULE_ECM_QUERY, "No fault response for %d polls, clearing MIL", ecmMilMaxMissedPolls);
+    ecmMilRequested = false;
+  }
+
+  if (ecmFaultService == ecmFaultServiceUds) {
+    unsigned char canPayloadRequest[8] = {0x03, ecmFaultServiceUds, 0x02, 0xFF, 0x00, 0x00, 0x00, 0x00};
+    canTxQueueSubmit(queue, 0x7DF, 8, canPayloadRequest, CAN_TX_PRIORITY_LOW);
+  } else {
+    unsigned char canPayloadRequest[8] = {0x03, ecmFaultServiceKwp, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00};
+    canTxQueueSubmit(queue, 0x7DF, 8, canPayloadRequest, CAN_TX_PRIORITY_LOW);
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Decode a complete fault response and work out what has changed
+ *
+ ****************************************************/
+bool isEcmFaultCodeInList(uint16_t code, const ecmFaultCode *list, int count) {
+  for (int i = 0; i < count; i++) {
+    if (list[i].code == code) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void decodeEcmFaultResponse(const unsigned char *data, int length) {
+  ecmFaultCode decodedCodes[maxEcmFaultCodes];
+  int decodedCount = 0;
+  bool milRequested = false;
+
+  if (data[0] == ecmFaultServiceKwp + 0x40 && length >= 2) {
+    // KWP: 0x57, number of DTCs, then DTC high, DTC low and status for each
+    int reportedCount = data[1];
+    for (int i = 2; i + 2 < length && decodedCount < reportedCount && decodedCount < maxEcmFaultCodes; i += 3) {
+      decodedCodes[decodedCount].code = (data[i] << 8) | data[i + 1];
+      decodedCodes[decodedCount].status = data[i + 2];
+      decodedCount++;
+    }
+    milRequested = decodedCount > 0;
+  } else if (data[0] == ecmFaultServiceUds + 0x40 && length >= 3) {
+    // UDS: 0x59, sub function, availability mask, then three DTC bytes and status for each. The third DTC byte is
+    // the failure type which we don't display.
+    for (int i = 3; i + 3 < length && decodedCount < maxEcmFaultCodes; i += 4) {
+      byte status = data[i + 3];
+      decodedCodes[decodedCount].code = (data[i] << 8) | data[i + 1];
+      decodedCodes[decodedCount].status = status;
+      decodedCount++;
+      // Warning indicator requested (bit 7) or confirmed (bit 3)
+      if (status & 0x88) {
+        milRequested = true;
+      }
+    }
+  } else {
+    return;
+  }
+
+  // Work out which codes are new and which have cleared since the last response
+  newEcmFaultCodeCount = 0;
+  clearedEcmFaultCodeCount = 0;
+  for (int i = 0; i < decodedCount; i++) {
+    if (!isEcmFaultCodeInList(decodedCodes[i].code, ecmFaultCodes, ecmFaultCodeCount)) {
+      newEcmFaultCodes[newEcmFaultCodeCount++] = decodedCodes[i].code;
+    }
+  }
+  for (int i = 0; i < ecmFaultCodeCount; i++) {
+    if (!isEcmFaultCodeInList(ecmFaultCodes[i].code, decodedCodes, decodedCount)) {
+      clearedEcmFaultCodes[clearedEcmFaultCodeCount++] = ecmFaultCodes[i].code;
+    }
+  }
+
+  if (newEcmFaultCodeCount > 0 || clearedEcmFaultCodeCount > 0) {
+    ecmFaultListChanged = true;
+  }
+  ecmFaultPollCompleted = true;
+
+  memcpy(ecmFaultCodes, decodedCodes, sizeof(ecmFaultCode) * decodedCount);
+  ecmFaultCodeCount = decodedCount;
+  ecmMilRequested = milRequested;
+  ecmFaultPollsUnanswered = 0;
+}
+
+/*****************************************************
+ *
+ * Function - Handle a 0x7E8 frame if it belongs to a fault response, returns true if it was consumed
+ *
+ ****************************************************/
+bool isEcmFaultResponseService(byte service) {
+  return service == ecmFaultServiceKwp + 0x40 || service == ecmFaultServiceUds + 0x40;
+}
+
+bool processEcmFaultFrame(canTxQueue *queue, unsigned char *buf, unsigned char len) {
+  byte frameType = buf[0] >> 4;
+
+  // Single frame
+  if (frameType == 0x0) {
+    int length = buf[0] & 0x0F;
+    if (length >= 3 && buf[1] == ecmNegativeResponse && buf[2] == ecmFaultServiceKwp) {
+      LOG_INFO(LOG_MODULE_ECM_QUERY, "ECM rejected fault request 0x17, switching to 0x19");
+      ecmFaultService = ecmFaultServiceUds;
+      return true;
+    }
+    if (length < 1 || length > 7 || !isEcmFaultResponseService(buf[1])) {
+      return false;
+    }
+    decodeEcmFaultResponse(&buf[1], length);
+    return true;
+  }
+
+  // First frame of a multi frame response, ask the ECM to send the rest with no block limit or separation time
+  if (frameType == 0x1) {
+    if (!isEcmFaultResponseService(buf[2])) {
+      return false;
+    }
+    int announcedLength = ((buf[0] & 0x0F) << 8) | buf[1];
+    ecmFaultResponseReceived = 0;
+
+    // Overflow (flow status 2) tells the ECM to abort the transfer
+    if (announcedLength > maxEcmFaultResponseLength) {
+      LOG_WARN(LOG_MODULE_ECM_QUERY, "ECM fault response of %d bytes refused", announcedLength);
+      unsigned char canPayloadFlowControl[8] = {0x32, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+      canTxQueueSubmit(queue, ecmPhysicalRequestId, 8, canPayloadFlowControl, CAN_TX_PRIORITY_MEDIUM);
+      return true;
+    }
+
+    ecmFaultResponseLength = announcedLength;
+    memcpy(ecmFaultResponse, &buf[2], 6);
+    ecmFaultResponseReceived = 6;
+    ecmFaultNextSequence = 1;
+    ecmFaultLastFrameMillis = millis();
+
+    unsigned char canPayloadFlowControl[8] = {0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    canTxQueueSubmit(queue, ecmPhysicalRequestId, 8, canPayloadFlowControl, CAN_TX_PRIORITY_MEDIUM);
+    return true;
+  }
+
+  // A response whose consecutive frames stopped coming is abandoned, so a late frame is not taken as its continuation
+  if (ecmFaultResponseReceived > 0 && millis() - ecmFaultLastFrameMillis > ecmConsecutiveFrameTimeoutMs) {
+    LOG_WARN(LOG_MODULE_ECM_QUERY, "ECM fault response timed out after %d of %d bytes", ecmFaultResponseReceived,
+             ecmFaultResponseLength);
+    ecmFaultResponseReceived = 0;
+  }
+
+  // Consecutive frame, only consumed if we are part way through a fault response
+  if (frameType == 0x2 && ecmFaultResponseReceived > 0) {
+    if ((buf[0] & 0x0F) != ecmFaultNextSequence) {
+      LOG_ERROR(LOG_MODULE_ECM_QUERY, "ECM fault response out of sequence, discarding");
+      ecmFaultResponseReceived = 0;
+      return true;
+    }
+    ecmFaultNextSequence = (ecmFaultNextSequence + 1) & 0x0F;
+    ecmFaultLastFrameMillis = millis();
+
+    for (int i = 1; i < len && ecmFaultResponseReceived < ecmFaultResponseLength; i++) {
+      ecmFaultResponse[ecmFaultResponseReceived++] = buf[i];
+    }
+
+    if (ecmFaultResponseReceived >= ecmFaultResponseLength) {
+      decodeEcmFaultResponse(ecmFaultResponse, ecmFaultResponseLength);
+      ecmFaultResponseReceived = 0;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+/*****************************************************
+ *
+ * Function - Get the check engine light state for the cluster (2 for check engine light, 0 for off)
+ *
+ ****************************************************/
+int getEcmCheckEngineLightState() {
+  if (millis() < bootCheckLightMillis || ecmMilRequested) {
+    return 2;
+  }
+  return 0;
+}
+
+/*****************************************************
+ *
+ * Functions - Report on the fault list
+ *
+ ****************************************************/
+bool hasEcmFaultListChanged() {
+  bool changed = ecmFaultListChanged;
+  ecmFaultListChanged = false;
+  return changed;
+}
+
+bool hasEcmFaultPollCompleted() {
+  bool completed = ecmFaultPollCompleted;
+  ecmFaultPollCompleted = false;
+  return completed;
+}
+
+void formatEcmFaultCode(char *output, uint16_t code) {
+  const char systemLetters[] = {'P', 'C', 'B', 'U'};
+  snprintf(output, 6, "%c%04X", systemLetters[code >> 14], code & 0x3FFF);
+}
+
+const char *formatEcmFaultCodeList(char *codeList, const uint16_t *codes, int count) {
+  codeList[0] = '\0';
+  for (int i = 0; i < count; i++) {
+    if (i > 0) {
+      codeList[i * 6 - 1] = ',';
+    }
+    formatEcmFaultCode(codeList + i * 6, codes[i]);
+  }
+  return codeList;
+}
+
+const char *getEcmFaultList() {
+  uint16_t codes[maxEcmFaultCodes];
+  for (int i = 0; i < ecmFaultCodeCount; i++) {
+    codes[i] = ecmFaultCodes[i].code;
+  }
+  return formatEcmFaultCodeList(ecmFaultCodeList, codes, ecmFaultCodeCount);
+}
+
+const char *getNewEcmFaultList() {
+  return formatEcmFaultCodeList(newEcmFaultCodeList, newEcmFaultCodes, newEcmFaultCodeCount);
+}
+
+const char *getClearedEcmFaultList() {
+  return formatEcmFaultCodeList(clearedEcmFaultCodeList, clearedEcmFaultCodes, clearedEcmFaultCodeCount);
+}
@@ -0,0 +1,32 @@
+#ifndef FUNCTIONS_ECM_FAULTS_H
+#define FUNCTIONS_ECM_FAULTS_H
+
+#include <Arduino.h>
+#include "functions_can_tx_queue.h"
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+struct ecmFaultCode {
+  uint16_t code;  // Two byte DTC as reported by the ECM, formatted to P0123 style for display
+  byte status;    // Status byte reported alongside the DTC
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void requestEcmFaults(canTxQueue *);
+bool processEcmFaultFrame(canTxQueue *, unsigned char *, unsigned char);
+int getEcmCheckEngineLightState();
+bool hasEcmFaultListChanged();
+bool hasEcmFaultPollCompleted();
+const char *getEcmFaultList();
+const char *getNewEcmFaultList();
+const char *getClearedEcmFaultList();
+void formatEcmFaultCode(char *, uint16_t);
+
+#endif
@@ -0,0 +1,81 @@
+#include "functions_fuel.h"
+
+/*****************************************************
+ *
+ * Variables - Fuel consumption
+ *
+ ****************************************************/
+// VQ37VHR injectors and layout, the dead time is the part of each pulse where the injector is still opening
+const float injectorFlowCcPerMinute = 270.0;
+const float injectorDeadTimeMs = 0.9;
+const int cylindersPerBank = 3;
+
+// The E46 cluster derives economy and the trip computer from a wrapping counter of injected fuel in 0x545, this is
+// how many picolitres of fuel one count represents. Calibrate against a brim to brim fill.
+const uint64_t fuelClusterPicolitresPerCount = 128000000; // 0.128 ml
+
+// Pulse widths older than this are treated as unknown so a lost ECM session does not keep integrating stale data
+const unsigned long injectorDurationMaxAgeMs = 1000;
+
+// Integrate in whole picolitres (nanolitres per millisecond multiplied by microseconds) so the total never drifts
+// over a long drive, and derive the wrapping cluster counter from the total rather than counting separately
+uint64_t fuelUsedPicolitres = 0;
+uint32_t fuelRatePicolitresPerMicrosecond = 0;
+unsigned long fuelLastUpdateMicros = 0;
+bool fuelIntegrationStarted = false;
+
+/*****************************************************
+ *
+ * Function - Convert pulse width and RPM into a fuel rate for one bank
+ *
+ ****************************************************/
+float calculateBankFuelRateNanolitresPerMs(int engineRpm, float injectorDurationMs) {
+  float effectiveDurationMs = injectorDurationMs - injectorDeadTimeMs;
+  if (effectiveDurationMs <= 0 || engineRpm <= 0) {
+    return 0;
+  }
+
+  // Sequential injection, so each cylinder injects once every two revolutions
+  float injectionsPerMs = (engineRpm / 120.0) / 1000.0 * cylindersPerBank;
+  float nanolitresPerInjectionMs = injectorFlowCcPerMinute * 1000000.0 / 60000.0;
+
+  return injectionsPerMs * effectiveDurationMs * nanolitresPerInjectionMs;
+}
+
+/*****************************************************
+ *
+ * Function - Integrate fuel used, called every loop
+ *
+ ****************************************************/
+void updateFuelConsumption(int engineRpm, float injectorDurationBank1, float injectorDurationBank2,
+                           unsigned long injectorDurationTimestamp, unsigned long nowMicros) {
+  if (!fuelIntegrationStarted) {
+    fuelLastUpdateMicros = nowMicros;
+    fuelIntegrationStarted = true;
+  }
+
+  // Integrate the previous interval at the rate that applied during it
+  unsigned long elapsedMicros = nowMicros - fuelLastUpdateMicros;
+  fuelLastUpdateMicros = nowMicros;
+  fuelUsedPicolitres += (uint64_t)fuelRatePicolitresPerMicrosecond * elapsedMicros;
+
+  if (injectorDurationTimestamp == 0 || millis() - injectorDurationTimestamp > injectorDurationMaxAgeMs) {
+    fuelRatePicolitresPerMicrosecond = 0;
+    return;
+  }
+
+  float rate = calculateBankFuelRateNanolitresPerMs(engineRpm, injectorDurationBank1) +
+               calculateBankFuelRateNanolitresPerMs(engineRpm, injectorDurationBank2);
+  fuelRatePicolitresPerMicrosecond = rate + 0.5;
+}
+
+/*****************************************************
+ *
+ * Functions - Report fuel consumption
+ *
+ ****************************************************/
+uint16_t getFuelClusterCounter() { return (uint16_t)(fuelUsedPicolitres / fuelClusterPicolitresPerCount); }
+
+float getFuelRateLitresPerHour() { return fuelRatePicolitresPerMicrosecond * 3600.0 / 1000000.0; }
+
+float getFuelUsedLitres() { return fuelUsedPicolitres / 1000000000000.0; }
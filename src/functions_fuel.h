@@ -0,0 +1,16 @@
+#ifndef FUNCTIONS_FUEL_H
+#define FUNCTIONS_FUEL_H
+
+#include <Arduino.h>
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void updateFuelConsumption(int, float, float, unsigned long, unsigned long);
+uint16_t getFuelClusterCounter();
+float getFuelRateLitresPerHour();
+float getFuelUsedLitres();
+
+#endif
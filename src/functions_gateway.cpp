@@ -0,0 +1,174 @@
+#include "functions_gateway.h"
+#include "functions_log.h"
+
+/*****************************************************
+ *
+ * Variables - Gateway tables and stats
+ *
+ ****************************************************/
+gatewayFrame *gatewayFrames = NULL;
+int gatewayFrameCount = 0;
+const gatewayRule *gatewayRules = NULL;
+int gatewayRuleCount = 0;
+canTxQueue *gatewayQueues[CAN_BUS_COUNT];
+
+const int maxGatewayFrames = 16;
+bool gatewayFrameDue[maxGatewayFrames];
+
+unsigned long gatewayPassMicrosTotal = 0;
+unsigned long gatewayPassCount = 0;
+unsigned long gatewayRulesEvaluated = 0;
+unsigned long gatewayLatencyTotalMicros = 0;
+unsigned long gatewayLatencyMaxMicros = 0;
+unsigned long gatewayLatencyCount = 0;
+
+/*****************************************************
+ *
+ * Function - Write a raw value into a payload bit field
+ *
+ ****************************************************/
+void writeGatewayField(unsigned char *payload, const gatewayRule *rule, uint32_t raw) {
+  if (rule->bigEndian) {
+    int bytes = (rule->lengthBits + 7) / 8;
+    for (int i = 0; i < bytes; i++) {
+      payload[rule->startByte + i] = raw >> (8 * (bytes - 1 - i));
+    }
+    return;
+  }
+
+  int bitPosition = rule->startBit;
+  int byteIndex = rule->startByte;
+  int remainingBits = rule->lengthBits;
+  while (remainingBits > 0 && byteIndex < 8) {
+    int chunkBits = min(8 - bitPosition, remainingBits);
+    unsigned char mask = ((1 << chunkBits) - 1) << bitPosition;
+    payload[byteIndex] = (payload[byteIndex] & ~mask) | ((raw << bitPosition) & mask);
+    raw >>= chunkBits;
+    remainingBits -= chunkBits;
+    bitPosition = 0;
+    byteIndex++;
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Set up the gateway with the frame and rule tables
+ *
+ ****************************************************/
+void initialiseGateway(gatewayFrame *frames, int frameCount, const gatewayRule *rules, int ruleCount,
+                       canTxQueue *bmwQueue, canTxQueue *nissanQueue) {
+  gatewayFrames = frames;
+  gatewayFrameCount = min(frameCount, maxGatewayFrames);
+  gatewayRules = rules;
+  gatewayRuleCount = ruleCount;
+  gatewayQueues[CAN_BUS_BMW] = bmwQueue;
+  gatewayQueues[CAN_BUS_NISSAN] = nissanQueue;
+
+  // Frames with no enabled rules are not sent at all, which is how unfinished translations are parked
+  for (int i = 0; i < gatewayFrameCount; i++) {
+    setGatewayFrameEnabled(i, gatewayFrames[i].enabled);
+  }
+
+  serialConsole.print("INFO - Gateway configured with ");
+  serialConsole.print(gatewayFrameCount);
+  serialConsole.print(" frames and ");
+  serialConsole.print(gatewayRuleCount);
+  serialConsole.println(" rules");
+}
+
+void setGatewayFrameEnabled(int frameIndex, bool enabled) {
+  gatewayFrame *frame = &gatewayFrames[frameIndex];
+  frame->enabled = enabled;
+  frame->active = false;
+
+  if (!enabled) {
+    return;
+  }
+
+  for (int i = 0; i < gatewayRuleCount; i++) {
+    if (gatewayRules[i].frame == frameIndex && gatewayRules[i].enabled) {
+      frame->active = true;
+      return;
+    }
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Evaluate every rule in one pass and send the frames, returns the number of frames submitted
+ *
+ ****************************************************/
+int serviceGateway() {
+  unsigned long startMicros = micros();
+
+  for (int i = 0; i < gatewayFrameCount; i++) {
+    gatewayFrame *frame = &gatewayFrames[i];
+    gatewayFrameDue[i] = frame->active;
+    if (frame->active && frame->sampleSequence != NULL) {
+      unsigned long sequence = frame->sampleSequence();
+      gatewayFrameDue[i] = sequence != frame->lastSequence;
+      frame->lastSequence = sequence;
+    }
+  }
+
+  for (int i = 0; i < gatewayRuleCount; i++) {
+    const gatewayRule *rule = &gatewayRules[i];
+    if (!rule->enabled || !gatewayFrameDue[rule->frame]) {
+      continue;
+    }
+
+    float value = rule->source() * rule->scale + rule->offset;
+    if (value < rule->minValue) {
+      value = rule->minValue;
+    } else if (value > rule->maxValue) {
+      value = rule->maxValue;
+    }
+
+    writeGatewayField(gatewayFrames[rule->frame].payload, rule, (uint32_t)(value + 0.5));
+    gatewayRulesEvaluated++;
+  }
+
+  int framesSubmitted = 0;
+  for (int i = 0; i < gatewayFrameCount; i++) {
+    gatewayFrame *frame = &gatewayFrames[i];
+    if (gatewayFrameDue[i] && canOutputSend(gatewayQueues[frame->bus], &frame->output, frame->payload)) {
+      framesSubmitted++;
+    }
+  }
+
+  gatewayPassMicrosTotal += micros() - startMicros;
+  gatewayPassCount++;
+  return framesSubmitted;
+}
+
+/*****************************************************
+ *
+ * Functions - Measure the gateway cost and the time from a source frame being read to its output being offered to
+ * the shield
+ *
+ ****************************************************/
+void recordGatewayLatency(unsigned long latencyMicros) {
+  gatewayLatencyTotalMicros += latencyMicros;
+  gatewayLatencyCount++;
+  if (latencyMicros > gatewayLatencyMaxMicros) {
+    gatewayLatencyMaxMicros = latencyMicros;
+  }
+}
+
+void reportGatewayStats() {
+  serialConsole.print("Gateway pass us avg: ");
+  serialConsole.print(gatewayPassCount > 0 ? (float)gatewayPassMicrosTotal / gatewayPassCount : 0);
+  serialConsole.print(", per rule us: ");
+  serialConsole.println(gatewayRulesEvaluated > 0 ? (float)gatewayPassMicrosTotal / gatewayRulesEvaluated : 0);
+  serialConsole.print("Gateway latency us avg / max: ");
+  serialConsole.print(gatewayLatencyCount > 0 ? gatewayLatencyTotalMicros / gatewayLatencyCount : 0);
+  serialConsole.print(" / ");
+  serialConsole.println(gatewayLatencyMaxMicros);
+
+  gatewayPassMicrosTotal = 0;
+  gatewayPassCount = 0;
+  gatewayRulesEvaluated = 0;
+  gatewayLatencyTotalMicros = 0;
+  gatewayLatencyMaxMicros = 0;
+  gatewayLatencyCount = 0;
+}
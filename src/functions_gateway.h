@@ -0,0 +1,53 @@
+#ifndef FUNCTIONS_GATEWAY_H
+#define FUNCTIONS_GATEWAY_H
+
+#include <Arduino.h>
+#include "functions_can_health.h"
+#include "functions_can_output.h"
+#include "functions_can_tx_queue.h"
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+// A frame the gateway builds and sends. Frames with a sample sequence are only evaluated when the sequence moves on,
+// so they follow the rate of the frame feeding them rather than the loop rate.
+struct gatewayFrame {
+  canOutputFrame output;                       // CAN ID, refresh floor and priority, see functions_can_output
+  canBus bus = CAN_BUS_BMW;                    // Which network the frame goes out on
+  unsigned long (*sampleSequence)() = NULL;    // Optional, frame only evaluated when this value changes
+  unsigned char payload[8] = {0};              // Initial payload, bits not covered by a rule are left as is
+  bool enabled = true;
+  unsigned long lastSequence = 0;              // Sample sequence at the last evaluation
+  bool active = false;                         // Enabled and has at least one enabled rule, worked out at init
+};
+
+// Maps one source signal onto a bit field of a gateway frame as raw = clamp(value * scale + offset, min, max)
+struct gatewayRule {
+  const char *name;
+  byte frame;          // Index into the gateway frame table
+  float (*source)();   // Returns the current value of the source signal
+  float scale;
+  float offset;
+  float minValue;
+  float maxValue;
+  byte startByte;
+  byte startBit;       // Bit position within the start byte of the least significant bit, little endian only
+  byte lengthBits;
+  bool bigEndian;      // Big endian fields must be whole bytes
+  bool enabled;
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void initialiseGateway(gatewayFrame *, int, const gatewayRule *, int, canTxQueue *, canTxQueue *);
+void setGatewayFrameEnabled(int, bool);
+int serviceGateway();
+void recordGatewayLatency(unsigned long);
+void reportGatewayStats();
+
+#endif
@@ -0,0 +1,156 @@
+#include "functions_launch.h"
+#include "functions_alarms.h"
+#include "functions_log.h"
+
+/*****************************************************
+ *
+ * Variables - Launch control assist
+ *
+ ****************************************************/
+// Target rear slip band in per-mille, the buzzer sounds as soon as slip goes above it
+const int32_t launchSlipTargetMaxPerMille = 150;
+const unsigned long launchTimeoutMs = 6000;
+const float launchTargetSpeedKmh = 50;
+const unsigned int launchBuzzerFrequency = 2500; // Lower than the alarm tone so the two can be told apart
+
+// Staging needs the revs held up with the clutch in, so an ordinary stop at the lights never arms a launch
+const int launchArmRpm = 2500;
+const int launchDisarmRpm = 1500; // Letting the revs fall back while still staged stands the launch down
+
+launchState currentLaunchState = LAUNCH_IDLE;
+launchSummary currentLaunchSummary;
+bool launchSummaryReady = false;
+bool launchBuzzerOn = false;
+bool launchStationary = true;
+bool launchVehicleMoving = false;
+unsigned long launchClutchReleaseMillis = 0;
+unsigned long launchLastFrameMillis = 0;
+
+/*****************************************************
+ *
+ * Function - Buzzer feedback, alarms always take priority over launch feedback
+ *
+ ****************************************************/
+void setLaunchBuzzer(bool on, int buzzerPin) {
+  if (isAlarmActive()) {
+    // The alarm service owns the buzzer while an alarm is active. If its pattern is in an off phase our tone would
+    // carry on underneath it, so stop it here, otherwise the alarm tone has already replaced ours on the pin
+    if (launchBuzzerOn && !isAlarmBuzzerOn()) {
+      noTone(buzzerPin);
+    }
+    launchBuzzerOn = false;
+    return;
+  }
+
+  if (on && !launchBuzzerOn) {
+    tone(buzzerPin, launchBuzzerFrequency);
+  } else if (!on && launchBuzzerOn) {
+    noTone(buzzerPin);
+  }
+  launchBuzzerOn = on;
+}
+
+/*****************************************************
+ *
+ * Function - Finish the launch and make the summary available
+ *
+ ****************************************************/
+void finishLaunch(int buzzerPin) {
+  setLaunchBuzzer(false, buzzerPin);
+  currentLaunchState = LAUNCH_IDLE;
+  launchSummaryReady = true;
+}
+
+/*****************************************************
+ *
+ * Function - Track staging and clutch release, called every loop
+ *
+ ****************************************************/
+void updateLaunchClutch(bool clutchPressed, float vehicleSpeed, int engineRpm, unsigned long now) {
+  switch (currentLaunchState) {
+  case LAUNCH_IDLE:
+    if (clutchPressed && launchStationary && vehicleSpeed == 0 && engineRpm >= launchArmRpm) {
+      currentLaunchState = LAUNCH_STAGED;
+    }
+    break;
+  case LAUNCH_STAGED:
+    if (!launchStationary) {
+      // Rolled away with the clutch still in so this is not a launch
+      currentLaunchState = LAUNCH_IDLE;
+    } else if (clutchPressed && engineRpm < launchDisarmRpm) {
+      currentLaunchState = LAUNCH_IDLE;
+    } else if (!clutchPressed) {
+      currentLaunchState = LAUNCH_ACTIVE;
+      currentLaunchSummary = launchSummary();
+      currentLaunchSummary.launchRpm = engineRpm;
+      launchClutchReleaseMillis = now;
+      launchLastFrameMillis = now;
+      launchVehicleMoving = false;
+    }
+    break;
+  case LAUNCH_ACTIVE:
+    break;
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Measure the launch on every wheel speed frame so feedback is never more than one frame late
+ *
+ ****************************************************/
+void updateLaunchWheelSpeed(int32_t rearSlipPerMille, float vehicleSpeed, unsigned long timestamp, int buzzerPin) {
+  launchStationary = vehicleSpeed == 0;
+
+  if (currentLaunchState != LAUNCH_ACTIVE) {
+    return;
+  }
+
+  unsigned long elapsed = timestamp - launchClutchReleaseMillis;
+
+  if (!launchVehicleMoving && !launchStationary) {
+    launchVehicleMoving = true;
+    currentLaunchSummary.reactionTimeMs = elapsed;
+  }
+
+  if (rearSlipPerMille > currentLaunchSummary.peakSlipPerMille) {
+    currentLaunchSummary.peakSlipPerMille = rearSlipPerMille;
+  }
+
+  bool overSlipBand = rearSlipPerMille > launchSlipTargetMaxPerMille;
+  if (overSlipBand) {
+    currentLaunchSummary.timeOverSlipBandMs += timestamp - launchLastFrameMillis;
+  }
+  launchLastFrameMillis = timestamp;
+  setLaunchBuzzer(overSlipBand, buzzerPin);
+
+  if (vehicleSpeed >= launchTargetSpeedKmh) {
+    currentLaunchSummary.zeroToFiftyMs = elapsed;
+    finishLaunch(buzzerPin);
+  } else if (elapsed > launchTimeoutMs || (launchVehicleMoving && launchStationary)) {
+    finishLaunch(buzzerPin);
+  }
+}
+
+launchState getLaunchState() { return currentLaunchState; }
+
+/*****************************************************
+ *
+ * Functions - Report the last launch
+ *
+ ****************************************************/
+bool isLaunchSummaryReady() { return launchSummaryReady; }
+
+String getLaunchSummary() {
+  launchSummaryReady = false;
+
+  LOG_INFO(LOG_MODULE_GENERAL, "Launch reaction %lu ms, 0-50 %lu ms, peak slip %ld per mille, %lu ms over band, %ld rpm",
+           currentLaunchSummary.reactionTimeMs, currentLaunchSummary.zeroToFiftyMs,
+           (long)currentLaunchSummary.peakSlipPerMille, currentLaunchSummary.timeOverSlipBandMs,
+           (long)currentLaunchSummary.launchRpm);
+
+  return "{\"reactionTime\":" + String(currentLaunchSummary.reactionTimeMs) +
+         ",\"zeroToFifty\":" + String(currentLaunchSummary.zeroToFiftyMs) +
+         ",\"peakSlip\":" + String(currentLaunchSummary.peakSlipPerMille) +
+         ",\"timeOverSlipBand\":" + String(currentLaunchSummary.timeOverSlipBandMs) +
+         ",\"launchRpm\":" + String(currentLaunchSummary.launchRpm) + "}";
+}
@@ -0,0 +1,36 @@
+#ifndef FUNCTIONS_LAUNCH_H
+#define FUNCTIONS_LAUNCH_H
+
+#include <Arduino.h>
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+enum launchState {
+  LAUNCH_IDLE,   // Not ready to launch
+  LAUNCH_STAGED, // Clutch in, stationary and revs held up, waiting for the clutch to be released
+  LAUNCH_ACTIVE  // Clutch released, measuring slip until 50 km/h or timeout
+};
+
+struct launchSummary {
+  unsigned long reactionTimeMs = 0;   // Clutch release to the front wheels turning
+  unsigned long zeroToFiftyMs = 0;    // Clutch release to 50 km/h, 0 if not reached
+  int32_t peakSlipPerMille = 0;       // Highest rear axle slip seen during the launch
+  unsigned long timeOverSlipBandMs = 0; // Time spent above the target slip band
+  int launchRpm = 0;                  // RPM at the moment the clutch was released
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void updateLaunchClutch(bool, float, int, unsigned long);
+void updateLaunchWheelSpeed(int32_t, float, unsigned long, int);
+launchState getLaunchState();
+bool isLaunchSummaryReady();
+String getLaunchSummary();
+
+#endif
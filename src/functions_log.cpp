@@ -0,0 +1,139 @@
+#include "functions_log.h"
+
+/*****************************************************
+ *
+ * Variables - Log ring buffer
+ *
+ ****************************************************/
+// Single producer (the loop) and single consumer (serviceLog), so the indexes only ever move forward on one side each
+// and no locking is needed. When full the newest record is dropped and counted rather than blocking.
+const int logRingSize = 32; // Must be a power of two
+logRecord logRing[logRingSize];
+volatile uint16_t logRingHead = 0; // Next record to write
+volatile uint16_t logRingTail = 0; // Next record to drain
+
+unsigned long logRecordsWritten = 0;
+unsigned long logRecordsDropped = 0;
+unsigned long logRecordsDroppedReported = 0;
+
+const char *logModuleNames[LOG_MODULE_COUNT] = {"GENERAL", "GEARS", "ECM QUERY", "AFR"};
+const char *logLevelNames[] = {"", "ERROR", "WARN", "INFO", "DEBUG", "TRACE"};
+
+// The line being written out, kept across calls so a long line goes out over several loops
+char logLine[128];
+int logLineLength = 0;
+int logLineWritten = 0;
+
+/*****************************************************
+ *
+ * Functions - Serial console for diagnostic text
+ *
+ ****************************************************/
+consoleOutput serialConsole;
+
+size_t consoleOutput::write(uint8_t c) { return write(&c, 1); }
+
+size_t consoleOutput::write(const uint8_t *buffer, size_t size) {
+  if (muted) {
+    mutedBytes += size;
+    return size;
+  }
+  return Serial.write(buffer, size);
+}
+
+int consoleOutput::availableForWrite() { return muted ? 0 : Serial.availableForWrite(); }
+
+// Records keep queuing in the ring while muted, a line part way out when muting starts is finished afterwards
+void setSerialConsoleMuted(bool muted) { serialConsole.muted = muted; }
+
+/*****************************************************
+ *
+ * Function - Copy a record into the ring, called through the LOG_* macros
+ *
+ ****************************************************/
+void logRecordWrite(logModule module, byte level, const char *format, const unsigned long *arguments, int count) {
+  uint16_t head = logRingHead;
+  if ((uint16_t)(head - logRingTail) >= logRingSize) {
+    logRecordsDropped++;
+    return;
+  }
+
+  logRecord *record = &logRing[head & (logRingSize - 1)];
+  record->timestamp = millis();
+  record->format = format;
+  record->module = module;
+  record->level = level;
+  for (int i = 0; i < count; i++) {
+    record->arguments[i] = arguments[i];
+  }
+
+  logRingHead = head + 1;
+  logRecordsWritten++;
+}
+
+/*****************************************************
+ *
+ * Function - Drain the ring to serial without ever waiting on the UART, called every loop
+ *
+ ****************************************************/
+void serviceLog() {
+  if (serialConsole.muted) {
+    return;
+  }
+
+  while (true) {
+    if (logLineWritten < logLineLength) {
+      int space = Serial.availableForWrite();
+      if (space <= 0) {
+        return;
+      }
+      int chunk = min(space, logLineLength - logLineWritten);
+      Serial.write((const uint8_t *)logLine + logLineWritten, chunk);
+      logLineWritten += chunk;
+      if (logLineWritten < logLineLength) {
+        return;
+      }
+    }
+
+    // Report drops once the backlog has cleared so the notice itself is not lost
+    if (logRecordsDropped != logRecordsDroppedReported && logRingTail == logRingHead) {
+      logLineLength = snprintf(logLine, sizeof(logLine), "[LOG] %lu records dropped\r\n",
+                               logRecordsDropped - logRecordsDroppedReported);
+      logLineWritten = 0;
+      logRecordsDroppedReported = logRecordsDropped;
+      continue;
+    }
+
+    uint16_t tail = logRingTail;
+    if (tail == logRingHead) {
+      return;
+    }
+
+    const logRecord *record = &logRing[tail & (logRingSize - 1)];
+    const unsigned long *a = record->arguments;
+    int length = snprintf(logLine, sizeof(logLine), "[%lu %s %s] ", record->timestamp, logLevelNames[record->level],
+                          logModuleNames[record->module]);
+    length += snprintf(logLine + length, sizeof(logLine) - length, record->format, a[0], a[1], a[2], a[3], a[4], a[5]);
+    if (length > (int)sizeof(logLine) - 3) {
+      length = sizeof(logLine) - 3;
+    }
+    logLine[length++] = '\r';
+    logLine[length++] = '\n';
+    logLineLength = length;
+    logLineWritten = 0;
+
+    logRingTail = tail + 1;
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Report how much has been logged and dropped
+ *
+ ****************************************************/
+void reportLogStats() {
+  serialConsole.print("Log records written / dropped: ");
+  serialConsole.print(logRecordsWritten);
+  serialConsole.print(" / ");
+  serialConsole.println(logRecordsDropped);
+}
@@ -0,0 +1,119 @@
+#ifndef FUNCTIONS_LOG_H
+#define FUNCTIONS_LOG_H
+
+#include <Arduino.h>
+
+/****************************************************
+ *
+ * Levels, anything above LOG_LEVEL is removed at compile time
+ *
+ ****************************************************/
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+enum logModule {
+  LOG_MODULE_GENERAL,
+  LOG_MODULE_GEARS,
+  LOG_MODULE_ECM_QUERY, // Responses to ECM queries on 0x7E8
+  LOG_MODULE_AFR,
+  LOG_MODULE_COUNT
+};
+
+// Formatting is deferred until the record is drained, so a log call only copies the format pointer and up to six
+// integer arguments. Formats must be string literals, strings passed as %s must be static and there is no %f.
+const int logMaximumArguments = 6;
+
+struct logRecord {
+  unsigned long timestamp;
+  const char *format;
+  unsigned long arguments[logMaximumArguments];
+  byte module;
+  byte level;
+};
+
+// Diagnostic text is printed through serialConsole rather than straight to Serial, so all of it can be held back while
+// the port carries something else, the LAWICEL stream in sniff mode. Writes while muted are discarded
+class consoleOutput : public Print {
+public:
+  bool muted = false;
+  unsigned long mutedBytes = 0; // Discarded while muted since boot
+
+  size_t write(uint8_t) override;
+  size_t write(const uint8_t *, size_t) override;
+  int availableForWrite() override;
+};
+
+/****************************************************
+ *
+ * Runtime module mask, a set bit enables logging for that module
+ *
+ ****************************************************/
+extern uint32_t logModuleMask;
+extern consoleOutput serialConsole;
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void logRecordWrite(logModule, byte, const char *, const unsigned long *, int);
+void serviceLog();
+void setSerialConsoleMuted(bool);
+void reportLogStats();
+
+/****************************************************
+ *
+ * Logging macros
+ *
+ ****************************************************/
+template <typename... T> inline void logWrite(logModule module, byte level, const char *format, T... arguments) {
+  if (logModuleMask & (1UL << module)) {
+    const unsigned long values[sizeof...(T) > 0 ? sizeof...(T) : 1] = {(unsigned long)arguments...};
+    static_assert(sizeof...(T) <= logMaximumArguments, "Too many log arguments");
+    logRecordWrite(module, level, format, values, sizeof...(T));
+  }
+}
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(module, ...) logWrite(module, LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(module, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(module, ...) logWrite(module, LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(module, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(module, ...) logWrite(module, LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(module, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(module, ...) logWrite(module, LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(module, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_TRACE
+#define LOG_TRACE(module, ...) logWrite(module, LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(module, ...) do {} while (0)
+#endif
+
+#endif
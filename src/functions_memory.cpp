@@ -0,0 +1,265 @@
+#include "functions_memory.h"
+#include "functions_log.h"
+#include <errno.h>
+#include <malloc.h>
+#include <stddef.h>
+
+/*****************************************************
+ *
+ * Variables - Heap accounting and stack painting
+ *
+ ****************************************************/
+memoryStats memoryUsage;
+memorySubsystem currentMemorySubsystem = MEMORY_SUBSYSTEM_SETUP;
+
+const char *memorySubsystemNames[MEMORY_SUBSYSTEM_COUNT] = {"setup", "mqtt", "can", "alarms", "analytics", "other"};
+
+const uint32_t stackPaintPattern = 0xA5A5A5A5;
+const int stackPaintMarginBytes = 64; // Left alone below the frame doing the painting
+
+#if defined(ARDUINO_ARCH_RENESAS)
+// Main stack and heap bounds from the FSP linker script
+extern "C" char __StackLimit;
+extern "C" char __StackTop;
+extern "C" char __HeapBase;
+extern "C" char __HeapLimit;
+
+volatile bool heapProbeActive = false; // Set while getLargestFreeHeapBlock probes, the heap may not grow
+#endif
+
+// glibc deprecates mallinfo for mallinfo2 with size_t fields, newlib on the R4 only has mallinfo
+#if !defined(ARDUINO)
+struct mallinfo2 readHeapInfo() { return mallinfo2(); }
+#else
+struct mallinfo readHeapInfo() { return mallinfo(); }
+#endif
+
+/*****************************************************
+ *
+ * Functions - malloc family wrappers, linked in with -Wl,--wrap (see platformio.ini)
+ *
+ ****************************************************/
+// operator new, String and the libraries all end up here so every heap block is counted against whoever was running
+extern "C" {
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+void __real_free(void *);
+
+void recordAllocation(void *pointer) {
+  if (pointer == NULL) {
+    memoryUsage.failedAllocations++;
+    return;
+  }
+  memoryUsage.allocations++;
+  memoryUsage.subsystemAllocations[currentMemorySubsystem]++;
+  memoryUsage.liveAllocations++;
+  memoryUsage.liveBytes += malloc_usable_size(pointer);
+  if (memoryUsage.liveBytes > memoryUsage.peakLiveBytes) {
+    memoryUsage.peakLiveBytes = memoryUsage.liveBytes;
+  }
+}
+
+void recordFree(void *pointer) {
+  if (pointer == NULL) {
+    return;
+  }
+  memoryUsage.liveAllocations--;
+  memoryUsage.liveBytes -= malloc_usable_size(pointer);
+}
+
+void *__wrap_malloc(size_t size) {
+  void *pointer = __real_malloc(size);
+  recordAllocation(pointer);
+  return pointer;
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  void *pointer = __real_calloc(count, size);
+  recordAllocation(pointer);
+  return pointer;
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+  size_t previousBytes = pointer != NULL ? malloc_usable_size(pointer) : 0;
+  void *resized = __real_realloc(pointer, size);
+
+  // A failed realloc leaves the original block in place, a zero size frees it
+  if (resized == NULL) {
+    if (size == 0 && pointer != NULL) {
+      memoryUsage.liveAllocations--;
+      memoryUsage.liveBytes -= previousBytes;
+    } else if (size != 0) {
+      memoryUsage.failedAllocations++;
+    }
+    return resized;
+  }
+
+  if (pointer != NULL) {
+    memoryUsage.liveAllocations--;
+    memoryUsage.liveBytes -= previousBytes;
+  }
+  recordAllocation(resized);
+  return resized;
+}
+
+void __wrap_free(void *pointer) {
+  recordFree(pointer);
+  __real_free(pointer);
+}
+
+#if defined(ARDUINO_ARCH_RENESAS)
+void *__real__sbrk(ptrdiff_t);
+
+// malloc only asks for more heap when no free block fits, refusing here makes an oversized probe fail in place
+void *__wrap__sbrk(ptrdiff_t increment) {
+  if (heapProbeActive && increment > 0) {
+    errno = ENOMEM;
+    return (void *)-1;
+  }
+  return __real__sbrk(increment);
+}
+#endif
+}
+
+#if !defined(ARDUINO_ARCH_RENESAS)
+// The host's operator new lives in the shared libstdc++ where --wrap cannot reach it, send it through malloc as the
+// Arduino core does so String and new are counted in host runs too
+void *operator new(size_t size) { return malloc(size); }
+void *operator new[](size_t size) { return malloc(size); }
+void operator delete(void *pointer) noexcept { free(pointer); }
+void operator delete[](void *pointer) noexcept { free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { free(pointer); }
+#endif
+
+/*****************************************************
+ *
+ * Function - Tag the allocations that follow with the subsystem making them
+ *
+ ****************************************************/
+void setMemorySubsystem(memorySubsystem subsystem) { currentMemorySubsystem = subsystem; }
+
+const memoryStats *getMemoryStats() { return &memoryUsage; }
+
+/*****************************************************
+ *
+ * Functions - Stack high-water mark, the unused stack is painted at boot and the deepest overwritten word found later
+ *
+ ****************************************************/
+#if defined(ARDUINO_ARCH_RENESAS)
+void paintStack() {
+  volatile uint8_t marker = 0;
+  uint32_t *word = (uint32_t *)&__StackLimit;
+  uint32_t *end = (uint32_t *)((uint8_t *)&marker - stackPaintMarginBytes);
+  while (word < end) {
+    *word++ = stackPaintPattern;
+  }
+}
+
+unsigned long getStackHighWaterBytes() {
+  uint32_t *word = (uint32_t *)&__StackLimit;
+  while (word < (uint32_t *)&__StackTop && *word == stackPaintPattern) {
+    word++;
+  }
+  return (uint8_t *)&__StackTop - (uint8_t *)word;
+}
+
+unsigned long getStackSizeBytes() { return &__StackTop - &__StackLimit; }
+#else
+// Host builds run on the operating system's stack, only the heap hooks apply there
+void paintStack() {}
+
+unsigned long getStackHighWaterBytes() { return 0; }
+
+unsigned long getStackSizeBytes() { return 0; }
+#endif
+
+/*****************************************************
+ *
+ * Function - Find the largest block the heap could hand out right now
+ *
+ ****************************************************/
+// Probes with the unwrapped allocator so the search does not show up in the counts. The probe is capped at the free
+// bytes already in the arena and _sbrk refuses to grow it meanwhile, so the largest block in the arena is found without
+// moving the break. The untouched space above the break is one contiguous block of its own.
+unsigned long getLargestFreeHeapBlock() {
+#if defined(ARDUINO_ARCH_RENESAS)
+  unsigned long low = 0;
+  unsigned long high = readHeapInfo().fordblks;
+  heapProbeActive = true;
+  while (low < high) {
+    unsigned long size = (low + high + 1) / 2;
+    void *pointer = __real_malloc(size);
+    if (pointer != NULL) {
+      __real_free(pointer);
+      low = size;
+    } else {
+      high = size - 1;
+    }
+  }
+  heapProbeActive = false;
+
+  unsigned long aboveBreak = &__HeapLimit - (char *)__real__sbrk(0);
+  return max(low, aboveBreak);
+#else
+  return readHeapInfo().fordblks;
+#endif
+}
+
+/*****************************************************
+ *
+ * Function - Optionally report memory use over serial and return a compact JSON summary for MQTT
+ *
+ ****************************************************/
+String reportMemoryUsage(bool printToSerial) {
+  // Take the per subsystem counts first, the strings built below show up in the next report
+  unsigned long subsystemAllocations[MEMORY_SUBSYSTEM_COUNT];
+  for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; i++) {
+    subsystemAllocations[i] = memoryUsage.subsystemAllocations[i];
+    memoryUsage.subsystemAllocations[i] = 0;
+  }
+
+  auto heapInfo = readHeapInfo();
+  unsigned long stackUsed = getStackHighWaterBytes();
+  unsigned long largestFree = getLargestFreeHeapBlock();
+
+  if (printToSerial) {
+    serialConsole.print("Memory stack: ");
+    serialConsole.print(stackUsed);
+    serialConsole.print("/");
+    serialConsole.print(getStackSizeBytes());
+    serialConsole.print(" heap live: ");
+    serialConsole.print(memoryUsage.liveBytes);
+    serialConsole.print(" in ");
+    serialConsole.print(memoryUsage.liveAllocations);
+    serialConsole.print(" blocks, peak: ");
+    serialConsole.print(memoryUsage.peakLiveBytes);
+    serialConsole.print(" arena: ");
+    serialConsole.print((unsigned long)heapInfo.arena);
+    serialConsole.print(" free in arena: ");
+    serialConsole.print((unsigned long)heapInfo.fordblks);
+    serialConsole.print(" largest free: ");
+    serialConsole.print(largestFree);
+    serialConsole.print(" failed: ");
+    serialConsole.println(memoryUsage.failedAllocations);
+
+    for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; i++) {
+      serialConsole.print("\t");
+      serialConsole.print(memorySubsystemNames[i]);
+      serialConsole.print(" allocations: ");
+      serialConsole.println(subsystemAllocations[i]);
+    }
+  }
+
+  String summary = "{\"stack\":" + String(stackUsed) + ",\"stackSize\":" + String(getStackSizeBytes()) +
+                   ",\"heapLive\":" + String(memoryUsage.liveBytes) +
+                   ",\"blocks\":" + String(memoryUsage.liveAllocations) +
+                   ",\"heapPeak\":" + String(memoryUsage.peakLiveBytes) +
+                   ",\"arena\":" + String((unsigned long)heapInfo.arena) +
+                   ",\"largestFree\":" + String(largestFree) + ",\"failed\":" + String(memoryUsage.failedAllocations);
+  for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; i++) {
+    summary += ",\"" + String(memorySubsystemNames[i]) + "\":" + String(subsystemAllocations[i]);
+  }
+  return summary + "}";
+}
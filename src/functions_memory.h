@@ -0,0 +1,44 @@
+#ifndef FUNCTIONS_MEMORY_H
+#define FUNCTIONS_MEMORY_H
+
+#include <Arduino.h>
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+// Whatever is running tags the heap allocations it makes so the report can say who is still allocating once warm
+enum memorySubsystem {
+  MEMORY_SUBSYSTEM_SETUP,
+  MEMORY_SUBSYSTEM_MQTT,
+  MEMORY_SUBSYSTEM_CAN,
+  MEMORY_SUBSYSTEM_ALARMS,
+  MEMORY_SUBSYSTEM_ANALYTICS, // Traction, launch and performance timing
+  MEMORY_SUBSYSTEM_OTHER,
+  MEMORY_SUBSYSTEM_COUNT
+};
+
+struct memoryStats {
+  unsigned long allocations = 0;        // Successful malloc, calloc and realloc calls since boot
+  unsigned long failedAllocations = 0;  // Calls which returned NULL
+  unsigned long liveAllocations = 0;    // Blocks not yet freed
+  unsigned long liveBytes = 0;          // Usable bytes in those blocks
+  unsigned long peakLiveBytes = 0;
+  unsigned long subsystemAllocations[MEMORY_SUBSYSTEM_COUNT] = {0}; // Allocations since the last report
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void paintStack();
+unsigned long getStackHighWaterBytes();
+unsigned long getStackSizeBytes();
+void setMemorySubsystem(memorySubsystem);
+const memoryStats *getMemoryStats();
+unsigned long getLargestFreeHeapBlock();
+String reportMemoryUsage(bool);
+
+#endif
@@ -1,4 +1,7 @@
 #include "functions_mqtt.h"
+#include "functions_command.h"
+#include "functions_config.h"
+#include "functions_log.h"
 
 #include <Ethernet.h>
 #include <PubSubClient.h> // MQTT Client library
@@ -10,46 +13,71 @@ const int ETH_SS_PIN = 4;
 // Define toggle for connection state
 bool mqttBrokerConnected = false;
 
-// Configure ethernet and MQTT pieces
-byte eth_mac[] = {0xA8, 0x61, 0x0A, 0xAE, 0xAB, 0x8D}; // Define the ethernet shielf MAC
-byte eth_ip[] = {192, 168, 11, 3};                     // Define the ethernet shield IP
-IPAddress mqtt_server(192, 168, 11, 2);                // Grafana server address on Raspberry Pi
-const int mqtt_port = 1883;                            // Grafana server port on Raspberry Pi
+// An unreachable broker blocks the loop for the TCP connect and then the CONNACK wait. The library defaults of 1 s and
+// 15 s would let one attempt trip the 4 s watchdog, so together these stay at about half of it
+const uint16_t mqttConnectionTimeoutMs = 1000;
+const uint16_t mqttSocketTimeoutSeconds = 1;
+
+// Configure ethernet and MQTT pieces, the MAC, IP and Grafana server on the Raspberry Pi come from the config
 EthernetClient eth_client;                             // Create ethernet client
 PubSubClient mqttClient(eth_client);                   // Create MQTT client on ethernet
 
-// Function for setting up the ethernet shield
-void initialiseEthernetShield() {
-  Serial.println("INFO - Initialising ethernet shield");
+// Function for setting up the ethernet shield, returns false if the W5500 did not answer so it can be retried
+bool initialiseEthernetShield() {
   Ethernet.init(ETH_SS_PIN);
-  Ethernet.begin(eth_mac, eth_ip);
+  IPAddress eth_ip(config.ethernetIp[0], config.ethernetIp[1], config.ethernetIp[2], config.ethernetIp[3]);
+  Ethernet.begin(config.ethernetMac, eth_ip);
 
   char eth_status = Ethernet.hardwareStatus();
 
   if (eth_status == EthernetW5500) {
-    Serial.println("\tOK - W5500 Ethernet controller detected");
-  } else if (eth_status != EthernetW5500) {
-    Serial.print("\tFATAL - Ethernet status is ");
-    Serial.println(eth_status);
+    LOG_INFO(LOG_MODULE_GENERAL, "W5500 Ethernet controller detected");
+    return true;
   }
+
+  LOG_ERROR(LOG_MODULE_GENERAL, "Ethernet status is %d", (int)eth_status);
+  return false;
 }
 
+// Liveness check for the supervisor, the PHY link register is read from the W5500 so a wedged chip also reads as down
+bool isEthernetLinkUp() { return Ethernet.linkStatus() == LinkON; }
+
 // Function for creating the MQTT client and connecting to server
+// Incoming messages are only ever commands, they are parsed straight out of the client's receive buffer
+void mqttMessageReceived(char *topic, uint8_t *payload, unsigned int length) {
+  if (strcmp(topic, commandTopic) == 0) {
+    handleConfigCommand((char *)payload, length);
+  }
+}
+
 void connectMqttClientToBroker() {
   if (!mqttClient.connected()) {
-    Serial.println("INFO - Connecting to MQTT broker");
-    mqttClient.setServer(mqtt_server, mqtt_port);
+    IPAddress mqtt_server(config.mqttServerIp[0], config.mqttServerIp[1], config.mqttServerIp[2], config.mqttServerIp[3]);
+    mqttClient.setServer(mqtt_server, config.mqttPort);
     mqttClient.setKeepAlive(5);
+    mqttClient.setSocketTimeout(mqttSocketTimeoutSeconds);
+    eth_client.setConnectionTimeout(mqttConnectionTimeoutMs);
+    mqttClient.setCallback(mqttMessageReceived);
     if (mqttClient.connect("arduino-client")) {
-      Serial.println("\tOK - MQTT Client connected");
+      LOG_INFO(LOG_MODULE_GENERAL, "MQTT client connected");
       mqttBrokerConnected = true;
+      mqttClient.subscribe(commandTopic);
     } else {
-      Serial.println("\tFATAL - MQTT Client not connected");
+      LOG_ERROR(LOG_MODULE_GENERAL, "MQTT client not connected");
       mqttBrokerConnected = false;
     }
   }
 }
 
+// Process incoming messages and keep the connection alive, must be called every loop
+void serviceMqttClient() {
+  if (mqttBrokerConnected) {
+    mqttBrokerConnected = mqttClient.loop();
+  }
+}
+
+bool isMqttBrokerConnected() { return mqttBrokerConnected; }
+
 // Publish metric via MQTT
 void publishMqttMetric(String topic, String metricName, int metricValue) {
   if (mqttBrokerConnected) {
@@ -63,4 +91,47 @@ void publishMqttMetric(String topic, String metricName, String metricValue) {
     String payload = "{\"" + metricName + "\":" + String(metricValue) + "}";
     mqttClient.publish(topic.c_str(), payload.c_str());
   }
-}
\ No newline at end of file
+}
+
+// Publish a reply from a fixed buffer without building a String
+void publishMqttReply(const char *topic, const char *payload) {
+  if (mqttBrokerConnected) {
+    mqttClient.publish(topic, payload);
+  }
+}
+
+// Publish a text metric as {"name":"text"} from a fixed buffer, for the lists published straight from the loop
+void publishMqttText(const char *topic, const char *metricName, const char *text) {
+  if (mqttBrokerConnected) {
+    char payload[160];
+    snprintf(payload, sizeof(payload), "{\"%s\":\"%s\"}", metricName, text);
+    mqttClient.publish(topic, payload);
+  }
+}
+
+// Publish an already formatted payload via MQTT
+void publishMqttPayload(String topic, String payload) {
+  if (mqttBrokerConnected) {
+    mqttClient.publish(topic.c_str(), payload.c_str());
+  }
+}
+
+void publishMqttPayload(const char *topic, const char *payload) {
+  if (mqttBrokerConnected) {
+    mqttClient.publish(topic, payload);
+  }
+}
+
+// Format a value with a fixed number of decimals without printf %f, which is not in the default newlib nano build
+int formatMqttValue(char *output, size_t size, float value, byte decimals) {
+  long scale = 1;
+  for (int i = 0; i < decimals; i++) {
+    scale *= 10;
+  }
+  long scaled = value < 0 ? (long)(value * scale - 0.5) : (long)(value * scale + 0.5);
+  if (decimals == 0) {
+    return snprintf(output, size, "%ld", scaled);
+  }
+  return snprintf(output, size, "%s%ld.%0*ld", scaled < 0 ? "-" : "", labs(scaled) / scale, (int)decimals,
+                  labs(scaled) % scale);
+}
@@ -9,8 +9,16 @@
  *
  ****************************************************/
 void connectMqttClientToBroker();
-void initialiseEthernetShield();
+bool initialiseEthernetShield();
+bool isEthernetLinkUp();
+bool isMqttBrokerConnected();
+void serviceMqttClient();
 void publishMqttMetric(String, String, int);
 void publishMqttMetric(String, String, String);
+void publishMqttText(const char *, const char *, const char *);
+void publishMqttPayload(String, String);
+void publishMqttPayload(const char *, const char *);
+void publishMqttReply(const char *, const char *);
+int formatMqttValue(char *, size_t, float, byte);
 
 #endif
@@ -1,4 +1,5 @@
 #include "functions_performance.h"
+#include "functions_log.h"
 #include <Arduino.h>
 
 /*****************************************************
@@ -113,7 +114,7 @@ void captureAccellerationDetailedData(unsigned long speedTimestamp, float speedV
   if (speedValue >= dynoStartSpeed && previousDynoSpeed < dynoStartSpeed && dynoRunActive == false) {
     dynoRunActive = true;
     dynoStartTimestamp = speedTimestamp;
-    Serial.println("Starting dyno run data logging ...");
+    serialConsole.println("Starting dyno run data logging ...");
   }
 
   // Log dyno data if we are in an active run and conditions are met, tap out if too many samples recorded
@@ -126,7 +127,7 @@ void captureAccellerationDetailedData(unsigned long speedTimestamp, float speedV
     arrayLocation++;
     // Stop recording if we reach max samples
     if (arrayLocation == (maxArraySamples - 1)) {
-      Serial.print("Stopping dyno run due to max samples reached.");
+      serialConsole.print("Stopping dyno run due to max samples reached.");
       memset(performanceDataArray, 0, sizeof(performanceDataArray));
       arrayLocation = 0;
       dynoRunActive = false;
@@ -136,29 +137,29 @@ void captureAccellerationDetailedData(unsigned long speedTimestamp, float speedV
   // Exit the dyno run if we detect a complete run
   if (dynoRunActive == true && speedValue >= dynoEndSpeed && previousDynoSpeed < dynoEndSpeed) {
     dynoRunActive = false;
-    Serial.print("Stopping dyno run data log and clearing array after ");
-    Serial.print(arrayLocation + 1);
-    Serial.println(" samples.");
+    serialConsole.print("Stopping dyno run data log and clearing array after ");
+    serialConsole.print(arrayLocation + 1);
+    serialConsole.println(" samples.");
     // Print the output for later diagnosis / graphing
     for (int i = 0; i < arrayLocation; i++) {
-      Serial.print(performanceDataArray[i].timestamp);
-      Serial.print(",");
-      Serial.println(performanceDataArray[i].speed);
+      serialConsole.print(performanceDataArray[i].timestamp);
+      serialConsole.print(",");
+      serialConsole.println(performanceDataArray[i].speed);
     }
     memset(performanceDataArray, 0, sizeof(performanceDataArray));
     arrayLocation = 0;
-    Serial.println("");
+    serialConsole.println("");
   }
 
   // Exit the dyno run if we time out
   if (dynoRunActive == true && dynoMillisElapsed > dynoMillisCutofftime) {
     dynoRunActive = false;
-    Serial.println("Stopping dyno run due to timeout");
-    Serial.print("dynoMilliselapsed: ");
-    Serial.print(dynoMillisElapsed);
-    Serial.print(" > ");
-    Serial.println(dynoMillisCutofftime);
-    Serial.println("");
+    serialConsole.println("Stopping dyno run due to timeout");
+    serialConsole.print("dynoMilliselapsed: ");
+    serialConsole.print(dynoMillisElapsed);
+    serialConsole.print(" > ");
+    serialConsole.println(dynoMillisCutofftime);
+    serialConsole.println("");
     memset(performanceDataArray, 0, sizeof(performanceDataArray));
     arrayLocation = 0;
   }
@@ -1,57 +1,53 @@
 #include "functions_poll_ecm.h"
-#include <mcp2515_can.h> // Used for Seeed shields
+#include "functions_log.h"
 
 /*****************************************************
  *
  * Function - Get the ECM in a state where we can query parameters on it
  *
  ****************************************************/
-void initialiseEcmForQueries(mcp2515_can CAN_NISSAN) {
-  Serial.println("Sending request for diagnostic mode so we can query ECU ...");
-  CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x02, 0x10, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00});
-  delay(50);
-  CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x02, 0x10, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00});
-  delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x02, 0x21, 0x83, 0x00, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x11, 0x40, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x11, 0x60, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x12, 0x00, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x12, 0x20, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x12, 0x40, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x11, 0x80, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x13, 0x01, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x13, 0x02, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x13, 0x03, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x13, 0x04, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x13, 0x05, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x13, 0x08, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x13, 0x09, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x13, 0x0A, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x13, 0x0B, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x13, 0x0D, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x03, 0x22, 0x13, 0x07, 0x00, 0x00, 0x00, 0x00});
-  // delay(50);
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, new uint8_t[8]{0x02, 0x31, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00});
-  delay(1000);
+// Run from the loop until it returns true, the gaps the ECM needs between requests are waited out across loops rather
+// than with delay() so the cluster and gateway keep running
+unsigned char canPayloadStartDiagnosticSession[8] = {0x02, 0x10, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00};
+unsigned char canPayloadStartExtendedSession[8] = {0x02, 0x10, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+enum ecmQueryInitialisationStep {
+  ECM_INIT_SEND_DIAGNOSTIC_SESSION,
+  ECM_INIT_SEND_EXTENDED_SESSION,
+  ECM_INIT_SETTLE,
+  ECM_INIT_DONE
+};
+
+ecmQueryInitialisationStep ecmInitStep = ECM_INIT_SEND_DIAGNOSTIC_SESSION;
+unsigned long ecmInitStepMillis = 0;
+
+bool serviceEcmQueryInitialisation(canTxQueue *queue) {
+  unsigned long elapsed = millis() - ecmInitStepMillis;
+
+  switch (ecmInitStep) {
+  case ECM_INIT_SEND_DIAGNOSTIC_SESSION:
+    LOG_INFO(LOG_MODULE_ECM_QUERY, "Sending request for diagnostic mode so we can query ECU ...");
+    canTxQueueSubmit(queue, 0x7DF, 8, canPayloadStartDiagnosticSession, CAN_TX_PRIORITY_MEDIUM);
+    ecmInitStep = ECM_INIT_SEND_EXTENDED_SESSION;
+    ecmInitStepMillis = millis();
+    break;
+  case ECM_INIT_SEND_EXTENDED_SESSION:
+    if (elapsed >= 50) {
+      canTxQueueSubmit(queue, 0x7DF, 8, canPayloadStartExtendedSession, CAN_TX_PRIORITY_MEDIUM);
+      ecmInitStep = ECM_INIT_SETTLE;
+      ecmInitStepMillis = millis();
+    }
+    break;
+  case ECM_INIT_SETTLE:
+    if (elapsed >= 1050) {
+      ecmInitStep = ECM_INIT_DONE;
+    }
+    break;
+  case ECM_INIT_DONE:
+    break;
+  }
+
+  return ecmInitStep == ECM_INIT_DONE;
 }
 
 /*****************************************************
@@ -60,61 +56,61 @@ void initialiseEcmForQueries(mcp2515_can CAN_NISSAN) {
  *
  ****************************************************/
 // Oil temp
-void requestEcmDataOilTemp(mcp2515_can CAN_NISSAN) {
+void requestEcmDataOilTemp(canTxQueue *queue) {
   unsigned char canPayload[8] = {0x03, 0x22, 0x11, 0x1F, 0x00, 0x00, 0x00, 0x00};
-  CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, canPayload);
+  canTxQueueSubmit(queue, 0x7DF, 8, canPayload, CAN_TX_PRIORITY_LOW);
 }
 
 // Battery voltage
-void requestEcmDataBatteryVoltage(mcp2515_can CAN_NISSAN) {
+void requestEcmDataBatteryVoltage(canTxQueue *queue) {
   unsigned char canPayload[8] = {0x03, 0x22, 0x11, 0x03, 0x00, 0x00, 0x00, 0x00};
-  CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, canPayload);
+  canTxQueueSubmit(queue, 0x7DF, 8, canPayload, CAN_TX_PRIORITY_LOW);
 }
 
 // Pedal position
-void requestEcmDataGasPedalPercentage(mcp2515_can CAN_NISSAN) {
+void requestEcmDataGasPedalPercentage(canTxQueue *queue) {
   unsigned char canPayload[8] = {0x03, 0x22, 0x12, 0x0D, 0x00, 0x00, 0x00, 0x00};
-  CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, canPayload);
+  canTxQueueSubmit(queue, 0x7DF, 8, canPayload, CAN_TX_PRIORITY_LOW);
 }
 
 // AF Voltage bank 1
-void requestEcmDataAfRatioBank1(mcp2515_can CAN_NISSAN) {
+void requestEcmDataAfRatioBank1(canTxQueue *queue) {
   unsigned char canPayload[8] = {0x03, 0x22, 0x12, 0x25, 0x00, 0x00, 0x00, 0x00};
-  CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, canPayload);
+  canTxQueueSubmit(queue, 0x7DF, 8, canPayload, CAN_TX_PRIORITY_LOW);
 }
 
 // AF Voltage bank 2
-void requestEcmDataAfRatioBank2(mcp2515_can CAN_NISSAN) {
+void requestEcmDataAfRatioBank2(canTxQueue *queue) {
   unsigned char canPayload[8] = {0x03, 0x22, 0x12, 0x26, 0x00, 0x00, 0x00, 0x00};
-  CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, canPayload);
+  canTxQueueSubmit(queue, 0x7DF, 8, canPayload, CAN_TX_PRIORITY_LOW);
 }
 
 // Alpha percentage bank 1
-void requestEcmDataAlphaPercentageBank1(mcp2515_can CAN_NISSAN) {
+void requestEcmDataAlphaPercentageBank1(canTxQueue *queue) {
   unsigned char canPayload[8] = {0x03, 0x22, 0x11, 0x23, 0x00, 0x00, 0x00, 0x00};
-  CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, canPayload);
+  canTxQueueSubmit(queue, 0x7DF, 8, canPayload, CAN_TX_PRIORITY_LOW);
 }
 
 // Alpha percentage bank 2
-void requestEcmDataAlphaPercentageBank2(mcp2515_can CAN_NISSAN) {
+void requestEcmDataAlphaPercentageBank2(canTxQueue *queue) {
   unsigned char canPayload[8] = {0x03, 0x22, 0x11, 0x24, 0x00, 0x00, 0x00, 0x00};
-  CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, canPayload);
+  canTxQueueSubmit(queue, 0x7DF, 8, canPayload, CAN_TX_PRIORITY_LOW);
 }
 
 // Air intake temp
-void requestEcmDataAirIntakeTemp(mcp2515_can CAN_NISSAN) {
+void requestEcmDataAirIntakeTemp(canTxQueue *queue) {
   unsigned char canPayload[8] = {0x03, 0x22, 0x11, 0x06, 0x00, 0x00, 0x00, 0x00};
-  CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, canPayload);
+  canTxQueueSubmit(queue, 0x7DF, 8, canPayload, CAN_TX_PRIORITY_LOW);
 }
 
-/*****************************************************
- *
- * Functions - Request fault data from ECM
- *
- ****************************************************/
-void requestEcmDataFaults(mcp2515_can CAN_NISSAN) {
-  // unsigned char canPayloadInitialise[8] = {0x02, 0x10, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00};
-  // CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, canPayloadInitialise);
-  unsigned char canPayloadRequest[8] = {0x03, 0x17, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00};
-  CAN_NISSAN.sendMsgBuf(0x7DF, 0, 8, canPayloadRequest);
+// Injector pulse width bank 1, the identifier still needs confirming against a scan tool
+void requestEcmDataInjectorDurationBank1(canTxQueue *queue) {
+  unsigned char canPayload[8] = {0x03, 0x22, 0x12, 0x14, 0x00, 0x00, 0x00, 0x00};
+  canTxQueueSubmit(queue, 0x7DF, 8, canPayload, CAN_TX_PRIORITY_LOW);
+}
+
+// Injector pulse width bank 2, the identifier still needs confirming against a scan tool
+void requestEcmDataInjectorDurationBank2(canTxQueue *queue) {
+  unsigned char canPayload[8] = {0x03, 0x22, 0x12, 0x15, 0x00, 0x00, 0x00, 0x00};
+  canTxQueueSubmit(queue, 0x7DF, 8, canPayload, CAN_TX_PRIORITY_LOW);
 }
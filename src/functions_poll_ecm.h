@@ -2,22 +2,23 @@
 #define FUNCTIONS_POLL_ECM_H
 
 #include <Arduino.h>
-#include <mcp2515_can.h> // Used for Seeed shields
+#include "functions_can_tx_queue.h"
 
 /****************************************************
  *
  * Function Prototypes
  *
  ****************************************************/
-void initialiseEcmForQueries(mcp2515_can);
-void requestEcmDataOilTemp(mcp2515_can);
-void requestEcmDataBatteryVoltage(mcp2515_can);
-void requestEcmDataGasPedalPercentage(mcp2515_can);
-void requestEcmDataAfRatioBank1(mcp2515_can);
-void requestEcmDataAfRatioBank2(mcp2515_can);
-void requestEcmDataAlphaPercentageBank1(mcp2515_can);
-void requestEcmDataAlphaPercentageBank2(mcp2515_can);
-void requestEcmDataAirIntakeTemp(mcp2515_can);
-void requestEcmDataFaults(mcp2515_can);
+bool serviceEcmQueryInitialisation(canTxQueue *);
+void requestEcmDataOilTemp(canTxQueue *);
+void requestEcmDataBatteryVoltage(canTxQueue *);
+void requestEcmDataGasPedalPercentage(canTxQueue *);
+void requestEcmDataAfRatioBank1(canTxQueue *);
+void requestEcmDataAfRatioBank2(canTxQueue *);
+void requestEcmDataAlphaPercentageBank1(canTxQueue *);
+void requestEcmDataAlphaPercentageBank2(canTxQueue *);
+void requestEcmDataAirIntakeTemp(canTxQueue *);
+void requestEcmDataInjectorDurationBank1(canTxQueue *);
+void requestEcmDataInjectorDurationBank2(canTxQueue *);
 
 #endif
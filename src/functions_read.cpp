@@ -1,4 +1,12 @@
 #include "functions_read.h"
+#include "bmwCanFrameViews.h"
+#include "functions_can_health.h"
+#include "functions_can_sniff.h"
+#include "functions_can_stream.h"
+#include "functions_config.h"
+#include "functions_ecm_faults.h"
+#include "functions_log.h"
+#include "functions_signals.h"
 #include <Adafruit_MCP9808.h> // Used for temperature sensor
 #include <map>                // Used for defining the AFR lookup table
 #include <mcp2515_can.h>      // Used for Seeed shields
@@ -48,118 +56,104 @@ float gasPedalMinVoltage = 0.65;
 float gasPedalMaxVoltage = 4.85;
 float gasPedalVoltageRange = gasPedalMaxVoltage - gasPedalMinVoltage;
 
-// Define engine check light watchdog
-unsigned long lastNoEcmFaultsTimestamp;
-int secondsToSetCheckLight = 30;
+// Define the IDs decoded below, 0x551 is where coolant temperature is located and 0x7E8 is for results of queried
+// CAN parameters
+const unsigned long nissanCanConsumedIds[] = {0x551, 0x7E8};
+const int nissanCanConsumedIdCount = sizeof(nissanCanConsumedIds) / sizeof(nissanCanConsumedIds[0]);
 
-// Define our custom struct for holding the values
-nissanCanValues latestNissanCanValues;
-int checkEngineLightState;
-
-nissanCanValues readNissanDataFromCan(mcp2515_can can) {
+void readNissanDataFromCan(mcp2515_can can, canTxQueue *txQueue) {
   unsigned char len = 0;
   unsigned char buf[8];
 
-  // Hard set of MIL after boot
-  if (millis() < 8000) {
-    latestNissanCanValues.checkEngineLightState = 2;
-  } else {
-    latestNissanCanValues.checkEngineLightState = 0;
+  // MIL state is driven from the ECM fault list (and hard set for a short time after boot). It is only written when it
+  // changes or a fault poll completes, so its sequence and timestamp say when the ECM last confirmed it
+  int checkEngineLightState = getEcmCheckEngineLightState();
+  if (hasEcmFaultPollCompleted() || checkEngineLightState != readSignal(SIGNAL_CHECK_ENGINE_LIGHT)) {
+    writeSignal(SIGNAL_CHECK_ENGINE_LIGHT, checkEngineLightState);
   }
 
   if (CAN_MSGAVAIL == can.checkReceive()) {
     can.readMsgBuf(&len, buf);
     unsigned long canId = can.getCanId();
+    canHealthRecordRxFrame(CAN_BUS_NISSAN, canId, len);
+    canSniffRecordFrame(CAN_BUS_NISSAN, canId, len, buf);
+    canStreamRecordFrame(CAN_BUS_NISSAN, canId, len, buf);
 
     // Get the current coolant temperature which is simply broadcast on the bus
     if (canId == 0x551) {
-      latestNissanCanValues.engineTempCelsius = buf[0] - 40;
+      writeSignal(SIGNAL_ENGINE_TEMP, buf[0] - 40);
     }
 
     // Read any responses that are from queries sent to the ECM
     else if (canId == 0x7E8) {
 
-      // Some skanky debug for printing the received data to console
-      if (1 == 1) {
-        Serial.print("0x");
-        Serial.print(canId, HEX);
-        Serial.print("\t");
-        for (int i = 0; i < len; i++) {
-          if (buf[i] < 0x10) {
-            Serial.print("0");
-          }
-          Serial.print(buf[i], HEX);
-          Serial.print("\t");
-        }
-        Serial.println();
-      }
+      // Trace every response, the payload is packed into two words so the record stays small
+      LOG_TRACE(LOG_MODULE_ECM_QUERY, "0x%03lX %08lX %08lX", canId,
+                ((unsigned long)buf[0] << 24) | ((unsigned long)buf[1] << 16) | (buf[2] << 8) | buf[3],
+                ((unsigned long)buf[4] << 24) | ((unsigned long)buf[5] << 16) | (buf[6] << 8) | buf[7]);
 
-      // Fault codes and MIL light (no faults detected)
-      if (buf[0] == 0x02 && buf[1] == 0x57 && buf[2] == 0x00 && millis() > 10000) {
-        lastNoEcmFaultsTimestamp = millis();
-        latestNissanCanValues.checkEngineLightState = 0;
-      }
-      // Fault codes and MIL light (timer expired, set the light)
-      if (lastNoEcmFaultsTimestamp < (millis() - secondsToSetCheckLight * 1000) && millis() > 10000) {
-        latestNissanCanValues.checkEngineLightState = 0; // DON'T EVER SET CHECK LIGHT AS THIS LOGIC IS MESSED UP ACTUALLY AND THE ABOVE 'GOOD' CONDITION IS NEVER TRIGGERED
-        // Serial.print("Setting check light as lastNoEcmFaultsTimestamp is ");
-        // Serial.print(lastNoEcmFaultsTimestamp);
-        // Serial.print(" and millis is ");
-        // Serial.println(millis());
+      // Fault code responses, including multi frame ones, are handled by the fault module
+      if (processEcmFaultFrame(txQueue, buf, len)) {
+        // Nothing more to do, the frame has been consumed
       }
       // Oil temperature
       else if (buf[0] == 0x04 && buf[1] == 0x62 && buf[2] == 0x11 && buf[3] == 0x1F) {
-        latestNissanCanValues.oilTempCelcius = buf[4] - 50;
+        writeSignal(SIGNAL_OIL_TEMP_ECM, buf[4] - 50);
       }
       // Battery voltage (at the ECM ?? Does not line up with actual battery)
       else if (buf[0] == 0x04 && buf[1] == 0x62 && buf[2] == 0x11 && buf[3] == 0x03) {
         int raw_value = (buf[3] << 8) | buf[4];
         float batteryVoltage = raw_value / 65.0; // This needs another look !!
-        latestNissanCanValues.batteryVoltage = batteryVoltage;
+        writeSignal(SIGNAL_BATTERY_VOLTAGE, batteryVoltage);
       }
       // Gas pedal position
       else if (buf[0] == 0x05 && buf[1] == 0x62 && buf[2] == 0x12 && buf[3] == 0x0D) {
         int raw_value = (buf[4] << 8) | buf[5];
         float voltage = raw_value / 200.0;
         int gasPedalPercentage = ((voltage - gasPedalMinVoltage) / gasPedalVoltageRange) * 100;
-        latestNissanCanValues.gasPedalPercentage = gasPedalPercentage;
+        writeSignal(SIGNAL_GAS_PEDAL_POSITION, gasPedalPercentage);
       }
       // Air fuel ratio bank 1
       else if (buf[0] == 0x05 && buf[1] == 0x62 && buf[2] == 0x12 && buf[3] == 0x25) {
         int raw_value = (buf[4] << 8) | buf[5];
         float airFuelRatioBank1Voltage = raw_value / 200.0;
-        Serial.print("Calculating AFR voltage bank 1 as ");
-        Serial.println(airFuelRatioBank1Voltage);
-        latestNissanCanValues.airFuelRatioBank1 = calculateAfRatioFromVoltage(airFuelRatioBank1Voltage);
+        LOG_DEBUG(LOG_MODULE_AFR, "Calculating AFR voltage bank 1 as %ld mV", (long)(airFuelRatioBank1Voltage * 1000));
+        writeSignal(SIGNAL_AF_RATIO_BANK1, calculateAfRatioFromVoltage(airFuelRatioBank1Voltage));
       }
       // Air fuel ratio bank 2
       else if (buf[0] == 0x05 && buf[1] == 0x62 && buf[2] == 0x12 && buf[3] == 0x26) {
         int raw_value = (buf[4] << 8) | buf[5];
         float airFuelRatioBank2Voltage = raw_value / 200.0;
-        Serial.print("Calculating AFR voltage bank 2 as ");
-        Serial.println(airFuelRatioBank2Voltage);
-        latestNissanCanValues.airFuelRatioBank2 = calculateAfRatioFromVoltage(airFuelRatioBank2Voltage);
+        LOG_DEBUG(LOG_MODULE_AFR, "Calculating AFR voltage bank 2 as %ld mV", (long)(airFuelRatioBank2Voltage * 1000));
+        writeSignal(SIGNAL_AF_RATIO_BANK2, calculateAfRatioFromVoltage(airFuelRatioBank2Voltage));
       }
       // Alpha percentage bank 1
       else if (buf[0] == 0x04 && buf[1] == 0x62 && buf[2] == 0x11 && buf[3] == 0x23) {
         int alphaPercentageBank1 = buf[4];
-        latestNissanCanValues.alphaPercentageBank1 = alphaPercentageBank1;
+        writeSignal(SIGNAL_ALPHA_PERCENTAGE_BANK1, alphaPercentageBank1);
       }
       // Alpha percentage bank 1
       else if (buf[0] == 0x04 && buf[1] == 0x62 && buf[2] == 0x11 && buf[3] == 0x24) {
         int alphaPercentageBank2 = buf[4];
-        latestNissanCanValues.alphaPercentageBank2 = alphaPercentageBank2;
+        writeSignal(SIGNAL_ALPHA_PERCENTAGE_BANK2, alphaPercentageBank2);
       }
       // Air intake temperature
       else if (buf[0] == 0x04 && buf[1] == 0x62 && buf[2] == 0x11 && buf[3] == 0x06) {
         int airIntakeTemp = buf[4] - 50;
-        latestNissanCanValues.airIntakeTemp = airIntakeTemp;
+        writeSignal(SIGNAL_AIR_INTAKE_TEMP, airIntakeTemp);
+      }
+      // Injector pulse width bank 1 in 0.01ms steps
+      else if (buf[0] == 0x05 && buf[1] == 0x62 && buf[2] == 0x12 && buf[3] == 0x14) {
+        int raw_value = (buf[4] << 8) | buf[5];
+        writeSignal(SIGNAL_INJECTOR_DURATION_BANK1, raw_value / 100.0);
+      }
+      // Injector pulse width bank 2 in 0.01ms steps
+      else if (buf[0] == 0x05 && buf[1] == 0x62 && buf[2] == 0x12 && buf[3] == 0x15) {
+        int raw_value = (buf[4] << 8) | buf[5];
+        writeSignal(SIGNAL_INJECTOR_DURATION_BANK2, raw_value / 100.0);
       }
     }
   }
-
-  // Return the values
-  return latestNissanCanValues;
 }
 
 /*****************************************************
@@ -167,17 +161,15 @@ nissanCanValues readNissanDataFromCan(mcp2515_can can) {
  * Function - Read latest values from BMW CAN
  *
  ****************************************************/
-bmwCanValues bmwCanData; // Holds the data to return to caller of function
+// Define the IDs decoded below, 0x1F0 is where the individual wheel speeds are, 0x153 is DSC status and torque
+// intervention, 0x1F3 lateral acceleration, 0x1F5 steering angle and 0x1F8 brake pressure
+// https://www.bimmerforums.com/forum/showthread.php?1887229-E46-Can-bus-project
+const unsigned long bmwCanConsumedIds[] = {0x1F0, 0x153, 0x1F3, 0x1F5, 0x1F8};
+const int bmwCanConsumedIdCount = sizeof(bmwCanConsumedIds) / sizeof(bmwCanConsumedIds[0]);
 
-float vehicleSpeedFront;
-float vehicleSpeedRear;
-float wheelSpeedFl = 0;
-float wheelSpeedFr = 0;
-float wheelSpeedRl = 0;
-float wheelSpeedRr = 0;
-float speedScaleFactor = 1.06;
+unsigned long wheelSpeedFrameMicros = 0; // When the latest wheel speeds were read off the shield, for latency
 
-bmwCanValues readBmwDataFromCan(mcp2515_can can) {
+void readBmwDataFromCan(mcp2515_can can) {
   unsigned char len = 0;
   unsigned char buf[8];
 
@@ -185,25 +177,68 @@ bmwCanValues readBmwDataFromCan(mcp2515_can can) {
     can.readMsgBuf(&len, buf);
 
     unsigned long canId = can.getCanId();
+    canHealthRecordRxFrame(CAN_BUS_BMW, canId, len);
+    canSniffRecordFrame(CAN_BUS_BMW, canId, len, buf);
+    canStreamRecordFrame(CAN_BUS_BMW, canId, len, buf);
 
     // Get the current vehicle wheel speeds
     if (canId == 0x1F0) {
-      wheelSpeedFl = ((buf[0] + (buf[1] & 15) * 256) / 16.0) * speedScaleFactor;
-      wheelSpeedFr = ((buf[2] + (buf[3] & 15) * 256) / 16.0) * speedScaleFactor;
-      wheelSpeedRl = ((buf[4] + (buf[5] & 15) * 256) / 16.0) * speedScaleFactor;
-      wheelSpeedRr = ((buf[6] + (buf[7] & 15) * 256) / 16.0) * speedScaleFactor;
+      wheelSpeedFrameMicros = micros();
+      unsigned long timestamp = millis();
+
+      uint16_t wheelSpeedRawFl = buf[0] + (buf[1] & 15) * 256;
+      uint16_t wheelSpeedRawFr = buf[2] + (buf[3] & 15) * 256;
+      uint16_t wheelSpeedRawRl = buf[4] + (buf[5] & 15) * 256;
+      uint16_t wheelSpeedRawRr = buf[6] + (buf[7] & 15) * 256;
+
+      float wheelSpeedFl = (wheelSpeedRawFl / 16.0) * config.speedScaleFactor;
+      float wheelSpeedFr = (wheelSpeedRawFr / 16.0) * config.speedScaleFactor;
+      float wheelSpeedRl = (wheelSpeedRawRl / 16.0) * config.speedScaleFactor;
+      float wheelSpeedRr = (wheelSpeedRawRr / 16.0) * config.speedScaleFactor;
+
+      float lowerRearSpeed = (wheelSpeedRl < wheelSpeedRr) ? wheelSpeedRl : wheelSpeedRr;
+      float higherRearSpeed = (wheelSpeedRl > wheelSpeedRr) ? wheelSpeedRl : wheelSpeedRr;
+
+      float rearSpeedVariation = higherRearSpeed - lowerRearSpeed;
+
+      // Calculate the required values, the variation is meaningless (and divides by zero) when stationary
+      writeSignal(SIGNAL_VEHICLE_SPEED_FRONT, (wheelSpeedFl + wheelSpeedFr) / 2, timestamp);
+      writeSignal(SIGNAL_VEHICLE_SPEED_REAR, (wheelSpeedRl + wheelSpeedRr) / 2, timestamp);
+      writeSignal(SIGNAL_VEHICLE_SPEED_REAR_VARIATION,
+                  (lowerRearSpeed > 0) ? (rearSpeedVariation / lowerRearSpeed) * 100 : 0, timestamp);
+
+      // The front left raw speed is written last so once it changes the whole frame is in the store
+      writeSignal(SIGNAL_WHEEL_SPEED_RAW_FR, wheelSpeedRawFr, timestamp);
+      writeSignal(SIGNAL_WHEEL_SPEED_RAW_RL, wheelSpeedRawRl, timestamp);
+      writeSignal(SIGNAL_WHEEL_SPEED_RAW_RR, wheelSpeedRawRr, timestamp);
+      writeSignal(SIGNAL_WHEEL_SPEED_RAW_FL, wheelSpeedRawFl, timestamp);
+    }
+    // DSC status and torque intervention
+    else if (canId == 0x153) {
+      bmwAsc1FrameView asc1 = {buf};
+      writeSignal(SIGNAL_DSC_REQUEST_ACTIVE, asc1.ascRequestActive());
+      writeSignal(SIGNAL_BRAKE_LIGHT_SWITCH, asc1.brakeLightSwitch());
+      writeSignal(SIGNAL_DSC_TORQUE_INTERVENTION, asc1.torqueInterventionPercent());
+      writeSignal(SIGNAL_DSC_SLOW_TORQUE_INTERVENTION, asc1.slowTorqueInterventionPercent());
+      writeSignal(SIGNAL_MSR_TORQUE_INTERVENTION, asc1.msrTorqueInterventionPercent());
+    }
+    // Lateral acceleration
+    else if (canId == 0x1F3) {
+      bmwAsc3FrameView asc3 = {buf};
+      writeSignal(SIGNAL_LATERAL_ACCELERATION, asc3.lateralAccelerationMs2());
+    }
+    // Steering angle
+    else if (canId == 0x1F5) {
+      bmwSteeringAngleFrameView steeringAngle = {buf};
+      writeSignal(SIGNAL_STEERING_ANGLE, steeringAngle.steeringAngleDegrees());
+      writeSignal(SIGNAL_STEERING_RATE, steeringAngle.steeringRateDegreesPerSecond());
+    }
+    // Brake pressure
+    else if (canId == 0x1F8) {
+      bmwBrakePressureFrameView brakePressure = {buf};
+      writeSignal(SIGNAL_BRAKE_PRESSURE, brakePressure.brakePressureBar());
     }
-
-    float lowerRearSpeed = (wheelSpeedRl < wheelSpeedRr) ? wheelSpeedRl : wheelSpeedRr;
-    float higherRearSpeed = (wheelSpeedRl > wheelSpeedRr) ? wheelSpeedRl : wheelSpeedRr;
-
-    float rearSpeedVariation = higherRearSpeed - lowerRearSpeed;
-
-    // Calculate the required values
-    bmwCanData.vehicleSpeedFront = ((wheelSpeedFl + wheelSpeedFr) / 2);
-    bmwCanData.vehicleSpeedRear = ((wheelSpeedRl + wheelSpeedRr) / 2);
-    bmwCanData.vehicleSpeedRearVariation = (rearSpeedVariation / lowerRearSpeed) * 100;
-    bmwCanData.timestamp = millis();
   }
-  return bmwCanData;
-}
\ No newline at end of file
+}
+
+unsigned long getWheelSpeedFrameMicros() { return wheelSpeedFrameMicros; }
\ No newline at end of file
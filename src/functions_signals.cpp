@@ -0,0 +1,144 @@
+#include "functions_signals.h"
+
+/*****************************************************
+ *
+ * Variables - The signal store
+ *
+ ****************************************************/
+// One contiguous array indexed by signal so a decoder writes in place and a reader touches a single entry
+signalSample signalStore[SIGNAL_COUNT];
+
+// Min, max and running sum of each signal a windowed telemetry policy consumes, fed by every write so the aggregate
+// covers the full input rate. Other signals skip the window, see setSignalWindowed
+signalWindow signalWindows[SIGNAL_COUNT];
+bool signalWindowed[SIGNAL_COUNT];
+
+// A window nobody takes is folded down at this count. The UDP datagram carries the count in 16 bits, and by then a
+// float sum has stopped adding small values exactly.
+const unsigned long signalWindowMaxCount = 0xFFFF;
+
+// Incremented for every write so readers can bookmark the store and ask what has been written since
+unsigned long signalStoreSequence = 0;
+
+// Seqlock version, odd while a write is in progress. Writes come from one context at a time (the loop, or an ISR
+// for a signal the loop does not write) so a snapshot taken in the loop retries if an interrupt wrote part way through.
+// Both counters are bumped with atomic adds, which are lock free on the Cortex-M4, so an ISR write can not lose the
+// loop's increment or the other way round.
+volatile unsigned long signalStoreVersion = 0;
+
+/*****************************************************
+ *
+ * Functions - Write and read single signals
+ *
+ ****************************************************/
+void writeSignal(signalId signal, float value, unsigned long timestamp) {
+  __atomic_add_fetch(&signalStoreVersion, 1, __ATOMIC_RELAXED);
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+  signalSample *sample = &signalStore[signal];
+  sample->value = value;
+  sample->timestamp = timestamp;
+  sample->sequence = __atomic_add_fetch(&signalStoreSequence, 1, __ATOMIC_RELAXED);
+
+  if (signalWindowed[signal]) {
+    signalWindow *window = &signalWindows[signal];
+
+    // Fold a full window into one sample of its mean, min and max still cover every write since the last take
+    if (window->count >= signalWindowMaxCount) {
+      window->sum /= window->count;
+      window->count = 1;
+    }
+    if (window->count == 0 || value < window->min) {
+      window->min = value;
+    }
+    if (window->count == 0 || value > window->max) {
+      window->max = value;
+    }
+    window->sum += value;
+    window->count++;
+  }
+
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&signalStoreVersion, 1, __ATOMIC_RELAXED);
+}
+
+void writeSignal(signalId signal, float value) { writeSignal(signal, value, millis()); }
+
+// A single aligned 32 bit load can not tear, only multi field reads need a snapshot
+float readSignal(signalId signal) { return signalStore[signal].value; }
+
+unsigned long getSignalTimestamp(signalId signal) { return signalStore[signal].timestamp; }
+
+unsigned long getSignalSequence(signalId signal) { return signalStore[signal].sequence; }
+
+unsigned long getSignalStoreSequence() { return signalStoreSequence; }
+
+/*****************************************************
+ *
+ * Function - Has a signal been written since a bookmark taken from getSignalStoreSequence or getSignalSequence
+ *
+ ****************************************************/
+// Written rather than different, so per frame consumers still run when a value repeats
+bool hasSignalChangedSince(signalId signal, unsigned long sequence) {
+  return (long)(signalStore[signal].sequence - sequence) > 0;
+}
+
+/*****************************************************
+ *
+ * Function - Copy a set of signals which are consistent with each other
+ *
+ ****************************************************/
+// Retries if an interrupt wrote to the store while copying, so it must not itself be called from an ISR
+void snapshotSignals(const signalId *signals, int signalCount, signalSample *samples) {
+  unsigned long version;
+  do {
+    version = signalStoreVersion;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    for (int i = 0; i < signalCount; i++) {
+      samples[i] = signalStore[signals[i]];
+    }
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  } while ((version & 1) || version != signalStoreVersion);
+}
+
+// Every value in signal order, for transports that send the whole store
+void snapshotSignalValues(float *values) {
+  unsigned long version;
+  do {
+    version = signalStoreVersion;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    for (int i = 0; i < SIGNAL_COUNT; i++) {
+      values[i] = signalStore[i].value;
+    }
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  } while ((version & 1) || version != signalStoreVersion);
+}
+
+/*****************************************************
+ *
+ * Function - Copy a signal's window and start a new one
+ *
+ ****************************************************/
+// Copying and restarting have to happen together or an interrupt write in between would be lost, so unlike a
+// snapshot this briefly holds off interrupts. An empty window means nothing was written since the last take
+void takeSignalWindow(signalId signal, signalWindow *window) {
+  noInterrupts();
+  *window = signalWindows[signal];
+  signalWindows[signal] = signalWindow();
+  interrupts();
+}
+
+/*****************************************************
+ *
+ * Function - Choose which signals keep a window
+ *
+ ****************************************************/
+// Turning a window off drops what it held, turning it on starts it empty
+void setSignalWindowed(signalId signal, bool windowed) {
+  noInterrupts();
+  signalWindowed[signal] = windowed;
+  signalWindows[signal] = signalWindow();
+  interrupts();
+}
+
+bool isSignalWindowed(signalId signal) { return signalWindowed[signal]; }
@@ -0,0 +1,92 @@
+#ifndef FUNCTIONS_SIGNALS_H
+#define FUNCTIONS_SIGNALS_H
+
+#include <Arduino.h>
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+// Every value the decoders, sensors and calculations produce, read by everything else straight from the store. The UDP
+// telemetry datagram carries them in this order, so append new signals and bump udpTelemetryLayoutVersion if not
+enum signalId {
+  // Streamed by the ECM and returned from queries sent to it
+  SIGNAL_ENGINE_TEMP,
+  SIGNAL_OIL_TEMP_ECM,
+  SIGNAL_BATTERY_VOLTAGE,
+  SIGNAL_AIR_INTAKE_TEMP,
+  SIGNAL_GAS_PEDAL_POSITION,
+  SIGNAL_AF_RATIO_BANK1,
+  SIGNAL_AF_RATIO_BANK2,
+  SIGNAL_ALPHA_PERCENTAGE_BANK1,
+  SIGNAL_ALPHA_PERCENTAGE_BANK2,
+  SIGNAL_INJECTOR_DURATION_BANK1, // ms
+  SIGNAL_INJECTOR_DURATION_BANK2, // ms
+  SIGNAL_CHECK_ENGINE_LIGHT,      // 2 check engine, 16 EML, 18 both, 0 neither
+  // BMW wheel speeds, written together once per 0x1F0 frame
+  SIGNAL_WHEEL_SPEED_RAW_FL, // 1/16 km/h, unscaled, for the fixed point traction maths
+  SIGNAL_WHEEL_SPEED_RAW_FR,
+  SIGNAL_WHEEL_SPEED_RAW_RL,
+  SIGNAL_WHEEL_SPEED_RAW_RR,
+  SIGNAL_VEHICLE_SPEED_FRONT,
+  SIGNAL_VEHICLE_SPEED_REAR,
+  SIGNAL_VEHICLE_SPEED_REAR_VARIATION,
+  // BMW DSC and steering angle broadcasts
+  SIGNAL_DSC_REQUEST_ACTIVE,
+  SIGNAL_BRAKE_LIGHT_SWITCH,
+  SIGNAL_DSC_TORQUE_INTERVENTION,
+  SIGNAL_DSC_SLOW_TORQUE_INTERVENTION,
+  SIGNAL_MSR_TORQUE_INTERVENTION,
+  SIGNAL_LATERAL_ACCELERATION,
+  SIGNAL_STEERING_ANGLE,
+  SIGNAL_STEERING_RATE,
+  SIGNAL_BRAKE_PRESSURE,
+  // Physical sensors and values calculated on the Arduino
+  SIGNAL_RPM,
+  SIGNAL_GEAR,
+  SIGNAL_CLUTCH_PRESSED,
+  SIGNAL_IN_NEUTRAL,
+  SIGNAL_OIL_PRESSURE,
+  SIGNAL_FUEL_PRESSURE,
+  SIGNAL_CRANK_CASE_VACUUM,
+  SIGNAL_RADIATOR_OUTLET_TEMP,
+  SIGNAL_OIL_TEMP_SENSOR,
+  SIGNAL_ENGINE_ELECTRONICS_TEMP,
+  SIGNAL_FAN_DUTY,
+  SIGNAL_COUNT
+};
+
+struct signalSample {
+  float value = 0;
+  unsigned long timestamp = 0; // millis() when last written
+  unsigned long sequence = 0;  // Store sequence when last written, zero if never written
+};
+
+// Every write to a signal since the window was last taken, so a short spike between two reads is not lost
+struct signalWindow {
+  float min = 0;
+  float max = 0;
+  float sum = 0;
+  unsigned long count = 0;
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void writeSignal(signalId, float);
+void writeSignal(signalId, float, unsigned long);
+float readSignal(signalId);
+unsigned long getSignalTimestamp(signalId);
+unsigned long getSignalSequence(signalId);
+unsigned long getSignalStoreSequence();
+bool hasSignalChangedSince(signalId, unsigned long);
+void snapshotSignals(const signalId *, int, signalSample *);
+void snapshotSignalValues(float *);
+void takeSignalWindow(signalId, signalWindow *);
+void setSignalWindowed(signalId, bool);
+bool isSignalWindowed(signalId);
+
+#endif
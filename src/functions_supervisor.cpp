@@ -0,0 +1,209 @@
+#include "functions_supervisor.h"
+#include "functions_config.h"
+#include "functions_log.h"
+#include <stddef.h>
+
+#if defined(ARDUINO_ARCH_RENESAS)
+#include <WDT.h>
+#endif
+
+/*****************************************************
+ *
+ * Variables - Reset cause and its persistent record
+ *
+ ****************************************************/
+const char *resetCauseNames[RESET_CAUSE_COUNT] = {"powerOn", "watchdog", "software", "lowVoltage", "pin", "unknown"};
+
+// Kept in the data flash after the configuration slots, written once per boot
+struct resetLogRecord {
+  uint16_t magic;
+  uint16_t reserved;
+  uint32_t bootCount;
+  uint32_t causeCounts[RESET_CAUSE_COUNT];
+  uint32_t crc;
+};
+
+const uint16_t resetLogMagic = 0x5E7C;
+
+resetCause currentResetCause = RESET_CAUSE_UNKNOWN;
+resetLogRecord resetLog;
+bool watchdogRunning = false;
+
+/*****************************************************
+ *
+ * Function - Read and clear the RA4M1 reset status flags
+ *
+ ****************************************************/
+#if defined(ARDUINO_ARCH_RENESAS)
+const uint8_t rstsr0PowerOn = 0x01;
+const uint8_t rstsr0LowVoltage = 0x0E; // LVD0RF, LVD1RF and LVD2RF
+const uint16_t rstsr1Watchdog = 0x03;  // IWDTRF and WDTRF
+const uint16_t rstsr1Software = 0x04;
+const uint8_t rstsr2WarmStart = 0x01;
+
+resetCause readResetCause() {
+  uint8_t rstsr0 = R_SYSTEM->RSTSR0;
+  uint16_t rstsr1 = R_SYSTEM->RSTSR1;
+  uint8_t rstsr2 = R_SYSTEM->RSTSR2;
+
+  // The flags latch until written to zero, the warm start flag is set so the next reset without flags reads as the pin
+  R_SYSTEM->RSTSR0 = 0;
+  R_SYSTEM->RSTSR1 = 0;
+  R_SYSTEM->RSTSR2 = rstsr2WarmStart;
+
+  if (rstsr1 & rstsr1Watchdog) {
+    return RESET_CAUSE_WATCHDOG;
+  } else if (rstsr1 & rstsr1Software) {
+    return RESET_CAUSE_SOFTWARE;
+  } else if (rstsr0 & rstsr0LowVoltage) {
+    return RESET_CAUSE_LOW_VOLTAGE;
+  } else if ((rstsr0 & rstsr0PowerOn) || !(rstsr2 & rstsr2WarmStart)) {
+    return RESET_CAUSE_POWER_ON;
+  }
+  return RESET_CAUSE_PIN;
+}
+#else
+resetCause readResetCause() { return RESET_CAUSE_UNKNOWN; }
+#endif
+
+/*****************************************************
+ *
+ * Function - Work out why we reset and count it in the persistent reset log
+ *
+ ****************************************************/
+uint32_t calculateResetLogCrc(const resetLogRecord *record) {
+  return ~updateConfigCrc(0xFFFFFFFF, record, offsetof(resetLogRecord, crc));
+}
+
+void recordResetCause() {
+  currentResetCause = readResetCause();
+  LOG_INFO(LOG_MODULE_GENERAL, "Reset cause %s", resetCauseNames[currentResetCause]);
+
+  int address = getConfigStorageEnd();
+  if (configStorageBegin() < address + (int)sizeof(resetLogRecord)) {
+    LOG_WARN(LOG_MODULE_GENERAL, "No storage available for the reset log");
+    return;
+  }
+
+  configStorageRead(address, &resetLog, sizeof(resetLog));
+  if (resetLog.magic != resetLogMagic || calculateResetLogCrc(&resetLog) != resetLog.crc) {
+    memset(&resetLog, 0, sizeof(resetLog));
+    resetLog.magic = resetLogMagic;
+  }
+
+  resetLog.bootCount++;
+  resetLog.causeCounts[currentResetCause]++;
+  resetLog.crc = calculateResetLogCrc(&resetLog);
+  configStorageWrite(address, &resetLog, sizeof(resetLog));
+
+  LOG_INFO(LOG_MODULE_GENERAL, "Boot %lu, %lu watchdog resets so far", (unsigned long)resetLog.bootCount,
+           (unsigned long)resetLog.causeCounts[RESET_CAUSE_WATCHDOG]);
+}
+
+resetCause getResetCause() { return currentResetCause; }
+
+const char *getResetCauseName(resetCause cause) { return resetCauseNames[cause]; }
+
+/*****************************************************
+ *
+ * Functions - Hardware watchdog, once started it can not be stopped so the loop must refresh it
+ *
+ ****************************************************/
+void initialiseWatchdog(unsigned long timeoutMs) {
+#if defined(ARDUINO_ARCH_RENESAS)
+  if (WDT.begin(timeoutMs)) {
+    watchdogRunning = true;
+    LOG_INFO(LOG_MODULE_GENERAL, "Watchdog running with a %lu ms timeout", timeoutMs);
+  } else {
+    LOG_ERROR(LOG_MODULE_GENERAL, "Watchdog could not be started");
+  }
+#else
+  LOG_WARN(LOG_MODULE_GENERAL, "No watchdog on this platform");
+#endif
+}
+
+void refreshWatchdog() {
+#if defined(ARDUINO_ARCH_RENESAS)
+  if (watchdogRunning) {
+    WDT.refresh();
+  }
+#endif
+}
+
+/*****************************************************
+ *
+ * Function - Check each peripheral and re-initialise any that have stopped working
+ *
+ ****************************************************/
+// A peripheral that keeps failing, or fails again soon after coming back, is retried half as often each time up to
+// the maximum. It has to stay up for the maximum interval before the back off starts again from the table interval
+const unsigned long supervisorMaxRetryIntervalMs = 60000;
+const byte supervisorMaxBackoffShift = 6;
+
+unsigned long getSupervisorRetryInterval(const supervisedPeripheral *peripheral) {
+  unsigned long interval = peripheral->retryIntervalMs << min(peripheral->repeatedAttempts, supervisorMaxBackoffShift);
+  return min(interval, supervisorMaxRetryIntervalMs);
+}
+
+// Only one peripheral is re-initialised per call so a slow one can not hold up the loop or starve the watchdog
+void serviceSupervisor(supervisedPeripheral *peripherals, int peripheralCount) {
+  unsigned long nowMillis = millis();
+
+  for (int i = 0; i < peripheralCount; i++) {
+    supervisedPeripheral *peripheral = &peripherals[i];
+    bool retryDue = nowMillis - peripheral->lastAttemptMillis >= getSupervisorRetryInterval(peripheral);
+
+    if (!peripheral->failed) {
+      if (peripheral->isAlive()) {
+        if (nowMillis - peripheral->lastAttemptMillis >= supervisorMaxRetryIntervalMs) {
+          peripheral->repeatedAttempts = 0;
+        }
+        continue;
+      }
+      peripheral->failed = true;
+      peripheral->failedMillis = nowMillis;
+      peripheral->failureCount++;
+      LOG_WARN(LOG_MODULE_GENERAL, "%s stopped responding, re-initialising", peripheral->name);
+    }
+    if (!retryDue) {
+      continue;
+    }
+
+    peripheral->lastAttemptMillis = nowMillis;
+    if (peripheral->repeatedAttempts < supervisorMaxBackoffShift) {
+      peripheral->repeatedAttempts++;
+    }
+    if (peripheral->reinitialise()) {
+      peripheral->failed = false;
+      peripheral->recoveryCount++;
+      peripheral->lastRecoveryMs = millis() - peripheral->failedMillis;
+      LOG_INFO(LOG_MODULE_GENERAL, "%s recovered in %lu ms", peripheral->name, peripheral->lastRecoveryMs);
+    }
+    return;
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Return the reset log and peripheral recovery counts as JSON for MQTT
+ *
+ ****************************************************/
+String reportSupervisor(const supervisedPeripheral *peripherals, int peripheralCount) {
+  String payload = "{\"resetCause\":\"" + String(resetCauseNames[currentResetCause]) +
+                   "\",\"boots\":" + String(resetLog.bootCount) +
+                   ",\"watchdogResets\":" + String(resetLog.causeCounts[RESET_CAUSE_WATCHDOG]) + ",\"peripherals\":[";
+
+  for (int i = 0; i < peripheralCount; i++) {
+    const supervisedPeripheral *peripheral = &peripherals[i];
+    if (i > 0) {
+      payload += ",";
+    }
+    payload += "{\"name\":\"" + String(peripheral->name) + "\",\"failed\":" + (peripheral->failed ? "true" : "false") +
+               ",\"failures\":" + String(peripheral->failureCount) +
+               ",\"recoveries\":" + String(peripheral->recoveryCount) +
+               ",\"lastRecoveryMs\":" + String(peripheral->lastRecoveryMs) +
+               ",\"retryMs\":" + String(getSupervisorRetryInterval(peripheral)) + "}";
+  }
+
+  return payload + "]}";
+}
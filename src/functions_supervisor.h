@@ -0,0 +1,50 @@
+#ifndef FUNCTIONS_SUPERVISOR_H
+#define FUNCTIONS_SUPERVISOR_H
+
+#include <Arduino.h>
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+enum resetCause {
+  RESET_CAUSE_POWER_ON,
+  RESET_CAUSE_WATCHDOG,
+  RESET_CAUSE_SOFTWARE,
+  RESET_CAUSE_LOW_VOLTAGE,
+  RESET_CAUSE_PIN,
+  RESET_CAUSE_UNKNOWN,
+  RESET_CAUSE_COUNT
+};
+
+// A piece of hardware checked from the loop, it is re-initialised on its own when the liveness check fails so the
+// rest of the system keeps running
+struct supervisedPeripheral {
+  const char *name;
+  bool (*isAlive)();                 // Returns false once the peripheral looks wedged
+  bool (*reinitialise)();            // Brings the peripheral back, returns true on success
+  unsigned long retryIntervalMs;     // Time between re-initialise attempts while failed, doubled on each repeat
+  bool failed = false;
+  unsigned long failedMillis = 0;    // When the failure was detected
+  unsigned long lastAttemptMillis = 0;
+  byte repeatedAttempts = 0;         // Attempts since the peripheral last stayed up, sets the back off
+  unsigned long failureCount = 0;
+  unsigned long recoveryCount = 0;
+  unsigned long lastRecoveryMs = 0;  // Time from detecting the last failure to getting the peripheral back
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void recordResetCause();
+resetCause getResetCause();
+const char *getResetCauseName(resetCause);
+void initialiseWatchdog(unsigned long);
+void refreshWatchdog();
+void serviceSupervisor(supervisedPeripheral *, int);
+String reportSupervisor(const supervisedPeripheral *, int);
+
+#endif
@@ -0,0 +1,175 @@
+#include "functions_telemetry.h"
+#include "functions_mqtt.h"
+#include "functions_telemetry_udp.h"
+#include "functions_log.h"
+
+/*****************************************************
+ *
+ * Variables - Telemetry statistics
+ *
+ ****************************************************/
+// MQTT PUBLISH fixed header and topic length field, added to the topic and payload to estimate bytes on the wire
+const int telemetryMessageOverheadBytes = 4;
+
+unsigned long telemetryStatsPreviousMillis = 0;
+
+/*****************************************************
+ *
+ * Functions - Formatting and window accumulation
+ *
+ ****************************************************/
+String formatTelemetryValue(float value, byte decimals) {
+  return decimals == 0 ? String((long)value) : String(value, decimals);
+}
+
+// Fold in everything written to the signal since the last call, the store's window is restarted each time
+void addTelemetryWindow(telemetryPolicy *policy) {
+  signalWindow latest;
+  takeSignalWindow(policy->signal, &latest);
+  if (latest.count == 0) {
+    return;
+  }
+
+  signalWindow *window = &policy->window;
+  if (window->count == 0 || latest.min < window->min) {
+    window->min = latest.min;
+  }
+  if (window->count == 0 || latest.max > window->max) {
+    window->max = latest.max;
+  }
+  window->sum += latest.sum;
+  window->count += latest.count;
+}
+
+/*****************************************************
+ *
+ * Function - Keep a window in the store for each windowed metric read from it
+ *
+ ****************************************************/
+// Every other signal skips the window on write, so call this once the table is set and again if it changes
+void initialiseTelemetry(telemetryPolicy *policies, int policyCount) {
+  for (int signal = 0; signal < SIGNAL_COUNT; signal++) {
+    setSignalWindowed((signalId)signal, false);
+  }
+  for (int i = 0; i < policyCount; i++) {
+    if (policies[i].windowed && policies[i].source == NULL) {
+      setSignalWindowed(policies[i].signal, true);
+    }
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Publish every metric that has left its deadband or reached its heartbeat
+ *
+ ****************************************************/
+void serviceTelemetry(telemetryPolicy *policies, int policyCount) {
+  // Nothing is retained by the broker, so after a reconnect every metric goes out again straight away
+  if (!isMqttBrokerConnected()) {
+    for (int i = 0; i < policyCount; i++) {
+      policies[i].everPublished = false;
+      if (policies[i].windowed && !(policies[i].source == NULL && isUdpTelemetryActive())) {
+        addTelemetryWindow(&policies[i]);
+        policies[i].window = signalWindow();
+      }
+    }
+    return;
+  }
+
+  unsigned long nowMillis = millis();
+
+  for (int i = 0; i < policyCount; i++) {
+    telemetryPolicy *policy = &policies[i];
+    unsigned long sinceLastPublish = nowMillis - policy->lastPublishedMillis;
+
+    // Store signals reach the broker through the UDP bridge when it is running, only computed values still go from
+    // here. The UDP datagram carries the store's window for windowed signals, so it is left for serviceUdpTelemetry
+    if (policy->source == NULL && isUdpTelemetryActive()) {
+      policy->window = signalWindow();
+      policy->everPublished = false;
+      continue;
+    }
+
+    if (policy->everPublished && sinceLastPublish < policy->minIntervalMs) {
+      continue;
+    }
+
+    float deadband = max(policy->absoluteDeadband, policy->relativeDeadband * fabsf(policy->lastValue));
+    float value;
+    bool outsideDeadband;
+
+    if (policy->windowed) {
+      addTelemetryWindow(policy);
+      signalWindow *window = &policy->window;
+      value = window->count > 0 ? window->sum / window->count : readSignal(policy->signal);
+      outsideDeadband = window->count > 0 && (fabsf(window->min - policy->lastValue) > deadband ||
+                                              fabsf(window->max - policy->lastValue) > deadband);
+    } else {
+      value = policy->source != NULL ? policy->source() : readSignal(policy->signal);
+      outsideDeadband = fabsf(value - policy->lastValue) > deadband;
+    }
+
+    if (policy->everPublished && !outsideDeadband && sinceLastPublish < policy->heartbeatMs) {
+      continue;
+    }
+
+    String payload = "{\"value\":" + formatTelemetryValue(value, policy->decimals);
+    if (policy->windowed) {
+      // A heartbeat with nothing written since the last publish repeats the value with a count of zero
+      signalWindow *window = &policy->window;
+      payload += ",\"min\":" + formatTelemetryValue(window->count > 0 ? window->min : value, policy->decimals) +
+                 ",\"max\":" + formatTelemetryValue(window->count > 0 ? window->max : value, policy->decimals) +
+                 ",\"count\":" + String(window->count);
+      *window = signalWindow();
+    }
+    payload += "}";
+
+    publishMqttPayload(policy->topic, payload);
+
+    policy->lastValue = value;
+    policy->lastPublishedMillis = nowMillis;
+    policy->everPublished = true;
+    policy->lastMessageBytes = strlen(policy->topic) + payload.length() + telemetryMessageOverheadBytes;
+    policy->publishedCount++;
+    policy->publishedBytes += policy->lastMessageBytes;
+  }
+}
+
+/*****************************************************
+ *
+ * Function - Report what was published against the fixed cadence the metrics used to go out at
+ *
+ ****************************************************/
+void reportTelemetryStats(telemetryPolicy *policies, int policyCount) {
+  float elapsedSeconds = (millis() - telemetryStatsPreviousMillis) / 1000.0;
+  telemetryStatsPreviousMillis = millis();
+  if (elapsedSeconds <= 0) {
+    return;
+  }
+
+  float messagesPerSecond = 0;
+  float bytesPerSecond = 0;
+  float legacyMessagesPerSecond = 0;
+  float legacyBytesPerSecond = 0;
+
+  for (int i = 0; i < policyCount; i++) {
+    telemetryPolicy *policy = &policies[i];
+    messagesPerSecond += policy->publishedCount / elapsedSeconds;
+    bytesPerSecond += policy->publishedBytes / elapsedSeconds;
+    if (policy->legacyPeriodMs > 0) {
+      legacyMessagesPerSecond += 1000.0 / policy->legacyPeriodMs;
+      legacyBytesPerSecond += policy->lastMessageBytes * 1000.0 / policy->legacyPeriodMs;
+    }
+    policy->publishedCount = 0;
+    policy->publishedBytes = 0;
+  }
+
+  serialConsole.print("Telemetry msg/s: ");
+  serialConsole.print(messagesPerSecond);
+  serialConsole.print(" bytes/s: ");
+  serialConsole.print(bytesPerSecond);
+  serialConsole.print(" saved msg/s: ");
+  serialConsole.print(legacyMessagesPerSecond - messagesPerSecond);
+  serialConsole.print(" saved bytes/s: ");
+  serialConsole.println(legacyBytesPerSecond - bytesPerSecond);
+}
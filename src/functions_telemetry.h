@@ -0,0 +1,45 @@
+#ifndef FUNCTIONS_TELEMETRY_H
+#define FUNCTIONS_TELEMETRY_H
+
+#include <Arduino.h>
+
+#include "functions_signals.h"
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+// A metric published by exception, it goes out as soon as it moves outside its deadband and otherwise only at the
+// heartbeat so a value that never changes costs almost nothing. A windowed metric is judged on the extremes of its
+// window rather than the latest sample, so a dip shorter than the publish interval still triggers a publish
+struct telemetryPolicy {
+  const char *topic;
+  signalId signal;
+  float (*source)();            // Read instead of the signal when set, for values kept outside the store
+  byte decimals;                // 0 publishes a whole number
+  float absoluteDeadband;       // Publish once the value has moved by more than this
+  float relativeDeadband;       // or by more than this fraction of the last published value, whichever is larger
+  unsigned long minIntervalMs;  // Shortest time between publishes
+  unsigned long heartbeatMs;    // Longest time between publishes, the value is repeated even if unchanged
+  unsigned long legacyPeriodMs; // The fixed period this metric used to be published at, used to report savings
+  bool windowed = false;        // Publish min, max, mean and count of every write since the last publish
+  signalWindow window;          // Accumulated from the store's window until the next publish
+  float lastValue = 0;
+  unsigned long lastPublishedMillis = 0;
+  bool everPublished = false;
+  unsigned long publishedCount = 0; // Messages since the last stats report
+  unsigned long publishedBytes = 0; // Topic and payload bytes since the last stats report
+  unsigned int lastMessageBytes = 0;
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void initialiseTelemetry(telemetryPolicy *, int);
+void serviceTelemetry(telemetryPolicy *, int);
+void reportTelemetryStats(telemetryPolicy *, int);
+
+#endif
@@ -0,0 +1,131 @@
+#include "functions_telemetry_udp.h"
+#include "functions_config.h"
+#include "functions_log.h"
+
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+#include <stddef.h>
+
+/*****************************************************
+ *
+ * Variables - UDP telemetry
+ *
+ ****************************************************/
+// A lost datagram is simply replaced by the next one, so a congested link drops stale samples instead of delaying
+// fresh ones behind TCP retransmits the way the MQTT connection does
+EthernetUDP udpTelemetry;
+udpTelemetryDatagram udpTelemetryPacket;
+bool udpTelemetryStarted = false;
+unsigned long udpTelemetryPreviousMillis = 0;
+
+unsigned long udpTelemetrySentCount = 0;
+unsigned long udpTelemetrySentBytes = 0;
+unsigned long udpTelemetryFailedCount = 0;
+unsigned long udpTelemetryStatsPreviousMillis = 0;
+
+/*****************************************************
+ *
+ * Function - Is the UDP transport carrying the signal store instead of MQTT
+ *
+ ****************************************************/
+bool isUdpTelemetryActive() { return config.udpTelemetryEnabled && udpTelemetryStarted; }
+
+/*****************************************************
+ *
+ * Function - Send the signal store to the MQTT server host every period
+ *
+ ****************************************************/
+// Call only once the ethernet shield is up. Re-initialising the W5500 closes the socket, a failed send opens it again.
+// The windowed store rows of the policy table have their windows taken here instead of by serviceTelemetry
+void serviceUdpTelemetry(telemetryPolicy *policies, int policyCount) {
+  if (!config.udpTelemetryEnabled) {
+    if (udpTelemetryStarted) {
+      udpTelemetry.stop();
+      udpTelemetryStarted = false;
+    }
+    return;
+  }
+
+  if (millis() - udpTelemetryPreviousMillis < config.udpTelemetryPeriodMs) {
+    return;
+  }
+  udpTelemetryPreviousMillis = millis();
+
+  if (!udpTelemetryStarted) {
+    if (!udpTelemetry.begin(config.udpTelemetryPort)) {
+      udpTelemetryFailedCount++;
+      return;
+    }
+    udpTelemetryStarted = true;
+  }
+
+  udpTelemetryPacket.magic = udpTelemetryMagic;
+  udpTelemetryPacket.version = udpTelemetryLayoutVersion;
+  udpTelemetryPacket.signalCount = SIGNAL_COUNT;
+  udpTelemetryPacket.sequence++;
+  udpTelemetryPacket.timestamp = millis();
+
+  // The packed members are not aligned for float access, so build in locals and copy the bytes across
+  float values[SIGNAL_COUNT];
+  snapshotSignalValues(values);
+  memcpy(udpTelemetryPacket.values, values, sizeof(values));
+
+  uint8_t windowCount = 0;
+  for (int i = 0; i < policyCount && windowCount < udpTelemetryMaxWindows; i++) {
+    if (!policies[i].windowed || policies[i].source != NULL) {
+      continue;
+    }
+    signalWindow taken;
+    takeSignalWindow(policies[i].signal, &taken);
+
+    udpTelemetryWindow window;
+    window.signal = policies[i].signal;
+    window.reserved = 0;
+    window.count = min(taken.count, 0xFFFFUL);
+    window.min = taken.min;
+    window.max = taken.max;
+    window.sum = taken.sum;
+    memcpy(&udpTelemetryPacket.windows[windowCount++], &window, sizeof(window));
+  }
+  udpTelemetryPacket.windowCount = windowCount;
+  size_t packetLength = offsetof(udpTelemetryDatagram, windows) + windowCount * sizeof(udpTelemetryWindow);
+
+  IPAddress host(config.mqttServerIp[0], config.mqttServerIp[1], config.mqttServerIp[2], config.mqttServerIp[3]);
+  if (!udpTelemetry.beginPacket(host, config.udpTelemetryPort)) {
+    udpTelemetryFailedCount++;
+    udpTelemetryStarted = false;
+    return;
+  }
+  udpTelemetry.write((const uint8_t *)&udpTelemetryPacket, packetLength);
+  if (!udpTelemetry.endPacket()) {
+    udpTelemetryFailedCount++;
+    udpTelemetryStarted = false;
+    return;
+  }
+  udpTelemetrySentCount++;
+  udpTelemetrySentBytes += packetLength;
+}
+
+/*****************************************************
+ *
+ * Function - Report datagram rate and failures over serial
+ *
+ ****************************************************/
+void reportUdpTelemetryStats() {
+  float elapsedSeconds = (millis() - udpTelemetryStatsPreviousMillis) / 1000.0;
+  udpTelemetryStatsPreviousMillis = millis();
+  if (elapsedSeconds <= 0 || !config.udpTelemetryEnabled) {
+    return;
+  }
+
+  serialConsole.print("UDP telemetry datagrams/s: ");
+  serialConsole.print(udpTelemetrySentCount / elapsedSeconds);
+  serialConsole.print(" bytes/s: ");
+  serialConsole.print(udpTelemetrySentBytes / elapsedSeconds);
+  serialConsole.print(" failed: ");
+  serialConsole.println(udpTelemetryFailedCount);
+
+  udpTelemetrySentCount = 0;
+  udpTelemetrySentBytes = 0;
+  udpTelemetryFailedCount = 0;
+}
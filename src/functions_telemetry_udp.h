@@ -0,0 +1,52 @@
+#ifndef FUNCTIONS_TELEMETRY_UDP_H
+#define FUNCTIONS_TELEMETRY_UDP_H
+
+#include <Arduino.h>
+
+#include "functions_signals.h"
+#include "functions_telemetry.h"
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+// Bump when the header changes or signals are reordered or removed, tools/udp_telemetry_bridge.py checks it
+const uint8_t udpTelemetryLayoutVersion = 2;
+const uint16_t udpTelemetryMagic = 0x5447; // "GT" on the wire
+const uint8_t udpTelemetryMaxWindows = 4;
+
+// Every write to a windowed signal since the previous datagram, so the bridge sees the same extremes MQTT would
+struct __attribute__((packed)) udpTelemetryWindow {
+  uint8_t signal;
+  uint8_t reserved;
+  uint16_t count; // Zero when nothing was written, min, max and sum are then zero too
+  float min;
+  float max;
+  float sum;
+};
+
+// One datagram carries every signal in the store, little endian as laid out in RAM on the RA4M1. The windows follow
+// the values, only windowCount of them are sent
+struct __attribute__((packed)) udpTelemetryDatagram {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t signalCount;
+  uint8_t windowCount;
+  uint8_t reserved[3];
+  uint32_t sequence;  // Incremented per datagram so the receiver can count loss and reordering
+  uint32_t timestamp; // millis() when the values were copied, the receiver measures jitter against it
+  float values[SIGNAL_COUNT];
+  udpTelemetryWindow windows[udpTelemetryMaxWindows];
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+bool isUdpTelemetryActive();
+void serviceUdpTelemetry(telemetryPolicy *, int);
+void reportUdpTelemetryStats();
+
+#endif
@@ -0,0 +1,175 @@
+#include "functions_traction.h"
+
+/*****************************************************
+ *
+ * Variables - Traction analytics
+ *
+ ****************************************************/
+// All maths is done on the raw 1/16 km/h wheel speeds from 0x1F0 with results in per-mille, so there is no floating
+// point in the per frame path
+const uint16_t tractionMinimumReferenceSpeed = 48; // 3 km/h, slip below this is taken against 3 km/h instead
+const int32_t tractionMaximumSlipPerMille = 10000; // 1000%, rear wheels spinning up from a standstill read as this
+
+int32_t tractionValues[TRACTION_METRIC_COUNT];
+tractionWindow tractionWindows[TRACTION_METRIC_COUNT];
+const char *tractionMetricNames[TRACTION_METRIC_COUNT] = {"slipFl", "slipFr", "slipRl", "slipRr", "slipRear", "rearSplit"};
+
+// Launch slip profile records the rear slip in fixed time buckets from the moment either axle turns
+const int launchSlipProfileBuckets = 30;
+const unsigned long launchSlipProfileBucketMs = 100;
+int16_t launchSlipProfile[launchSlipProfileBuckets];
+int32_t launchSlipBucketSum = 0;
+uint16_t launchSlipBucketCount = 0;
+int launchSlipBucket = 0;
+unsigned long launchStartTimestamp = 0;
+bool launchSlipProfileActive = false;
+bool launchSlipProfileReady = false;
+bool tractionPreviouslyStationary = true;
+
+/*****************************************************
+ *
+ * Function - Add a sample to a window
+ *
+ ****************************************************/
+void addTractionWindowSample(tractionWindow *window, int32_t value) {
+  if (value < window->min) {
+    window->min = value;
+  }
+  if (value > window->max) {
+    window->max = value;
+  }
+  window->sum += value;
+  window->count++;
+}
+
+/*****************************************************
+ *
+ * Function - Update the launch slip profile with the latest rear slip
+ *
+ ****************************************************/
+void updateLaunchSlipProfile(uint16_t frontReference, uint16_t rearAverage, int32_t rearSlip, unsigned long timestamp) {
+  bool stationary = frontReference == 0 && rearAverage == 0;
+
+  // Start a new profile as soon as any wheel moves from standstill, a launch with wheelspin turns the rears first
+  if (tractionPreviouslyStationary && !stationary) {
+    launchSlipProfileActive = true;
+    launchSlipProfileReady = false;
+    launchStartTimestamp = timestamp;
+    launchSlipBucket = 0;
+    launchSlipBucketSum = 0;
+    launchSlipBucketCount = 0;
+  }
+  tractionPreviouslyStationary = stationary;
+
+  if (!launchSlipProfileActive) {
+    return;
+  }
+
+  // Stopping again before the profile completes abandons it
+  if (stationary) {
+    launchSlipProfileActive = false;
+    return;
+  }
+
+  int bucket = (timestamp - launchStartTimestamp) / launchSlipProfileBucketMs;
+  while (launchSlipBucket < bucket && launchSlipBucket < launchSlipProfileBuckets) {
+    launchSlipProfile[launchSlipBucket++] = launchSlipBucketCount > 0 ? launchSlipBucketSum / launchSlipBucketCount : 0;
+    launchSlipBucketSum = 0;
+    launchSlipBucketCount = 0;
+  }
+
+  if (launchSlipBucket >= launchSlipProfileBuckets) {
+    launchSlipProfileActive = false;
+    launchSlipProfileReady = true;
+    return;
+  }
+
+  launchSlipBucketSum += rearSlip;
+  launchSlipBucketCount++;
+}
+
+/*****************************************************
+ *
+ * Function - Calculate slip and split for every new wheel speed frame
+ *
+ ****************************************************/
+// Wheelspin from a standstill is exactly when the front reference is near zero, so rather than dropping the ratio
+// there the difference is scaled against the minimum reference speed, which keeps sensor noise at a crawl small
+int32_t calculateSlipPerMille(uint16_t wheelSpeed, uint16_t referenceSpeed) {
+  int32_t reference = max(referenceSpeed, tractionMinimumReferenceSpeed);
+  int32_t slip = ((int32_t)wheelSpeed - referenceSpeed) * 1000 / reference;
+  return constrain(slip, -tractionMaximumSlipPerMille, tractionMaximumSlipPerMille);
+}
+
+void updateTractionAnalytics(uint16_t fl, uint16_t fr, uint16_t rl, uint16_t rr, unsigned long timestamp) {
+  uint16_t frontReference = (fl + fr) / 2;
+  uint16_t rearAverage = (rl + rr) / 2;
+
+  tractionValues[TRACTION_SLIP_FL] = calculateSlipPerMille(fl, frontReference);
+  tractionValues[TRACTION_SLIP_FR] = calculateSlipPerMille(fr, frontReference);
+  tractionValues[TRACTION_SLIP_RL] = calculateSlipPerMille(rl, frontReference);
+  tractionValues[TRACTION_SLIP_RR] = calculateSlipPerMille(rr, frontReference);
+  tractionValues[TRACTION_SLIP_REAR] = calculateSlipPerMille(rearAverage, frontReference);
+
+  // The undriven front axle tells us how much left / right difference comes from the corner geometry, so the rear
+  // split is the rear ratio relative to the front ratio: (rl / rr) / (fl / fr) - 1
+  if (frontReference >= tractionMinimumReferenceSpeed && rr > 0 && fl > 0) {
+    int64_t numerator = (int64_t)rl * fr - (int64_t)rr * fl;
+    tractionValues[TRACTION_REAR_SPLIT] = numerator * 1000 / ((int64_t)rr * fl);
+  } else {
+    tractionValues[TRACTION_REAR_SPLIT] = 0;
+  }
+
+  for (int i = 0; i < TRACTION_METRIC_COUNT; i++) {
+    addTractionWindowSample(&tractionWindows[i], tractionValues[i]);
+  }
+
+  updateLaunchSlipProfile(frontReference, rearAverage, tractionValues[TRACTION_SLIP_REAR], timestamp);
+}
+
+int32_t getTractionValue(tractionMetric metric) { return tractionValues[metric]; }
+
+/*****************************************************
+ *
+ * Function - Summarise and reset the windows as JSON for publishing
+ *
+ ****************************************************/
+String getTractionWindowSummary() {
+  String summary = "{";
+  for (int i = 0; i < TRACTION_METRIC_COUNT; i++) {
+    tractionWindow *window = &tractionWindows[i];
+    if (i > 0) {
+      summary += ",";
+    }
+    summary += "\"" + String(tractionMetricNames[i]) + "\":";
+    if (window->count == 0) {
+      summary += "null";
+    } else {
+      summary += "{\"min\":" + String(window->min) + ",\"max\":" + String(window->max) +
+                 ",\"avg\":" + String(window->sum / window->count) + "}";
+    }
+    *window = tractionWindow();
+  }
+  summary += "}";
+  return summary;
+}
+
+/*****************************************************
+ *
+ * Functions - Launch slip profile
+ *
+ ****************************************************/
+bool isLaunchSlipProfileReady() { return launchSlipProfileReady; }
+
+String getLaunchSlipProfile() {
+  String profile = "[";
+  for (int i = 0; i < launchSlipProfileBuckets; i++) {
+    if (i > 0) {
+      profile += ",";
+    }
+    profile += String(launchSlipProfile[i]);
+  }
+  profile += "]";
+  launchSlipProfileReady = false;
+  return profile;
+}
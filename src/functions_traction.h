@@ -0,0 +1,40 @@
+#ifndef FUNCTIONS_TRACTION_H
+#define FUNCTIONS_TRACTION_H
+
+#include <Arduino.h>
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+// Rolling min / max / average of a per-mille value over one publish window
+struct tractionWindow {
+  int32_t min = INT32_MAX;
+  int32_t max = INT32_MIN;
+  int32_t sum = 0;
+  uint16_t count = 0;
+};
+
+enum tractionMetric {
+  TRACTION_SLIP_FL,        // Front left slip versus the front axle reference
+  TRACTION_SLIP_FR,        // Front right slip versus the front axle reference
+  TRACTION_SLIP_RL,        // Rear left slip versus the front axle reference
+  TRACTION_SLIP_RR,        // Rear right slip versus the front axle reference
+  TRACTION_SLIP_REAR,      // Rear axle slip versus the front axle
+  TRACTION_REAR_SPLIT,     // Rear left / right split with the cornering component removed
+  TRACTION_METRIC_COUNT
+};
+
+/****************************************************
+ *
+ * Function Prototypes
+ *
+ ****************************************************/
+void updateTractionAnalytics(uint16_t, uint16_t, uint16_t, uint16_t, unsigned long);
+int32_t getTractionValue(tractionMetric);
+String getTractionWindowSummary();
+bool isLaunchSlipProfileReady();
+String getLaunchSlipProfile();
+
+#endif
@@ -1,24 +1,12 @@
 #include "functions_write.h"
-#include <mcp2515_can.h> // Used for Seeed shields
+#include "functions_config.h"
+#include "functions_log.h"
 
 /*****************************************************
  *
- * Function - Write the current temperature value to the CAN bus for cluster gauge display
+ * Function - Convert RPM into the value the cluster is expecting in 0x316, used as a gateway rule source
  *
  ****************************************************/
-unsigned char canPayloadTemp[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-
-void canWriteTemp(int currentEngineTempCelsius, mcp2515_can can) {
-  canPayloadTemp[1] = (currentEngineTempCelsius + 48.373) / 0.75;
-  can.sendMsgBuf(0x329, 0, 8, canPayloadTemp);
-}
-
-/*****************************************************
- *
- * Function - Write the current RPM value to the CAN bus for cluster gauge display
- *
- ****************************************************/
-unsigned char canPayloadRpm[8] = {0, 0, 0, 0, 0, 0, 0, 0};
 int previousRpm;                        // Will store the previous RPM value
 int multipliedRpm;                      // The RPM value to represent in CAN payload which the cluster is expecting
 float rpmHexConversionMultipler = 5.6; // Default multiplier set to a sensible value for accuracy at lower
@@ -27,16 +15,16 @@ float rpmHexConversionMultipler = 5.6; // Default multiplier set to a sensible v
 
 const int numPoints = 8;
 int measuredRpmValues[numPoints] = {1000, 2000, 3000, 4000, 5000, 6000, 7000, 8000};
-float measuredHexConversionMultiplerValues[numPoints] = {5.9, 5.4, 5.2, 5.15, 5.1, 5.05, 5.0, 5.0};
+// The multipliers measured at each of these points come from the config (rpmMultipliers)
 
-void canWriteRpm(int currentRpm, mcp2515_can can) {
+int getClusterRpmValue(int currentRpm) {
   if (currentRpm != 0 && abs(currentRpm - previousRpm) < 750) { // We see some odd values from time to time so lets filter them out
 
     // Calculate the rpmHexConversionMultipler based on linear interpolation of measured data points
     if (currentRpm <= 1200) {
-        rpmHexConversionMultipler = 5.9;
+        rpmHexConversionMultipler = config.rpmMultipliers[0];
     } else if (currentRpm >= 8000) {
-        rpmHexConversionMultipler = 5.0;
+        rpmHexConversionMultipler = config.rpmMultipliers[numPoints - 1];
     } else
     {
       // Find the two nearest RPM values in the table
@@ -49,35 +37,18 @@ void canWriteRpm(int currentRpm, mcp2515_can can) {
       // Perform linear interpolation
       float x0 = measuredRpmValues[i];
       float x1 = measuredRpmValues[i + 1];
-      float y0 = measuredHexConversionMultiplerValues[i];
-      float y1 = measuredHexConversionMultiplerValues[i + 1];
+      float y0 = config.rpmMultipliers[i];
+      float y1 = config.rpmMultipliers[i + 1];
 
       rpmHexConversionMultipler = y0 + (y1 - y0) * (currentRpm - x0) / (x1 - x0);
     }
 
-    // Write the calculated value
     multipliedRpm = currentRpm * rpmHexConversionMultipler;
-    canPayloadRpm[2] = multipliedRpm;        // LSB
-    canPayloadRpm[3] = (multipliedRpm >> 8); // MSB
   }
 
-  can.sendMsgBuf(0x316, 0, 8, canPayloadRpm);
+  // Glitches hold the last good value
   previousRpm = currentRpm;
-}
-
-/*****************************************************
- *
- * Function - Write the current speed value to the CAN bus for ECU consumption
- *
- ****************************************************/
-unsigned char canPayloadSpeed[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-
-void canWriteSpeed(int currentVehicleSpeed, mcp2515_can can) {
-  float speedValue = (0.3903 * currentVehicleSpeed) + 0.5144;
-  canPayloadSpeed[4] = speedValue;
-  // canPayloadSpeed[5] = speedValue >> 8;
-  // can.sendMsgBuf(0x284, 0, 8, canPayloadSpeed);   // ID used for 2009 JDM Nissan Skyline 370GT ECU
-  can.sendMsgBuf(0x280, 0, 8, canPayloadSpeed);      // ID used for 2011 USDM Nissan 370Z ECU
+  return multipliedRpm;
 }
 
 /*****************************************************
@@ -87,28 +58,7 @@ void canWriteSpeed(int currentVehicleSpeed, mcp2515_can can) {
  ****************************************************/
 unsigned char canPayloadKeepalive[8] = {0x03, 0x22, 0x12, 0x01, 0x00, 0x00, 0x00, 0x00};
 
-void canWriteDiagnosticKeepalive(mcp2515_can can) {
-  can.sendMsgBuf(0x7DF, 0, 8, canPayloadKeepalive);
-  // Serial.println("Sending keepalive");
-}
-
-/*****************************************************
- *
- * Function - Write the current clutch status to the CAN bus for ECU consumption
- *
- ****************************************************/
-unsigned char canPayloadClutchStatus[2] = {255, 255};
-unsigned char canPayloadClutchStatusBig[8] = {255, 255, 255, 255, 255, 255, 255, 255};
-
-void canWriteClutchStatus(int currentClutchStatus, mcp2515_can can) {
-  // can.sendMsgBuf(0x216, 0, 2, canPayloadClutchStatus);
-  can.sendMsgBuf(0x35d, 0, 8, canPayloadClutchStatusBig);
-
-  // Debug to look at the bits which are set on a particular byte
-  // Serial.println();
-  // for (int i = 7; i >= 0; i--)
-  // {
-  //     bool b = bitRead(canPayloadClutchStatus[1], i);
-  //     Serial.print(b);
-  // }
+void canWriteDiagnosticKeepalive(canTxQueue *queue) {
+  canTxQueueSubmit(queue, 0x7DF, 8, canPayloadKeepalive, CAN_TX_PRIORITY_MEDIUM);
+  // serialConsole.println("Sending keepalive");
 }
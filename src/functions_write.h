@@ -2,17 +2,24 @@
 #define FUNCTIONS_WRITE_H
 
 #include <Arduino.h>
-#include <mcp2515_can.h> // Used for Seeed shields
+#include "functions_can_tx_queue.h"
+
+/****************************************************
+ *
+ * Custom Data Types
+ *
+ ****************************************************/
+enum nissanSpeedLayout {
+  NISSAN_SPEED_LAYOUT_370Z,   // 0x280 as used by the 2011 USDM 370Z ECU
+  NISSAN_SPEED_LAYOUT_SKYLINE // 0x284 as used by the 2009 JDM Skyline 370GT ECU
+};
 
 /****************************************************
  *
  * Function Prototypes
  *
  ****************************************************/
-void canWriteTemp(int, mcp2515_can);
-void canWriteRpm(int, mcp2515_can);
-void canWriteSpeed(int, mcp2515_can);
-void canWriteClutchStatus(int, mcp2515_can);
-void canWriteDiagnosticKeepalive(mcp2515_can);
+int getClusterRpmValue(int);
+void canWriteDiagnosticKeepalive(canTxQueue *);
 
 #endif
@@ -6,7 +6,7 @@
 /* ======================================================================
    FUNCTION PROTOTYPES
    ====================================================================== */
-int getCurrentGear(int *, float *, bool *, bool *);
+int getCurrentGear(int, float, bool, bool);
 bool getClutchStatus(byte);
 bool getNeutralStatus(byte);
 
@@ -1,4 +1,5 @@
 #include "globalHelpers.h"
+#include "functions_log.h"
 #include <light_CD74HC4067.h>
 
 /* ======================================================================
@@ -25,7 +26,7 @@ const int millisWithoutSerialCommsBeforeFault = 1000; // How long is ms without
    FUNCTION: Setup the multiplexer
    ====================================================================== */
 void setupMux() {
-  DEBUG_GENERAL("Configuring mux board ...");
+  LOG_INFO(LOG_MODULE_GENERAL, "Configuring mux board ...");
   pinMode(muxSignalPin, INPUT);
 }
 
@@ -72,11 +73,11 @@ unsigned long arduinoLoopExecutionPreviousExecutionMillis;
 void reportArduinoLoopRate(unsigned long *loopCount) {
   float loopFrequencyHz = (*loopCount / ((millis() - arduinoLoopExecutionPreviousExecutionMillis) / 1000));
   float loopExecutionMs = (millis() - arduinoLoopExecutionPreviousExecutionMillis) / *loopCount;
-  Serial.print("Loop execution frequency (Hz): ");
-  Serial.print(loopFrequencyHz);
-  Serial.print(" or every ");
-  Serial.print(loopExecutionMs);
-  Serial.println("ms");
+  serialConsole.print("Loop execution frequency (Hz): ");
+  serialConsole.print(loopFrequencyHz);
+  serialConsole.print(" or every ");
+  serialConsole.print(loopExecutionMs);
+  serialConsole.println("ms");
   *loopCount = 1;
   arduinoLoopExecutionPreviousExecutionMillis = millis();
 }
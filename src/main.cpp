@@ -3,12 +3,33 @@
 #include <mcp2515_can.h> // Used for Seeed CAN shields
 #include <ptScheduler.h> // The task scheduling library of choice
 
+#include "functions_alarms.h"
 #include "functions_analogue_gauges.h"
+#include "functions_boot.h"
+#include "functions_can_filters.h"
+#include "functions_can_health.h"
+#include "functions_can_output.h"
+#include "functions_can_sniff.h"
+#include "functions_can_stream.h"
+#include "functions_can_tx_queue.h"
+#include "functions_command.h"
+#include "functions_config.h"
 #include "functions_do.h"
+#include "functions_ecm_faults.h"
+#include "functions_fuel.h"
+#include "functions_gateway.h"
+#include "functions_launch.h"
+#include "functions_log.h"
+#include "functions_memory.h"
 #include "functions_mqtt.h"
 #include "functions_performance.h"
 #include "functions_poll_ecm.h"
 #include "functions_read.h"
+#include "functions_signals.h"
+#include "functions_supervisor.h"
+#include "functions_telemetry.h"
+#include "functions_telemetry_udp.h"
+#include "functions_traction.h"
 #include "functions_write.h"
 #include "gearCalculation.h"
 #include "globalHelpers.h"
@@ -18,12 +39,13 @@
 /* ======================================================================
    VARIABLES: Debug and stat output
    ====================================================================== */
-bool debugSerialReceive = false;
-bool debugSerialSend = false;
-bool debugGeneral = false;
-bool debugGears = true;
+// Modules with logging enabled, the compile time LOG_LEVEL in functions_log.h decides which levels exist at all
+uint32_t logModuleMask = (1UL << LOG_MODULE_GENERAL) | (1UL << LOG_MODULE_GEARS);
 
 bool reportArduinoLoopStats = false;
+bool logBmwCanData = false;
+bool reportCanBusHealthStats = false; // CAN bus health is always published over MQTT, this adds serial output
+bool reportMemoryUsageStats = false;  // Memory use is always published over MQTT, this adds serial output
 
 /* ======================================================================
    VARIABLES: Pin constants
@@ -58,101 +80,301 @@ const byte neutralSwitchMuxChannel = 6;
 mcp2515_can CAN_BMW(SPI_SS_PIN_BMW);
 mcp2515_can CAN_NISSAN(SPI_SS_PIN_NISSAN);
 
+// Software transmit queues so nothing in the loop blocks waiting on a shield's hardware buffers
+canTxQueue canTxQueueBmw = {&CAN_BMW};
+canTxQueue canTxQueueNissan = {&CAN_NISSAN};
+
 /* ======================================================================
    VARIABLES: General use / functional
    ====================================================================== */
 // Define variables for CAN polling behaviour
 bool pollEcmCanMetrics = false;
-bool pollEcmCanFaults = false;
+bool pollEcmCanFaults = true;
+bool pollEcmCanInjectorDuration = true; // Needed for the cluster fuel consumption counter
+bool pollEcmCanAirIntakeTemp = true;    // Needed for the radiator fan feed forward
 bool ecmQuerySetupPerformed = false; // Have we sent the setup payloads to ECM to allow us to query various params
 
-// Define variables for current states
-float currentAfRatioBank1;
-float currentAfRatioBank2;
-int currentAirIntakeTemp;
-float currentBatteryVoltage;
-float currentCrankCaseVacuumPsi;
-float currentEngineElectronicsTemp;
-float currentFuelPressurePsi;
-float currentOilPressurePsi;
-float currentOilTempSensor;
-float currentRadiatorOutletTemp;
-float currentVehicleSpeedFront;
-float currentVehicleSpeedRear;
-float currentVehicleSpeedRearVariation;
-int currentAlphaPercentageBank1;
-int currentAlphaPercentageBank2;
-int currentCheckEngineLightState = 2; // Setting initial state so check engine light illuminates as soon as possible when powered on
-int currentEngineTempCelsius;
-int currentFanDutyPercentage;
-int currentGasPedalPosition;
-int currentOilTempEcm;
-int currentRpm = 0;
-int currentGear = 0;
-unsigned long currentVehicleSpeedTimestamp;
-
-bool clutchPressed = true;
-bool inNeutral = true;
-
-// Define constants for different alarm states
-const float alarmCrankCaseVacuumPsi = -5;
-const int alarmEngineTempCelcius = 110;
-const int alarmFuelPressureLowPsi = 48;
-const int alarmFuelPressureHighPsi = 57;
-const int alarmOilPressurePsi = 10;
-const int alarmOilTempCelcius = 120;
+// Which speed frame the ECM expects, 0x280 for the 370Z or 0x284 for the Skyline 370GT
+const nissanSpeedLayout speedFrameLayout = NISSAN_SPEED_LAYOUT_370Z;
+
+// Define the last wheel speed frame seen so the per frame work runs once for each one, the values themselves are all
+// in the signal store
+unsigned long lastWheelSpeedSequence = 0;
+
+// Define the last coolant and oil temperature values the alarms saw, they are evaluated once per new value from the ECM
+unsigned long lastEngineTempAlarmSequence = 0;
+unsigned long lastOilTempAlarmSequence = 0;
 
 // Define misc variables
-int consumptionValue = 10;
-int setupRetriesMax = 3;            // The number of times we should loop with delay to configure shields etc
 float atmospheric_voltage = 0.5707; // The pressure sensor voltage before we start the car, this is 0psi
 unsigned long arduinoLoopExecutionCount = 0;
 
-// Define misc CAN payload object
-unsigned char canPayloadMisc[8] = {0, 0, 0, 0, 0, 0, 0, 0}; // Check light, fuel consumption and temp alarm light
-
 // Create the MCP9808 temperature sensor object used in the ECU compartment temp measurement
 Adafruit_MCP9808 tempSensorEngineElectronics = Adafruit_MCP9808();
 
 /* ======================================================================
-   FUNCTION: Write misc payloads to BMW CAN
+   VARIABLES: Gateway frames and translation rules
+   ====================================================================== */
+// Source signals for the gateway rules below
+float gatewaySourceEngineTemp() { return readSignal(SIGNAL_ENGINE_TEMP); }
+float gatewaySourceClusterRpm() { return getClusterRpmValue(readSignal(SIGNAL_RPM)); }
+float gatewaySourceCheckEngineLight() { return readSignal(SIGNAL_CHECK_ENGINE_LIGHT); }
+float gatewaySourceFuelCounter() { return getFuelClusterCounter(); }
+float gatewaySourceTempAlarmLight() { return readSignal(SIGNAL_ENGINE_TEMP) >= config.alarmEngineTemp; }
+float gatewaySourceVehicleSpeed() { return readSignal(SIGNAL_VEHICLE_SPEED_REAR); }
+float gatewaySourceClutchPressed() { return readSignal(SIGNAL_CLUTCH_PRESSED); }
+unsigned long gatewaySampleWheelSpeed() { return getSignalSequence(SIGNAL_WHEEL_SPEED_RAW_FL); }
+
+enum gatewayFrameIndex {
+  GATEWAY_FRAME_CLUSTER_TEMP,
+  GATEWAY_FRAME_CLUSTER_RPM,
+  GATEWAY_FRAME_CLUSTER_MISC,
+  GATEWAY_FRAME_ECM_SPEED_370Z,
+  GATEWAY_FRAME_ECM_SPEED_SKYLINE,
+  GATEWAY_FRAME_ECM_CLUTCH,
+  GATEWAY_FRAME_COUNT
+};
+
+// Cluster frames go out on change or at the refresh floor, the speed frames follow every new 0x1F0 sample
+gatewayFrame gatewayFrameTable[GATEWAY_FRAME_COUNT] = {
+    {{0x329, canOutputClusterRefreshMs, 10}, CAN_BUS_BMW},
+    {{0x316, canOutputClusterRefreshMs, 10}, CAN_BUS_BMW},
+    {{0x545, canOutputClusterRefreshMs, 10}, CAN_BUS_BMW},
+    {{0x280, 0, 20}, CAN_BUS_NISSAN, gatewaySampleWheelSpeed},
+    {{0x284, 0, 20}, CAN_BUS_NISSAN, gatewaySampleWheelSpeed},
+    {{0x35D, canOutputEcmRefreshMs, 0, CAN_TX_PRIORITY_MEDIUM}, CAN_BUS_NISSAN, NULL, {255, 255, 255, 255, 255, 255, 255, 255}},
+};
+
+// name, frame, source, scale, offset, min, max, start byte, start bit, length bits, big endian, enabled
+const gatewayRule gatewayRuleTable[] = {
+    // Coolant temperature gauge, raw = (celsius + 48.373) / 0.75
+    {"clusterTemp", GATEWAY_FRAME_CLUSTER_TEMP, gatewaySourceEngineTemp, 1.0 / 0.75, 48.373 / 0.75, 0, 255, 1, 0, 8, false, true},
+    // Tachometer, the multiplier is interpolated from measured points in functions_write
+    {"clusterRpm", GATEWAY_FRAME_CLUSTER_RPM, gatewaySourceClusterRpm, 1, 0, 0, 65535, 2, 0, 16, false, true},
+    // 2 check engine, 16 EML, 18 both, 0 neither
+    {"checkEngineLight", GATEWAY_FRAME_CLUSTER_MISC, gatewaySourceCheckEngineLight, 1, 0, 0, 255, 0, 0, 8, false, true},
+    {"fuelCounter", GATEWAY_FRAME_CLUSTER_MISC, gatewaySourceFuelCounter, 1, 0, 0, 65535, 1, 0, 16, false, true},
+    {"tempAlarmLight", GATEWAY_FRAME_CLUSTER_MISC, gatewaySourceTempAlarmLight, 1, 0, 0, 1, 3, 3, 1, false, true},
+    // Vehicle speed as km/h x 100, the Skyline ECU takes it per wheel so it goes into each slot
+    {"ecmSpeed", GATEWAY_FRAME_ECM_SPEED_370Z, gatewaySourceVehicleSpeed, 100, 0, 0, 65535, 4, 0, 16, true, true},
+    {"ecmSpeedFr", GATEWAY_FRAME_ECM_SPEED_SKYLINE, gatewaySourceVehicleSpeed, 100, 0, 0, 65535, 0, 0, 16, true, true},
+    {"ecmSpeedFl", GATEWAY_FRAME_ECM_SPEED_SKYLINE, gatewaySourceVehicleSpeed, 100, 0, 0, 65535, 2, 0, 16, true, true},
+    {"ecmSpeedRear", GATEWAY_FRAME_ECM_SPEED_SKYLINE, gatewaySourceVehicleSpeed, 100, 0, 0, 65535, 4, 0, 16, true, true},
+    // Clutch status for the ECM, the bit it expects has not been found yet so this stays disabled
+    {"ecmClutch", GATEWAY_FRAME_ECM_CLUTCH, gatewaySourceClutchPressed, 1, 0, 0, 1, 0, 0, 1, false, false},
+};
+const int gatewayRuleCount = sizeof(gatewayRuleTable) / sizeof(gatewayRuleTable[0]);
+
+/* ======================================================================
+   FUNCTION: Configure CAN shield masks and filters (opened up while sniffing or streaming)
+   ====================================================================== */
+canFilterPlan canFilterPlanNissan;
+canFilterPlan canFilterPlanBmw;
+
+// Planned from the IDs the decoders consume, scored against the IDs and rates captured from each bus in sniff mode
+void planCanBusFilters() {
+  canFilterPlanNissan = planCanFilters(nissanCanConsumedIds, nissanCanConsumedIdCount,
+                                       config.canCapturedIds[CAN_BUS_NISSAN], config.canCapturedIdRates[CAN_BUS_NISSAN],
+                                       config.canCapturedIdCount[CAN_BUS_NISSAN]);
+  canFilterPlanBmw = planCanFilters(bmwCanConsumedIds, bmwCanConsumedIdCount, config.canCapturedIds[CAN_BUS_BMW],
+                                    config.canCapturedIdRates[CAN_BUS_BMW], config.canCapturedIdCount[CAN_BUS_BMW]);
+  printCanFilterPlan(&canFilterPlanNissan, "Nissan");
+  printCanFilterPlan(&canFilterPlanBmw, "BMW");
+}
+
+void configureCanFilters(canBus bus) {
+  mcp2515_can &can = bus == CAN_BUS_BMW ? CAN_BMW : CAN_NISSAN;
+
+  bool open = isCanSniffActive() || isCanStreamOpen(bus);
+  setCanBusFiltersOpen(bus, open);
+  if (open) {
+    can.init_Mask(0, 0, 0x000);
+    can.init_Mask(1, 0, 0x000);
+    return;
+  }
+
+  // Planned from the IDs the decoders consume so the CPU only sees traffic it is interested in
+  applyCanFilterPlan(can, bus == CAN_BUS_BMW ? &canFilterPlanBmw : &canFilterPlanNissan);
+}
+
+/* ======================================================================
+   VARIABLES: Staged boot
    ====================================================================== */
-void canWriteMisc() {
-  canPayloadMisc[0] = currentCheckEngineLightState;       // 2 for check engine light
-                                                          // 16 for EML light
-                                                          // 18 for check engine AND EML
-                                                          // 0 for neither
-  canPayloadMisc[1] = consumptionValue;                   // Fuel consumption LSB
-  canPayloadMisc[2] = (consumptionValue >> 8);            // Fuel consumption MSB
-  if (currentEngineTempCelsius >= alarmEngineTempCelcius) // Set the red alarm light on the temp gauge if needed
-    canPayloadMisc[3] = 8;
-  else
-    canPayloadMisc[3] = 0;
-
-  CAN_BMW.sendMsgBuf(0x545, 0, 8, canPayloadMisc);
+// Setup only brings up the CAN shields and gateway so the cluster needles are live straight away, everything else is
+// started from the loop as boot tasks and a shield that fails its first init is retried there too
+const unsigned long bootClusterBudgetMs = 200; // Time from power on to the first 0x316 and 0x329 frames
+unsigned long bootClusterLiveMillis = 0;
+bool bootTasksReported = false;
+
+int vacuumCalibrationSamples = 0;
+float vacuumCalibrationTotalVoltage = 0.0;
+
+bool bootStepCanBmw() {
+  if (CAN_BMW.begin(CAN_500KBPS) != CAN_OK) {
+    serialConsole.println("\tERROR - BMW CAN shield init failed, retrying ...");
+    return false;
+  }
+  serialConsole.println("\tOK - BMW CAN shield initialised");
+  configureCanFilters(CAN_BUS_BMW);
+  resetCanBusLiveness(CAN_BUS_BMW);
+  return true;
+}
+
+bool bootStepCanNissan() {
+  if (CAN_NISSAN.begin(CAN_500KBPS) != CAN_OK) {
+    serialConsole.println("\tERROR - Nissan CAN shield init failed, retrying ...");
+    return false;
+  }
+  serialConsole.println("\tOK - Nissan CAN shield initialised");
+  configureCanFilters(CAN_BUS_NISSAN);
+  resetCanBusLiveness(CAN_BUS_NISSAN);
+  return true;
+}
+
+bool bootStepEthernet() { return initialiseEthernetShield(); }
+
+bool bootStepTempSensor() {
+  if (!tempSensorEngineElectronics.begin(0x18)) {
+    serialConsole.println("\tERROR - MCP9808 temperature sensor init failed, retrying ...");
+    return false;
+  }
+  serialConsole.println("\tOK - MCP9808 temperature sensor initialised");
+  tempSensorEngineElectronics.setResolution(3);
+  return true;
+}
+
+// Set the current 0psi voltage of the crank case vacuum sensor if engine is off so that any variation in atmospheric
+// pressure is taken into account, one sample is taken per step
+bool bootStepVacuumCalibration() {
+  if (readSignal(SIGNAL_RPM) != 0) {
+    serialConsole.println("\tWARNING - Engine running, keeping the default crank case vacuum sensor zero");
+    return true;
+  }
+
+  int sensorValue = getAveragedMuxAnalogueChannelReading(gaugeCrankCaseVacuumMuxChannel, 1, 0);
+  vacuumCalibrationTotalVoltage += sensorValue * (5.0 / 1023.0);
+  vacuumCalibrationSamples++;
+  if (vacuumCalibrationSamples < 10) {
+    return false;
+  }
+
+  atmospheric_voltage = vacuumCalibrationTotalVoltage / vacuumCalibrationSamples;
+  serialConsole.print("INFO - Initialised crank case vacuum sensor at ");
+  serialConsole.print(atmospheric_voltage);
+  serialConsole.println(" V");
+  return true;
 }
 
+enum bootTaskIndex {
+  BOOT_TASK_CAN_BMW,
+  BOOT_TASK_CAN_NISSAN,
+  BOOT_TASK_ETHERNET,
+  BOOT_TASK_TEMP_SENSOR,
+  BOOT_TASK_VACUUM_CALIBRATION,
+  BOOT_TASK_COUNT
+};
+
+// name, step, interval ms, max attempts
+bootTask bootTaskTable[BOOT_TASK_COUNT] = {
+    {"BMW CAN shield", bootStepCanBmw, 500, 3},
+    {"Nissan CAN shield", bootStepCanNissan, 500, 3},
+    {"Ethernet shield", bootStepEthernet, 1000, 3},
+    {"MCP9808 temperature sensor", bootStepTempSensor, 500, 3},
+    {"Crank case vacuum calibration", bootStepVacuumCalibration, 20, 0},
+};
+
+/* ======================================================================
+   VARIABLES: Runtime supervisor
+   ====================================================================== */
+// Once boot has finished each peripheral is checked and re-initialised on its own if it stops working, the boot steps
+// double as the recovery so filters are reapplied the same way
+const unsigned long watchdogTimeoutMs = 4000;      // Twice the slowest blocking call, an MQTT connect attempt
+const unsigned long canBusSilenceTimeoutMs = 1000; // Both buses carry frames every few ms while the ignition is on
+
+bool superviseCanBmw() { return isCanBusAlive(CAN_BUS_BMW, canBusSilenceTimeoutMs); }
+bool superviseCanNissan() { return isCanBusAlive(CAN_BUS_NISSAN, canBusSilenceTimeoutMs); }
+
+enum supervisedPeripheralIndex {
+  SUPERVISED_CAN_BMW,
+  SUPERVISED_CAN_NISSAN,
+  SUPERVISED_ETHERNET,
+  SUPERVISED_COUNT
+};
+
+// name, liveness check, re-initialise, retry interval ms
+supervisedPeripheral supervisedPeripheralTable[SUPERVISED_COUNT] = {
+    {"BMW CAN shield", superviseCanBmw, bootStepCanBmw, 1000},
+    {"Nissan CAN shield", superviseCanNissan, bootStepCanNissan, 1000},
+    {"Ethernet shield", isEthernetLinkUp, bootStepEthernet, 5000},
+};
+
+/* ======================================================================
+   VARIABLES: MQTT telemetry published by exception
+   ====================================================================== */
+// Values kept outside the signal store, the performance times are held in ms and published in seconds
+float telemetrySourceFuelRate() { return getFuelRateLitresPerHour(); }
+float telemetrySourceFuelUsed() { return getFuelUsedLitres(); }
+float telemetrySourceBestZeroToFifty() { return getBestZeroToFifty() / 1000; }
+float telemetrySourceBestZeroToOneHundred() { return getBestZeroToOneHundred() / 1000; }
+float telemetrySourceBestEightyToOneTwenty() { return getBestEightyToOneTwenty() / 1000; }
+
+// Each metric goes out when it moves by more than its deadband, no faster than the minimum interval, and is repeated
+// at the heartbeat so Grafana can tell a steady value from a dead link. Deadbands sit around the gauge resolution.
+// Windowed metrics publish the min, max and mean of every sample since the last publish instead of the latest one
+// topic, signal, source, decimals, absolute deadband, relative deadband, min interval, heartbeat, legacy ms, windowed
+telemetryPolicy telemetryPolicyTable[] = {
+    {"rpm", SIGNAL_RPM, NULL, 0, 25, 0, 50, 5000, 100, true},
+    {"speed", SIGNAL_VEHICLE_SPEED_FRONT, NULL, 0, 0.5, 0, 50, 5000, 100},
+    {"gear", SIGNAL_GEAR, NULL, 0, 0, 0, 50, 5000, 100},
+    {"diffSpeedSplit", SIGNAL_VEHICLE_SPEED_REAR_VARIATION, NULL, 0, 0.5, 0, 50, 5000, 100},
+    {"oilPressure", SIGNAL_OIL_PRESSURE, NULL, 2, 0.5, 0, 50, 5000, 100, true},
+    {"crankCaseVacuum", SIGNAL_CRANK_CASE_VACUUM, NULL, 2, 0.05, 0, 50, 5000, 100},
+    {"steeringAngle", SIGNAL_STEERING_ANGLE, NULL, 2, 1, 0, 50, 5000, 100},
+    {"brakePressure", SIGNAL_BRAKE_PRESSURE, NULL, 2, 0.5, 0, 50, 5000, 100},
+    {"lateralAccel", SIGNAL_LATERAL_ACCELERATION, NULL, 2, 0.1, 0, 50, 5000, 100},
+    {"dscIntervention", SIGNAL_DSC_TORQUE_INTERVENTION, NULL, 2, 1, 0, 50, 5000, 100},
+    // {"gasPedalPercent", SIGNAL_GAS_PEDAL_POSITION, NULL, 0, 1, 0, 50, 5000, 100},
+    // {"afRatioBank1", SIGNAL_AF_RATIO_BANK1, NULL, 2, 0.1, 0, 50, 5000, 100},
+    // {"afRatioBank2", SIGNAL_AF_RATIO_BANK2, NULL, 2, 0.1, 0, 50, 5000, 100},
+    // {"alphaPercentageBank1", SIGNAL_ALPHA_PERCENTAGE_BANK1, NULL, 0, 1, 0, 50, 5000, 100},
+    // {"alphaPercentageBank2", SIGNAL_ALPHA_PERCENTAGE_BANK2, NULL, 0, 1, 0, 50, 5000, 100},
+    {"fuelPressure", SIGNAL_FUEL_PRESSURE, NULL, 2, 0.5, 0, 200, 10000, 1000},
+    {"coolant", SIGNAL_ENGINE_TEMP, NULL, 0, 0.5, 0, 200, 10000, 1000},
+    {"ecm", SIGNAL_ENGINE_ELECTRONICS_TEMP, NULL, 0, 0.5, 0, 200, 10000, 1000},
+    {"fan", SIGNAL_FAN_DUTY, NULL, 0, 1, 0, 200, 10000, 1000},
+    {"oilTempSensor", SIGNAL_OIL_TEMP_SENSOR, NULL, 0, 0.5, 0, 200, 10000, 1000},
+    {"radiatorTemp", SIGNAL_RADIATOR_OUTLET_TEMP, NULL, 0, 0.5, 0, 200, 10000, 1000},
+    {"fuelRate", SIGNAL_COUNT, telemetrySourceFuelRate, 2, 0.1, 0.02, 200, 10000, 1000},
+    {"fuelUsed", SIGNAL_COUNT, telemetrySourceFuelUsed, 3, 0.01, 0, 1000, 10000, 1000},
+    {"0to50", SIGNAL_COUNT, telemetrySourceBestZeroToFifty, 2, 0, 0, 1000, 30000, 1000},
+    {"0to100", SIGNAL_COUNT, telemetrySourceBestZeroToOneHundred, 2, 0, 0, 1000, 30000, 1000},
+    {"80to120", SIGNAL_COUNT, telemetrySourceBestEightyToOneTwenty, 2, 0, 0, 1000, 30000, 1000},
+    // {"oilTempEcm", SIGNAL_OIL_TEMP_ECM, NULL, 0, 0.5, 0, 200, 10000, 1000},
+    // {"airIntakeTemp", SIGNAL_AIR_INTAKE_TEMP, NULL, 0, 0.5, 0, 200, 10000, 1000},
+    // {"batteryVoltage", SIGNAL_BATTERY_VOLTAGE, NULL, 2, 0.1, 0, 200, 10000, 1000},
+};
+const int telemetryPolicyCount = sizeof(telemetryPolicyTable) / sizeof(telemetryPolicyTable[0]);
+
 /* ======================================================================
    OBJECTS: Pretty tiny scheduler objects / tasks
    ====================================================================== */
 // High frequency tasks
-ptScheduler ptCanWriteMisc = ptScheduler(PT_TIME_10MS);
-ptScheduler ptCanWriteRpm = ptScheduler(PT_TIME_10MS);
-ptScheduler ptCanWriteSpeed = ptScheduler(PT_TIME_20MS);
-ptScheduler ptCanWriteTemp = ptScheduler(PT_TIME_10MS);
 ptScheduler ptCanRequestAirFuelRatioBank1 = ptScheduler(PT_TIME_50MS);
 ptScheduler ptCanRequestAirFuelRatioBank2 = ptScheduler(PT_TIME_50MS);
 ptScheduler ptCanRequestAlphaPercentageBank1 = ptScheduler(PT_TIME_50MS);
 ptScheduler ptCanRequestAlphaPercentageBank2 = ptScheduler(PT_TIME_50MS);
+ptScheduler ptGaugeReadValueOilPressure = ptScheduler(PT_TIME_10MS); // Short dips are caught by the telemetry window
+ptScheduler ptServiceTelemetry = ptScheduler(PT_TIME_20MS);
 
 // Medium frequency tasks
-ptScheduler ptAreWeInAlarmState = ptScheduler(PT_TIME_500MS);
 ptScheduler ptCalculateRpm = ptScheduler(PT_TIME_200MS);
 ptScheduler ptCanRequestGasPedalPercentage = ptScheduler(PT_TIME_100MS);
+ptScheduler ptCanRequestInjectorDuration = ptScheduler(PT_TIME_100MS);
 ptScheduler ptGaugeReadValueCrankCaseVacuum = ptScheduler(PT_TIME_100MS);
-ptScheduler ptGaugeReadValueOilPressure = ptScheduler(PT_TIME_100MS);
-ptScheduler ptPublishMqttData100Ms = ptScheduler(PT_TIME_100MS);
 ptScheduler ptGetCurrentClutchNeutralAndGear = ptScheduler(PT_TIME_100MS);
+ptScheduler ptSampleCanBusHealth = ptScheduler(PT_TIME_100MS);
+ptScheduler ptSetRadiatorFanOutput = ptScheduler(PT_TIME_200MS);
+ptScheduler ptSuperviseHardware = ptScheduler(PT_TIME_100MS);
 
 // Low frequency tasks
 ptScheduler ptCanRequestBatteryVoltage = ptScheduler(PT_TIME_1S);
@@ -161,12 +383,16 @@ ptScheduler ptCanWriteDiagnosticKeepalive = ptScheduler(PT_TIME_1S);
 ptScheduler ptGaugeReadValueFuelPressure = ptScheduler(PT_TIME_1S);
 ptScheduler ptCanRequestEcmAirIntakeTemp = ptScheduler(PT_TIME_1S);
 ptScheduler ptLogNissanCanQueryData = ptScheduler(PT_TIME_1S);
+ptScheduler ptLogBmwCanData = ptScheduler(PT_TIME_1S);
 ptScheduler ptReportArduinoLoopStats = ptScheduler(PT_TIME_5S);
-ptScheduler ptGaugeReadValueRadiatorOutletTemp = ptScheduler(PT_TIME_5S);
+ptScheduler ptReportCanSniffSummary = ptScheduler(PT_TIME_5S);
+ptScheduler ptGaugeReadValueRadiatorOutletTemp = ptScheduler(PT_TIME_1S);
 ptScheduler ptGaugeReadValueOilTemp = ptScheduler(PT_TIME_5S);
 ptScheduler ptPublishMqttData1S = ptScheduler(PT_TIME_1S);
+ptScheduler ptReportCanBusHealth = ptScheduler(PT_TIME_1S);
+ptScheduler ptReportSupervisor = ptScheduler(PT_TIME_5S);
+ptScheduler ptReportMemory = ptScheduler(PT_TIME_5S);
 ptScheduler ptReadEngineElectronicsTemp = ptScheduler(PT_TIME_5S);
-ptScheduler ptSetRadiatorFanOutput = ptScheduler(PT_TIME_5S);
 ptScheduler ptCanRequestFaults = ptScheduler(PT_TIME_5S);
 ptScheduler ptConnectToMqttBroker = ptScheduler(PT_TIME_5S);
 
@@ -174,63 +400,46 @@ ptScheduler ptConnectToMqttBroker = ptScheduler(PT_TIME_5S);
    SETUP
    ====================================================================== */
 void setup() {
+  // Fill the unused stack with a known pattern first so the deepest point it reaches can be found later
+  paintStack();
+
   Serial.begin(115200);
-  while (!Serial) {
-  };
+
+  // Start with the clutch in and neutral selected until the switches are read, and the check engine light on so it
+  // illuminates as soon as possible when powered on
+  writeSignal(SIGNAL_CLUTCH_PRESSED, true);
+  writeSignal(SIGNAL_IN_NEUTRAL, true);
+  writeSignal(SIGNAL_CHECK_ENGINE_LIGHT, 2);
+
+  // Load calibration and network settings from data flash before anything uses them
+  loadConfig();
+
+  // Work out why we reset and count it in the reset log kept after the configuration
+  recordResetCause();
 
   // Initialise the multiplexer analogue input board input pin
   setupMux();
 
-  // Initialise ethernet shield
-  initialiseEthernetShield();
-
-  // Set the current 0psi voltage of the crank case vacuum sensor if engine is off so that any variation in atmospheric pressure is taken into account
-  if (currentRpm == 0) {
-    float totalVoltage = 0.0;
-    for (int i = 0; i < 10; i++) {
-      int sensorValue = analogRead(gaugeCrankCaseVacuumMuxChannel);
-      float voltage = sensorValue * (5.0 / 1023.0);
-      totalVoltage += voltage;
-      delay(20);
-    }
-    atmospheric_voltage = totalVoltage / 10.0;
-    Serial.print("INFO: Initialised crank case vacuum sensor at ");
-    Serial.print(atmospheric_voltage);
-    Serial.println(" V");
-  }
-
-  // Configure CAN shield interfaces
-  Serial.println("INFO - Initialising BMW CAN shield");
-
-  for (int i = 0; i < setupRetriesMax; i++) {
-    bool result = CAN_BMW.begin(CAN_500KBPS);
-    if (result == CAN_OK) {
-      Serial.println("\tOK - BMW CAN shield initialised");
-      break;
-    } else if (result != CAN_OK) {
-      Serial.println("\tERROR - BMW CAN shield init failed, retrying ...");
-      delay(500);
-    }
-    if (i == setupRetriesMax) {
-      Serial.println("\tFATAL - BMW CAN shield init failed");
-    }
-  }
+  // Plan the masks and filters for both shields so they can be applied as soon as each shield comes up
+  planCanBusFilters();
 
-  Serial.println("INFO - Initialising Nissan CAN shield");
+  // Give each CAN shield one attempt here, the first pass runs the BMW task and the second the Nissan one
+  serialConsole.println("INFO - Initialising CAN shields");
+  serviceBootTasks(bootTaskTable, BOOT_TASK_CAN_NISSAN + 1);
+  serviceBootTasks(bootTaskTable, BOOT_TASK_CAN_NISSAN + 1);
 
-  for (int i = 0; i < setupRetriesMax; i++) {
-    bool result = CAN_NISSAN.begin(CAN_500KBPS);
-    if (result == CAN_OK) {
-      Serial.println("\tOK - Nissan CAN shield initialised");
-      break;
-    } else if (result != CAN_OK) {
-      Serial.println("\tERROR - Nissan CAN shield init failed, retrying ...");
-      delay(500);
-    }
-    if (i == setupRetriesMax) {
-      Serial.println("\tFATAL - Nissan CAN shield init failed");
-    }
-  }
+  // Monitor error registers and traffic on both shields
+  initialiseCanBusHealth(CAN_BUS_BMW, SPI_SS_PIN_BMW, &canTxQueueBmw);
+  initialiseCanBusHealth(CAN_BUS_NISSAN, SPI_SS_PIN_NISSAN, &canTxQueueNissan);
+
+  // Load the gateway translation tables and enable the speed frame for the ECM in use
+  initialiseGateway(gatewayFrameTable, GATEWAY_FRAME_COUNT, gatewayRuleTable, gatewayRuleCount, &canTxQueueBmw,
+                    &canTxQueueNissan);
+  setGatewayFrameEnabled(GATEWAY_FRAME_ECM_SPEED_370Z, speedFrameLayout == NISSAN_SPEED_LAYOUT_370Z);
+  setGatewayFrameEnabled(GATEWAY_FRAME_ECM_SPEED_SKYLINE, speedFrameLayout == NISSAN_SPEED_LAYOUT_SKYLINE);
+
+  // Only the signals a windowed metric reads keep a min, max and mean in the store
+  initialiseTelemetry(telemetryPolicyTable, telemetryPolicyCount);
 
   // Configure interrupt for RPM signal input
   pinMode(rpmSignalPin, INPUT_PULLUP);
@@ -239,274 +448,372 @@ void setup() {
   // Configure pins for output to fan controller, clutch swith and neutral switch
   pinMode(fanDriverPwmSignalPin, OUTPUT);
 
-  // Configure the temperature sensor located in the ECU compartment
-  Serial.println("INFO - Initialising MCP9808 temperature sensor");
-
-  for (int i = 0; i < setupRetriesMax; i++) {
-    bool result = tempSensorEngineElectronics.begin(0x18);
-    if (result == 1) {
-      Serial.println("\tOK - MCP9808 temperature sensor initialised");
-      tempSensorEngineElectronics.setResolution(3);
-      break;
-    } else if (result != 1) {
-      Serial.println("\tERROR - MCP9808 temperature sensor init failed, retrying ...");
-      delay(500);
-    }
-    if (i == setupRetriesMax) {
-      Serial.print("\tFATAL - MCP9808 temperature sensor not found, returned status ");
-      Serial.println(result);
-    }
-  }
-
-  /*
-  Configure masks and filters for shields to reduce noise. There are two masks in the mcp2515 which both need to be
-  set. Mask 0 has 2 filters and mask 1 has 4 so we set them all as needed.
-  0x551 is where coolant temperature is located and 0x7E8 is for results of queried CAN parameters.
-  */
-  CAN_NISSAN.init_Mask(0, 0, 0xFFF);
-  CAN_NISSAN.init_Filt(0, 0, 0x551);
-  CAN_NISSAN.init_Filt(1, 0, 0x7E8);
-
-  CAN_NISSAN.init_Mask(1, 0, 0xFFF);
-  CAN_NISSAN.init_Filt(2, 0, 0x551);
-  CAN_NISSAN.init_Filt(3, 0, 0x7E8);
-  CAN_NISSAN.init_Filt(4, 0, 0x551);
-  CAN_NISSAN.init_Filt(5, 0, 0x7E8);
-
-  // 0x1F0 is where the individual wheel speeds are
-  // https://www.bimmerforums.com/forum/showthread.php?1887229-E46-Can-bus-project
-  CAN_BMW.init_Mask(0, 0, 0xFFF);
-  CAN_BMW.init_Filt(0, 0, 0x1F0);
-  CAN_BMW.init_Filt(1, 0, 0x1F0);
-
-  CAN_BMW.init_Mask(1, 0, 0xFFF);
-  CAN_BMW.init_Filt(2, 0, 0x1F0);
-  CAN_BMW.init_Filt(3, 0, 0x1F0);
-  CAN_BMW.init_Filt(4, 0, 0x1F0);
-  CAN_BMW.init_Filt(5, 0, 0x1F0);
-
-  // Perform short beep to ensure its working on startup
+  // Perform short beep to ensure its working on startup, tone stops itself so there is no need to wait for it
   tone(alarmBuzzerPin, 4000, 1500);
-  delay(1500);
+
+  // From here on the loop has to keep refreshing the watchdog
+  initialiseWatchdog(watchdogTimeoutMs);
 }
 
 /* ======================================================================
    MAIN LOOP
    ====================================================================== */
 void loop() {
+  // Bring up the remaining hardware one step at a time once the cluster is fed (or its budget has gone) and report how
+  // long boot took once it has all settled
+  if (!bootTasksReported && (bootClusterLiveMillis != 0 || millis() >= bootClusterBudgetMs)) {
+    serviceBootTasks(bootTaskTable, BOOT_TASK_COUNT);
+    if (areBootTasksComplete(bootTaskTable, BOOT_TASK_COUNT)) {
+      reportBootTasks(bootTaskTable, BOOT_TASK_COUNT);
+      bootTasksReported = true;
+    }
+  }
+
+  setMemorySubsystem(MEMORY_SUBSYSTEM_MQTT);
+  // Receive any MQTT commands and apply staged config changes before anything in this loop reads the config
+  serviceMqttClient();
+  if (applyPendingConfigCommand()) {
+    publishMqttReply(commandReplyTopic, getConfigCommandReply());
+  }
+
   // Wait until we are sure the ECM is online and publishing data before we call to setup for queried data`
-  if (ecmQuerySetupPerformed == false && currentEngineTempCelsius != 0) {
-    initialiseEcmForQueries(CAN_NISSAN);
-    ecmQuerySetupPerformed = true;
+  if (ecmQuerySetupPerformed == false && readSignal(SIGNAL_ENGINE_TEMP) != 0) {
+    ecmQuerySetupPerformed = serviceEcmQueryInitialisation(&canTxQueueNissan);
   }
 
+  setMemorySubsystem(MEMORY_SUBSYSTEM_OTHER);
   // Get the clutch, neutral status and determine the current gear from speed and rpm
   if (ptGetCurrentClutchNeutralAndGear.call()) {
-    clutchPressed = getClutchStatus(clutchSwitchMuxChannel);
-    inNeutral = getNeutralStatus(neutralSwitchMuxChannel);
-    currentGear = getCurrentGear(&currentRpm, &currentVehicleSpeedRear, &clutchPressed, &inNeutral);
+    writeSignal(SIGNAL_CLUTCH_PRESSED, getClutchStatus(clutchSwitchMuxChannel));
+    writeSignal(SIGNAL_IN_NEUTRAL, getNeutralStatus(neutralSwitchMuxChannel));
+    writeSignal(SIGNAL_GEAR, getCurrentGear(readSignal(SIGNAL_RPM), readSignal(SIGNAL_VEHICLE_SPEED_REAR),
+                                            readSignal(SIGNAL_CLUTCH_PRESSED), readSignal(SIGNAL_IN_NEUTRAL)));
   }
 
   // Execute main tasks based on defined timers
   if (ptCalculateRpm.call()) {
     detachInterrupt(digitalPinToInterrupt(rpmSignalPin));
-    currentRpm = calculateRpm();
+    writeSignal(SIGNAL_RPM, calculateRpm());
     attachInterrupt(digitalPinToInterrupt(rpmSignalPin), updateRpmPulse, RISING);
     // Change frequency of rpm calculation depending on RPM to avoid high error at low pulse counts
-    if (currentRpm >= 1500 && ptCalculateRpm.sequenceList[0] != PT_TIME_50MS) {
+    if (readSignal(SIGNAL_RPM) >= 1500 && ptCalculateRpm.sequenceList[0] != PT_TIME_50MS) {
       ptCalculateRpm.sequenceList[0] = PT_TIME_50MS;
-    } else if (currentRpm < 1500 && ptCalculateRpm.sequenceList[0] != PT_TIME_200MS) {
+    } else if (readSignal(SIGNAL_RPM) < 1500 && ptCalculateRpm.sequenceList[0] != PT_TIME_200MS) {
       ptCalculateRpm.sequenceList[0] = PT_TIME_200MS;
     }
   }
 
-  if (ptCanWriteRpm.call()) {
-    canWriteRpm(currentRpm, CAN_BMW);
-  }
-
-  if (ptCanWriteTemp.call()) {
-    canWriteTemp(currentEngineTempCelsius, CAN_BMW);
-  }
-
-  if (ptCanWriteSpeed.call()) {
-    canWriteSpeed(currentVehicleSpeedRear, CAN_NISSAN);
-  }
-
-  if (ptCanWriteMisc.call()) {
-    canWriteMisc();
-  }
-
   if (ptCanWriteDiagnosticKeepalive.call()) {
-    canWriteDiagnosticKeepalive(CAN_NISSAN);
+    canWriteDiagnosticKeepalive(&canTxQueueNissan);
   }
 
   if (ptSetRadiatorFanOutput.call()) {
-    currentFanDutyPercentage = setRadiatorFanOutput(currentEngineTempCelsius, currentRpm, fanDriverPwmSignalPin);
+    int fanDutyPercentage =
+        setRadiatorFanOutput(readSignal(SIGNAL_ENGINE_TEMP), readSignal(SIGNAL_RADIATOR_OUTLET_TEMP),
+                             readSignal(SIGNAL_VEHICLE_SPEED_REAR), readSignal(SIGNAL_AIR_INTAKE_TEMP),
+                             readSignal(SIGNAL_RPM), fanDriverPwmSignalPin);
+    writeSignal(SIGNAL_FAN_DUTY, fanDutyPercentage);
   }
 
-  if (ptReadEngineElectronicsTemp.call()) {
-    currentEngineElectronicsTemp = readEngineElectronicsTemp(tempSensorEngineElectronics);
+  if (ptReadEngineElectronicsTemp.call() && bootTaskTable[BOOT_TASK_TEMP_SENSOR].done) {
+    writeSignal(SIGNAL_ENGINE_ELECTRONICS_TEMP, readEngineElectronicsTemp(tempSensorEngineElectronics));
   }
 
-  if (ptConnectToMqttBroker.call()) {
+  if (ptConnectToMqttBroker.call() && bootTaskTable[BOOT_TASK_ETHERNET].done) {
     connectMqttClientToBroker();
   }
 
+  setMemorySubsystem(MEMORY_SUBSYSTEM_CAN);
   // Request CAN data based on defined timers
-  if (ptCanRequestFaults.call() && pollEcmCanFaults == true) {
-    requestEcmDataFaults(CAN_NISSAN);
+  if (ptCanRequestFaults.call() && pollEcmCanFaults == true && ecmQuerySetupPerformed == true) {
+    requestEcmFaults(&canTxQueueNissan);
+  }
+
+  if (ptCanRequestInjectorDuration.call() && pollEcmCanInjectorDuration == true && ecmQuerySetupPerformed == true) {
+    requestEcmDataInjectorDurationBank1(&canTxQueueNissan);
+    requestEcmDataInjectorDurationBank2(&canTxQueueNissan);
   }
 
   if (ptCanRequestOilTemp.call() && pollEcmCanMetrics == true) {
-    requestEcmDataOilTemp(CAN_NISSAN);
+    requestEcmDataOilTemp(&canTxQueueNissan);
   }
 
   if (ptCanRequestBatteryVoltage.call() && pollEcmCanMetrics == true) {
-    requestEcmDataBatteryVoltage(CAN_NISSAN);
+    requestEcmDataBatteryVoltage(&canTxQueueNissan);
   }
 
   if (ptCanRequestGasPedalPercentage.call() && pollEcmCanMetrics == true) {
-    requestEcmDataGasPedalPercentage(CAN_NISSAN);
+    requestEcmDataGasPedalPercentage(&canTxQueueNissan);
   }
 
   if (ptCanRequestAirFuelRatioBank1.call() && pollEcmCanMetrics == true) {
-    requestEcmDataAfRatioBank1(CAN_NISSAN);
+    requestEcmDataAfRatioBank1(&canTxQueueNissan);
   }
 
   if (ptCanRequestAirFuelRatioBank2.call() && pollEcmCanMetrics == true) {
-    requestEcmDataAfRatioBank2(CAN_NISSAN);
+    requestEcmDataAfRatioBank2(&canTxQueueNissan);
   }
 
   if (ptCanRequestAirFuelRatioBank1.call() && pollEcmCanMetrics == true) {
-    requestEcmDataAlphaPercentageBank1(CAN_NISSAN);
+    requestEcmDataAlphaPercentageBank1(&canTxQueueNissan);
   }
 
   if (ptCanRequestAirFuelRatioBank2.call() && pollEcmCanMetrics == true) {
-    requestEcmDataAlphaPercentageBank2(CAN_NISSAN);
+    requestEcmDataAlphaPercentageBank2(&canTxQueueNissan);
   }
 
-  if (ptCanRequestEcmAirIntakeTemp.call() && pollEcmCanMetrics == true) {
-    requestEcmDataAirIntakeTemp(CAN_NISSAN);
+  if (ptCanRequestEcmAirIntakeTemp.call() &&
+      (pollEcmCanMetrics == true || (pollEcmCanAirIntakeTemp == true && ecmQuerySetupPerformed == true))) {
+    requestEcmDataAirIntakeTemp(&canTxQueueNissan);
   }
 
+  setMemorySubsystem(MEMORY_SUBSYSTEM_OTHER);
   // Request physical sensor values based on defined timers
   if (ptGaugeReadValueOilPressure.call()) {
-    currentOilPressurePsi = gaugeReadPressurePsi(gaugeOilPressureMuxChannel);
+    writeSignal(SIGNAL_OIL_PRESSURE, gaugeReadPressurePsi(gaugeOilPressureMuxChannel));
+    updateAlarmSignal(ALARM_SIGNAL_OIL_PRESSURE, readSignal(SIGNAL_OIL_PRESSURE), readSignal(SIGNAL_RPM));
   }
 
   if (ptGaugeReadValueFuelPressure.call()) {
-    currentFuelPressurePsi = gaugeReadPressurePsi(gaugeFuelPressureMuxChannel);
+    writeSignal(SIGNAL_FUEL_PRESSURE, gaugeReadPressurePsi(gaugeFuelPressureMuxChannel));
+    updateAlarmSignal(ALARM_SIGNAL_FUEL_PRESSURE, readSignal(SIGNAL_FUEL_PRESSURE), readSignal(SIGNAL_RPM));
   }
 
   if (ptGaugeReadValueRadiatorOutletTemp.call()) {
-    currentRadiatorOutletTemp = gaugeReadTemperatureCelcius(gaugeRadiatorOutletTempMuxChannel);
+    writeSignal(SIGNAL_RADIATOR_OUTLET_TEMP, gaugeReadTemperatureCelcius(gaugeRadiatorOutletTempMuxChannel));
   }
 
   if (ptGaugeReadValueOilTemp.call()) {
-    currentOilTempSensor = gaugeReadTemperatureCelcius(gaugeOilTemperatureMuxChannel);
+    writeSignal(SIGNAL_OIL_TEMP_SENSOR, gaugeReadTemperatureCelcius(gaugeOilTemperatureMuxChannel));
   }
 
   if (ptGaugeReadValueCrankCaseVacuum.call()) {
-    currentCrankCaseVacuumPsi = gaugeReadVacuumPsi(gaugeCrankCaseVacuumMuxChannel, atmospheric_voltage);
+    writeSignal(SIGNAL_CRANK_CASE_VACUUM, gaugeReadVacuumPsi(gaugeCrankCaseVacuumMuxChannel, atmospheric_voltage));
+    updateAlarmSignal(ALARM_SIGNAL_CRANK_CASE_VACUUM, readSignal(SIGNAL_CRANK_CASE_VACUUM), readSignal(SIGNAL_RPM));
+  }
+
+  setMemorySubsystem(MEMORY_SUBSYSTEM_CAN);
+  // Load any waiting frames into free hardware transmit buffers on both shields
+  serviceCanTxQueue(&canTxQueueBmw);
+  serviceCanTxQueue(&canTxQueueNissan);
+
+  setMemorySubsystem(MEMORY_SUBSYSTEM_MQTT);
+  // Publish data for Grafana Live consumption over MQTT, scalar metrics by exception and the summaries on a timer
+  if (ptServiceTelemetry.call()) {
+    serviceTelemetry(telemetryPolicyTable, telemetryPolicyCount);
   }
 
-  // Publish data for Grafana Live consumption via defined timers and over MQTT
-  if (ptPublishMqttData100Ms.call()) {
-    publishMqttMetric("rpm", "value", currentRpm);
-    publishMqttMetric("speed", "value", currentVehicleSpeedFront);
-    publishMqttMetric("gear", "value", currentGear);
-    publishMqttMetric("diffSpeedSplit", "value", currentVehicleSpeedRearVariation);
-    publishMqttMetric("oilPressure", "value", String(currentOilPressurePsi));
-    publishMqttMetric("crankCaseVacuum", "value", String(currentCrankCaseVacuumPsi));
-    // publishMqttMetric("gasPedalPercent", "value", currentGasPedalPosition);
-    // publishMqttMetric("afRatioBank1", "value", String(currentAfRatioBank1));
-    // publishMqttMetric("afRatioBank2", "value", String(currentAfRatioBank2));
-    // publishMqttMetric("alphaPercentageBank1", "value", currentAlphaPercentageBank1);
-    // publishMqttMetric("alphaPercentageBank2", "value", currentAlphaPercentageBank2);
+  // Optionally send the whole signal store as UDP datagrams for tools/udp_telemetry_bridge.py to republish
+  if (bootTaskTable[BOOT_TASK_ETHERNET].done) {
+    serviceUdpTelemetry(telemetryPolicyTable, telemetryPolicyCount);
   }
 
   if (ptPublishMqttData1S.call()) {
-    publishMqttMetric("fuelPressure", "value", String(currentFuelPressurePsi));
-    publishMqttMetric("coolant", "value", currentEngineTempCelsius);
-    publishMqttMetric("ecm", "value", currentEngineElectronicsTemp);
-    publishMqttMetric("fan", "value", currentFanDutyPercentage);
-    publishMqttMetric("oilTempSensor", "value", currentOilTempSensor);
-    publishMqttMetric("radiatorTemp", "value", currentRadiatorOutletTemp);
-    publishMqttMetric("0to50", "value", String(getBestZeroToFifty() / 1000));
-    publishMqttMetric("0to100", "value", String(getBestZeroToOneHundred() / 1000));
-    publishMqttMetric("80to120", "value", String(getBestEightyToOneTwenty() / 1000));
-    // publishMqttMetric("oilTempEcm", "value", currentOilTempEcm);
-    // publishMqttMetric("airIntakeTemp", "value", currentAirIntakeTemp);
-    // publishMqttMetric("batteryVoltage", "value", String(currentBatteryVoltage));
-  }
-
-  // Set or unset audible alarm state if conditions are met
-  if (ptAreWeInAlarmState.call()) {
-    if (currentOilTempEcm > alarmOilTempCelcius || currentEngineTempCelsius > alarmEngineTempCelcius ||
-        currentOilPressurePsi < alarmOilPressurePsi || currentCrankCaseVacuumPsi < alarmCrankCaseVacuumPsi ||
-        currentFuelPressurePsi < alarmFuelPressureLowPsi || currentFuelPressurePsi > alarmFuelPressureHighPsi) {
-      alarmEnable(alarmBuzzerPin, currentRpm);
-    } else {
-      alarmDisable(alarmBuzzerPin);
+    publishMqttText("alarms", "active", getActiveAlarmList());
+    publishMqttPayload("traction", getTractionWindowSummary());
+  }
+
+  setMemorySubsystem(MEMORY_SUBSYSTEM_CAN);
+  // Handle LAWICEL / sniff commands on serial, opening or restoring the filters if the mode changed. Leaving sniff
+  // mode captures the IDs seen on each bus, so the filters are planned again from that capture
+  if (processCanSniffSerialCommands()) {
+    if (!isCanSniffActive()) {
+      planCanBusFilters();
+    }
+    configureCanFilters(CAN_BUS_BMW);
+    configureCanFilters(CAN_BUS_NISSAN);
+  }
+
+  // Stream raw frames to slcan clients over ethernet, a bus's filters are opened while its channel is open
+  if (bootTaskTable[BOOT_TASK_ETHERNET].done) {
+    if (serviceCanStream(CAN_BUS_BMW)) {
+      configureCanFilters(CAN_BUS_BMW);
     }
+    if (serviceCanStream(CAN_BUS_NISSAN)) {
+      configureCanFilters(CAN_BUS_NISSAN);
+    }
+  }
+
+  if (ptReportCanSniffSummary.call()) {
+    reportCanSniffSummary(true);
+  }
+  serviceCanSniffSummary();
+
+  // Sample CAN error registers and report bus load and health for both networks
+  if (ptSampleCanBusHealth.call()) {
+    sampleCanBusHealth(CAN_BUS_BMW);
+    sampleCanBusHealth(CAN_BUS_NISSAN);
+  }
+
+  if (ptReportCanBusHealth.call()) {
+    publishMqttPayload("canHealthBmw", reportCanBusHealth(CAN_BUS_BMW, "BMW", reportCanBusHealthStats));
+    publishMqttPayload("canHealthNissan", reportCanBusHealth(CAN_BUS_NISSAN, "Nissan", reportCanBusHealthStats));
   }
 
-  // Fetch the latest values from Nissan CAN
-  nissanCanValues currentNissanCanValues = readNissanDataFromCan(CAN_NISSAN);
+  // Re-initialise any shield that has wedged or gone bus off, the boot tasks look after them until boot has finished
+  if (ptSuperviseHardware.call() && bootTasksReported) {
+    serviceSupervisor(supervisedPeripheralTable, SUPERVISED_COUNT);
+  }
+
+  if (ptReportSupervisor.call()) {
+    publishMqttPayload("supervisor", reportSupervisor(supervisedPeripheralTable, SUPERVISED_COUNT));
+  }
+
+  setMemorySubsystem(MEMORY_SUBSYSTEM_ALARMS);
+  // Raise any debounced alarms, drive the buzzer and publish the active alarm list straight away when it changes
+  serviceAlarms(alarmBuzzerPin, readSignal(SIGNAL_RPM));
+
+  if (hasActiveAlarmListChanged()) {
+    publishMqttText("alarms", "active", getActiveAlarmList());
+  }
+
+  setMemorySubsystem(MEMORY_SUBSYSTEM_CAN);
+  // Decode the latest frames from both buses straight into the signal store
+  readNissanDataFromCan(CAN_NISSAN, &canTxQueueNissan);
+  readBmwDataFromCan(CAN_BMW);
 
-  // Fetch the latest values from BMW CAN
-  bmwCanValues currentBmwCanValues = readBmwDataFromCan(CAN_BMW);
+  // Integrate fuel used from injector pulse width for the cluster economy and trip computer
+  // Bank 2 is queried straight after bank 1 so its timestamp says when the pair was last refreshed
+  updateFuelConsumption(readSignal(SIGNAL_RPM), readSignal(SIGNAL_INJECTOR_DURATION_BANK1),
+                        readSignal(SIGNAL_INJECTOR_DURATION_BANK2), getSignalTimestamp(SIGNAL_INJECTOR_DURATION_BANK2),
+                        micros());
 
-  // Pull the values we are interested in from the Nissan CAN response
-  currentEngineTempCelsius = currentNissanCanValues.engineTempCelsius;
-  currentOilTempEcm = currentNissanCanValues.oilTempCelcius;
-  currentBatteryVoltage = currentNissanCanValues.batteryVoltage;
-  currentGasPedalPosition = currentNissanCanValues.gasPedalPercentage;
-  currentAfRatioBank1 = currentNissanCanValues.airFuelRatioBank1;
-  currentAfRatioBank2 = currentNissanCanValues.airFuelRatioBank2;
-  currentAlphaPercentageBank1 = currentNissanCanValues.alphaPercentageBank1;
-  currentAlphaPercentageBank2 = currentNissanCanValues.alphaPercentageBank2;
-  currentCheckEngineLightState = currentNissanCanValues.checkEngineLightState;
-  currentAirIntakeTemp = currentNissanCanValues.airIntakeTemp;
+  // Publish new and cleared fault codes only when the ECM fault list changes
+  if (hasEcmFaultListChanged()) {
+    publishMqttText("ecmFaults", "new", getNewEcmFaultList());
+    publishMqttText("ecmFaults", "cleared", getClearedEcmFaultList());
+    publishMqttText("ecmFaults", "active", getEcmFaultList());
+  }
+
+  // Evaluate alarms against the CAN sourced values once for each new 0x551 frame or oil temperature response, so the
+  // debounce runs on the ECM's refresh rate rather than the loop's
+  if (hasSignalChangedSince(SIGNAL_ENGINE_TEMP, lastEngineTempAlarmSequence)) {
+    lastEngineTempAlarmSequence = getSignalSequence(SIGNAL_ENGINE_TEMP);
+    updateAlarmSignal(ALARM_SIGNAL_ENGINE_TEMP, readSignal(SIGNAL_ENGINE_TEMP), readSignal(SIGNAL_RPM));
+  }
+  if (hasSignalChangedSince(SIGNAL_OIL_TEMP_ECM, lastOilTempAlarmSequence)) {
+    lastOilTempAlarmSequence = getSignalSequence(SIGNAL_OIL_TEMP_ECM);
+    updateAlarmSignal(ALARM_SIGNAL_OIL_TEMP_ECM, readSignal(SIGNAL_OIL_TEMP_ECM), readSignal(SIGNAL_RPM));
+  }
 
   if (ptLogNissanCanQueryData.call() && 1 == 2) {
-    Serial.print("Engine temp: ");
-    Serial.println(currentEngineTempCelsius);
-    Serial.print("Oil temp: ");
-    Serial.println(currentOilTempEcm);
-    Serial.print("Battery voltage: ");
-    Serial.println(currentBatteryVoltage);
-    Serial.print("Pedal position: ");
-    Serial.println(currentGasPedalPosition);
-    Serial.print("AFR Bank 1: ");
-    Serial.println(currentAfRatioBank1);
-    Serial.print("AFR Bank 2: ");
-    Serial.println(currentAfRatioBank2);
-    Serial.print("Alpha Percentage Bank 1: ");
-    Serial.println(currentAlphaPercentageBank1);
-    Serial.print("Alpha Percentage Bank 2: ");
-    Serial.println(currentAlphaPercentageBank2);
-    Serial.print("Check light status: ");
-    Serial.println(currentCheckEngineLightState);
-    Serial.print("Air intake temp: ");
-    Serial.println(currentAirIntakeTemp);
-  }
-
-  // Pull the values were are interested in from the BMW CAN response
-  currentVehicleSpeedFront = currentBmwCanValues.vehicleSpeedFront;
-  currentVehicleSpeedRear = currentBmwCanValues.vehicleSpeedRear;
-  currentVehicleSpeedRearVariation = currentBmwCanValues.vehicleSpeedRearVariation;
-  currentVehicleSpeedTimestamp = currentBmwCanValues.timestamp;
+    serialConsole.print("Engine temp: ");
+    serialConsole.println(readSignal(SIGNAL_ENGINE_TEMP));
+    serialConsole.print("Oil temp: ");
+    serialConsole.println(readSignal(SIGNAL_OIL_TEMP_ECM));
+    serialConsole.print("Battery voltage: ");
+    serialConsole.println(readSignal(SIGNAL_BATTERY_VOLTAGE));
+    serialConsole.print("Pedal position: ");
+    serialConsole.println(readSignal(SIGNAL_GAS_PEDAL_POSITION));
+    serialConsole.print("AFR Bank 1: ");
+    serialConsole.println(readSignal(SIGNAL_AF_RATIO_BANK1));
+    serialConsole.print("AFR Bank 2: ");
+    serialConsole.println(readSignal(SIGNAL_AF_RATIO_BANK2));
+    serialConsole.print("Alpha Percentage Bank 1: ");
+    serialConsole.println(readSignal(SIGNAL_ALPHA_PERCENTAGE_BANK1));
+    serialConsole.print("Alpha Percentage Bank 2: ");
+    serialConsole.println(readSignal(SIGNAL_ALPHA_PERCENTAGE_BANK2));
+    serialConsole.print("Check light status: ");
+    serialConsole.println(readSignal(SIGNAL_CHECK_ENGINE_LIGHT));
+    serialConsole.print("Air intake temp: ");
+    serialConsole.println(readSignal(SIGNAL_AIR_INTAKE_TEMP));
+  }
+
+  if (ptLogBmwCanData.call() && logBmwCanData) {
+    serialConsole.print("DSC request active: ");
+    serialConsole.println(readSignal(SIGNAL_DSC_REQUEST_ACTIVE));
+    serialConsole.print("DSC torque intervention %: ");
+    serialConsole.println(readSignal(SIGNAL_DSC_TORQUE_INTERVENTION));
+    serialConsole.print("Brake light switch: ");
+    serialConsole.println(readSignal(SIGNAL_BRAKE_LIGHT_SWITCH));
+    serialConsole.print("Brake pressure bar: ");
+    serialConsole.println(readSignal(SIGNAL_BRAKE_PRESSURE));
+    serialConsole.print("Steering angle: ");
+    serialConsole.println(readSignal(SIGNAL_STEERING_ANGLE));
+    serialConsole.print("Lateral acceleration m/s2: ");
+    serialConsole.println(readSignal(SIGNAL_LATERAL_ACCELERATION));
+  }
+
+  // Translate the latest values onto the other bus in a single pass over the gateway rule table, frames go out as
+  // soon as their payload changes, otherwise at their refresh floor
+  serviceGateway();
+
+  // Push the first cluster frames straight to the shield rather than waiting a loop and record how long that took
+  if (bootClusterLiveMillis == 0 && gatewayFrameTable[GATEWAY_FRAME_CLUSTER_RPM].output.everSent &&
+      gatewayFrameTable[GATEWAY_FRAME_CLUSTER_TEMP].output.everSent) {
+    serviceCanTxQueue(&canTxQueueBmw);
+    bootClusterLiveMillis = millis();
+    serialConsole.print("INFO - Cluster frames live ");
+    serialConsole.print(bootClusterLiveMillis);
+    serialConsole.println(" ms after power on");
+    if (bootClusterLiveMillis > bootClusterBudgetMs) {
+      serialConsole.print("\tWARNING - Over the ");
+      serialConsole.print(bootClusterBudgetMs);
+      serialConsole.println(" ms boot budget");
+    }
+  }
+
+  setMemorySubsystem(MEMORY_SUBSYSTEM_ANALYTICS);
+  // Offer a new wheel speed sample to the shield straight away and run the traction analytics once per frame
+  if (hasSignalChangedSince(SIGNAL_WHEEL_SPEED_RAW_FL, lastWheelSpeedSequence)) {
+    lastWheelSpeedSequence = getSignalSequence(SIGNAL_WHEEL_SPEED_RAW_FL);
+
+    serviceCanTxQueue(&canTxQueueNissan);
+    recordGatewayLatency(micros() - getWheelSpeedFrameMicros());
+
+    unsigned long wheelSpeedTimestamp = getSignalTimestamp(SIGNAL_WHEEL_SPEED_RAW_FL);
+    updateTractionAnalytics(readSignal(SIGNAL_WHEEL_SPEED_RAW_FL), readSignal(SIGNAL_WHEEL_SPEED_RAW_FR),
+                            readSignal(SIGNAL_WHEEL_SPEED_RAW_RL), readSignal(SIGNAL_WHEEL_SPEED_RAW_RR),
+                            wheelSpeedTimestamp);
+
+    updateLaunchWheelSpeed(getTractionValue(TRACTION_SLIP_REAR), readSignal(SIGNAL_VEHICLE_SPEED_FRONT),
+                           wheelSpeedTimestamp, alarmBuzzerPin);
+  }
+
+  // Poll the clutch every loop while staged so the launch is timed from the actual release, not the 100ms gear task
+  if (getLaunchState() == LAUNCH_STAGED) {
+    writeSignal(SIGNAL_CLUTCH_PRESSED, getClutchStatus(clutchSwitchMuxChannel));
+  }
+  updateLaunchClutch(readSignal(SIGNAL_CLUTCH_PRESSED), readSignal(SIGNAL_VEHICLE_SPEED_FRONT), readSignal(SIGNAL_RPM),
+                     millis());
+
+  if (isLaunchSummaryReady()) {
+    publishMqttPayload("launch", getLaunchSummary());
+  }
+
+  if (isLaunchSlipProfileReady()) {
+    publishMqttPayload("launchSlipProfile", getLaunchSlipProfile());
+  }
 
   // Pass the current speed and timestamp values into functions for performance metrics
-  captureAccellerationTimes(currentVehicleSpeedTimestamp, currentVehicleSpeedFront);
-  // captureAccellerationDetailedData(currentVehicleSpeedTimestamp, currentVehicleSpeed);
+  captureAccellerationTimes(getSignalTimestamp(SIGNAL_VEHICLE_SPEED_FRONT), readSignal(SIGNAL_VEHICLE_SPEED_FRONT));
+  // captureAccellerationDetailedData(getSignalTimestamp(SIGNAL_VEHICLE_SPEED_FRONT),
+  //                                  readSignal(SIGNAL_VEHICLE_SPEED_FRONT));
+
+  setMemorySubsystem(MEMORY_SUBSYSTEM_OTHER);
+  if (ptReportMemory.call()) {
+    publishMqttPayload("memory", reportMemoryUsage(reportMemoryUsageStats));
+  }
 
   // Increment loop counter if needed so we can report on stats (806 Hz for Mega and 4550 Hz for Uno R4)
   if (millis() > 10000 && reportArduinoLoopStats) {
     arduinoLoopExecutionCount++;
     if (ptReportArduinoLoopStats.call()) {
       reportArduinoLoopRate(&arduinoLoopExecutionCount);
+      reportCanOutputStats();
+      reportGatewayStats();
+      reportCanTxQueueStats(&canTxQueueBmw, "BMW");
+      reportCanTxQueueStats(&canTxQueueNissan, "Nissan");
+      reportTelemetryStats(telemetryPolicyTable, telemetryPolicyCount);
+      reportUdpTelemetryStats();
+      reportCanStreamStats();
+      reportLogStats();
     }
   }
+
+  // Write out buffered log lines with whatever room the UART has, never waiting on it
+  serviceLog();
+
+  // Only a loop that gets all the way round keeps the watchdog from resetting us
+  refreshWatchdog();
 }
@@ -0,0 +1,11 @@
+#ifndef STUB_ADAFRUIT_MCP9808_H
+#define STUB_ADAFRUIT_MCP9808_H
+
+class Adafruit_MCP9808 {
+public:
+  bool begin(unsigned char) { return true; }
+  float readTempC() { return 35.0; }
+  void setResolution(unsigned char) {}
+};
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef STUB_ARDUINO_H
+#define STUB_ARDUINO_H
+
+// Just enough of the Arduino core for the firmware modules to build and run on a host for the native tests. Time only
+// moves when a test moves it, pins and the serial port are plain arrays a test can inspect.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <deque>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define RISING 3
+#define HEX 16
+#define DEC 10
+#define A0 14
+#define PI 3.14159265358979
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+template <class T> T constrain(T value, T low, T high) { return value < low ? low : (value > high ? high : value); }
+template <class T, class L> auto min(const T &a, const L &b) -> decltype(a < b ? a : b) { return (b < a) ? b : a; }
+template <class T, class L> auto max(const T &a, const L &b) -> decltype(a < b ? a : b) { return (a < b) ? b : a; }
+
+/*****************************************************
+ *
+ * Time, moved on by the test
+ *
+ ****************************************************/
+inline unsigned long stubMicros = 0;
+
+inline unsigned long micros() { return stubMicros; }
+inline unsigned long millis() { return stubMicros / 1000; }
+inline void stubAdvanceMicros(unsigned long us) { stubMicros += us; }
+inline void stubAdvanceMillis(unsigned long ms) { stubMicros += ms * 1000; }
+inline void delay(unsigned long ms) { stubAdvanceMillis(ms); }
+inline void delayMicroseconds(unsigned int us) { stubAdvanceMicros(us); }
+
+/*****************************************************
+ *
+ * Pins
+ *
+ ****************************************************/
+const int stubPinCount = 32;
+inline int stubPinMode[stubPinCount];
+inline int stubDigitalValue[stubPinCount];
+inline int stubAnalogWriteValue[stubPinCount];
+inline int stubAnalogReadValue[stubPinCount];
+inline unsigned int stubToneFrequency[stubPinCount]; // 0 while silent
+inline unsigned long stubToneCount[stubPinCount];
+inline unsigned long stubNoToneCount[stubPinCount];
+
+inline void pinMode(uint8_t pin, uint8_t mode) { stubPinMode[pin % stubPinCount] = mode; }
+inline void digitalWrite(uint8_t pin, uint8_t value) { stubDigitalValue[pin % stubPinCount] = value; }
+inline int digitalRead(uint8_t pin) { return stubDigitalValue[pin % stubPinCount]; }
+inline void analogWrite(uint8_t pin, int value) { stubAnalogWriteValue[pin % stubPinCount] = value; }
+inline int analogRead(uint8_t pin) { return stubAnalogReadValue[pin % stubPinCount]; }
+
+inline void tone(uint8_t pin, unsigned int frequency, unsigned long duration = 0) {
+  stubToneFrequency[pin % stubPinCount] = frequency;
+  stubToneCount[pin % stubPinCount]++;
+}
+
+inline void noTone(uint8_t pin) {
+  stubToneFrequency[pin % stubPinCount] = 0;
+  stubNoToneCount[pin % stubPinCount]++;
+}
+
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterrupt(int, void (*)(), int) {}
+inline void detachInterrupt(int) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+/*****************************************************
+ *
+ * String, backed by std::string so it still allocates from the heap like the real one
+ *
+ ****************************************************/
+class String {
+public:
+  String() {}
+  String(const char *text) : text(text != NULL ? text : "") {}
+  String(char c) : text(1, c) {}
+  String(int value, unsigned char base = 10) : text(format(value, base)) {}
+  String(unsigned int value, unsigned char base = 10) : text(format(value, base)) {}
+  String(long value, unsigned char base = 10) : text(format(value, base)) {}
+  String(unsigned long value, unsigned char base = 10) : text(format(value, base)) {}
+  String(unsigned char value, unsigned char base = 10) : text(format(value, base)) {}
+  String(float value, unsigned char decimals = 2) : text(formatFloat(value, decimals)) {}
+  String(double value, unsigned char decimals = 2) : text(formatFloat(value, decimals)) {}
+
+  const char *c_str() const { return text.c_str(); }
+  unsigned int length() const { return text.size(); }
+  bool operator==(const String &other) const { return text == other.text; }
+  bool operator==(const char *other) const { return text == other; }
+  String &operator+=(const String &other) {
+    text += other.text;
+    return *this;
+  }
+  friend String operator+(const String &a, const String &b) { return String(a) += b; }
+  friend String operator+(const String &a, const char *b) { return String(a) += String(b); }
+  friend String operator+(const char *a, const String &b) { return String(a) += b; }
+
+private:
+  std::string text;
+
+  static std::string format(long long value, unsigned char base) {
+    char buffer[72];
+    if (base == 16) {
+      snprintf(buffer, sizeof(buffer), "%llX", value);
+    } else {
+      snprintf(buffer, sizeof(buffer), "%lld", value);
+    }
+    return buffer;
+  }
+
+  static std::string formatFloat(double value, unsigned char decimals) {
+    char buffer[72];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    return buffer;
+  }
+};
+
+/*****************************************************
+ *
+ * Print and the serial port, everything written is kept in output for the test to look at
+ *
+ ****************************************************/
+class Print {
+public:
+  std::string output;
+  int writeRoom = 1 << 20; // What availableForWrite reports, lower it to model a full UART or socket
+
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t c) {
+    output += (char)c;
+    return 1;
+  }
+
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    output.append((const char *)buffer, size);
+    return size;
+  }
+
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+  virtual int availableForWrite() { return writeRoom; }
+
+  size_t print(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+  size_t print(char *text) { return print((const char *)text); }
+  size_t print(const String &text) { return print(text.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(float value, int decimals = 2) { return print(String(value, (unsigned char)decimals)); }
+  size_t print(double value, int decimals = 2) { return print(String(value, (unsigned char)decimals)); }
+  size_t print(int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(unsigned int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(unsigned long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(unsigned char value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+
+  size_t println() { return print("\r\n"); }
+  template <class T> size_t println(T value) { return print(value) + println(); }
+  template <class T> size_t println(T value, int format) { return print(value, format) + println(); }
+};
+
+// Transmits at the begin() baud rate from a buffer the size of the R4 core's. A write that does not fit waits for room
+// as the core does, so time spent printing shows up in millis(). Before begin() writes take no time
+class HardwareSerial : public Print {
+public:
+  std::deque<char> input;
+  unsigned long baud = 0;
+  int txBufferSize = 512;
+
+  void begin(unsigned long rate) {
+    baud = rate;
+    txQueued = 0;
+    txQueuedMicros = micros();
+  }
+
+  using Print::write;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+
+  size_t write(const uint8_t *buffer, size_t size) override {
+    drainTx();
+    if (baud != 0) {
+      txQueued += size;
+      if (txQueued > txBufferSize) {
+        stubAdvanceMicros((unsigned long)((txQueued - txBufferSize) * 10 * 1000000 / baud));
+        txQueued = txBufferSize;
+        txQueuedMicros = micros();
+      }
+    }
+    return Print::write(buffer, size);
+  }
+
+  int availableForWrite() override {
+    drainTx();
+    return baud != 0 ? min(writeRoom, txBufferSize - (int)txQueued) : writeRoom;
+  }
+
+  operator bool() { return true; }
+  int available() { return input.size(); }
+
+  int read() {
+    if (input.empty()) {
+      return -1;
+    }
+    char c = input.front();
+    input.pop_front();
+    return (uint8_t)c;
+  }
+
+  void stubReceive(const char *text) { input.insert(input.end(), text, text + strlen(text)); }
+
+private:
+  double txQueued = 0; // Bytes still to go out on the wire
+  unsigned long txQueuedMicros = 0;
+
+  void drainTx() {
+    if (baud != 0) {
+      txQueued = max(0.0, txQueued - (micros() - txQueuedMicros) * (baud / 10.0) / 1000000);
+      txQueuedMicros = micros();
+    }
+  }
+};
+
+inline HardwareSerial Serial;
+
+#endif
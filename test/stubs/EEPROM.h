@@ -0,0 +1,21 @@
+#ifndef STUB_EEPROM_H
+#define STUB_EEPROM_H
+
+// Fake data flash, erased flash reads as 0xFF
+
+#include <Arduino.h>
+
+class EEPROMClass {
+public:
+  EEPROMClass() { memset(bytes, 0xFF, sizeof(bytes)); }
+  uint8_t read(int address) { return bytes[address]; }
+  void write(int address, uint8_t value) { bytes[address] = value; }
+  void update(int address, uint8_t value) { bytes[address] = value; }
+  uint16_t length() { return sizeof(bytes); }
+
+  uint8_t bytes[8192];
+};
+
+inline EEPROMClass EEPROM;
+
+#endif
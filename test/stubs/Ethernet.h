@@ -0,0 +1,143 @@
+#ifndef STUB_ETHERNET_H
+#define STUB_ETHERNET_H
+
+// Fake W5500 Ethernet library. A TCP connection is a pair of byte queues shared between the EthernetClient the
+// firmware holds and the test, which opens connections to a listening port with stubEthernetConnect.
+
+#include <Arduino.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+enum EthernetHardwareStatus { EthernetNoHardware, EthernetW5100, EthernetW5200, EthernetW5500 };
+enum EthernetLinkStatus { Unknown, LinkON, LinkOFF };
+
+class IPAddress {
+public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+  IPAddress(const uint8_t *address) { memcpy(bytes, address, 4); }
+  uint8_t operator[](int index) const { return bytes[index]; }
+
+private:
+  uint8_t bytes[4] = {0, 0, 0, 0};
+};
+
+struct stubTcpConnection {
+  std::deque<char> toDevice;  // Written by the test, read by the firmware
+  std::string fromDevice;     // Written by the firmware, read by the test
+  bool open = true;
+  int room = 2048;            // Free space in the W5500 transmit buffer
+
+  void send(const char *text) { toDevice.insert(toDevice.end(), text, text + strlen(text)); }
+};
+
+struct stubEthernetState {
+  EthernetHardwareStatus hardware = EthernetW5500;
+  EthernetLinkStatus link = LinkON;
+  unsigned long beginCount = 0;
+  std::map<uint16_t, std::vector<std::shared_ptr<stubTcpConnection>>> pending; // Waiting for accept, by port
+  bool outgoingReachable = true; // A client connect reaches its host, otherwise it waits out its timeout
+};
+
+inline stubEthernetState stubEthernet;
+
+class EthernetClass {
+public:
+  void init(uint8_t) {}
+  void begin(uint8_t *, IPAddress) { stubEthernet.beginCount++; }
+  EthernetHardwareStatus hardwareStatus() { return stubEthernet.hardware; }
+  EthernetLinkStatus linkStatus() { return stubEthernet.link; }
+};
+
+inline EthernetClass Ethernet;
+
+class EthernetClient : public Print {
+public:
+  EthernetClient() {}
+  EthernetClient(std::shared_ptr<stubTcpConnection> connection) : connection(connection) {}
+
+  // The real library blocks for the connection timeout when nothing answers, 1 s unless it has been changed
+  int connect(IPAddress, uint16_t) {
+    if (!stubEthernet.outgoingReachable || stubEthernet.link != LinkON) {
+      stubAdvanceMillis(connectionTimeoutMs);
+      connection.reset();
+      return 0;
+    }
+    connection = std::make_shared<stubTcpConnection>();
+    return 1;
+  }
+
+  void setConnectionTimeout(uint16_t timeoutMs) { connectionTimeoutMs = timeoutMs; }
+  uint16_t getConnectionTimeout() const { return connectionTimeoutMs; }
+
+  int connected() { return connection != nullptr && connection->open; }
+  operator bool() { return connection != nullptr; }
+
+  void stop() {
+    if (connection != nullptr) {
+      connection->open = false;
+    }
+    connection.reset();
+  }
+
+  int available() { return connection != nullptr ? connection->toDevice.size() : 0; }
+
+  int read() {
+    if (connection == nullptr || connection->toDevice.empty()) {
+      return -1;
+    }
+    char c = connection->toDevice.front();
+    connection->toDevice.pop_front();
+    return (uint8_t)c;
+  }
+
+  using Print::write;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+
+  size_t write(const uint8_t *buffer, size_t size) override {
+    if (connection == nullptr || !connection->open) {
+      return 0;
+    }
+    connection->fromDevice.append((const char *)buffer, size);
+    return size;
+  }
+
+  int availableForWrite() override { return connection != nullptr ? connection->room : 0; }
+
+private:
+  std::shared_ptr<stubTcpConnection> connection;
+  uint16_t connectionTimeoutMs = 1000;
+};
+
+class EthernetServer {
+public:
+  EthernetServer(uint16_t port) : port(port) {}
+  void begin() { listening = true; }
+
+  EthernetClient accept() {
+    std::vector<std::shared_ptr<stubTcpConnection>> &waiting = stubEthernet.pending[port];
+    if (!listening || waiting.empty()) {
+      return EthernetClient();
+    }
+    std::shared_ptr<stubTcpConnection> connection = waiting.front();
+    waiting.erase(waiting.begin());
+    return EthernetClient(connection);
+  }
+
+  EthernetClient available() { return accept(); }
+
+private:
+  uint16_t port;
+  bool listening = false;
+};
+
+// Open a connection to a port the firmware listens on, it is handed over on the next accept
+inline std::shared_ptr<stubTcpConnection> stubEthernetConnect(uint16_t port) {
+  std::shared_ptr<stubTcpConnection> connection = std::make_shared<stubTcpConnection>();
+  stubEthernet.pending[port].push_back(connection);
+  return connection;
+}
+
+#endif
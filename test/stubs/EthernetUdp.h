@@ -0,0 +1,45 @@
+#ifndef STUB_ETHERNET_UDP_H
+#define STUB_ETHERNET_UDP_H
+
+// Fake EthernetUDP, every datagram sent is kept in stubUdpSent for the test to decode
+
+#include <Ethernet.h>
+
+#include <string>
+#include <vector>
+
+inline std::vector<std::string> stubUdpSent;
+
+class EthernetUDP : public Print {
+public:
+  uint8_t begin(uint16_t) {
+    open = true;
+    return 1;
+  }
+
+  void stop() { open = false; }
+
+  int beginPacket(IPAddress, uint16_t) {
+    packet.clear();
+    return open && stubEthernet.link == LinkON;
+  }
+
+  using Print::write;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+
+  size_t write(const uint8_t *buffer, size_t size) override {
+    packet.append((const char *)buffer, size);
+    return size;
+  }
+
+  int endPacket() {
+    stubUdpSent.push_back(packet);
+    return 1;
+  }
+
+private:
+  bool open = false;
+  std::string packet;
+};
+
+#endif
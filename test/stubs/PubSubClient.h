@@ -0,0 +1,121 @@
+#ifndef STUB_PUBSUBCLIENT_H
+#define STUB_PUBSUBCLIENT_H
+
+// Fake PubSubClient standing in for the broker as well. Published messages are kept in stubMqtt.published and
+// messages queued with stubMqttDeliver reach the callback from loop(), the way the real client hands them over.
+
+#include <Ethernet.h>
+
+#include <string>
+#include <vector>
+
+#define MQTT_SOCKET_TIMEOUT 15
+#define MQTT_CALLBACK_SIGNATURE void (*callback)(char *, uint8_t *, unsigned int)
+
+struct stubMqttMessage {
+  std::string topic;
+  std::string payload;
+  unsigned long micros;
+};
+
+struct stubMqttBroker {
+  bool responds = true; // Accepts the TCP connection and answers CONNECT, otherwise the client waits out its timeout
+  unsigned long connectCount = 0;
+  std::vector<stubMqttMessage> published;
+  std::vector<std::string> subscriptions;
+  std::vector<stubMqttMessage> incoming;
+};
+
+inline stubMqttBroker stubMqtt;
+
+inline void stubMqttDeliver(const char *topic, const char *payload) {
+  stubMqtt.incoming.push_back({topic, payload, micros()});
+}
+
+class PubSubClient {
+public:
+  PubSubClient(EthernetClient &client) : client(&client) {}
+
+  PubSubClient &setServer(IPAddress ip, uint16_t port) {
+    serverIp = ip;
+    serverPort = port;
+    return *this;
+  }
+  PubSubClient &setKeepAlive(uint16_t seconds) {
+    keepAliveSeconds = seconds;
+    return *this;
+  }
+  PubSubClient &setSocketTimeout(uint16_t seconds) {
+    socketTimeoutSeconds = seconds;
+    return *this;
+  }
+  PubSubClient &setBufferSize(uint16_t) { return *this; }
+  PubSubClient &setCallback(MQTT_CALLBACK_SIGNATURE) {
+    this->callback = callback;
+    return *this;
+  }
+
+  // Blocks for the socket timeout waiting on CONNACK when the broker has stopped answering
+  bool connect(const char *) {
+    stubMqtt.connectCount++;
+    if (!client->connect(serverIp, serverPort)) {
+      isConnected = false;
+      return false;
+    }
+    if (!stubMqtt.responds) {
+      stubAdvanceMillis(socketTimeoutSeconds * 1000UL);
+      client->stop();
+      isConnected = false;
+      return false;
+    }
+    isConnected = true;
+    return true;
+  }
+
+  bool connected() { return isConnected && client->connected(); }
+
+  bool publish(const char *topic, const char *payload) {
+    if (!connected()) {
+      return false;
+    }
+    stubMqtt.published.push_back({topic, payload, micros()});
+    return true;
+  }
+
+  bool subscribe(const char *topic) {
+    stubMqtt.subscriptions.push_back(topic);
+    return connected();
+  }
+
+  // A broker that stops answering is noticed here once the keep alive runs out
+  bool loop() {
+    if (!connected() || !stubMqtt.responds) {
+      isConnected = false;
+      client->stop();
+      return false;
+    }
+    std::vector<stubMqttMessage> messages;
+    messages.swap(stubMqtt.incoming);
+    for (stubMqttMessage &message : messages) {
+      std::string topic = message.topic;
+      std::string payload = message.payload;
+      if (callback != NULL) {
+        callback(&topic[0], (uint8_t *)&payload[0], payload.size());
+      }
+    }
+    return true;
+  }
+
+  uint16_t getSocketTimeout() const { return socketTimeoutSeconds; }
+
+private:
+  EthernetClient *client;
+  IPAddress serverIp;
+  uint16_t serverPort = 1883;
+  uint16_t keepAliveSeconds = 15;
+  uint16_t socketTimeoutSeconds = MQTT_SOCKET_TIMEOUT;
+  bool isConnected = false;
+  MQTT_CALLBACK_SIGNATURE = NULL;
+};
+
+#endif
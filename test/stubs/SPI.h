@@ -0,0 +1,75 @@
+#ifndef STUB_SPI_H
+#define STUB_SPI_H
+
+// Fake SPI bus that answers MCP2515 READ, WRITE and BIT MODIFY instructions from the register file of whichever
+// stubMcp2515 chip has its chip select held low
+
+#include <Arduino.h>
+#include <mcp2515_can.h>
+
+#define MSBFIRST 1
+#define SPI_MODE0 0
+
+class SPISettings {
+public:
+  SPISettings(unsigned long, int, int) {}
+};
+
+class SPIClass {
+public:
+  void beginTransaction(SPISettings) { position = 0; }
+  void endTransaction() {}
+
+  uint8_t transfer(uint8_t data) {
+    int pin = selectedPin();
+    if (pin < 0) {
+      return 0xFF;
+    }
+
+    stubMcp2515Chip *chip = &stubMcp2515[pin];
+    int index = position++;
+    if (index == 0) {
+      instruction = data;
+      return 0;
+    }
+    if (index == 1) {
+      address = data & 0x7F;
+      return 0;
+    }
+
+    switch (instruction) {
+    case 0x03: // READ, sequential reads move on through the registers
+      return chip->registersFloating ? 0xFF : chip->registers[(address + index - 2) & 0x7F];
+    case 0x02: // WRITE
+      chip->registers[(address + index - 2) & 0x7F] = data;
+      return 0;
+    case 0x05: // BIT MODIFY, mask then data
+      if (index == 2) {
+        mask = data;
+      } else if (index == 3) {
+        chip->registers[address] = (chip->registers[address] & ~mask) | (data & mask);
+      }
+      return 0;
+    }
+    return 0;
+  }
+
+private:
+  int position = 0;
+  uint8_t instruction = 0;
+  uint8_t address = 0;
+  uint8_t mask = 0;
+
+  static int selectedPin() {
+    for (int pin = 0; pin < stubPinCount; pin++) {
+      if (stubMcp2515[pin].beginCount > 0 && stubDigitalValue[pin] == LOW) {
+        return pin;
+      }
+    }
+    return -1;
+  }
+};
+
+inline SPIClass SPI;
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef STUB_WDT_H
+#define STUB_WDT_H
+
+// Fake watchdog, a test checks no gap between refreshes is longer than the timeout
+
+#include <Arduino.h>
+
+class WDTimer {
+public:
+  uint32_t timeoutMs = 0;
+  unsigned long refreshCount = 0;
+  unsigned long lastRefreshMillis = 0;
+  unsigned long longestGapMs = 0;
+
+  int begin(uint32_t timeout) {
+    timeoutMs = timeout;
+    lastRefreshMillis = millis();
+    return 1;
+  }
+
+  void refresh() {
+    unsigned long gap = millis() - lastRefreshMillis;
+    longestGapMs = gap > longestGapMs ? gap : longestGapMs;
+    lastRefreshMillis = millis();
+    refreshCount++;
+  }
+};
+
+inline WDTimer WDT;
+
+#endif
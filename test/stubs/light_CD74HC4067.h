@@ -0,0 +1,10 @@
+#ifndef STUB_LIGHT_CD74HC4067_H
+#define STUB_LIGHT_CD74HC4067_H
+
+class CD74HC4067 {
+public:
+  CD74HC4067(int, int, int, int) {}
+  void channel(int) {}
+};
+
+#endif
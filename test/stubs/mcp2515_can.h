@@ -0,0 +1,161 @@
+#ifndef STUB_MCP2515_CAN_H
+#define STUB_MCP2515_CAN_H
+
+// Fake Seeed MCP2515 driver. The firmware passes mcp2515_can around by value, so each object only carries its chip
+// select pin and the chip itself lives in stubMcp2515[pin] where a test can feed it frames and look at what was sent.
+
+#include <Arduino.h>
+
+#include <deque>
+#include <vector>
+
+#define CAN_OK 0
+#define CAN_FAILINIT 1
+#define CAN_FAILTX 6
+#define CAN_MSGAVAIL 3
+#define CAN_NOMSG 4
+#define CAN_CTRLERROR 5
+#define CAN_500KBPS 16
+#define MCP_16MHz 1
+#define MCP_N_TXBUFFERS 3
+
+struct stubCanFrame {
+  unsigned long id;
+  byte len;
+  byte data[8];
+  unsigned long micros; // When it was received or loaded for transmit
+  byte txBuffer;        // Hardware buffer a sent frame was loaded into
+};
+
+struct stubMcp2515Chip {
+  byte beginResult = CAN_OK;
+  unsigned long beginCount = 0;
+  bool initialised = false;
+
+  unsigned long masks[2] = {0, 0};
+  unsigned long filters[6] = {0, 0, 0, 0, 0, 0};
+  unsigned long maskWrites = 0;
+
+  std::deque<stubCanFrame> received; // Accepted by the filters, waiting to be read
+  unsigned long rejectedCount = 0;   // Offered but rejected by the filters
+
+  std::vector<stubCanFrame> sent;
+  bool holdTxBuffers = false;     // When set a loaded buffer stays busy until stubMcp2515CompleteTx
+  bool txBufferBusy[MCP_N_TXBUFFERS] = {false, false, false};
+  unsigned long trySendCount = 0;
+
+  byte registers[128] = {0}; // Read and written over SPI, TEC 0x1C, REC 0x1D, EFLG 0x2D, CANSTAT 0x0E, CANCTRL 0x0F
+  bool registersFloating = false; // Model a chip that has dropped off the bus, every read returns 0xFF
+
+  bool accepts(unsigned long id) const {
+    for (int i = 0; i < 6; i++) {
+      unsigned long mask = masks[i < 2 ? 0 : 1];
+      if ((id & mask) == (filters[i] & mask)) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+inline stubMcp2515Chip stubMcp2515[stubPinCount];
+
+// Put a frame on the bus as seen by the chip on this pin, returns true if its filters let it through
+inline bool stubMcp2515Receive(int pin, unsigned long id, byte len, const byte *data) {
+  stubMcp2515Chip *chip = &stubMcp2515[pin];
+  if (!chip->initialised || !chip->accepts(id)) {
+    chip->rejectedCount++;
+    return false;
+  }
+  stubCanFrame frame = {id, len, {0}, micros()};
+  memcpy(frame.data, data, len);
+  chip->received.push_back(frame);
+  return true;
+}
+
+inline void stubMcp2515CompleteTx(int pin) {
+  for (int i = 0; i < MCP_N_TXBUFFERS; i++) {
+    stubMcp2515[pin].txBufferBusy[i] = false;
+  }
+}
+
+class MCP_CAN {
+public:
+  MCP_CAN(byte csPin) : csPin(csPin) {}
+
+  byte readMsgBuf(byte *len, byte *buf) {
+    stubMcp2515Chip *chip = &stubMcp2515[csPin];
+    if (chip->received.empty()) {
+      return CAN_NOMSG;
+    }
+    stubCanFrame frame = chip->received.front();
+    chip->received.pop_front();
+    *len = frame.len;
+    memcpy(buf, frame.data, frame.len);
+    lastId = frame.id;
+    return CAN_OK;
+  }
+
+  unsigned long getCanId() { return lastId; }
+
+protected:
+  byte csPin;
+  unsigned long lastId = 0;
+};
+
+class mcp2515_can : public MCP_CAN {
+public:
+  mcp2515_can(byte csPin) : MCP_CAN(csPin) {}
+
+  byte begin(uint32_t, const byte = MCP_16MHz) {
+    stubMcp2515Chip *chip = &stubMcp2515[csPin];
+    chip->beginCount++;
+    pinMode(csPin, OUTPUT);
+    digitalWrite(csPin, HIGH);
+    if (chip->beginResult != CAN_OK) {
+      chip->initialised = false;
+      return chip->beginResult;
+    }
+    // The Seeed driver opens every mask and filter on init
+    memset(chip->masks, 0, sizeof(chip->masks));
+    memset(chip->filters, 0, sizeof(chip->filters));
+    chip->received.clear();
+    chip->initialised = true;
+    chip->registers[0x0E] = 0x00; // CANSTAT normal mode
+    chip->registers[0x0F] = 0x07; // CANCTRL as left by the driver
+    return CAN_OK;
+  }
+
+  byte init_Mask(byte num, byte, unsigned long ulData) {
+    stubMcp2515[csPin].masks[num % 2] = ulData;
+    stubMcp2515[csPin].maskWrites++;
+    return CAN_OK;
+  }
+
+  byte init_Filt(byte num, byte, unsigned long ulData) {
+    stubMcp2515[csPin].filters[num % 6] = ulData;
+    return CAN_OK;
+  }
+
+  byte checkReceive() { return stubMcp2515[csPin].received.empty() ? CAN_NOMSG : CAN_MSGAVAIL; }
+
+  byte trySendMsgBuf(unsigned long id, byte, byte, byte len, const byte *buf, byte iTxBuf = 0xff) {
+    stubMcp2515Chip *chip = &stubMcp2515[csPin];
+    chip->trySendCount++;
+    byte index = iTxBuf < MCP_N_TXBUFFERS ? iTxBuf : 0;
+    if (!chip->initialised || chip->txBufferBusy[index]) {
+      return CAN_FAILTX;
+    }
+    chip->txBufferBusy[index] = chip->holdTxBuffers;
+    stubCanFrame frame = {id, len, {0}, micros(), index};
+    memcpy(frame.data, buf, len);
+    chip->sent.push_back(frame);
+    return CAN_OK;
+  }
+
+  byte sendMsgBuf(unsigned long id, byte ext, byte rtrBit, byte len, const byte *buf, bool = true) {
+    return trySendMsgBuf(id, ext, rtrBit, len, buf);
+  }
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef STUB_PTSCHEDULER_H
+#define STUB_PTSCHEDULER_H
+
+// Periodic subset of ptScheduler, call() is true once per interval of the stub clock
+
+#include <Arduino.h>
+
+#define PT_TIME_1MS 1000UL
+#define PT_TIME_5MS 5000UL
+#define PT_TIME_10MS 10000UL
+#define PT_TIME_20MS 20000UL
+#define PT_TIME_50MS 50000UL
+#define PT_TIME_100MS 100000UL
+#define PT_TIME_200MS 200000UL
+#define PT_TIME_500MS 500000UL
+#define PT_TIME_1S 1000000UL
+#define PT_TIME_2S 2000000UL
+#define PT_TIME_5S 5000000UL
+#define PT_TIME_10S 10000000UL
+#define PT_TIME_1MIN 60000000UL
+
+class ptScheduler {
+public:
+  ptScheduler(unsigned long intervalMicros) : sequenceList(intervals) { intervals[0] = intervalMicros; }
+  ptScheduler(const ptScheduler &other) : sequenceList(intervals) { intervals[0] = other.intervals[0]; }
+
+  bool call() {
+    if (micros() - lastMicros < sequenceList[0]) {
+      return false;
+    }
+    lastMicros = micros();
+    return true;
+  }
+
+  unsigned long *sequenceList;
+
+private:
+  unsigned long intervals[1];
+  unsigned long lastMicros = 0;
+};
+
+#endif
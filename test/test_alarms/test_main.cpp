@@ -0,0 +1,142 @@
+// Alarm rules evaluated at the rate main.cpp samples each input, with serviceAlarms run every 1 ms loop
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "functions_alarms.h"
+#include "functions_config.h"
+
+const int buzzerPin = 5;                      // alarmBuzzerPin in main.cpp
+const unsigned int alarmTone = 4000;          // Frequency serviceAlarms sounds
+const unsigned long oilPressureSampleMs = 10; // ptGaugeReadValueOilPressure period
+const unsigned long engineTempFrameMs = 100;  // Coolant temperature frame from the ECM
+const unsigned long oilPressureDebounceMs = 300;
+const unsigned long engineTempDebounceMs = 1000;
+
+// One 1 ms loop, a new sample of the signal is offered every samplePeriodMs like the timers in main.cpp
+void runLoop(alarmSignal signal, float value, int rpm, unsigned long samplePeriodMs) {
+  stubAdvanceMillis(1);
+  if (millis() % samplePeriodMs == 0) {
+    updateAlarmSignal(signal, value, rpm);
+  }
+  serviceAlarms(buzzerPin, rpm);
+}
+
+// Run until the buzzer sounds or the time runs out, returns how long it took
+unsigned long msUntilBuzzer(alarmSignal signal, float value, int rpm, unsigned long samplePeriodMs,
+                            unsigned long limitMs) {
+  unsigned long start = millis();
+  while (stubToneFrequency[buzzerPin] != alarmTone && millis() - start < limitMs) {
+    runLoop(signal, value, rpm, samplePeriodMs);
+  }
+  return millis() - start;
+}
+
+void setUp() {
+  config = configData();
+
+  // Healthy values with the engine stopped clear every rule and silence the buzzer
+  updateAlarmSignal(ALARM_SIGNAL_OIL_PRESSURE, 60, 0);
+  updateAlarmSignal(ALARM_SIGNAL_ENGINE_TEMP, 90, 0);
+  serviceAlarms(buzzerPin, 0);
+  hasActiveAlarmListChanged();
+  TEST_ASSERT_FALSE(isAlarmActive());
+  TEST_ASSERT_EQUAL(0, stubToneFrequency[buzzerPin]);
+
+  // Start on a sample boundary so the first sample of a crossing lands a whole period later
+  while (millis() % 1000 != 0) {
+    stubAdvanceMillis(1);
+  }
+}
+
+void tearDown() {}
+
+// The old 500 ms timer plus a 1 s hold took up to 1.5 s, the rule sounds within its debounce and one sample
+void test_oil_pressure_loss_at_high_rpm_reaches_the_buzzer_within_its_debounce() {
+  for (int i = 0; i < 100; i++) {
+    runLoop(ALARM_SIGNAL_OIL_PRESSURE, 55, 6000, oilPressureSampleMs);
+  }
+
+  unsigned long reactionMs = msUntilBuzzer(ALARM_SIGNAL_OIL_PRESSURE, 20, 6000, oilPressureSampleMs, 2000);
+  char summary[64];
+  snprintf(summary, sizeof(summary), "oil pressure crossing to buzzer %lu ms", reactionMs);
+  TEST_MESSAGE(summary);
+
+  TEST_ASSERT_GREATER_OR_EQUAL_MESSAGE(oilPressureDebounceMs, reactionMs, summary);
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(oilPressureDebounceMs + oilPressureSampleMs + 1, reactionMs, summary);
+  TEST_ASSERT_TRUE(hasActiveAlarmListChanged());
+  TEST_ASSERT_EQUAL_STRING("oilPressure", getActiveAlarmList());
+}
+
+// Coolant comes from the ECM frame, and the fast beep pattern may start in its off phase
+void test_engine_temperature_reaches_the_buzzer_at_the_frame_rate() {
+  unsigned long reactionMs = msUntilBuzzer(ALARM_SIGNAL_ENGINE_TEMP, config.alarmEngineTemp + 2, 3000,
+                                           engineTempFrameMs, 3000);
+  char summary[64];
+  snprintf(summary, sizeof(summary), "engine temperature crossing to buzzer %lu ms", reactionMs);
+  TEST_MESSAGE(summary);
+
+  // Fast beep is on for the first 100 ms of every 200 ms
+  TEST_ASSERT_GREATER_OR_EQUAL_MESSAGE(engineTempDebounceMs, reactionMs, summary);
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(engineTempDebounceMs + engineTempFrameMs + 100, reactionMs, summary);
+  TEST_ASSERT_EQUAL_STRING("engineTemp", getActiveAlarmList());
+}
+
+// The same 15 psi is normal at idle and an alarm at the limiter
+void test_oil_pressure_threshold_follows_rpm() {
+  TEST_ASSERT_EQUAL(2000, msUntilBuzzer(ALARM_SIGNAL_OIL_PRESSURE, 15, 900, oilPressureSampleMs, 2000));
+  TEST_ASSERT_FALSE(isAlarmActive());
+
+  TEST_ASSERT_LESS_THAN(2000, msUntilBuzzer(ALARM_SIGNAL_OIL_PRESSURE, 15, 6000, oilPressureSampleMs, 2000));
+  TEST_ASSERT_TRUE(isAlarmActive());
+}
+
+// A dip shorter than the debounce never sounds, and recovering before it would have clears the timer
+void test_short_dip_is_debounced() {
+  for (int i = 0; i < 200; i++) {
+    runLoop(ALARM_SIGNAL_OIL_PRESSURE, 20, 6000, oilPressureSampleMs);
+  }
+  for (int i = 0; i < 50; i++) {
+    runLoop(ALARM_SIGNAL_OIL_PRESSURE, 55, 6000, oilPressureSampleMs);
+  }
+  for (int i = 0; i < 200; i++) {
+    runLoop(ALARM_SIGNAL_OIL_PRESSURE, 20, 6000, oilPressureSampleMs);
+  }
+  TEST_ASSERT_FALSE(isAlarmActive());
+  TEST_ASSERT_EQUAL(0, stubToneFrequency[buzzerPin]);
+}
+
+// The highest priority alarm chooses the pattern and clearing it hands the buzzer back to the next one
+void test_highest_priority_alarm_drives_the_buzzer() {
+  msUntilBuzzer(ALARM_SIGNAL_ENGINE_TEMP, config.alarmEngineTemp + 2, 6000, engineTempFrameMs, 3000);
+  for (int i = 0; i < 400; i++) {
+    runLoop(ALARM_SIGNAL_OIL_PRESSURE, 20, 6000, oilPressureSampleMs);
+  }
+  TEST_ASSERT_EQUAL_STRING("oilPressure,engineTemp", getActiveAlarmList());
+
+  // Continuous for oil pressure, so it never goes quiet through a full fast beep cycle
+  for (int i = 0; i < 200; i++) {
+    runLoop(ALARM_SIGNAL_OIL_PRESSURE, 20, 6000, oilPressureSampleMs);
+    TEST_ASSERT_EQUAL(alarmTone, stubToneFrequency[buzzerPin]);
+  }
+
+  // Back to the engine temperature fast beep once the pressure recovers
+  int silentLoops = 0;
+  for (int i = 0; i < 200; i++) {
+    runLoop(ALARM_SIGNAL_OIL_PRESSURE, 55, 6000, oilPressureSampleMs);
+    silentLoops += stubToneFrequency[buzzerPin] == 0;
+  }
+  TEST_ASSERT_EQUAL_STRING("engineTemp", getActiveAlarmList());
+  TEST_ASSERT_GREATER_OR_EQUAL(90, silentLoops);
+  TEST_ASSERT_LESS_OR_EQUAL(110, silentLoops);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_oil_pressure_loss_at_high_rpm_reaches_the_buzzer_within_its_debounce);
+  RUN_TEST(test_engine_temperature_reaches_the_buzzer_at_the_frame_rate);
+  RUN_TEST(test_oil_pressure_threshold_follows_rpm);
+  RUN_TEST(test_short_dip_is_debounced);
+  RUN_TEST(test_highest_priority_alarm_drives_the_buzzer);
+  return UNITY_END();
+}
@@ -0,0 +1,107 @@
+// E46 PT-CAN frame views, payloads worked out from the CAN matrix layouts in bmwCanFrameViews.h with the values they
+// decode to, then the same frames read off the BMW shield into the signal store
+
+#include <Arduino.h>
+#include <mcp2515_can.h>
+#include <unity.h>
+
+#include "bmwCanFrameViews.h"
+#include "functions_read.h"
+#include "functions_signals.h"
+
+const int bmwCsPin = 9; // SPI_SS_PIN_BMW in main.cpp
+
+// ASC request, ASC passive and the brake light switch set, MSR not. 64, 32 and 128 steps of 0.390625 %
+const unsigned char asc1Payload[8] = {0x15, 0x00, 0x00, 0x40, 0x20, 0x00, 0x80, 0x00};
+
+// -3.27 m/s2 as a signed 16 bit little endian count of 0.01 m/s2
+const unsigned char asc3Payload[8] = {0xB9, 0xFE, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+// 90 degrees (2000 steps) one way at 180 degrees/s (4000 steps) the other, the sign in the top bit of each high byte
+const unsigned char steeringPayload[8] = {0xD0, 0x07, 0xA0, 0x8F, 0x00, 0x00, 0x00, 0x00};
+
+// 85 bar in byte 2, the bytes either side belong to other fields and must not leak in
+const unsigned char brakePressurePayload[8] = {0xFF, 0xFF, 0x55, 0xFF, 0x00, 0x00, 0x00, 0x00};
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_asc1_status_and_torque_intervention() {
+  bmwAsc1FrameView asc1 = {asc1Payload};
+  TEST_ASSERT_TRUE(asc1.ascRequestActive());
+  TEST_ASSERT_FALSE(asc1.msrRequestActive());
+  TEST_ASSERT_TRUE(asc1.ascPassive());
+  TEST_ASSERT_TRUE(asc1.brakeLightSwitch());
+  TEST_ASSERT_EQUAL_FLOAT(25.0, asc1.torqueInterventionPercent());
+  TEST_ASSERT_EQUAL_FLOAT(12.5, asc1.msrTorqueInterventionPercent());
+  TEST_ASSERT_EQUAL_FLOAT(50.0, asc1.slowTorqueInterventionPercent());
+}
+
+void test_asc3_lateral_acceleration_is_signed() {
+  bmwAsc3FrameView asc3 = {asc3Payload};
+  TEST_ASSERT_FLOAT_WITHIN(0.001, -3.27, asc3.lateralAccelerationMs2());
+
+  const unsigned char oneG[8] = {0xD5, 0x03};
+  asc3.buf = oneG;
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 9.81, asc3.lateralAccelerationMs2());
+}
+
+// Sign and magnitude rather than two's complement, so 0x8FA0 is -4000 steps and not -28768
+void test_steering_angle_and_rate_are_sign_magnitude() {
+  bmwSteeringAngleFrameView steering = {steeringPayload};
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 90.0, steering.steeringAngleDegrees());
+  TEST_ASSERT_FLOAT_WITHIN(0.001, -180.0, steering.steeringRateDegreesPerSecond());
+
+  TEST_ASSERT_FLOAT_WITHIN(0.001, -45.0, bmwSteeringAngleFrameView::decodeSignMagnitude(0xE8, 0x83));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0.045, bmwSteeringAngleFrameView::decodeSignMagnitude(0x01, 0x00));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, -0.045, bmwSteeringAngleFrameView::decodeSignMagnitude(0x01, 0x80));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0x7FFF * 0.045, bmwSteeringAngleFrameView::decodeSignMagnitude(0xFF, 0x7F));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, -0x7FFF * 0.045, bmwSteeringAngleFrameView::decodeSignMagnitude(0xFF, 0xFF));
+
+  // Negative zero from the sign bit alone still reads as zero
+  TEST_ASSERT_EQUAL_FLOAT(0, bmwSteeringAngleFrameView::decodeSignMagnitude(0x00, 0x80));
+}
+
+void test_brake_pressure_is_byte_two() {
+  bmwBrakePressureFrameView brakePressure = {brakePressurePayload};
+  TEST_ASSERT_EQUAL_FLOAT(85, brakePressure.brakePressureBar());
+
+  const unsigned char released[8] = {0x12, 0x34, 0x00, 0x56};
+  brakePressure.buf = released;
+  TEST_ASSERT_EQUAL_FLOAT(0, brakePressure.brakePressureBar());
+}
+
+// The decoder in functions_read writes what the views return, one frame per call as the loop reads them
+void test_frames_read_off_the_shield_reach_the_signal_store() {
+  mcp2515_can can(bmwCsPin);
+  can.begin(CAN_500KBPS);
+  stubMcp2515Receive(bmwCsPin, 0x153, 8, asc1Payload);
+  stubMcp2515Receive(bmwCsPin, 0x1F3, 8, asc3Payload);
+  stubMcp2515Receive(bmwCsPin, 0x1F5, 8, steeringPayload);
+  stubMcp2515Receive(bmwCsPin, 0x1F8, 8, brakePressurePayload);
+  TEST_ASSERT_EQUAL(4, stubMcp2515[bmwCsPin].received.size());
+  for (int i = 0; i < 4; i++) {
+    readBmwDataFromCan(can);
+  }
+
+  TEST_ASSERT_EQUAL_FLOAT(1, readSignal(SIGNAL_DSC_REQUEST_ACTIVE));
+  TEST_ASSERT_EQUAL_FLOAT(1, readSignal(SIGNAL_BRAKE_LIGHT_SWITCH));
+  TEST_ASSERT_EQUAL_FLOAT(25.0, readSignal(SIGNAL_DSC_TORQUE_INTERVENTION));
+  TEST_ASSERT_EQUAL_FLOAT(50.0, readSignal(SIGNAL_DSC_SLOW_TORQUE_INTERVENTION));
+  TEST_ASSERT_EQUAL_FLOAT(12.5, readSignal(SIGNAL_MSR_TORQUE_INTERVENTION));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, -3.27, readSignal(SIGNAL_LATERAL_ACCELERATION));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 90.0, readSignal(SIGNAL_STEERING_ANGLE));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, -180.0, readSignal(SIGNAL_STEERING_RATE));
+  TEST_ASSERT_EQUAL_FLOAT(85, readSignal(SIGNAL_BRAKE_PRESSURE));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_asc1_status_and_torque_intervention);
+  RUN_TEST(test_asc3_lateral_acceleration_is_signed);
+  RUN_TEST(test_steering_angle_and_rate_are_sign_magnitude);
+  RUN_TEST(test_brake_pressure_is_byte_two);
+  RUN_TEST(test_frames_read_off_the_shield_reach_the_signal_store);
+  return UNITY_END();
+}
@@ -0,0 +1,66 @@
+// Staged boot of the whole firmware, the serial port transmits at its real rate so blocking prints cost boot time
+
+#include <Arduino.h>
+#include <mcp2515_can.h>
+#include <unity.h>
+
+void setup();
+void loop();
+
+extern unsigned long bootClusterLiveMillis;
+
+const int bmwCsPin = 9;                       // SPI_SS_PIN_BMW in main.cpp
+const unsigned long bootClusterBudgetMs = 200; // Same budget as main.cpp
+
+bool clusterFrameSent(unsigned long canId) {
+  for (const stubCanFrame &frame : stubMcp2515[bmwCsPin].sent) {
+    if (frame.id == canId) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_cluster_frames_are_live_within_the_budget() {
+  setup();
+  unsigned long setupMs = millis();
+  unsigned long setupBytes = Serial.output.size();
+  while (bootClusterLiveMillis == 0 && millis() < 2000) {
+    loop();
+    stubAdvanceMillis(1);
+  }
+
+  char summary[96];
+  snprintf(summary, sizeof(summary), "setup printed %lu bytes in %lu ms, cluster live at %lu ms", setupBytes, setupMs,
+           bootClusterLiveMillis);
+  TEST_MESSAGE(summary);
+
+  // What setup prints directly must fit in the UART buffer, anything more waits on the port before the cluster is live
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(Serial.txBufferSize, setupBytes, summary);
+  TEST_ASSERT_GREATER_THAN(0, bootClusterLiveMillis);
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(bootClusterBudgetMs, bootClusterLiveMillis, summary);
+  TEST_ASSERT_TRUE(clusterFrameSent(0x316));
+  TEST_ASSERT_TRUE(clusterFrameSent(0x329));
+}
+
+// Everything printed while booting goes through the log ring, so none of it is lost once the loop drains it
+void test_boot_messages_reach_the_console() {
+  for (int i = 0; i < 3000; i++) {
+    loop();
+    stubAdvanceMillis(1);
+  }
+  TEST_ASSERT_TRUE(Serial.output.find("Reset cause") != std::string::npos);
+  TEST_ASSERT_TRUE(Serial.output.find("Boot task") != std::string::npos);
+  TEST_ASSERT_TRUE(Serial.output.find("records dropped") == std::string::npos);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_cluster_frames_are_live_within_the_budget);
+  RUN_TEST(test_boot_messages_reach_the_console);
+  return UNITY_END();
+}
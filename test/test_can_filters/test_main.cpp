@@ -0,0 +1,168 @@
+// Hardware filter planning, scored against a capture of the bus and counted without walking the ID space
+
+#include <Arduino.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include "functions_can_filters.h"
+#include "functions_can_sniff.h"
+#include "functions_config.h"
+
+// More IDs than the MCP2515 has filters, so some have to share one
+const unsigned long consumedIds[] = {0x1F0, 0x1F3, 0x1F5, 0x1F8, 0x153, 0x316, 0x329, 0x545};
+const int consumedIdCount = sizeof(consumedIds) / sizeof(consumedIds[0]);
+
+bool isConsumedCanIdInTest(unsigned long canId) {
+  for (int i = 0; i < consumedIdCount; i++) {
+    if (consumedIds[i] == canId) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int countAcceptsByWalking(const canFilterPlan *plan) {
+  int acceptedCount = 0;
+  for (unsigned long canId = 0; canId < 2048; canId++) {
+    acceptedCount += canFilterPlanAccepts(plan, canId);
+  }
+  return acceptedCount;
+}
+
+void setUp() {
+  uint8_t erased[256];
+  memset(erased, 0xFF, sizeof(erased));
+  setenv("CONFIG_STORAGE_FILE", "test_can_filters.bin", 1);
+  for (int address = 0; address < configStorageBegin(); address += sizeof(erased)) {
+    configStorageWrite(address, erased, sizeof(erased));
+  }
+  loadConfig();
+}
+
+void tearDown() {}
+
+void test_accept_count_matches_walking_the_id_space() {
+  unsigned long random = 1;
+  for (int trial = 0; trial < 2000; trial++) {
+    canFilterPlan plan;
+    for (int i = 0; i < 2; i++) {
+      random = random * 1103515245 + 12345;
+      plan.masks[i] = (random >> 8) & 0x7FF;
+    }
+    // Mostly small groups of filters that share or nearly share a value, as the planner builds them
+    for (int i = 0; i < 6; i++) {
+      random = random * 1103515245 + 12345;
+      bool nearPrevious = i > 0 && (random & 0x100);
+      plan.filters[i] = nearPrevious ? plan.filters[i - 1] ^ ((random >> 12) & 0x0F) : (random >> 16) & 0x7FF;
+    }
+    TEST_ASSERT_EQUAL(countAcceptsByWalking(&plan), countCanFilterPlanAccepts(&plan));
+  }
+}
+
+void test_every_consumed_id_is_accepted() {
+  canFilterPlan plan = planCanFilters(consumedIds, consumedIdCount, NULL, NULL, 0);
+  for (int i = 0; i < consumedIdCount; i++) {
+    TEST_ASSERT_TRUE(canFilterPlanAccepts(&plan, consumedIds[i]));
+  }
+  TEST_ASSERT_EQUAL(countAcceptsByWalking(&plan) - consumedIdCount, plan.falseAcceptCount);
+  TEST_ASSERT_EQUAL(-1, plan.busFalseAcceptCount);
+}
+
+// Periods of the frames replayed onto the BMW bus for the capture, the consumed IDs at their PT-CAN rates, 0x1F1
+// every 10 ms and a handful of IDs near the consumed ones sent once a second
+struct replayedBusId {
+  uint16_t canId;
+  unsigned long periodMs;
+};
+
+const replayedBusId replayedBmwBus[] = {
+    {0x153, 10}, {0x1F0, 10},   {0x1F3, 10},   {0x1F5, 10},   {0x1F8, 20},   {0x316, 10},   {0x329, 10},   {0x545, 100},
+    {0x1F1, 10}, {0x116, 1000}, {0x145, 1000}, {0x155, 1000}, {0x173, 1000}, {0x1D3, 1000}, {0x1FD, 1000}, {0x321, 1000},
+};
+
+// Sniff the replayed bus for ten seconds, leaving sniff mode keeps the IDs and their rates in the config
+void captureReplayedBmwBus() {
+  const unsigned char payload[8] = {0};
+  setCanSniffMode(CAN_SNIFF_SUMMARY);
+  for (unsigned long ms = 0; ms < 10000; ms++) {
+    for (const replayedBusId &busId : replayedBmwBus) {
+      if (ms % busId.periodMs == 0) {
+        canSniffRecordFrame(CAN_BUS_BMW, busId.canId, 8, payload);
+      }
+    }
+    stubAdvanceMillis(1);
+  }
+  setCanSniffMode(CAN_SNIFF_OFF);
+}
+
+int capturedRate(uint16_t canId) {
+  for (int i = 0; i < config.canCapturedIdCount[CAN_BUS_BMW]; i++) {
+    if (config.canCapturedIds[CAN_BUS_BMW][i] == canId) {
+      return config.canCapturedIdRates[CAN_BUS_BMW][i];
+    }
+  }
+  return 0;
+}
+
+// Counting IDs, letting 0x1F1 through looks cheapest as it is one ID against two. Weighted by the captured rates it
+// costs 100 frames/s, so the plan takes the two that are sent once a second instead.
+void test_capture_steers_the_plan_away_from_busy_ids_on_the_bus() {
+  captureReplayedBmwBus();
+  TEST_ASSERT_EQUAL(sizeof(replayedBmwBus) / sizeof(replayedBmwBus[0]), config.canCapturedIdCount[CAN_BUS_BMW]);
+  for (const replayedBusId &busId : replayedBmwBus) {
+    TEST_ASSERT_EQUAL(1000 / busId.periodMs, capturedRate(busId.canId));
+  }
+
+  const uint16_t *busIds = config.canCapturedIds[CAN_BUS_BMW];
+  const uint16_t *busIdRates = config.canCapturedIdRates[CAN_BUS_BMW];
+  int busIdCount = config.canCapturedIdCount[CAN_BUS_BMW];
+
+  canFilterPlan counted = planCanFilters(consumedIds, consumedIdCount, busIds, NULL, busIdCount);
+  TEST_ASSERT_EQUAL(1, counted.busFalseAcceptCount);
+  TEST_ASSERT_TRUE(canFilterPlanAccepts(&counted, 0x1F1));
+
+  canFilterPlan plan = planCanFilters(consumedIds, consumedIdCount, busIds, busIdRates, busIdCount);
+  TEST_ASSERT_FALSE(canFilterPlanAccepts(&plan, 0x1F1));
+  int passedRate = 0;
+  for (const replayedBusId &busId : replayedBmwBus) {
+    if (canFilterPlanAccepts(&plan, busId.canId) && !isConsumedCanIdInTest(busId.canId)) {
+      passedRate += 1000 / busId.periodMs;
+    }
+  }
+  TEST_ASSERT_EQUAL(2, plan.busFalseAcceptCount);
+  TEST_ASSERT_EQUAL(passedRate, plan.busFalseAcceptCount);
+  for (int i = 0; i < consumedIdCount; i++) {
+    TEST_ASSERT_TRUE(canFilterPlanAccepts(&plan, consumedIds[i]));
+  }
+}
+
+// Leaving sniff mode keeps what was seen on each bus in the saved configuration
+void test_sniff_session_is_captured_into_the_config() {
+  const unsigned char payload[8] = {0};
+  setCanSniffMode(CAN_SNIFF_SUMMARY);
+  canSniffRecordFrame(CAN_BUS_BMW, 0x1F0, 8, payload);
+  canSniffRecordFrame(CAN_BUS_BMW, 0x1F1, 8, payload);
+  canSniffRecordFrame(CAN_BUS_NISSAN, 0x551, 8, payload);
+  setCanSniffMode(CAN_SNIFF_OFF);
+
+  config = configData();
+  loadConfig();
+  TEST_ASSERT_EQUAL(2, config.canCapturedIdCount[CAN_BUS_BMW]);
+  TEST_ASSERT_EQUAL(1, config.canCapturedIdCount[CAN_BUS_NISSAN]);
+  TEST_ASSERT_EQUAL(0x551, config.canCapturedIds[CAN_BUS_NISSAN][0]);
+
+  // A session that saw nothing keeps the last capture
+  setCanSniffMode(CAN_SNIFF_SUMMARY);
+  setCanSniffMode(CAN_SNIFF_OFF);
+  TEST_ASSERT_EQUAL(2, config.canCapturedIdCount[CAN_BUS_BMW]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_accept_count_matches_walking_the_id_space);
+  RUN_TEST(test_every_consumed_id_is_accepted);
+  RUN_TEST(test_capture_steers_the_plan_away_from_busy_ids_on_the_bus);
+  RUN_TEST(test_sniff_session_is_captured_into_the_config);
+  unlink("test_can_filters.bin");
+  return UNITY_END();
+}
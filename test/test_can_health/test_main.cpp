@@ -0,0 +1,98 @@
+// Bus load and error counters against the fake MCP2515, frames go through its filters and registers over fake SPI
+
+#include <Arduino.h>
+#include <mcp2515_can.h>
+#include <unity.h>
+
+#include "functions_can_filters.h"
+#include "functions_can_health.h"
+#include "functions_memory.h"
+#include "functions_read.h"
+
+const int bmwCsPin = 9;
+const unsigned char payload[8] = {0};
+
+mcp2515_can canBmw(bmwCsPin);
+
+// One second of a bus carrying a consumed ID and an ID nobody decodes, both at 100 Hz
+void runBus() {
+  for (int i = 0; i < 100; i++) {
+    stubAdvanceMillis(10);
+    stubMcp2515Receive(bmwCsPin, 0x1F0, 8, payload);
+    stubMcp2515Receive(bmwCsPin, 0x3B4, 8, payload);
+    while (canBmw.checkReceive() == CAN_MSGAVAIL) {
+      readBmwDataFromCan(canBmw);
+    }
+  }
+}
+
+float reportedLoad(const char *summary) { return atof(strstr(summary, "\"acceptedLoad\":") + 15); }
+
+void setUp() {
+  canBmw.begin(CAN_500KBPS);
+  initialiseCanBusHealth(CAN_BUS_BMW, bmwCsPin, NULL);
+  reportCanBusHealth(CAN_BUS_BMW, "BMW", false);
+}
+
+void tearDown() {}
+
+// With the filters applied only the consumed ID is counted, the report says so
+void test_filtered_load_is_labelled_accepted() {
+  const unsigned long consumed[] = {0x1F0};
+  canFilterPlan plan = planCanFilters(consumed, 1, NULL, NULL, 0);
+  applyCanFilterPlan(canBmw, &plan);
+  setCanBusFiltersOpen(CAN_BUS_BMW, false);
+
+  runBus();
+  unsigned long allocations = getMemoryStats()->allocations;
+  const char *summary = reportCanBusHealth(CAN_BUS_BMW, "BMW", false);
+  TEST_ASSERT_EQUAL(allocations, getMemoryStats()->allocations); // Formatted in place, it is published every second
+  TEST_ASSERT_TRUE(strstr(summary, "\"filtersOpen\":false") != NULL);
+  TEST_ASSERT_EQUAL(100, stubMcp2515[bmwCsPin].rejectedCount);
+
+  // 100 eight byte frames of about 130 bits in a second at 500 kbit/s
+  TEST_ASSERT_FLOAT_WITHIN(0.3, 2.6, reportedLoad(summary));
+}
+
+// With the masks open every frame on the bus arrives, so the same figure is the whole bus load
+void test_open_filters_see_the_whole_bus() {
+  canBmw.init_Mask(0, 0, 0);
+  canBmw.init_Mask(1, 0, 0);
+  setCanBusFiltersOpen(CAN_BUS_BMW, true);
+
+  runBus();
+  const char *summary = reportCanBusHealth(CAN_BUS_BMW, "BMW", false);
+  TEST_ASSERT_TRUE(strstr(summary, "\"filtersOpen\":true") != NULL);
+  TEST_ASSERT_FLOAT_WITHIN(0.6, 5.2, reportedLoad(summary));
+}
+
+// Overflow flags are counted and cleared, error passive and bus off counted on the way in
+void test_error_registers_are_counted() {
+  stubMcp2515Chip *chip = &stubMcp2515[bmwCsPin];
+  chip->registers[0x2D] = 0xC0; // RX0OVR and RX1OVR
+  sampleCanBusHealth(CAN_BUS_BMW);
+  TEST_ASSERT_EQUAL(0, chip->registers[0x2D]);
+  TEST_ASSERT_TRUE(strstr(reportCanBusHealth(CAN_BUS_BMW, "BMW", false), "\"ovr\":1") != NULL);
+
+  chip->registers[0x2D] = 0x08; // RXEP
+  chip->registers[0x1D] = 130;
+  sampleCanBusHealth(CAN_BUS_BMW);
+  sampleCanBusHealth(CAN_BUS_BMW);
+  const char *summary = reportCanBusHealth(CAN_BUS_BMW, "BMW", false);
+  TEST_ASSERT_TRUE(strstr(summary, "\"state\":\"passive\"") != NULL);
+  TEST_ASSERT_TRUE(strstr(summary, "\"rec\":130") != NULL);
+
+  chip->registers[0x2D] = 0x20; // TXBO
+  sampleCanBusHealth(CAN_BUS_BMW);
+  TEST_ASSERT_FALSE(isCanBusAlive(CAN_BUS_BMW, 1000));
+  chip->registers[0x2D] = 0;
+  chip->registers[0x1D] = 0;
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_filtered_load_is_labelled_accepted);
+  RUN_TEST(test_open_filters_see_the_whole_bus);
+  RUN_TEST(test_error_registers_are_counted);
+  return UNITY_END();
+}
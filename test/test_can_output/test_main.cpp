@@ -0,0 +1,194 @@
+// Cluster frames from the whole firmware on a replayed drive, sent on change with a refresh floor instead of the old
+// fixed 10 ms timers
+
+#include <Arduino.h>
+#include <mcp2515_can.h>
+#include <unity.h>
+
+#include <vector>
+
+#include "functions_can_output.h"
+#include "functions_do.h"
+#include "functions_gateway.h"
+#include "functions_signals.h"
+
+void setup();
+void loop();
+
+extern gatewayFrame gatewayFrameTable[];
+extern unsigned long bootClusterLiveMillis;
+
+const int bmwCsPin = 9;     // SPI_SS_PIN_BMW in main.cpp
+const int nissanCsPin = 10; // SPI_SS_PIN_NISSAN
+const int clusterRpmFrame = 1; // GATEWAY_FRAME_CLUSTER_RPM in main.cpp
+const unsigned long clusterIds[] = {0x316, 0x329, 0x545};
+const unsigned long legacyPeriodMs = 10; // canWriteRpm, canWriteTemp and canWriteMisc timers
+
+// Crank pulses for the RPM interrupt, coolant from the ECM every 100 ms and wheel speeds every 10 ms
+struct replayedEngine {
+  float rpm = 800;
+  float coolant = 70;
+  unsigned long nextPulseMicros = 0;
+
+  void step() {
+    unsigned long endMicros = micros() + 1000;
+    unsigned long pulseMicros = 60000000 / (rpm * 3);
+    if (nextPulseMicros < micros()) {
+      nextPulseMicros = micros();
+    }
+    while (nextPulseMicros < endMicros) {
+      stubAdvanceMicros(nextPulseMicros - micros());
+      updateRpmPulse();
+      nextPulseMicros += pulseMicros;
+    }
+    stubAdvanceMicros(endMicros - micros());
+
+    if (millis() % 100 == 0) {
+      unsigned char temperature[8] = {(unsigned char)(coolant + 40)};
+      stubMcp2515Receive(nissanCsPin, 0x551, 8, temperature);
+    }
+    if (millis() % 10 == 5) {
+      unsigned char wheelSpeeds[8] = {0x20, 0x03, 0x20, 0x03, 0x20, 0x03, 0x20, 0x03};
+      stubMcp2515Receive(bmwCsPin, 0x1F0, 8, wheelSpeeds);
+    }
+  }
+};
+
+replayedEngine engine;
+
+struct clusterStream {
+  unsigned long count = 0;
+  unsigned long maxGapMicros = 0;
+  unsigned long lastMicros = 0;
+};
+
+// A minute of idle, pulls through the gears and the coolant warming up, returns the cluster frames sent while it ran
+std::vector<stubCanFrame> replayDrive() {
+  stubMcp2515[bmwCsPin].sent.clear();
+  for (unsigned long ms = 0; ms < 60000; ms++) {
+    unsigned long phase = ms % 10000;
+    if (phase < 2000) {
+      engine.rpm = 800;
+    } else if (phase < 6000) {
+      engine.rpm = 800 + (phase - 2000) * 1.2f; // 1200 RPM per second up to 5600
+    } else {
+      engine.rpm = max(800.0f, 5600 - (phase - 6000) * 2.0f);
+    }
+    if (ms % 1000 == 0 && engine.coolant < 90) {
+      engine.coolant += 0.5f;
+    }
+    engine.step();
+    loop();
+  }
+  return stubMcp2515[bmwCsPin].sent;
+}
+
+clusterStream streamFor(const std::vector<stubCanFrame> &sent, unsigned long canId) {
+  clusterStream stream;
+  for (const stubCanFrame &frame : sent) {
+    if (frame.id != canId) {
+      continue;
+    }
+    if (stream.count > 0) {
+      stream.maxGapMicros = max(stream.maxGapMicros, frame.micros - stream.lastMicros);
+    }
+    stream.lastMicros = frame.micros;
+    stream.count++;
+  }
+  return stream;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_cluster_is_live_after_boot() {
+  setup();
+  while (bootClusterLiveMillis == 0 && millis() < 2000) {
+    engine.step();
+    loop();
+  }
+  TEST_ASSERT_GREATER_THAN(0, bootClusterLiveMillis);
+
+  // Let boot finish and the ECM query setup settle before measuring
+  for (int i = 0; i < 5000; i++) {
+    engine.step();
+    loop();
+  }
+}
+
+// The cluster drops its needles when a DME frame goes missing, each one must keep coming at the refresh floor at worst
+void test_replayed_drive_keeps_every_cluster_frame_inside_its_refresh_floor() {
+  std::vector<stubCanFrame> sent = replayDrive();
+
+  for (unsigned long canId : clusterIds) {
+    clusterStream stream = streamFor(sent, canId);
+    float perSecond = stream.count / 60.0f;
+    char summary[128];
+    snprintf(summary, sizeof(summary), "0x%03lX %.1f frames/s, %.1f/s saved against the 10 ms timer, worst gap %lu us",
+             canId, perSecond, 1000.0f / legacyPeriodMs - perSecond, stream.maxGapMicros);
+    TEST_MESSAGE(summary);
+
+    // One loop of slack for a frame that waits in the queue behind another
+    TEST_ASSERT_LESS_OR_EQUAL_MESSAGE((canOutputClusterRefreshMs + 2) * 1000, stream.maxGapMicros, summary);
+    TEST_ASSERT_LESS_THAN_MESSAGE(1000 / legacyPeriodMs, perSecond, summary);
+  }
+
+  // Temperature and the lamps barely move, so they cost the refresh floor and little more
+  TEST_ASSERT_LESS_OR_EQUAL(60 * (1000 / canOutputClusterRefreshMs + 2), streamFor(sent, 0x329).count);
+  TEST_ASSERT_LESS_OR_EQUAL(60 * (1000 / canOutputClusterRefreshMs + 2), streamFor(sent, 0x545).count);
+}
+
+// A new RPM payload reaches the shield by the next loop, the fixed timer could hold it back for up to 10 ms
+void test_rpm_changes_reach_the_cluster_by_the_next_loop() {
+  gatewayFrame *rpmFrame = &gatewayFrameTable[clusterRpmFrame];
+  unsigned char lastPayload[8];
+  memcpy(lastPayload, rpmFrame->output.lastPayload, 8);
+
+  unsigned long changes = 0;
+  unsigned long worstMicros = 0;
+  for (unsigned long ms = 0; ms < 4000; ms++) {
+    engine.rpm = 1500 + ms; // Revving up through the range
+    engine.step();
+    stubMcp2515[bmwCsPin].sent.clear();
+    unsigned long changeMicros = micros();
+    loop();
+
+    if (memcmp(lastPayload, rpmFrame->output.lastPayload, 8) == 0) {
+      continue;
+    }
+    memcpy(lastPayload, rpmFrame->output.lastPayload, 8);
+    changes++;
+
+    // Either this loop already put it on the bus or the next one does
+    bool onTheBus = false;
+    for (int loops = 0; loops < 2 && !onTheBus; loops++) {
+      for (const stubCanFrame &frame : stubMcp2515[bmwCsPin].sent) {
+        if (frame.id == 0x316 && memcmp(frame.data, lastPayload, 8) == 0) {
+          onTheBus = true;
+          worstMicros = max(worstMicros, frame.micros - changeMicros);
+        }
+      }
+      if (!onTheBus) {
+        engine.step();
+        loop();
+        ms++;
+      }
+    }
+    TEST_ASSERT_TRUE_MESSAGE(onTheBus, "new RPM payload did not reach the shield by the next loop");
+  }
+
+  char summary[64];
+  snprintf(summary, sizeof(summary), "%lu RPM changes, worst %lu us to the shield", changes, worstMicros);
+  TEST_MESSAGE(summary);
+  TEST_ASSERT_GREATER_THAN(40, changes);
+  TEST_ASSERT_LESS_OR_EQUAL(2000, worstMicros);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_cluster_is_live_after_boot);
+  RUN_TEST(test_replayed_drive_keeps_every_cluster_frame_inside_its_refresh_floor);
+  RUN_TEST(test_rpm_changes_reach_the_cluster_by_the_next_loop);
+  return UNITY_END();
+}
@@ -0,0 +1,109 @@
+// Sniff mode, the LAWICEL stream on the serial port and the MQTT ID summary
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+#include <unity.h>
+
+#include "functions_can_sniff.h"
+#include "functions_log.h"
+#include "functions_mqtt.h"
+
+const unsigned char payload[8] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+
+void sendCommand(const char *command) {
+  Serial.stubReceive(command);
+  processCanSniffSerialCommands();
+}
+
+int countPublishes(const char *topic) {
+  int count = 0;
+  for (stubMqttMessage &message : stubMqtt.published) {
+    count += message.topic == topic;
+  }
+  return count;
+}
+
+void setUp() {
+  sendCommand("C\r");
+  serviceLog();
+  Serial.output.clear();
+  stubMqtt.published.clear();
+}
+
+void tearDown() {}
+
+// Anything else written to the port while CANHacker reads it would corrupt the frames
+void test_lawicel_stream_carries_nothing_else() {
+  sendCommand("O\r");
+  Serial.output.clear();
+
+  serialConsole.println("INFO - Something from elsewhere in the loop");
+  LOG_WARN(LOG_MODULE_GENERAL, "logged while streaming %d", 1);
+  canSniffRecordFrame(CAN_BUS_BMW, 0x1F0, 8, payload);
+  serviceLog();
+  canSniffRecordFrame(CAN_BUS_NISSAN, 0x23D, 2, payload);
+
+  TEST_ASSERT_EQUAL_STRING("T000011F080102030405060708\rT0000223D20102\r", Serial.output.c_str());
+
+  // Closing the channel lets the queued log record out
+  sendCommand("C\r");
+  Serial.output.clear();
+  serviceLog();
+  TEST_ASSERT_TRUE(Serial.output.find("logged while streaming 1") != std::string::npos);
+}
+
+void test_summary_mode_keeps_the_console() {
+  sendCommand("X\r");
+  serialConsole.println("console text");
+  TEST_ASSERT_TRUE(Serial.output.find("console text") != std::string::npos);
+  sendCommand("X\r");
+}
+
+void test_frame_format() {
+  char frame[32];
+  int length = formatLawicelFrame(frame, 0x123, 2, payload, false);
+  frame[length] = '\0';
+  TEST_ASSERT_EQUAL_STRING("t12320102\r", frame);
+
+  length = formatLawicelFrame(frame, 0x1ABCDEF0, 0, payload, false);
+  frame[length] = '\0';
+  TEST_ASSERT_EQUAL_STRING("T1ABCDEF00\r", frame);
+}
+
+// A full table is published a couple of IDs per loop rather than in one burst
+void test_summary_publishes_are_spread_across_loops() {
+  connectMqttClientToBroker();
+  sendCommand("X\r");
+  for (unsigned long id = 0x100; id < 0x100 + 40; id++) {
+    canSniffRecordFrame(id % 2 == 0 ? CAN_BUS_BMW : CAN_BUS_NISSAN, id, 8, payload);
+  }
+  stubMqtt.published.clear();
+
+  reportCanSniffSummary(false);
+  TEST_ASSERT_EQUAL(0, countPublishes("canSniff"));
+
+  int loops = 0;
+  int mostInOneLoop = 0;
+  while (countPublishes("canSniff") < 40 && loops < 100) {
+    int before = countPublishes("canSniff");
+    serviceCanSniffSummary();
+    mostInOneLoop = max(mostInOneLoop, countPublishes("canSniff") - before);
+    loops++;
+  }
+  TEST_ASSERT_EQUAL(40, countPublishes("canSniff"));
+  TEST_ASSERT_LESS_OR_EQUAL(2, mostInOneLoop);
+
+  // Nothing more until the next report
+  serviceCanSniffSummary();
+  TEST_ASSERT_EQUAL(40, countPublishes("canSniff"));
+  sendCommand("X\r");
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_lawicel_stream_carries_nothing_else);
+  RUN_TEST(test_summary_mode_keeps_the_console);
+  RUN_TEST(test_frame_format);
+  RUN_TEST(test_summary_publishes_are_spread_across_loops);
+  return UNITY_END();
+}
@@ -0,0 +1,195 @@
+// Raw CAN stream against the fake W5500, a test connection plays slcand. The timestamped frames of the last test are
+// checked in as capture.slcan next to this file, which tools/test_can_stream_candump.py replays through the candump
+// converter, so the converter is tested on the bytes the firmware writes
+
+#include <Arduino.h>
+#include <Ethernet.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "functions_can_stream.h"
+#include "functions_config.h"
+
+const uint16_t bmwPort = 5010;    // canStreamPorts in functions_can_stream.cpp
+const uint16_t nissanPort = 5011;
+
+const unsigned char payload[8] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
+
+// Connect, send the commands slcand would and let the firmware accept and answer them, replacing the last test's
+// connection
+std::shared_ptr<stubTcpConnection> openStream(canBus bus, uint16_t port, const char *commands) {
+  std::shared_ptr<stubTcpConnection> connection = stubEthernetConnect(port);
+  connection->send(commands);
+  serviceCanStream(bus);
+  TEST_ASSERT_TRUE(isCanStreamOpen(bus));
+  TEST_ASSERT_EQUAL(std::count(commands, commands + strlen(commands), '\r'), connection->fromDevice.size());
+  connection->fromDevice.clear();
+  return connection;
+}
+
+// Record a frame and give the stream its turn in the loop, as main.cpp does for every frame read off a shield
+void receive(canBus bus, unsigned long canId, byte len, const unsigned char *buf) {
+  canStreamRecordFrame(bus, canId, len, buf);
+  serviceCanStream(bus);
+}
+
+// Send whatever is still batched, the flush interval has passed by the next call
+void flush(canBus bus) {
+  stubAdvanceMillis(10);
+  serviceCanStream(bus);
+}
+
+std::vector<std::string> streamedFrames(const std::shared_ptr<stubTcpConnection> &connection) {
+  std::vector<std::string> frames;
+  std::stringstream stream(connection->fromDevice);
+  std::string frame;
+  while (std::getline(stream, frame, '\r')) {
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+void setUp() {
+  config.canStreamEnabled = 1;
+  for (int bus = 0; bus < CAN_BUS_COUNT; bus++) {
+    config.canStreamMaxFramesPerSecond[bus] = 1000;
+    config.canStreamIdFilter[bus] = 0;
+    config.canStreamIdMask[bus] = 0;
+  }
+}
+
+void tearDown() {}
+
+// Nothing is queued until the client has opened the channel
+void test_frames_wait_for_the_channel_to_open() {
+  TEST_ASSERT_FALSE(serviceCanStream(CAN_BUS_BMW));
+  std::shared_ptr<stubTcpConnection> connection = stubEthernetConnect(bmwPort);
+  connection->send("S6\r");
+  serviceCanStream(CAN_BUS_BMW);
+  receive(CAN_BUS_BMW, 0x1F0, 8, payload);
+  flush(CAN_BUS_BMW);
+  TEST_ASSERT_FALSE(isCanStreamOpen(CAN_BUS_BMW));
+  TEST_ASSERT_EQUAL_STRING("\r", connection->fromDevice.c_str());
+
+  connection->send("O\r");
+  TEST_ASSERT_TRUE(serviceCanStream(CAN_BUS_BMW));
+  receive(CAN_BUS_BMW, 0x1F0, 8, payload);
+  flush(CAN_BUS_BMW);
+  TEST_ASSERT_EQUAL_STRING("\r\rt1F081122334455667788\r", connection->fromDevice.c_str());
+}
+
+// Only IDs matching the bus's filter under its mask are streamed, the other bus keeps its own filter
+void test_id_filter_is_per_bus() {
+  config.canStreamIdFilter[CAN_BUS_BMW] = 0x1F0;
+  config.canStreamIdMask[CAN_BUS_BMW] = 0x7F0;
+  std::shared_ptr<stubTcpConnection> bmw = openStream(CAN_BUS_BMW, bmwPort, "O\r");
+  std::shared_ptr<stubTcpConnection> nissan = openStream(CAN_BUS_NISSAN, nissanPort, "O\r");
+
+  const unsigned long ids[] = {0x1F0, 0x316, 0x1F5, 0x153, 0x1FD, 0x0F0};
+  for (unsigned long canId : ids) {
+    receive(CAN_BUS_BMW, canId, 2, payload);
+    receive(CAN_BUS_NISSAN, canId, 2, payload);
+  }
+  flush(CAN_BUS_BMW);
+  flush(CAN_BUS_NISSAN);
+
+  std::vector<std::string> bmwFrames = streamedFrames(bmw);
+  TEST_ASSERT_EQUAL(3, bmwFrames.size());
+  TEST_ASSERT_EQUAL_STRING("t1F021122", bmwFrames[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("t1F521122", bmwFrames[1].c_str());
+  TEST_ASSERT_EQUAL_STRING("t1FD21122", bmwFrames[2].c_str());
+  TEST_ASSERT_EQUAL(6, streamedFrames(nissan).size());
+}
+
+// A tenth of a second's worth goes out at once, after that the bus is thinned to the configured rate
+void test_token_bucket_limits_a_busy_bus() {
+  config.canStreamMaxFramesPerSecond[CAN_BUS_BMW] = 100;
+  std::shared_ptr<stubTcpConnection> connection = openStream(CAN_BUS_BMW, bmwPort, "O\r");
+
+  for (int i = 0; i < 50; i++) {
+    receive(CAN_BUS_BMW, 0x1F0, 8, payload);
+  }
+  flush(CAN_BUS_BMW);
+  TEST_ASSERT_EQUAL(10, streamedFrames(connection).size());
+
+  // Two seconds of a frame every 2 ms, five times what the client asked for
+  connection->fromDevice.clear();
+  for (int i = 0; i < 1000; i++) {
+    stubAdvanceMillis(2);
+    receive(CAN_BUS_BMW, 0x1F0, 8, payload);
+  }
+  flush(CAN_BUS_BMW);
+  TEST_ASSERT_INT_WITHIN(1, 200, streamedFrames(connection).size());
+}
+
+// A client that stops reading fills the batch buffer, newer frames are dropped and the oldest go out once it drains
+void test_overflow_keeps_the_oldest_frames() {
+  std::shared_ptr<stubTcpConnection> connection = openStream(CAN_BUS_BMW, bmwPort, "O\r");
+  connection->room = 0;
+
+  unsigned char data[8];
+  memcpy(data, payload, 8);
+  for (int i = 0; i < 20; i++) {
+    data[0] = i;
+    receive(CAN_BUS_BMW, 0x1F0, 8, data);
+  }
+  flush(CAN_BUS_BMW);
+  TEST_ASSERT_EQUAL(0, connection->fromDevice.size());
+
+  // The 256 byte buffer keeps room for a longest frame, so eleven of these 22 byte frames fit
+  connection->room = 2048;
+  flush(CAN_BUS_BMW);
+  std::vector<std::string> frames = streamedFrames(connection);
+  TEST_ASSERT_EQUAL(11, frames.size());
+  for (size_t i = 0; i < frames.size(); i++) {
+    char expected[32];
+    snprintf(expected, sizeof(expected), "t1F08%02X22334455667788", (unsigned)i);
+    TEST_ASSERT_EQUAL_STRING(expected, frames[i].c_str());
+  }
+
+  data[0] = 0x20;
+  receive(CAN_BUS_BMW, 0x1F0, 8, data);
+  flush(CAN_BUS_BMW);
+  TEST_ASSERT_EQUAL_STRING("t1F082022334455667788", streamedFrames(connection).back().c_str());
+}
+
+// Timestamped frames across the LAWICEL minute wrap, standard and extended IDs, must match capture.slcan
+void test_timestamped_capture_matches_the_checked_in_file() {
+  std::shared_ptr<stubTcpConnection> connection = openStream(CAN_BUS_BMW, bmwPort, "C\rS6\rZ1\rO\r");
+
+  const unsigned char steering[2] = {0x40, 0x06};
+  const unsigned char wheelSpeeds[8] = {9, 10, 11, 12, 13, 14, 15, 16};
+  const unsigned char diagnostic[3] = {0x02, 0x10, 0x03};
+  stubAdvanceMillis(60000 - millis() % 60000 - 10);
+  receive(CAN_BUS_BMW, 0x1F0, 8, payload);
+  stubAdvanceMillis(5);
+  receive(CAN_BUS_BMW, 0x153, 2, steering);
+  stubAdvanceMillis(10);
+  receive(CAN_BUS_BMW, 0x1F0, 8, wheelSpeeds);
+  stubAdvanceMillis(5);
+  receive(CAN_BUS_BMW, 0x7E8, 0, payload);
+  receive(CAN_BUS_BMW, 0x18DAF110, 3, diagnostic);
+  flush(CAN_BUS_BMW);
+
+  std::string path = __FILE__;
+  path = path.substr(0, path.find_last_of("/\\") + 1) + "capture.slcan";
+  std::ifstream file(path, std::ios::binary);
+  TEST_ASSERT_TRUE_MESSAGE(file.is_open(), path.c_str());
+  std::string capture((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  TEST_ASSERT_EQUAL_STRING(capture.c_str(), connection->fromDevice.c_str());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_frames_wait_for_the_channel_to_open);
+  RUN_TEST(test_id_filter_is_per_bus);
+  RUN_TEST(test_token_bucket_limits_a_busy_bus);
+  RUN_TEST(test_overflow_keeps_the_oldest_frames);
+  RUN_TEST(test_timestamped_capture_matches_the_checked_in_file);
+  return UNITY_END();
+}
@@ -0,0 +1,132 @@
+// Software transmit queue against the fake MCP2515, whose buffers can be held busy to model a congested bus
+
+#include <Arduino.h>
+#include <mcp2515_can.h>
+#include <unity.h>
+
+#include "functions_can_tx_queue.h"
+
+const int csPin = 9;
+mcp2515_can can(csPin);
+canTxQueue queue;
+
+const unsigned char payload[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+void submit(unsigned long canId, canTxPriority priority, unsigned char first = 0) {
+  unsigned char data[8];
+  memcpy(data, payload, 8);
+  data[0] = first;
+  TEST_ASSERT_TRUE(canTxQueueSubmit(&queue, canId, 8, data, priority));
+}
+
+void setUp() {
+  stubMcp2515[csPin] = stubMcp2515Chip();
+  can.begin(CAN_500KBPS);
+  queue = canTxQueue();
+  queue.can = &can;
+  stubMcp2515[csPin].holdTxBuffers = true;
+}
+
+void tearDown() {}
+
+// Submitting never touches the shield, so a busy bus can not hold up the loop
+void test_submit_does_not_touch_the_hardware() {
+  stubMcp2515[csPin].txBufferBusy[0] = stubMcp2515[csPin].txBufferBusy[1] = stubMcp2515[csPin].txBufferBusy[2] = true;
+  submit(0x316, CAN_TX_PRIORITY_HIGH);
+  submit(0x7DF, CAN_TX_PRIORITY_LOW);
+  TEST_ASSERT_EQUAL(0, stubMcp2515[csPin].trySendCount);
+  TEST_ASSERT_EQUAL(2, queue.queuedCount);
+}
+
+// With every buffer busy frames wait and are retried, then leave highest class first once the buffers free up
+void test_frames_wait_for_busy_buffers_and_leave_in_priority_order() {
+  stubMcp2515[csPin].txBufferBusy[0] = stubMcp2515[csPin].txBufferBusy[1] = stubMcp2515[csPin].txBufferBusy[2] = true;
+  submit(0x7DF, CAN_TX_PRIORITY_LOW);
+  submit(0x7DF, CAN_TX_PRIORITY_MEDIUM, 1);
+  submit(0x316, CAN_TX_PRIORITY_HIGH);
+
+  serviceCanTxQueue(&queue);
+  serviceCanTxQueue(&queue);
+  TEST_ASSERT_EQUAL(0, stubMcp2515[csPin].sent.size());
+  TEST_ASSERT_EQUAL(2, queue.retriedCount);
+  TEST_ASSERT_EQUAL(0, queue.droppedCount);
+
+  stubMcp2515CompleteTx(csPin);
+  serviceCanTxQueue(&queue);
+  TEST_ASSERT_EQUAL(3, stubMcp2515[csPin].sent.size());
+  TEST_ASSERT_EQUAL(0x316, stubMcp2515[csPin].sent[0].id);
+  TEST_ASSERT_EQUAL(1, stubMcp2515[csPin].sent[1].data[0]); // Medium class before low
+  TEST_ASSERT_EQUAL(0, stubMcp2515[csPin].sent[2].data[0]);
+  TEST_ASSERT_EQUAL(3, queue.sentCount);
+}
+
+// All three hardware buffers are used, TXB2 transmits first and is kept for the cluster frames
+void test_cluster_frames_get_the_reserved_buffer() {
+  submit(0x7DF, CAN_TX_PRIORITY_LOW, 1);
+  submit(0x7DF, CAN_TX_PRIORITY_LOW, 2);
+  submit(0x7DF, CAN_TX_PRIORITY_LOW, 3);
+  serviceCanTxQueue(&queue);
+
+  // Queried data only gets TXB1 and TXB0, the third request waits even though TXB2 is free
+  TEST_ASSERT_EQUAL(2, stubMcp2515[csPin].sent.size());
+  TEST_ASSERT_FALSE(stubMcp2515[csPin].txBufferBusy[2]);
+
+  submit(0x316, CAN_TX_PRIORITY_HIGH);
+  serviceCanTxQueue(&queue);
+  TEST_ASSERT_EQUAL(3, stubMcp2515[csPin].sent.size());
+  TEST_ASSERT_EQUAL(0x316, stubMcp2515[csPin].sent[2].id);
+  TEST_ASSERT_EQUAL(2, stubMcp2515[csPin].sent[2].txBuffer);
+  TEST_ASSERT_EQUAL(1, queue.count[CAN_TX_PRIORITY_LOW]);
+}
+
+// A gauge frame still waiting is updated in place, only its newest value is worth sending
+void test_waiting_cluster_frame_is_replaced_not_queued_twice() {
+  stubMcp2515[csPin].txBufferBusy[0] = stubMcp2515[csPin].txBufferBusy[1] = stubMcp2515[csPin].txBufferBusy[2] = true;
+  for (int i = 0; i < 20; i++) {
+    submit(0x316, CAN_TX_PRIORITY_HIGH, i);
+  }
+  TEST_ASSERT_EQUAL(1, queue.count[CAN_TX_PRIORITY_HIGH]);
+  TEST_ASSERT_EQUAL(19, queue.replacedCount);
+
+  stubMcp2515CompleteTx(csPin);
+  serviceCanTxQueue(&queue);
+  TEST_ASSERT_EQUAL(1, stubMcp2515[csPin].sent.size());
+  TEST_ASSERT_EQUAL(19, stubMcp2515[csPin].sent[0].data[0]);
+}
+
+// A full class drops and counts the frame without blocking or crowding out the other classes
+void test_full_class_drops_without_blocking() {
+  stubMcp2515[csPin].txBufferBusy[0] = stubMcp2515[csPin].txBufferBusy[1] = stubMcp2515[csPin].txBufferBusy[2] = true;
+  for (int i = 0; i < canTxQueueDepth; i++) {
+    submit(0x7DF, CAN_TX_PRIORITY_LOW, i);
+  }
+  unsigned long start = micros();
+  TEST_ASSERT_FALSE(canTxQueueSubmit(&queue, 0x7DF, 8, payload, CAN_TX_PRIORITY_LOW));
+  TEST_ASSERT_EQUAL(start, micros());
+  TEST_ASSERT_EQUAL(1, queue.droppedCount);
+
+  submit(0x7E0, CAN_TX_PRIORITY_MEDIUM);
+  TEST_ASSERT_EQUAL(1, queue.count[CAN_TX_PRIORITY_MEDIUM]);
+
+  // Freeing the buffers loop by loop sends every frame that was accepted, oldest first
+  for (int i = 0; i < 20; i++) {
+    stubMcp2515CompleteTx(csPin);
+    serviceCanTxQueue(&queue);
+  }
+  TEST_ASSERT_EQUAL(canTxQueueDepth + 1, stubMcp2515[csPin].sent.size());
+  TEST_ASSERT_EQUAL(0x7E0, stubMcp2515[csPin].sent[0].id);
+  for (int i = 0; i < canTxQueueDepth; i++) {
+    TEST_ASSERT_EQUAL(i, stubMcp2515[csPin].sent[i + 1].data[0]);
+  }
+  TEST_ASSERT_EQUAL(queue.queuedCount, queue.sentCount);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_submit_does_not_touch_the_hardware);
+  RUN_TEST(test_frames_wait_for_busy_buffers_and_leave_in_priority_order);
+  RUN_TEST(test_cluster_frames_get_the_reserved_buffer);
+  RUN_TEST(test_waiting_cluster_frame_is_replaced_not_queued_twice);
+  RUN_TEST(test_full_class_drops_without_blocking);
+  return UNITY_END();
+}
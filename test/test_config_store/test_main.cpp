@@ -0,0 +1,91 @@
+// Configuration ring in data flash, backed by a file on the host
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <unity.h>
+
+#include "functions_config.h"
+
+// Same layout as configRecordHeader in functions_config.cpp
+struct recordHeader {
+  uint16_t magic;
+  uint16_t layoutVersion;
+  uint16_t length;
+  uint16_t reserved;
+  uint32_t sequence;
+  uint32_t crc;
+};
+
+void eraseStorage() {
+  uint8_t erased[256];
+  memset(erased, 0xFF, sizeof(erased));
+  for (int address = 0; address < configStorageBegin(); address += sizeof(erased)) {
+    configStorageWrite(address, erased, sizeof(erased));
+  }
+}
+
+void setUp() {
+  setenv("CONFIG_STORAGE_FILE", "test_config_store.bin", 1);
+  eraseStorage();
+  loadConfig();
+}
+
+void tearDown() {}
+
+void test_saved_config_survives_a_reload() {
+  config.fanTargetEngineTemperature = 97;
+  TEST_ASSERT_TRUE(saveConfig());
+  config.fanTargetEngineTemperature = 0;
+
+  loadConfig();
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 97, config.fanTargetEngineTemperature);
+}
+
+void test_newest_record_wins_after_the_ring_wraps() {
+  for (int i = 0; i < 20; i++) {
+    config.mqttPort = 2000 + i;
+    TEST_ASSERT_TRUE(saveConfig());
+  }
+
+  loadConfig();
+  TEST_ASSERT_EQUAL(2019, config.mqttPort);
+}
+
+// Records kept after the configuration, like the reset log, must not move when configData grows
+void test_storage_end_does_not_depend_on_the_config_size() {
+  TEST_ASSERT_EQUAL(4096, getConfigStorageEnd());
+}
+
+// A record saved before the CAN stream fields were appended loads them with their defaults
+void test_record_from_before_appended_fields_loads_with_defaults() {
+  configData older;
+  older.mqttPort = 1999;
+  older.canStreamEnabled = 1; // Past the older length, must not be read back
+
+  recordHeader header;
+  header.magic = 0xC0F6;
+  header.layoutVersion = configLayoutVersion;
+  header.length = offsetof(configData, canStreamEnabled);
+  header.reserved = 0;
+  header.sequence = 1;
+  header.crc = ~updateConfigCrc(updateConfigCrc(0xFFFFFFFF, &header, offsetof(recordHeader, crc)), &older,
+                                header.length);
+  configStorageWrite(sizeof(header), &older, sizeof(older));
+  configStorageWrite(0, &header, sizeof(header));
+
+  loadConfig();
+  TEST_ASSERT_EQUAL(1999, config.mqttPort);
+  TEST_ASSERT_EQUAL(0, config.canStreamEnabled);
+  TEST_ASSERT_EQUAL(1000, config.canStreamMaxFramesPerSecond[1]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_saved_config_survives_a_reload);
+  RUN_TEST(test_newest_record_wins_after_the_ring_wraps);
+  RUN_TEST(test_storage_end_does_not_depend_on_the_config_size);
+  RUN_TEST(test_record_from_before_appended_fields_loads_with_defaults);
+  unlink("test_config_store.bin");
+  return UNITY_END();
+}
@@ -0,0 +1,133 @@
+// ISO-TP fault responses from the ECM on 0x7E8 and the check engine light they drive
+
+#include <Arduino.h>
+#include <mcp2515_can.h>
+#include <unity.h>
+
+#include "functions_can_tx_queue.h"
+#include "functions_ecm_faults.h"
+#include "functions_read.h"
+#include "functions_signals.h"
+
+canTxQueue queue;
+
+// The flow control frame sent in reply to the last first frame, 0 when none was queued
+byte lastFlowControlStatus() {
+  int count = queue.count[CAN_TX_PRIORITY_MEDIUM];
+  if (count == 0) {
+    return 0;
+  }
+  const canTxFrame *frame = &queue.frames[CAN_TX_PRIORITY_MEDIUM][(queue.head[CAN_TX_PRIORITY_MEDIUM] + count - 1) %
+                                                                  canTxQueueDepth];
+  TEST_ASSERT_EQUAL(0x7E0, frame->canId);
+  return frame->payload[0];
+}
+
+bool receive(unsigned char b0, unsigned char b1, unsigned char b2, unsigned char b3, unsigned char b4,
+             unsigned char b5, unsigned char b6, unsigned char b7) {
+  unsigned char frame[8] = {b0, b1, b2, b3, b4, b5, b6, b7};
+  return processEcmFaultFrame(&queue, frame, 8);
+}
+
+// KWP response with three codes in 11 bytes: 0x57, count, then code high, code low and status for each
+void receiveThreeCodeResponse() {
+  receive(0x10, 11, 0x57, 3, 0x01, 0x71, 0x00, 0x01);
+  receive(0x21, 0x72, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00);
+}
+
+void setUp() {
+  queue = canTxQueue();
+  if (millis() < 10000) {
+    stubAdvanceMillis(10000); // Past the bulb check at boot
+  }
+}
+
+void tearDown() {}
+
+void test_multi_frame_response_is_reassembled() {
+  receiveThreeCodeResponse();
+  TEST_ASSERT_EQUAL(0x30, lastFlowControlStatus());
+  TEST_ASSERT_TRUE(hasEcmFaultListChanged());
+  TEST_ASSERT_EQUAL_STRING("P0171,P0172,P0300", getEcmFaultList());
+  TEST_ASSERT_EQUAL(2, getEcmCheckEngineLightState());
+}
+
+// More than the 64 byte buffer is refused with an overflow flow control, not cut short and decoded
+void test_oversized_first_frame_is_refused() {
+  TEST_ASSERT_TRUE(receive(0x10, 100, 0x57, 20, 0x01, 0x00, 0x00, 0x01));
+  TEST_ASSERT_EQUAL(0x32, lastFlowControlStatus());
+
+  for (int sequence = 1; sequence <= 14; sequence++) {
+    TEST_ASSERT_FALSE(receive(0x20 | (sequence & 0x0F), 0x02, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00));
+  }
+  TEST_ASSERT_FALSE(hasEcmFaultListChanged());
+  TEST_ASSERT_EQUAL_STRING("P0171,P0172,P0300", getEcmFaultList());
+}
+
+// A consecutive frame arriving after N_Cr belongs to nothing we are still waiting on
+void test_stalled_response_is_abandoned() {
+  receive(0x10, 11, 0x57, 1, 0x04, 0x20, 0x00, 0x00);
+  stubAdvanceMillis(1500);
+  TEST_ASSERT_FALSE(receive(0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00));
+  TEST_ASSERT_FALSE(hasEcmFaultListChanged());
+
+  // Within N_Cr the same response completes
+  receive(0x10, 8, 0x57, 2, 0x04, 0x20, 0x00, 0x01);
+  stubAdvanceMillis(900);
+  TEST_ASSERT_TRUE(receive(0x21, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00));
+  TEST_ASSERT_TRUE(hasEcmFaultListChanged());
+  TEST_ASSERT_EQUAL_STRING("P0420,P0105", getEcmFaultList());
+}
+
+// The ECM stopped answering, the last MIL state is held for a few polls and then let go
+void test_mil_expires_after_missed_polls() {
+  receiveThreeCodeResponse();
+  TEST_ASSERT_EQUAL(2, getEcmCheckEngineLightState());
+
+  for (int poll = 0; poll < 3; poll++) {
+    requestEcmFaults(&queue);
+    TEST_ASSERT_EQUAL(2, getEcmCheckEngineLightState());
+  }
+  requestEcmFaults(&queue);
+  TEST_ASSERT_EQUAL(0, getEcmCheckEngineLightState());
+
+  // An answer brings it back
+  receiveThreeCodeResponse();
+  TEST_ASSERT_EQUAL(2, getEcmCheckEngineLightState());
+}
+
+// The MIL signal only moves when its state changes or a poll is answered, not on every pass over the Nissan bus
+void test_mil_signal_is_written_on_change_or_completed_poll() {
+  mcp2515_can can(10);
+  receiveThreeCodeResponse();
+  readNissanDataFromCan(can, &queue);
+  TEST_ASSERT_EQUAL(2, readSignal(SIGNAL_CHECK_ENGINE_LIGHT));
+
+  unsigned long sequence = getSignalSequence(SIGNAL_CHECK_ENGINE_LIGHT);
+  for (int i = 0; i < 100; i++) {
+    readNissanDataFromCan(can, &queue);
+  }
+  TEST_ASSERT_EQUAL(sequence, getSignalSequence(SIGNAL_CHECK_ENGINE_LIGHT));
+
+  // The same list again confirms the state, so the timestamp moves on without the value changing
+  stubAdvanceMillis(1000);
+  receiveThreeCodeResponse();
+  readNissanDataFromCan(can, &queue);
+  TEST_ASSERT_GREATER_THAN(sequence, getSignalSequence(SIGNAL_CHECK_ENGINE_LIGHT));
+  TEST_ASSERT_EQUAL(millis(), getSignalTimestamp(SIGNAL_CHECK_ENGINE_LIGHT));
+
+  // Cleared codes turn it off in the next pass
+  receive(0x02, 0x57, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
+  readNissanDataFromCan(can, &queue);
+  TEST_ASSERT_EQUAL(0, readSignal(SIGNAL_CHECK_ENGINE_LIGHT));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_multi_frame_response_is_reassembled);
+  RUN_TEST(test_oversized_first_frame_is_refused);
+  RUN_TEST(test_stalled_response_is_abandoned);
+  RUN_TEST(test_mil_expires_after_missed_polls);
+  RUN_TEST(test_mil_signal_is_written_on_change_or_completed_poll);
+  return UNITY_END();
+}
@@ -0,0 +1,183 @@
+// Radiator fan controller against a lumped thermal model of the engine, thermostat and radiator. The coolant reading
+// is quantised to whole degrees the way the ECM reports it, so single degree steps reach the controller as they do in
+// the car.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "functions_config.h"
+#include "functions_do.h"
+
+const byte fanPin = 6;
+const float fanMinimumPercent = 40; // fanMinimumPercentageOutput in functions_do.cpp
+const unsigned long tickMs = 200;   // ptSetRadiatorFanOutput period in main.cpp
+const float fanRatedWatts = 400;    // E46 auxiliary fan at full duty, power goes with the cube of speed
+
+struct thermalModel {
+  float coolant = 90;        // Celcius
+  float ambient = 35;
+  float heatCapacity = 60000; // Joules per degree for the coolant and the block around it
+  float engineWatts = 6000;   // Heat rejected to the coolant at idle
+  float vehicleSpeed = 0;
+  unsigned long noise = 1;
+
+  // Thermostat opens between 82 and 95 degrees, the radiator conducts more with fan and ram air
+  void step(float fanPercent, float seconds) {
+    float thermostatOpen = constrain((coolant - 82) / 13.0f, 0.05f, 1.0f);
+    float airflow = 60 + 500 * fanPercent / 100 + 1200 * min(vehicleSpeed / 80.0f, 1.0f);
+    float rejectedWatts = thermostatOpen * airflow * (coolant - ambient);
+    coolant += (engineWatts - rejectedWatts) * seconds / heatCapacity;
+  }
+
+  // Whole degrees with a little sender noise so the reading flickers across a boundary now and then
+  int reading() {
+    noise = noise * 1103515245 + 12345;
+    float jitter = ((noise >> 16) % 1000) / 1000.0f * 0.6f - 0.3f;
+    return (int)floorf(coolant + jitter);
+  }
+};
+
+// Stop the engine with cold coolant so the integral, filter and output all start again from zero
+void resetFanController() {
+  for (int i = 0; i < 3; i++) {
+    stubAdvanceMillis(tickMs);
+    setRadiatorFanOutput(20, 20, 0, 20, 0, fanPin);
+  }
+}
+
+int runFan(float coolant, int airIntakeTemp = 25, int rpm = 800, float speed = 0) {
+  stubAdvanceMillis(tickMs);
+  return setRadiatorFanOutput(coolant, coolant - 8, speed, airIntakeTemp, rpm, fanPin);
+}
+
+void setUp() {
+  config = configData();
+  resetFanController();
+}
+
+void tearDown() {}
+
+void test_single_degree_drop_does_not_stop_the_fan() {
+  int output = 0;
+  for (int i = 0; i < 50; i++) {
+    output = runFan(94);
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(fanMinimumPercent, output);
+
+  // A raw derivative with Kd 20 made this tick worth -100%
+  int afterDrop = runFan(93);
+  TEST_ASSERT_GREATER_OR_EQUAL_MESSAGE(fanMinimumPercent, afterDrop, "one degree step stopped the fan");
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(15 + 3, output - afterDrop, "more than the proportional step");
+}
+
+void test_fan_is_held_at_minimum_through_a_short_dip() {
+  for (int i = 0; i < 50; i++) {
+    runFan(94);
+  }
+
+  // Ten seconds well under target, then back up
+  for (int i = 0; i < 50; i++) {
+    TEST_ASSERT_EQUAL_MESSAGE(fanMinimumPercent, runFan(88), "fan did not hold its minimum");
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(fanMinimumPercent, runFan(93));
+
+  // A dip that lasts past the off delay does switch it off
+  int output = 0;
+  for (int i = 0; i < 350; i++) {
+    output = runFan(86);
+  }
+  TEST_ASSERT_EQUAL(0, output);
+}
+
+void test_hot_intake_air_adds_feed_forward() {
+  int coolOutput = 0;
+  for (int i = 0; i < 10; i++) {
+    coolOutput = runFan(92, 25);
+  }
+
+  resetFanController();
+  int hotOutput = 0;
+  for (int i = 0; i < 10; i++) {
+    hotOutput = runFan(92, 55);
+  }
+  TEST_ASSERT_GREATER_THAN(coolOutput, hotOutput);
+}
+
+void test_idle_in_traffic_holds_temperature_without_short_cycling() {
+  thermalModel engine;
+  float fanPercent = 0;
+  float hottest = 0;
+  int switchOffs = 0;
+  unsigned long onSinceMillis = 0;
+  unsigned long shortestOnMillis = 0xFFFFFFFF;
+  int largestDrop = 0;
+  float settledMin = 200, settledMax = 0;
+  float fanJoules = 0;
+
+  // Thirty minutes at idle on a hot day
+  for (unsigned long t = 0; t < 30UL * 60 * 1000; t += tickMs) {
+    engine.step(fanPercent, tickMs / 1000.0f);
+    int output = runFan(engine.reading());
+
+    if (output == 0 && fanPercent > 0) {
+      switchOffs++;
+      shortestOnMillis = min(shortestOnMillis, millis() - onSinceMillis);
+    } else if (output > 0 && fanPercent == 0) {
+      onSinceMillis = millis();
+    }
+    if (output > 0) {
+      largestDrop = max(largestDrop, (int)fanPercent - output);
+    }
+    fanJoules += fanRatedWatts * powf(output / 100.0f, 3) * tickMs / 1000.0f;
+    hottest = max(hottest, engine.coolant);
+    if (t > 10UL * 60 * 1000) {
+      settledMin = min(settledMin, engine.coolant);
+      settledMax = max(settledMax, engine.coolant);
+    }
+    fanPercent = output;
+  }
+
+  // Held at the minimum the whole time, what the fan would cost if it never switched off
+  float minimumJoules = fanRatedWatts * powf(fanMinimumPercent / 100, 3) * 30 * 60;
+
+  char summary[200];
+  snprintf(summary, sizeof(summary), "overshoot %.1f settled %.1f - %.1f switch offs %d shortest on %lu ms fan energy "
+           "%.1f Wh (%.1f Wh held at minimum)", hottest - config.fanTargetEngineTemperature, settledMin, settledMax,
+           switchOffs, shortestOnMillis, fanJoules / 3600, minimumJoules / 3600);
+  TEST_MESSAGE(summary);
+
+  TEST_ASSERT_LESS_THAN_MESSAGE(config.alarmEngineTemp - 10, hottest, summary);
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(4, fabsf(settledMax - config.fanTargetEngineTemperature), summary);
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(10, fabsf(settledMin - config.fanTargetEngineTemperature), summary);
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(15, switchOffs, summary); // Once every two minutes at most
+  if (switchOffs > 0) {
+    TEST_ASSERT_GREATER_OR_EQUAL_MESSAGE(60000, shortestOnMillis, summary);
+  }
+  TEST_ASSERT_LESS_THAN_MESSAGE(minimumJoules, fanJoules, summary);
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(30, largestDrop, summary);
+}
+
+void test_after_run_cools_a_hot_engine_after_shut_down() {
+  for (int i = 0; i < 50; i++) {
+    runFan(100);
+  }
+
+  int output = runFan(100, 25, 0);
+  TEST_ASSERT_GREATER_THAN(0, output);
+
+  // Gives up after two minutes even if the coolant is still hot
+  for (int i = 0; i < 650; i++) {
+    output = runFan(100, 25, 0);
+  }
+  TEST_ASSERT_EQUAL(0, output);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_single_degree_drop_does_not_stop_the_fan);
+  RUN_TEST(test_fan_is_held_at_minimum_through_a_short_dip);
+  RUN_TEST(test_hot_intake_air_adds_feed_forward);
+  RUN_TEST(test_idle_in_traffic_holds_temperature_without_short_cycling);
+  RUN_TEST(test_after_run_cools_a_hot_engine_after_shut_down);
+  return UNITY_END();
+}
@@ -0,0 +1,125 @@
+// Fuel integration from injector pulse widths, against an exact integration of the same rates and the edges of the
+// cluster counter and the stale data cutoff
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "functions_fuel.h"
+
+extern uint64_t fuelUsedPicolitres;
+
+float calculateBankFuelRateNanolitresPerMs(int, float);
+
+const uint64_t picolitresPerCount = 128000000; // fuelClusterPicolitresPerCount
+
+// One loop with fresh pulse widths from the ECM, as main.cpp calls it
+void step(int engineRpm, float injectorDurationMs, unsigned long loopMicros) {
+  stubAdvanceMicros(loopMicros);
+  updateFuelConsumption(engineRpm, injectorDurationMs, injectorDurationMs, millis(), micros());
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+// Each rate is rounded to a whole pL/us, which must average out over a drive rather than build up. Two hours of idle,
+// cruise and pulls with the RPM and pulse width moving every loop, checked against the unrounded rates
+void test_rounded_rate_does_not_drift_over_a_long_drive() {
+  step(0, 0, 1000); // Starts the integration
+  uint64_t startPicolitres = fuelUsedPicolitres;
+  double exactPicolitres = 0;
+  double lastRate = 0;
+
+  const unsigned long loopMicros = 1000;
+  for (unsigned long ms = 0; ms < 2UL * 3600 * 1000; ms++) {
+    unsigned long phase = ms % 60000;
+    float engineRpm, injectorDurationMs;
+    if (phase < 20000) {
+      engineRpm = 800 + (ms % 7);
+      injectorDurationMs = 2.4 + (ms % 13) * 0.003;
+    } else if (phase < 50000) {
+      engineRpm = 2500 + (phase % 400);
+      injectorDurationMs = 3.5 + (phase % 17) * 0.01;
+    } else {
+      engineRpm = 2000 + (phase - 50000) * 0.5f;
+      injectorDurationMs = 9.0 + (phase % 11) * 0.02;
+    }
+
+    exactPicolitres += lastRate * loopMicros;
+    step(engineRpm, injectorDurationMs, loopMicros);
+    lastRate = 2.0 * calculateBankFuelRateNanolitresPerMs(engineRpm, injectorDurationMs);
+  }
+
+  double usedPicolitres = fuelUsedPicolitres - startPicolitres;
+  double errorPercent = (usedPicolitres - exactPicolitres) / exactPicolitres * 100;
+  char summary[96];
+  snprintf(summary, sizeof(summary), "%.3f l over two hours, %.4f %% from the unrounded rates",
+           usedPicolitres / 1e12, errorPercent);
+  TEST_MESSAGE(summary);
+
+  // Half a pL/us at the idle rate of about 280 pL/us would be 0.18 %, the errors cancel to far less than that
+  TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.01, 0, errorPercent, summary);
+}
+
+// The cluster only looks at the difference between counter values, so the 16 bit wrap after 8388 l must carry on
+// counting without a jump
+void test_cluster_counter_wraps_without_a_jump() {
+  fuelUsedPicolitres = 65535 * picolitresPerCount;
+  TEST_ASSERT_EQUAL(65535, getFuelClusterCounter());
+
+  // Just under a count from the wrap, then 0.128 ml more
+  fuelUsedPicolitres += picolitresPerCount - 1;
+  TEST_ASSERT_EQUAL(65535, getFuelClusterCounter());
+  fuelUsedPicolitres += 1;
+  TEST_ASSERT_EQUAL(0, getFuelClusterCounter());
+
+  // Across the wrap at full load, the difference the cluster takes matches the fuel integrated
+  uint16_t counterBefore = getFuelClusterCounter() - 10;
+  fuelUsedPicolitres -= 10 * picolitresPerCount;
+  uint64_t usedBefore = fuelUsedPicolitres;
+  for (int i = 0; i < 5000; i++) {
+    step(6500, 12.0, 1000);
+  }
+  uint16_t counts = getFuelClusterCounter() - counterBefore;
+  TEST_ASSERT_EQUAL(fuelUsedPicolitres / picolitresPerCount - usedBefore / picolitresPerCount, counts);
+  TEST_ASSERT_GREATER_THAN(10, counts);
+  TEST_ASSERT_LESS_THAN(counterBefore, getFuelClusterCounter());
+}
+
+// Pulse widths a second old still count, a moment later the rate drops to zero and nothing more is integrated
+void test_stale_pulse_widths_stop_the_integration() {
+  step(3000, 5.0, 1000);
+  unsigned long injectorDurationTimestamp = millis();
+  TEST_ASSERT_GREATER_THAN(0, getFuelRateLitresPerHour());
+
+  stubAdvanceMillis(1000);
+  updateFuelConsumption(3000, 5.0, 5.0, injectorDurationTimestamp, micros());
+  TEST_ASSERT_GREATER_THAN(0, getFuelRateLitresPerHour());
+
+  stubAdvanceMillis(1);
+  updateFuelConsumption(3000, 5.0, 5.0, injectorDurationTimestamp, micros());
+  TEST_ASSERT_EQUAL_FLOAT(0, getFuelRateLitresPerHour());
+
+  uint64_t usedWhenStale = fuelUsedPicolitres;
+  for (int i = 0; i < 1000; i++) {
+    stubAdvanceMillis(1);
+    updateFuelConsumption(3000, 5.0, 5.0, injectorDurationTimestamp, micros());
+  }
+  TEST_ASSERT_TRUE(usedWhenStale == fuelUsedPicolitres);
+
+  // No pulse widths at all since boot reads the same as stale ones
+  updateFuelConsumption(3000, 5.0, 5.0, 0, micros());
+  TEST_ASSERT_EQUAL_FLOAT(0, getFuelRateLitresPerHour());
+
+  // Fresh data starts it again
+  step(3000, 5.0, 1000);
+  TEST_ASSERT_GREATER_THAN(0, getFuelRateLitresPerHour());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_rounded_rate_does_not_drift_over_a_long_drive);
+  RUN_TEST(test_cluster_counter_wraps_without_a_jump);
+  RUN_TEST(test_stale_pulse_widths_stop_the_integration);
+  return UNITY_END();
+}
@@ -0,0 +1,218 @@
+// BMW to Nissan speed gateway in the whole firmware, wheel speed frames replayed among the rest of the PT-CAN traffic
+
+#include <Arduino.h>
+#include <chrono>
+#include <mcp2515_can.h>
+#include <unity.h>
+
+#include <vector>
+
+#include "functions_config.h"
+#include "functions_gateway.h"
+
+void setup();
+void loop();
+
+const int bmwCsPin = 9;          // SPI_SS_PIN_BMW in main.cpp
+const int nissanCsPin = 10;      // SPI_SS_PIN_NISSAN
+const int speed370zFrame = 3;    // GATEWAY_FRAME_ECM_SPEED_370Z in main.cpp
+const int speedSkylineFrame = 4; // GATEWAY_FRAME_ECM_SPEED_SKYLINE
+
+struct speedSample {
+  unsigned long receivedMicros;
+  uint16_t rawRear; // 1/16 km/h before the speed scale factor
+};
+
+// Wheel speeds every 10 ms with DSC, steering and brake frames landing in the same millisecond, returns each wheel
+// speed frame put on the bus
+std::vector<speedSample> replayWheelSpeeds(unsigned long durationMs, float startKmh, float kmhPerSecond) {
+  std::vector<speedSample> samples;
+  unsigned long start = millis();
+  unsigned long nextFrameMs = 0;
+  while (millis() - start < durationMs) {
+    unsigned long elapsedMs = millis() - start;
+    if (elapsedMs >= nextFrameMs) {
+      nextFrameMs += 10;
+      unsigned char other[8] = {0};
+      stubMcp2515Receive(bmwCsPin, 0x153, 8, other);
+      stubMcp2515Receive(bmwCsPin, 0x1F5, 8, other);
+
+      uint16_t raw = (startKmh + kmhPerSecond * elapsedMs / 1000) * 16;
+      unsigned char wheelSpeeds[8] = {(unsigned char)raw, (unsigned char)(raw >> 8), (unsigned char)raw,
+                                      (unsigned char)(raw >> 8), (unsigned char)raw, (unsigned char)(raw >> 8),
+                                      (unsigned char)raw, (unsigned char)(raw >> 8)};
+      stubMcp2515Receive(bmwCsPin, 0x1F0, 8, wheelSpeeds);
+      samples.push_back({micros(), raw});
+
+      stubMcp2515Receive(bmwCsPin, 0x1F8, 8, other);
+    }
+    loop();
+    stubAdvanceMicros(250); // A loop on the R4 runs at about 4 kHz
+  }
+  return samples;
+}
+
+std::vector<stubCanFrame> sentToEcm(unsigned long canId) {
+  std::vector<stubCanFrame> frames;
+  for (const stubCanFrame &frame : stubMcp2515[nissanCsPin].sent) {
+    if (frame.id == canId) {
+      frames.push_back(frame);
+    }
+  }
+  return frames;
+}
+
+uint16_t bigEndianWord(const stubCanFrame &frame, int startByte) {
+  return (frame.data[startByte] << 8) | frame.data[startByte + 1];
+}
+
+void setUp() { stubMcp2515[nissanCsPin].sent.clear(); }
+
+void tearDown() {}
+
+void test_boot() {
+  setup();
+  for (int i = 0; i < 12000; i++) {
+    loop();
+    stubAdvanceMicros(250);
+  }
+}
+
+// Every wheel speed frame is forwarded once, as km/h x 100 over both bytes, as soon as it is read off the shield
+void test_each_wheel_speed_frame_is_forwarded_with_full_resolution() {
+  std::vector<speedSample> samples = replayWheelSpeeds(5000, 20, 15.3);
+  std::vector<stubCanFrame> frames = sentToEcm(0x280);
+  TEST_ASSERT_EQUAL(samples.size(), frames.size());
+
+  unsigned long worstMicros = 0, totalMicros = 0;
+  for (size_t i = 0; i < samples.size(); i++) {
+    unsigned long latencyMicros = frames[i].micros - samples[i].receivedMicros;
+    worstMicros = max(worstMicros, latencyMicros);
+    totalMicros += latencyMicros;
+
+    float expected = samples[i].rawRear / 16.0f * config.speedScaleFactor * 100;
+    TEST_ASSERT_FLOAT_WITHIN(1, expected, bigEndianWord(frames[i], 4));
+  }
+
+  // Needs both bytes, the old code only wrote byte 4
+  TEST_ASSERT_GREATER_THAN(255, bigEndianWord(frames.back(), 4));
+
+  char summary[96];
+  snprintf(summary, sizeof(summary), "%u samples, bus to shield latency avg %lu us, worst %lu us",
+           (unsigned)samples.size(), totalMicros / samples.size(), worstMicros);
+  TEST_MESSAGE(summary);
+
+  // The BMW shield is read one frame per loop, so the wheel speeds wait behind the two frames that arrived first and
+  // go out in the loop that decodes them. The old 20 ms timer added up to a whole period on top.
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(2 * 250, worstMicros, summary);
+}
+
+// The Skyline layout carries the same 16 bit value in each wheel's slot and the 370Z frame stops
+void test_skyline_layout_is_selectable() {
+  setGatewayFrameEnabled(speed370zFrame, false);
+  setGatewayFrameEnabled(speedSkylineFrame, true);
+
+  std::vector<speedSample> samples = replayWheelSpeeds(500, 100, 0);
+  std::vector<stubCanFrame> frames = sentToEcm(0x284);
+  TEST_ASSERT_EQUAL(0, sentToEcm(0x280).size());
+
+  // Plus the sample left over from the last test, which goes out as soon as the frame is enabled
+  TEST_ASSERT_EQUAL(samples.size() + 1, frames.size());
+
+  float expected = 100 * config.speedScaleFactor * 100;
+  TEST_ASSERT_FLOAT_WITHIN(1, expected, bigEndianWord(frames.back(), 0));
+  TEST_ASSERT_FLOAT_WITHIN(1, expected, bigEndianWord(frames.back(), 2));
+  TEST_ASSERT_FLOAT_WITHIN(1, expected, bigEndianWord(frames.back(), 4));
+
+  setGatewayFrameEnabled(speedSkylineFrame, false);
+  setGatewayFrameEnabled(speed370zFrame, true);
+}
+
+// Rule layouts as used in main.cpp, each benchmarked on its own by filling a frame with copies of it
+float benchmarkSource() { return 87.3; }
+float clutchPressed = 0;
+float benchmarkClutch() { return clutchPressed; }
+
+// name, frame, source, scale, offset, min, max, start byte, start bit, length bits, big endian, enabled
+const gatewayRule benchmarkRules[] = {
+    {"byte", 0, benchmarkSource, 1.0 / 0.75, 48.373 / 0.75, 0, 255, 1, 0, 8, false, true},
+    {"littleEndianWord", 0, benchmarkSource, 1, 0, 0, 65535, 2, 0, 16, false, true},
+    {"singleBit", 0, benchmarkSource, 1, 0, 0, 1, 3, 3, 1, false, true},
+    {"bigEndianWord", 0, benchmarkSource, 100, 0, 0, 65535, 4, 0, 16, true, true},
+};
+const int benchmarkRuleCopies = 16;
+const int benchmarkPasses = 200000;
+
+mcp2515_can benchmarkCan(bmwCsPin);
+mcp2515_can benchmarkEcmCan(nissanCsPin);
+canTxQueue benchmarkQueue = {&benchmarkCan};
+canTxQueue benchmarkEcmQueue = {&benchmarkEcmCan};
+
+// Host nanoseconds for one pass over the frame with the given rules
+double nanosecondsPerPass(const gatewayRule *rules, int ruleCount) {
+  gatewayFrame frames[1] = {{{0x316, canOutputClusterRefreshMs, 10}, CAN_BUS_BMW}};
+  initialiseGateway(frames, 1, rules, ruleCount, &benchmarkQueue, &benchmarkQueue);
+  serviceGateway(); // The first pass sends, every later one finds the payload unchanged
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < benchmarkPasses; i++) {
+    serviceGateway();
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / benchmarkPasses;
+}
+
+void test_per_rule_cost() {
+  double emptyPass = nanosecondsPerPass(benchmarkRules, 0);
+
+  for (const gatewayRule &rule : benchmarkRules) {
+    gatewayRule copies[benchmarkRuleCopies];
+    for (int i = 0; i < benchmarkRuleCopies; i++) {
+      copies[i] = rule;
+    }
+    double perRule = (nanosecondsPerPass(copies, benchmarkRuleCopies) - emptyPass) / benchmarkRuleCopies;
+
+    char summary[96];
+    snprintf(summary, sizeof(summary), "%s %.1f ns per rule, pass overhead %.1f ns", rule.name, perRule, emptyPass);
+    TEST_MESSAGE(summary);
+    TEST_ASSERT_LESS_THAN_MESSAGE(200, (int)perRule, summary);
+  }
+}
+
+// A new translation is only a table entry, here the 0x35D clutch status bit on the ECM bus
+void test_clutch_status_translation_is_data() {
+  const gatewayRule clutchRules[] = {
+      {"ecmClutch", 0, benchmarkClutch, 1, 0, 0, 1, 0, 0, 1, false, true},
+  };
+  gatewayFrame frames[1] = {
+      {{0x35D, canOutputEcmRefreshMs, 0, CAN_TX_PRIORITY_MEDIUM},
+       CAN_BUS_NISSAN,
+       NULL,
+       {255, 255, 255, 255, 255, 255, 255, 255}},
+  };
+  initialiseGateway(frames, 1, clutchRules, 1, &benchmarkQueue, &benchmarkEcmQueue);
+
+  clutchPressed = 0;
+  TEST_ASSERT_EQUAL(1, serviceGateway());
+  clutchPressed = 1;
+  TEST_ASSERT_EQUAL(1, serviceGateway());
+  serviceCanTxQueue(&benchmarkEcmQueue);
+
+  std::vector<stubCanFrame> sent = sentToEcm(0x35D);
+  TEST_ASSERT_EQUAL(2, sent.size());
+  TEST_ASSERT_EQUAL(0xFE, sent[0].data[0]);
+  TEST_ASSERT_EQUAL(0xFF, sent[1].data[0]);
+  TEST_ASSERT_EQUAL(0xFF, sent[1].data[7]);
+
+  // Unchanged and inside the refresh floor, nothing to send
+  TEST_ASSERT_EQUAL(0, serviceGateway());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_boot);
+  RUN_TEST(test_each_wheel_speed_frame_is_forwarded_with_full_resolution);
+  RUN_TEST(test_skyline_layout_is_selectable);
+  RUN_TEST(test_per_rule_cost);
+  RUN_TEST(test_clutch_status_translation_is_data);
+  return UNITY_END();
+}
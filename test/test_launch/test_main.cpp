@@ -0,0 +1,126 @@
+// Launch control assist driven by wheel speed frames the way main.cpp feeds it
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "functions_alarms.h"
+#include "functions_config.h"
+#include "functions_launch.h"
+#include "functions_traction.h"
+
+const int buzzerPin = 4;
+const uint16_t kmh = 16;              // Raw wheel speed units per km/h
+const unsigned long frameMs = 20;     // Wheel speed frame period
+const unsigned int launchTone = 2500; // launchBuzzerFrequency in functions_launch.cpp
+
+// One wheel speed frame, both front wheels at frontKmh and both rears at rearKmh
+void wheelFrame(float frontKmh, float rearKmh) {
+  stubAdvanceMillis(frameMs);
+  updateTractionAnalytics(frontKmh * kmh, frontKmh * kmh, rearKmh * kmh, rearKmh * kmh, millis());
+  updateLaunchWheelSpeed(getTractionValue(TRACTION_SLIP_REAR), frontKmh, millis(), buzzerPin);
+}
+
+void stage(int rpm = 4000) {
+  wheelFrame(0, 0);
+  updateLaunchClutch(true, 0, rpm, millis());
+}
+
+void release(int rpm = 4000) { updateLaunchClutch(false, 0, rpm, millis()); }
+
+void setUp() {
+  config = configData();
+  stubToneFrequency[buzzerPin] = 0;
+  // Reach 50 km/h so any launch left over from the last test finishes
+  wheelFrame(50, 50);
+  wheelFrame(0, 0);
+  updateLaunchClutch(false, 0, 800, millis());
+}
+
+void tearDown() {}
+
+void test_stopping_at_idle_does_not_stage() {
+  stage(800);
+  TEST_ASSERT_EQUAL(LAUNCH_IDLE, getLaunchState());
+
+  // Pulling away normally is not measured as a launch
+  release(1200);
+  TEST_ASSERT_EQUAL(LAUNCH_IDLE, getLaunchState());
+}
+
+void test_revs_arm_and_dropping_to_idle_disarms() {
+  stage(3000);
+  TEST_ASSERT_EQUAL(LAUNCH_STAGED, getLaunchState());
+
+  updateLaunchClutch(true, 0, 900, millis());
+  TEST_ASSERT_EQUAL(LAUNCH_IDLE, getLaunchState());
+}
+
+void test_initial_wheelspin_sounds_the_buzzer() {
+  stage();
+  release();
+  TEST_ASSERT_EQUAL(LAUNCH_ACTIVE, getLaunchState());
+
+  // Rears spin up before the fronts have turned at all
+  wheelFrame(0, 8);
+  TEST_ASSERT_EQUAL_MESSAGE(launchTone, stubToneFrequency[buzzerPin], "no buzzer with the fronts still stopped");
+
+  // Hooks up and drives away inside the slip band
+  wheelFrame(10, 10.5);
+  TEST_ASSERT_EQUAL(0, stubToneFrequency[buzzerPin]);
+
+  for (int speed = 12; speed <= 50; speed += 2) {
+    wheelFrame(speed, speed * 1.05f);
+  }
+  TEST_ASSERT_EQUAL(LAUNCH_IDLE, getLaunchState());
+  TEST_ASSERT_TRUE(isLaunchSummaryReady());
+  getLaunchSummary();
+}
+
+void test_slip_profile_starts_on_rear_wheelspin() {
+  stage();
+  release();
+  wheelFrame(0, 8);
+
+  // 3 s of profile at 100 ms per bucket
+  for (int i = 0; i < 160; i++) {
+    wheelFrame(1 + i * 0.3f, 2 + i * 0.3f);
+  }
+  TEST_ASSERT_TRUE(isLaunchSlipProfileReady());
+  String profile = getLaunchSlipProfile();
+
+  // The first bucket holds the wheelspin, it would be missing if the profile waited for the fronts
+  TEST_ASSERT_GREATER_THAN(500, atoi(profile.c_str() + 1));
+}
+
+void test_alarm_silences_the_launch_tone() {
+  stage();
+  release();
+  wheelFrame(0, 8);
+  TEST_ASSERT_EQUAL(launchTone, stubToneFrequency[buzzerPin]);
+
+  // Engine temperature alarm raised in an off phase of its beep pattern
+  updateAlarmSignal(ALARM_SIGNAL_ENGINE_TEMP, config.alarmEngineTemp + 5, 4000);
+  stubAdvanceMillis(1000);
+  while (millis() % 200 < 100) {
+    stubAdvanceMillis(1);
+  }
+  serviceAlarms(buzzerPin, 4000);
+  TEST_ASSERT_TRUE(isAlarmActive());
+
+  // The next frame must not leave the launch tone running under the alarm
+  wheelFrame(0, 8);
+  TEST_ASSERT_EQUAL(0, stubToneFrequency[buzzerPin]);
+
+  updateAlarmSignal(ALARM_SIGNAL_ENGINE_TEMP, 80, 4000);
+  serviceAlarms(buzzerPin, 4000);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_stopping_at_idle_does_not_stage);
+  RUN_TEST(test_revs_arm_and_dropping_to_idle_disarms);
+  RUN_TEST(test_initial_wheelspin_sounds_the_buzzer);
+  RUN_TEST(test_slip_profile_starts_on_rear_wheelspin);
+  RUN_TEST(test_alarm_silences_the_launch_tone);
+  return UNITY_END();
+}
@@ -0,0 +1,83 @@
+// Cost of a log call and what happens when the ring or the UART is full. Debug is compiled out of this file only.
+
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+#include <Arduino.h>
+#include <chrono>
+#include <unity.h>
+
+#include "functions_log.h"
+
+extern unsigned long logRecordsWritten;
+extern unsigned long logRecordsDropped;
+
+const int benchmarkCalls = 1000000;
+
+// Host nanoseconds per call, the ring is drained between batches of 16 and only the calls themselves are timed
+double nanosecondsPerCall(logModule module) {
+  Serial.writeRoom = 1 << 30;
+  std::chrono::steady_clock::duration elapsed{};
+  for (int batch = 0; batch < benchmarkCalls / 16; batch++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 16; i++) {
+      LOG_INFO(module, "Gear change detected from %ld to %ld with a ratio delta of %ld rpm", (long)i, (long)i + 1, 42L);
+    }
+    elapsed += std::chrono::steady_clock::now() - start;
+    serviceLog();
+    Serial.output.clear();
+  }
+  return std::chrono::duration<double, std::nano>(elapsed).count() / benchmarkCalls;
+}
+
+void setUp() {
+  logModuleMask = 0xFFFFFFFF;
+  Serial.output.clear();
+}
+
+void tearDown() {}
+
+void test_per_call_cost() {
+  double enabled = nanosecondsPerCall(LOG_MODULE_GEARS);
+  logModuleMask = ~(uint32_t)(1u << LOG_MODULE_GEARS);
+  double masked = nanosecondsPerCall(LOG_MODULE_GEARS);
+
+  char summary[96];
+  snprintf(summary, sizeof(summary), "%.1f ns per call, %.1f ns with the module masked off", enabled, masked);
+  TEST_MESSAGE(summary);
+  TEST_ASSERT_LESS_THAN_MESSAGE(200, (int)enabled, summary);
+  TEST_ASSERT_LESS_THAN_MESSAGE((int)enabled + 1, (int)masked, summary);
+}
+
+// A full ring drops the newest record rather than waiting, and says so once the backlog has gone out
+void test_full_ring_drops_without_blocking() {
+  Serial.writeRoom = 0;
+  unsigned long dropped = logRecordsDropped;
+  unsigned long before = micros();
+  for (int i = 0; i < 100; i++) {
+    LOG_WARN(LOG_MODULE_GENERAL, "Record %d", i);
+    serviceLog();
+  }
+  TEST_ASSERT_EQUAL(before, micros());
+  TEST_ASSERT_GREATER_THAN(dropped, logRecordsDropped);
+
+  Serial.writeRoom = 1 << 30;
+  serviceLog();
+  TEST_ASSERT_TRUE(Serial.output.find("records dropped") != std::string::npos);
+}
+
+void test_levels_above_log_level_are_compiled_out() {
+  unsigned long written = logRecordsWritten;
+  LOG_DEBUG(LOG_MODULE_GENERAL, "Compiled out");
+  LOG_TRACE(LOG_MODULE_GENERAL, "Compiled out");
+  TEST_ASSERT_EQUAL(written, logRecordsWritten);
+  LOG_INFO(LOG_MODULE_GENERAL, "Kept");
+  TEST_ASSERT_EQUAL(written + 1, logRecordsWritten);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_per_call_cost);
+  RUN_TEST(test_full_ring_drops_without_blocking);
+  RUN_TEST(test_levels_above_log_level_are_compiled_out);
+  return UNITY_END();
+}
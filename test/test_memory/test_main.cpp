@@ -0,0 +1,86 @@
+// Heap use of the whole firmware once warm, setup() and loop() run against the fake shields and a replayed BMW bus
+
+#include <Arduino.h>
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+#include <PubSubClient.h>
+#include <malloc.h>
+#include <mcp2515_can.h>
+#include <unity.h>
+
+#include "functions_memory.h"
+
+void setup();
+void loop();
+
+const int bmwCsPin = 9;     // SPI_SS_PIN_BMW in main.cpp
+const int nissanCsPin = 10; // SPI_SS_PIN_NISSAN
+
+// Wheel speeds, ASC, steering angle, brake pressure and ABS at roughly their rates in the car
+void runLoops(unsigned long durationMs) {
+  unsigned char frame[8] = {0x40, 0x06, 0x40, 0x06, 0x40, 0x06, 0x40, 0x06};
+  unsigned long start = millis();
+  while (millis() - start < durationMs) {
+    if (millis() % 10 == 0) {
+      frame[0]++;
+      stubMcp2515Receive(bmwCsPin, 0x1F0, 8, frame);
+      stubMcp2515Receive(bmwCsPin, 0x153, 8, frame);
+    }
+    if (millis() % 20 == 0) {
+      stubMcp2515Receive(bmwCsPin, 0x1F5, 8, frame);
+      stubMcp2515Receive(bmwCsPin, 0x1F8, 8, frame);
+    }
+    loop();
+    stubMqtt.published.clear(); // The fakes keep what was sent, that is not the firmware's memory
+    stubUdpSent.clear();
+    stubMcp2515[bmwCsPin].sent.clear();
+    stubMcp2515[nissanCsPin].sent.clear();
+    stubAdvanceMillis(1);
+  }
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_boot_and_warm_up() {
+  setup();
+  runLoops(60000);
+  TEST_ASSERT_GREATER_THAN(0, stubMqtt.connectCount);
+  TEST_ASSERT_GREATER_THAN(0, getMemoryStats()->allocations);
+}
+
+// Strings come and go with every publish, but nothing may be left behind once the firmware is warm
+void test_no_steady_state_growth() {
+  unsigned long liveAllocations = getMemoryStats()->liveAllocations;
+  unsigned long liveBytes = getMemoryStats()->liveBytes;
+
+  runLoops(300000);
+
+  char summary[96];
+  snprintf(summary, sizeof(summary), "live blocks %lu -> %lu, bytes %lu -> %lu", liveAllocations,
+           getMemoryStats()->liveAllocations, liveBytes, getMemoryStats()->liveBytes);
+  TEST_MESSAGE(summary);
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(liveAllocations, getMemoryStats()->liveAllocations, summary);
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(liveBytes, getMemoryStats()->liveBytes, summary);
+  TEST_ASSERT_EQUAL_MESSAGE(0, getMemoryStats()->failedAllocations, summary);
+}
+
+// The free block search is not itself counted and leaves the heap as it found it
+void test_free_block_search_does_not_touch_the_heap() {
+  unsigned long allocations = getMemoryStats()->allocations;
+  size_t arena = mallinfo2().arena;
+  for (int i = 0; i < 100; i++) {
+    getLargestFreeHeapBlock();
+  }
+  TEST_ASSERT_EQUAL(allocations, getMemoryStats()->allocations);
+  TEST_ASSERT_EQUAL(arena, mallinfo2().arena);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_boot_and_warm_up);
+  RUN_TEST(test_no_steady_state_growth);
+  RUN_TEST(test_free_block_search_does_not_touch_the_heap);
+  return UNITY_END();
+}
@@ -0,0 +1,143 @@
+// Live tuning over the MQTT command topic, the fake PubSubClient stands in for the broker and hands messages to the
+// firmware's callback from its loop() the way the real client does
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+#include <mcp2515_can.h>
+#include <unity.h>
+
+#include <string>
+
+#include "functions_command.h"
+#include "functions_config.h"
+#include "functions_memory.h"
+
+void setup();
+void loop();
+
+const int bmwCsPin = 9;      // SPI_SS_PIN_BMW in main.cpp
+const int nissanCsPin = 10;  // SPI_SS_PIN_NISSAN
+const uint16_t rawKmh = 100 * 16; // Wheel speed frames at 100 km/h before the scale factor
+
+// One R4 loop with wheel speeds from the BMW every 10 ms
+void runLoop() {
+  if (micros() % 10000 < 250) {
+    unsigned char wheelSpeeds[8] = {(unsigned char)rawKmh, rawKmh >> 8, (unsigned char)rawKmh, rawKmh >> 8,
+                                    (unsigned char)rawKmh, rawKmh >> 8, (unsigned char)rawKmh, rawKmh >> 8};
+    stubMcp2515Receive(bmwCsPin, 0x1F0, 8, wheelSpeeds);
+  }
+  loop();
+  stubAdvanceMicros(250);
+}
+
+// The latest reply on the reply topic, empty if there is none
+std::string lastReply() {
+  for (auto message = stubMqtt.published.rbegin(); message != stubMqtt.published.rend(); ++message) {
+    if (message->topic == commandReplyTopic) {
+      return message->payload;
+    }
+  }
+  return "";
+}
+
+// km/h x 100 in the last speed frame sent to the ECM
+int lastEcmSpeed() {
+  for (auto frame = stubMcp2515[nissanCsPin].sent.rbegin(); frame != stubMcp2515[nissanCsPin].sent.rend(); ++frame) {
+    if (frame->id == 0x280) {
+      return (frame->data[4] << 8) | frame->data[5];
+    }
+  }
+  return -1;
+}
+
+void setUp() {
+  stubMqtt.published.clear();
+  stubMcp2515[nissanCsPin].sent.clear();
+}
+
+void tearDown() {}
+
+void test_subscribes_once_connected() {
+  setup();
+  for (int i = 0; i < 40000 && stubMqtt.subscriptions.empty(); i++) {
+    runLoop();
+  }
+  TEST_ASSERT_EQUAL(1, stubMqtt.subscriptions.size());
+  TEST_ASSERT_EQUAL_STRING(commandTopic, stubMqtt.subscriptions[0].c_str());
+}
+
+// From the message reaching the client to the ECM seeing the new speed scale, and the reply carrying the same id
+void test_command_to_effect_latency() {
+  for (int i = 0; i < 100; i++) {
+    runLoop();
+  }
+  TEST_ASSERT_INT_WITHIN(1, 100 * config.speedScaleFactor * 100, lastEcmSpeed());
+
+  unsigned long sentMicros = micros();
+  stubMqttDeliver(commandTopic, "#42 set speedScaleFactor 1.1");
+
+  unsigned long appliedMicros = 0, effectMicros = 0;
+  while ((appliedMicros == 0 || effectMicros == 0) && micros() - sentMicros < 100000) {
+    runLoop();
+    if (appliedMicros == 0 && config.speedScaleFactor == 1.1f) {
+      appliedMicros = micros();
+    }
+    if (effectMicros == 0 && lastEcmSpeed() == 11000) {
+      effectMicros = micros();
+    }
+  }
+
+  char summary[128];
+  snprintf(summary, sizeof(summary), "applied after %lu us, on the ECM bus after %lu us, reply \"%s\"",
+           appliedMicros - sentMicros, effectMicros - sentMicros, lastReply().c_str());
+  TEST_MESSAGE(summary);
+
+  // Applied at the top of the very next loop, and in effect with the next wheel speed frame
+  TEST_ASSERT_GREATER_THAN_MESSAGE(0, appliedMicros, summary);
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(250, appliedMicros - sentMicros, summary);
+  TEST_ASSERT_GREATER_THAN_MESSAGE(0, effectMicros, summary);
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(10000 + 250, effectMicros - sentMicros, summary);
+  TEST_ASSERT_EQUAL_STRING_LEN("#42 ok set speedScaleFactor 1.100 in ", lastReply().c_str(), 37);
+}
+
+// A bad value is refused as a whole, the running config is untouched and the reply says why
+void test_invalid_array_is_rejected_without_touching_the_config() {
+  float before[8];
+  memcpy(before, config.rpmMultipliers, sizeof(before));
+
+  stubMqttDeliver(commandTopic, "#43 set rpmMultipliers 5,5,5,5,5,5,5,50");
+  runLoop();
+  TEST_ASSERT_EQUAL_MEMORY(before, config.rpmMultipliers, sizeof(before));
+  TEST_ASSERT_EQUAL_STRING_LEN("#43 error invalid value for rpmMultipliers", lastReply().c_str(), 42);
+
+  stubMqttDeliver(commandTopic, "#44 set rpmMultipliers 5,5,5,5,5,5,5,5");
+  runLoop();
+  for (int i = 0; i < 8; i++) {
+    TEST_ASSERT_EQUAL_FLOAT(5, config.rpmMultipliers[i]);
+  }
+  TEST_ASSERT_EQUAL_STRING_LEN("#44 ok set rpmMultipliers", lastReply().c_str(), 25);
+}
+
+// Parsed in place in the receive buffer, nothing is allocated from the command arriving to the reply being built
+void test_commands_do_not_allocate() {
+  char commands[][48] = {"#1 get gearRatios", "#2 set fanTargetEngineTemperature 94", "#3 set gearRatios[2] 1.5",
+                         "#4 set tyreWidth 9000", "#5 frobnicate"};
+
+  unsigned long allocations = getMemoryStats()->allocations;
+  for (char *command : commands) {
+    handleConfigCommand(command, strlen(command));
+    TEST_ASSERT_TRUE(applyPendingConfigCommand());
+  }
+  TEST_ASSERT_EQUAL(allocations, getMemoryStats()->allocations);
+  TEST_ASSERT_EQUAL_FLOAT(1.5, config.gearRatios[2]);
+  TEST_ASSERT_EQUAL_STRING_LEN("#5 error unknown command", getConfigCommandReply(), 24);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_subscribes_once_connected);
+  RUN_TEST(test_command_to_effect_latency);
+  RUN_TEST(test_invalid_array_is_rejected_without_touching_the_config);
+  RUN_TEST(test_commands_do_not_allocate);
+  return UNITY_END();
+}
@@ -0,0 +1,115 @@
+// Failure injection against the whole firmware, setup() and loop() run against the fake shields and broker
+
+#include <Arduino.h>
+#include <Ethernet.h>
+#include <PubSubClient.h>
+#include <mcp2515_can.h>
+#include <unity.h>
+
+void setup();
+void loop();
+
+const int bmwCsPin = 9; // SPI_SS_PIN_BMW in main.cpp
+const unsigned long watchdogTimeoutMs = 4000;
+
+unsigned long longestLoopMs = 0;
+
+// One loop per millisecond of simulated time, remembering the longest the loop ever blocked
+void runLoops(unsigned long durationMs) {
+  unsigned long start = millis();
+  while (millis() - start < durationMs) {
+    unsigned long before = millis();
+    loop();
+    longestLoopMs = max(longestLoopMs, millis() - before);
+    stubAdvanceMillis(1);
+  }
+}
+
+void setUp() {
+  stubEthernet.outgoingReachable = true;
+  stubMqtt.responds = true;
+  stubMcp2515[bmwCsPin].beginResult = CAN_OK;
+  stubMcp2515[bmwCsPin].registersFloating = false;
+  longestLoopMs = 0;
+}
+
+void tearDown() {}
+
+void test_boot_completes() {
+  setup();
+  runLoops(10000);
+  TEST_ASSERT_TRUE(stubMcp2515[bmwCsPin].initialised);
+  TEST_ASSERT_GREATER_THAN(0, stubMqtt.connectCount);
+}
+
+// The car parked with the ignition off, the shield is fine but nothing is on the bus
+void test_quiet_bus_is_not_reinitialised() {
+  unsigned long beginCount = stubMcp2515[bmwCsPin].beginCount;
+  runLoops(30000);
+  TEST_ASSERT_EQUAL(beginCount, stubMcp2515[bmwCsPin].beginCount);
+}
+
+// The controller reset itself and is sitting in configuration mode, it is brought back straight away
+void test_reset_controller_is_recovered() {
+  unsigned long beginCount = stubMcp2515[bmwCsPin].beginCount;
+  stubMcp2515[bmwCsPin].registers[0x0E] = 0x80;
+  stubMcp2515[bmwCsPin].registers[0x0F] = 0x87;
+  runLoops(3000);
+  TEST_ASSERT_EQUAL(beginCount + 1, stubMcp2515[bmwCsPin].beginCount);
+  TEST_ASSERT_EQUAL(0x00, stubMcp2515[bmwCsPin].registers[0x0E]);
+}
+
+// A shield that has dropped off SPI is retried less and less often rather than every second forever
+void test_wedged_controller_is_retried_with_back_off() {
+  runLoops(61000); // Long enough up for the back off to start again from the table interval
+  unsigned long beginCount = stubMcp2515[bmwCsPin].beginCount;
+  stubMcp2515[bmwCsPin].registersFloating = true;
+  stubMcp2515[bmwCsPin].beginResult = CAN_FAILINIT;
+
+  runLoops(5000);
+  unsigned long earlyAttempts = stubMcp2515[bmwCsPin].beginCount - beginCount;
+  TEST_ASSERT_GREATER_OR_EQUAL(2, earlyAttempts);
+
+  runLoops(115000);
+  unsigned long attempts = stubMcp2515[bmwCsPin].beginCount - beginCount;
+  char message[64];
+  snprintf(message, sizeof(message), "%lu attempts in two minutes", attempts);
+  TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(9, attempts, message);
+
+  // Comes back once the shield answers again
+  stubMcp2515[bmwCsPin].registersFloating = false;
+  stubMcp2515[bmwCsPin].beginResult = CAN_OK;
+  runLoops(61000);
+  TEST_ASSERT_TRUE(stubMcp2515[bmwCsPin].initialised);
+}
+
+// Every blocking wait in an MQTT connect attempt has to fit inside the watchdog timeout
+void test_unreachable_broker_does_not_starve_the_watchdog() {
+  // The broker host has gone, the current connection drops and every reconnect waits out the TCP connect
+  stubEthernet.outgoingReachable = false;
+  stubMqtt.responds = false;
+  unsigned long connectCount = stubMqtt.connectCount;
+  runLoops(20000);
+  TEST_ASSERT_GREATER_THAN(connectCount, stubMqtt.connectCount);
+  TEST_ASSERT_LESS_THAN(watchdogTimeoutMs / 2 + 100, longestLoopMs);
+}
+
+// The host is up but Mosquitto is not answering, every reconnect waits out the CONNACK
+void test_silent_broker_does_not_starve_the_watchdog() {
+  stubMqtt.responds = false;
+  unsigned long connectCount = stubMqtt.connectCount;
+  runLoops(20000);
+  TEST_ASSERT_GREATER_THAN(connectCount, stubMqtt.connectCount);
+  TEST_ASSERT_LESS_THAN(watchdogTimeoutMs / 2 + 100, longestLoopMs);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_boot_completes);
+  RUN_TEST(test_quiet_bus_is_not_reinitialised);
+  RUN_TEST(test_reset_controller_is_recovered);
+  RUN_TEST(test_wedged_controller_is_retried_with_back_off);
+  RUN_TEST(test_unreachable_broker_does_not_starve_the_watchdog);
+  RUN_TEST(test_silent_broker_does_not_starve_the_watchdog);
+  return UNITY_END();
+}
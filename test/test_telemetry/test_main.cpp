@@ -0,0 +1,291 @@
+// MQTT telemetry published by exception on a replayed drive, against the fixed 100 ms and 1 s cadence it replaced
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <PubSubClient.h>
+#include <map>
+#include <string>
+
+#include "functions_config.h"
+#include "functions_mqtt.h"
+#include "functions_signals.h"
+#include "functions_telemetry.h"
+
+float bestZeroToOneHundred() { return 6.42; }
+
+// The signal rows of telemetryPolicyTable in main.cpp
+// topic, signal, source, decimals, absolute deadband, relative deadband, min interval, heartbeat, legacy ms, windowed
+telemetryPolicy policies[] = {
+    {"rpm", SIGNAL_RPM, NULL, 0, 25, 0, 50, 5000, 100, true},
+    {"speed", SIGNAL_VEHICLE_SPEED_FRONT, NULL, 0, 0.5, 0, 50, 5000, 100},
+    {"gear", SIGNAL_GEAR, NULL, 0, 0, 0, 50, 5000, 100},
+    {"diffSpeedSplit", SIGNAL_VEHICLE_SPEED_REAR_VARIATION, NULL, 0, 0.5, 0, 50, 5000, 100},
+    {"oilPressure", SIGNAL_OIL_PRESSURE, NULL, 2, 0.5, 0, 50, 5000, 100, true},
+    {"crankCaseVacuum", SIGNAL_CRANK_CASE_VACUUM, NULL, 2, 0.05, 0, 50, 5000, 100},
+    {"steeringAngle", SIGNAL_STEERING_ANGLE, NULL, 2, 1, 0, 50, 5000, 100},
+    {"brakePressure", SIGNAL_BRAKE_PRESSURE, NULL, 2, 0.5, 0, 50, 5000, 100},
+    {"lateralAccel", SIGNAL_LATERAL_ACCELERATION, NULL, 2, 0.1, 0, 50, 5000, 100},
+    {"fuelPressure", SIGNAL_FUEL_PRESSURE, NULL, 2, 0.5, 0, 200, 10000, 1000},
+    {"coolant", SIGNAL_ENGINE_TEMP, NULL, 0, 0.5, 0, 200, 10000, 1000},
+    {"fan", SIGNAL_FAN_DUTY, NULL, 0, 1, 0, 200, 10000, 1000},
+    {"radiatorTemp", SIGNAL_RADIATOR_OUTLET_TEMP, NULL, 0, 0.5, 0, 200, 10000, 1000},
+    {"0to100", SIGNAL_COUNT, bestZeroToOneHundred, 2, 0, 0, 1000, 30000, 1000},
+};
+const int policyCount = sizeof(policies) / sizeof(policies[0]);
+const int oilPressurePolicy = 4;
+const unsigned long servicePeriodMs = 20; // ptServiceTelemetry in main.cpp
+
+unsigned long noiseState = 1;
+
+// Sender noise of up to +- amplitude
+float noise(float amplitude) {
+  noiseState = noiseState * 1103515245 + 12345;
+  return ((int)((noiseState >> 16) % 2001) - 1000) / 1000.0f * amplitude;
+}
+
+// A lap of a B road every 60 s, each signal written at the rate its source delivers it
+void writeDriveSignals(unsigned long ms) {
+  float lap = (ms % 60000) / 60000.0f * 2 * PI;
+  float speed = 70 + 40 * sinf(lap) + 10 * sinf(5 * lap);
+  float rpm = 2500 + 2000 * sinf(3 * lap);
+
+  if (ms % 10 == 0) {
+    writeSignal(SIGNAL_VEHICLE_SPEED_FRONT, speed + noise(0.1));
+    writeSignal(SIGNAL_VEHICLE_SPEED_REAR_VARIATION, fabsf(noise(0.4)));
+    writeSignal(SIGNAL_OIL_PRESSURE, 20 + rpm / 100 + noise(0.3));
+  }
+  if (ms % 20 == 0) {
+    writeSignal(SIGNAL_STEERING_ANGLE, 90 * sinf(5 * lap) + noise(0.2));
+    writeSignal(SIGNAL_LATERAL_ACCELERATION, 6 * sinf(5 * lap) + noise(0.05));
+    writeSignal(SIGNAL_BRAKE_PRESSURE, max(0.0f, -40 * cosf(3 * lap)));
+  }
+  if (ms % 50 == 0) {
+    writeSignal(SIGNAL_RPM, rpm + noise(10));
+  }
+  if (ms % 100 == 0) {
+    writeSignal(SIGNAL_GEAR, speed < 50 ? 3 : 4);
+    writeSignal(SIGNAL_CRANK_CASE_VACUUM, -1.5f + noise(0.02));
+    writeSignal(SIGNAL_ENGINE_TEMP, 89 + (ms / 20000) % 2);
+  }
+  if (ms % 200 == 0) {
+    writeSignal(SIGNAL_FAN_DUTY, 0);
+  }
+  if (ms % 1000 == 0) {
+    writeSignal(SIGNAL_FUEL_PRESSURE, 52 + noise(0.2));
+    writeSignal(SIGNAL_RADIATOR_OUTLET_TEMP, 78 + noise(0.2));
+  }
+}
+
+// Sitting in the paddock with the engine idling, nothing but sender noise
+void writeIdleSignals(unsigned long ms) {
+  if (ms % 10 == 0) {
+    writeSignal(SIGNAL_VEHICLE_SPEED_FRONT, 0);
+    writeSignal(SIGNAL_VEHICLE_SPEED_REAR_VARIATION, 0);
+    writeSignal(SIGNAL_OIL_PRESSURE, 28 + noise(0.3));
+  }
+  if (ms % 20 == 0) {
+    writeSignal(SIGNAL_STEERING_ANGLE, 2 + noise(0.2));
+    writeSignal(SIGNAL_LATERAL_ACCELERATION, noise(0.05));
+    writeSignal(SIGNAL_BRAKE_PRESSURE, 0);
+  }
+  if (ms % 50 == 0) {
+    writeSignal(SIGNAL_RPM, 800 + noise(10));
+  }
+  if (ms % 100 == 0) {
+    writeSignal(SIGNAL_GEAR, 0);
+    writeSignal(SIGNAL_CRANK_CASE_VACUUM, -1.5f + noise(0.02));
+    writeSignal(SIGNAL_ENGINE_TEMP, 91);
+  }
+  if (ms % 200 == 0) {
+    writeSignal(SIGNAL_FAN_DUTY, 45);
+  }
+  if (ms % 1000 == 0) {
+    writeSignal(SIGNAL_FUEL_PRESSURE, 52 + noise(0.2));
+    writeSignal(SIGNAL_RADIATOR_OUTLET_TEMP, 80 + noise(0.2));
+  }
+}
+
+struct telemetryTotals {
+  std::map<std::string, unsigned long> messages;
+  float sentMessages = 0;
+  float sentBytes = 0;
+  float legacyMessages = 0;
+  float legacyBytes = 0;
+};
+
+// Replays the drive through serviceTelemetry and totals what reached the broker against the fixed cadence, with the
+// legacy messages costed at the average size of that topic's messages
+telemetryTotals replay(const char *name, void (*writeSignals)(unsigned long), unsigned long durationMs) {
+  stubMqtt.published.clear();
+  for (unsigned long ms = 0; ms < durationMs; ms++) {
+    stubAdvanceMillis(1);
+    writeSignals(ms);
+    if (ms % servicePeriodMs == 0) {
+      serviceTelemetry(policies, policyCount);
+    }
+  }
+
+  telemetryTotals totals;
+  std::map<std::string, unsigned long> bytes;
+  for (stubMqttMessage &message : stubMqtt.published) {
+    totals.messages[message.topic]++;
+    bytes[message.topic] += message.topic.size() + message.payload.size() + 4;
+  }
+
+  for (telemetryPolicy &policy : policies) {
+    std::string topic = policy.topic;
+    TEST_ASSERT_GREATER_OR_EQUAL_MESSAGE(durationMs / policy.heartbeatMs, totals.messages[topic], policy.topic);
+
+    float averageBytes = (float)bytes[topic] / totals.messages[topic];
+    totals.sentMessages += totals.messages[topic];
+    totals.sentBytes += bytes[topic];
+    totals.legacyMessages += durationMs / policy.legacyPeriodMs;
+    totals.legacyBytes += durationMs / policy.legacyPeriodMs * averageBytes;
+  }
+
+  float seconds = durationMs / 1000.0f;
+  char summary[160];
+  snprintf(summary, sizeof(summary), "%s %.1f msg/s %.0f bytes/s, saved %.1f msg/s %.0f bytes/s against %.1f msg/s %.0f "
+           "bytes/s", name, totals.sentMessages / seconds, totals.sentBytes / seconds,
+           (totals.legacyMessages - totals.sentMessages) / seconds, (totals.legacyBytes - totals.sentBytes) / seconds,
+           totals.legacyMessages / seconds, totals.legacyBytes / seconds);
+  TEST_MESSAGE(summary);
+  return totals;
+}
+
+void setUp() {
+  config = configData();
+  connectMqttClientToBroker();
+}
+
+void tearDown() {}
+
+// Ten minutes of hard driving. Steering, g and RPM move faster than their deadbands and go out at up to 20 Hz, more
+// often than the old 100 ms slot, which the slow and static metrics more than pay for
+void test_replayed_drive_saves_messages_and_bytes() {
+  telemetryTotals totals = replay("B road", writeDriveSignals, 600000);
+  TEST_ASSERT_LESS_THAN(totals.legacyMessages * 0.75f, totals.sentMessages);
+  TEST_ASSERT_LESS_THAN(totals.legacyBytes * 0.85f, totals.sentBytes);
+
+  // Static values cost their heartbeat and nothing more
+  TEST_ASSERT_LESS_OR_EQUAL(600000 / 30000 + 1, totals.messages["0to100"]);
+  TEST_ASSERT_LESS_OR_EQUAL(600000 / 10000 + 1, totals.messages["fan"]);
+  TEST_ASSERT_LESS_OR_EQUAL(600000 / 5000 + 1, totals.messages["crankCaseVacuum"]);
+}
+
+// Idling, sender noise stays inside the deadbands so almost everything is down to its heartbeat
+void test_idle_costs_little_more_than_the_heartbeats() {
+  telemetryTotals totals = replay("Paddock", writeIdleSignals, 600000);
+  TEST_ASSERT_LESS_THAN(totals.legacyMessages * 0.05f, totals.sentMessages);
+  TEST_ASSERT_LESS_THAN(totals.legacyBytes * 0.1f, totals.sentBytes);
+}
+
+// A change beyond the deadband goes out at the next service after the minimum interval, not the next fixed slot
+void test_change_is_published_at_the_next_service() {
+  for (int i = 0; i < 100; i++) {
+    stubAdvanceMillis(servicePeriodMs);
+    writeSignal(SIGNAL_VEHICLE_SPEED_FRONT, 50);
+    serviceTelemetry(policies, policyCount);
+  }
+  stubMqtt.published.clear();
+
+  unsigned long changedMillis = millis();
+  unsigned long publishedMillis = 0;
+  while (publishedMillis == 0 && millis() - changedMillis < 1000) {
+    stubAdvanceMillis(servicePeriodMs);
+    writeSignal(SIGNAL_VEHICLE_SPEED_FRONT, 55);
+    serviceTelemetry(policies, policyCount);
+    for (stubMqttMessage &message : stubMqtt.published) {
+      if (message.topic == "speed" && message.payload == "{\"value\":55}") {
+        publishedMillis = millis();
+      }
+    }
+  }
+  TEST_ASSERT_GREATER_THAN(0, publishedMillis);
+  TEST_ASSERT_LESS_OR_EQUAL(servicePeriodMs, publishedMillis - changedMillis);
+}
+
+// A 30 ms oil pressure dip in a corner, sampled every 10 ms. The old 100 ms snapshot of the latest value never lands on
+// it, the windowed publish carries it in its min and accounts for every sample
+void test_short_dip_survives_the_window_but_not_a_snapshot() {
+  for (int i = 0; i < 100; i++) {
+    stubAdvanceMillis(servicePeriodMs);
+    writeSignal(SIGNAL_OIL_PRESSURE, 55);
+    serviceTelemetry(policies, policyCount);
+  }
+  stubMqtt.published.clear();
+
+  // Only count what is written from here on, drop whatever is still waiting in the store and the policy
+  signalWindow pending;
+  takeSignalWindow(SIGNAL_OIL_PRESSURE, &pending);
+  policies[oilPressurePolicy].window = signalWindow();
+
+  float snapshotMin = 1000;
+  unsigned long samples = 0;
+  for (unsigned long ms = 1; ms <= 1000; ms++) {
+    stubAdvanceMillis(1);
+    if (ms % 10 == 0) {
+      writeSignal(SIGNAL_OIL_PRESSURE, ms >= 430 && ms < 460 ? 12 : 55);
+      samples++;
+    }
+    if (ms % 100 == 0) {
+      snapshotMin = min(snapshotMin, readSignal(SIGNAL_OIL_PRESSURE));
+    }
+    if (ms % servicePeriodMs == 0) {
+      serviceTelemetry(policies, policyCount);
+    }
+  }
+
+  float windowMin = 1000;
+  unsigned long windowCount = 0;
+  for (stubMqttMessage &message : stubMqtt.published) {
+    if (message.topic != "oilPressure") {
+      continue;
+    }
+    float minimum = 0, maximum = 0;
+    unsigned long count = 0;
+    sscanf(strstr(message.payload.c_str(), "\"min\":"), "\"min\":%f,\"max\":%f,\"count\":%lu", &minimum, &maximum,
+           &count);
+    windowMin = min(windowMin, minimum);
+    windowCount += count;
+  }
+
+  TEST_ASSERT_EQUAL(55, snapshotMin);
+  TEST_ASSERT_EQUAL(12, windowMin);
+  TEST_ASSERT_EQUAL(samples, windowCount + policies[oilPressurePolicy].window.count);
+}
+
+// Only the signals a windowed policy reads pay for a window, and one nobody takes stops growing at the count the UDP
+// datagram can carry while still holding the extremes
+void test_windows_are_kept_only_for_windowed_signals_and_bounded() {
+  TEST_ASSERT_TRUE(isSignalWindowed(SIGNAL_OIL_PRESSURE));
+  TEST_ASSERT_FALSE(isSignalWindowed(SIGNAL_STEERING_ANGLE));
+
+  signalWindow taken;
+  writeSignal(SIGNAL_STEERING_ANGLE, 12);
+  takeSignalWindow(SIGNAL_STEERING_ANGLE, &taken);
+  TEST_ASSERT_EQUAL(0, taken.count);
+
+  takeSignalWindow(SIGNAL_OIL_PRESSURE, &taken);
+  writeSignal(SIGNAL_OIL_PRESSURE, 10);
+  for (int i = 0; i < 200000; i++) {
+    writeSignal(SIGNAL_OIL_PRESSURE, i == 150000 ? 90 : 50);
+  }
+  takeSignalWindow(SIGNAL_OIL_PRESSURE, &taken);
+  TEST_ASSERT_LESS_OR_EQUAL(0xFFFF, taken.count);
+  TEST_ASSERT_EQUAL(10, taken.min);
+  TEST_ASSERT_EQUAL(90, taken.max);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 50, taken.sum / taken.count);
+}
+
+int main() {
+  UNITY_BEGIN();
+  initialiseTelemetry(policies, policyCount);
+  RUN_TEST(test_replayed_drive_saves_messages_and_bytes);
+  RUN_TEST(test_idle_costs_little_more_than_the_heartbeats);
+  RUN_TEST(test_change_is_published_at_the_next_service);
+  RUN_TEST(test_short_dip_survives_the_window_but_not_a_snapshot);
+  RUN_TEST(test_windows_are_kept_only_for_windowed_signals_and_bounded);
+  return UNITY_END();
+}
@@ -0,0 +1,59 @@
+// Wheel slip from the raw 1/16 km/h wheel speeds
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "functions_traction.h"
+
+const uint16_t kmh = 16; // Raw wheel speed units per km/h
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_slip_at_speed_is_relative_to_the_front_axle() {
+  updateTractionAnalytics(100 * kmh, 100 * kmh, 105 * kmh, 105 * kmh, 1000);
+  TEST_ASSERT_EQUAL(50, getTractionValue(TRACTION_SLIP_REAR));
+  TEST_ASSERT_EQUAL(0, getTractionValue(TRACTION_SLIP_FL));
+}
+
+// The case launch control cares about, the front wheels have not moved yet
+void test_wheelspin_from_a_standstill_reports_slip() {
+  updateTractionAnalytics(0, 0, 10 * kmh, 10 * kmh, 1000);
+  TEST_ASSERT_GREATER_THAN(1000, getTractionValue(TRACTION_SLIP_REAR));
+  TEST_ASSERT_GREATER_THAN(1000, getTractionValue(TRACTION_SLIP_RL));
+
+  updateTractionAnalytics(1 * kmh, 1 * kmh, 20 * kmh, 20 * kmh, 1100);
+  TEST_ASSERT_GREATER_THAN(1000, getTractionValue(TRACTION_SLIP_REAR));
+}
+
+void test_creeping_noise_stays_small() {
+  updateTractionAnalytics(0, 0, 1, 2, 1000);
+  TEST_ASSERT_LESS_THAN(50, getTractionValue(TRACTION_SLIP_REAR));
+}
+
+void test_slip_is_clamped() {
+  updateTractionAnalytics(0, 0, 200 * kmh, 200 * kmh, 1000);
+  TEST_ASSERT_EQUAL(10000, getTractionValue(TRACTION_SLIP_REAR));
+
+  updateTractionAnalytics(2 * kmh, 2 * kmh, 0, 0, 1100);
+  TEST_ASSERT_GREATER_OR_EQUAL(-1000, getTractionValue(TRACTION_SLIP_REAR));
+}
+
+void test_rear_split_needs_a_front_reference() {
+  updateTractionAnalytics(0, 0, 10 * kmh, 5 * kmh, 1000);
+  TEST_ASSERT_EQUAL(0, getTractionValue(TRACTION_REAR_SPLIT));
+
+  updateTractionAnalytics(50 * kmh, 50 * kmh, 55 * kmh, 50 * kmh, 1100);
+  TEST_ASSERT_EQUAL(100, getTractionValue(TRACTION_REAR_SPLIT));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_slip_at_speed_is_relative_to_the_front_axle);
+  RUN_TEST(test_wheelspin_from_a_standstill_reports_slip);
+  RUN_TEST(test_creeping_noise_stays_small);
+  RUN_TEST(test_slip_is_clamped);
+  RUN_TEST(test_rear_split_needs_a_front_reference);
+  return UNITY_END();
+}
@@ -0,0 +1,158 @@
+// UDP telemetry datagrams against the same writes published over MQTT by serviceTelemetry
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <EthernetUdp.h>
+#include <PubSubClient.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "functions_config.h"
+#include "functions_mqtt.h"
+#include "functions_signals.h"
+#include "functions_telemetry.h"
+#include "functions_telemetry_udp.h"
+
+// topic, signal, source, decimals, absolute deadband, relative deadband, min interval, heartbeat, legacy ms, windowed
+telemetryPolicy policies[] = {
+    {"rpm", SIGNAL_RPM, NULL, 0, 25, 0, 50, 5000, 100, true},
+    {"coolant", SIGNAL_ENGINE_TEMP, NULL, 0, 0.5, 0, 200, 10000, 1000},
+};
+const int policyCount = sizeof(policies) / sizeof(policies[0]);
+
+struct rpmSummary {
+  float min = 1e9;
+  float max = 0;
+  unsigned long count = 0;
+};
+
+// Two seconds of RPM at the 100 Hz the ECM streams it with one frame spiking to the limiter in between datagrams
+void driveRpm(bool useUdp) {
+  for (int tick = 0; tick < 400; tick++) {
+    stubAdvanceMillis(5);
+    if (tick % 2 == 0) {
+      writeSignal(SIGNAL_RPM, tick == 200 ? 6500 : 3000 + (tick % 20));
+    }
+    serviceTelemetry(policies, policyCount);
+    if (useUdp) {
+      serviceUdpTelemetry(policies, policyCount);
+    }
+  }
+}
+
+rpmSummary rpmFromMqtt() {
+  rpmSummary summary;
+  for (stubMqttMessage &message : stubMqtt.published) {
+    if (message.topic != "rpm") {
+      continue;
+    }
+    float minimum = 0, maximum = 0;
+    unsigned long count = 0;
+    sscanf(strstr(message.payload.c_str(), "\"min\":"), "\"min\":%f,\"max\":%f,\"count\":%lu", &minimum, &maximum,
+           &count);
+    summary.min = min(summary.min, minimum);
+    summary.max = max(summary.max, maximum);
+    summary.count += count;
+  }
+  return summary;
+}
+
+std::vector<udpTelemetryDatagram> decodeDatagrams() {
+  std::vector<udpTelemetryDatagram> datagrams;
+  for (std::string &sent : stubUdpSent) {
+    udpTelemetryDatagram datagram;
+    memset(&datagram, 0, sizeof(datagram));
+    memcpy(&datagram, sent.data(), min(sent.size(), sizeof(datagram)));
+    TEST_ASSERT_EQUAL(udpTelemetryMagic, datagram.magic);
+    TEST_ASSERT_EQUAL(udpTelemetryLayoutVersion, datagram.version);
+    TEST_ASSERT_EQUAL(offsetof(udpTelemetryDatagram, windows) + datagram.windowCount * sizeof(udpTelemetryWindow),
+                      sent.size());
+    datagrams.push_back(datagram);
+  }
+  return datagrams;
+}
+
+rpmSummary rpmFromUdp() {
+  rpmSummary summary;
+  for (udpTelemetryDatagram &datagram : decodeDatagrams()) {
+    for (int i = 0; i < datagram.windowCount; i++) {
+      udpTelemetryWindow window;
+      memcpy(&window, &datagram.windows[i], sizeof(window));
+      if (window.signal != SIGNAL_RPM || window.count == 0) {
+        continue;
+      }
+      summary.min = min(summary.min, window.min);
+      summary.max = max(summary.max, window.max);
+      summary.count += window.count;
+    }
+  }
+  return summary;
+}
+
+void setUp() {
+  config = configData();
+  connectMqttClientToBroker();
+  stubMqtt.published.clear();
+  stubUdpSent.clear();
+}
+
+void tearDown() {}
+
+void test_mqtt_keeps_the_short_spike() {
+  driveRpm(false);
+  rpmSummary mqtt = rpmFromMqtt();
+  TEST_ASSERT_EQUAL(6500, mqtt.max);
+  TEST_ASSERT_EQUAL(3000, mqtt.min);
+  // Writes inside the deadband since the last publish are still waiting in the policy's window
+  TEST_ASSERT_EQUAL(200, mqtt.count + policies[0].window.count);
+}
+
+// The same writes carried over UDP reach the bridge with the same extremes and count as the PubSubClient path
+void test_udp_windows_match_mqtt() {
+  config.udpTelemetryEnabled = 1;
+  driveRpm(true);
+  config.udpTelemetryEnabled = 0;
+  serviceUdpTelemetry(policies, policyCount);
+
+  rpmSummary udp = rpmFromUdp();
+  TEST_ASSERT_GREATER_OR_EQUAL(90, stubUdpSent.size());
+  TEST_ASSERT_EQUAL(6500, udp.max);
+  TEST_ASSERT_EQUAL(3000, udp.min);
+  // The first datagram opens the socket, anything before it was already taken by serviceTelemetry
+  TEST_ASSERT_GREATER_OR_EQUAL(195, udp.count);
+
+  // Store topics are left to the bridge while UDP runs
+  for (stubMqttMessage &message : stubMqtt.published) {
+    TEST_ASSERT_TRUE(message.topic != "rpm" && message.topic != "coolant");
+  }
+}
+
+void test_values_are_the_latest_store_contents() {
+  config.udpTelemetryEnabled = 1;
+  writeSignal(SIGNAL_ENGINE_TEMP, 91.5);
+  writeSignal(SIGNAL_FAN_DUTY, 40);
+  stubAdvanceMillis(100);
+  serviceUdpTelemetry(policies, policyCount);
+  config.udpTelemetryEnabled = 0;
+  serviceUdpTelemetry(policies, policyCount);
+
+  std::vector<udpTelemetryDatagram> datagrams = decodeDatagrams();
+  TEST_ASSERT_EQUAL(1, datagrams.size());
+  float values[SIGNAL_COUNT];
+  memcpy(values, datagrams[0].values, sizeof(values));
+  TEST_ASSERT_EQUAL(SIGNAL_COUNT, datagrams[0].signalCount);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 91.5, values[SIGNAL_ENGINE_TEMP]);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 40, values[SIGNAL_FAN_DUTY]);
+  TEST_ASSERT_EQUAL(1, datagrams[0].windowCount);
+}
+
+int main() {
+  UNITY_BEGIN();
+  initialiseTelemetry(policies, policyCount);
+  RUN_TEST(test_mqtt_keeps_the_short_spike);
+  RUN_TEST(test_udp_windows_match_mqtt);
+  RUN_TEST(test_values_are_the_latest_store_contents);
+  return UNITY_END();
+}
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Print the Arduino's raw CAN stream in candump log format, without needing slcand or a vcan interface.
+
+The firmware serves slcan (LAWICEL) on TCP port 5010 for the BMW bus and 5011 for the Nissan bus once
+canStreamEnabled is set. This opens a channel the same way slcand does and prints every frame as
+
+    (1697712345.123456) bmw 316#0102030405060708
+
+which is what `candump -L` writes, so the output can be replayed with `canplayer` or read by tools that take
+candump logs. Timestamps are switched on with Z1 so the times come from the Arduino's clock as each frame was
+received, not from when the batched TCP segment reached this host.
+
+    python3 can_stream_candump.py --host 192.168.11.3 --port 5010 --interface bmw
+    python3 can_stream_candump.py --port 5011 --interface nissan > nissan.log
+"""
+
+import argparse
+import socket
+import sys
+import time
+
+
+LAWICEL_TIMESTAMP_WRAP_MS = 60000
+
+
+def parse_frame(line):
+    """Decode a LAWICEL frame (tiiildd..[tttt] or Tiiiiiiiildd..[tttt]).
+
+    Returns (id, extended, data, timestamp) with timestamp in ms 0-59999, or None when the frame has none. Returns
+    None for anything that is not a frame.
+    """
+    if len(line) < 1 or line[0] not in "tT":
+        return None
+    extended = line[0] == "T"
+    id_length = 8 if extended else 3
+    try:
+        can_id = int(line[1:1 + id_length], 16)
+        length = int(line[1 + id_length], 16)
+        data_end = 2 + id_length + 2 * length
+        if length > 8 or len(line) < data_end:
+            return None
+        data = bytes.fromhex(line[2 + id_length:data_end])
+        timestamp = int(line[data_end:data_end + 4], 16) if len(line) >= data_end + 4 else None
+    except (ValueError, IndexError):
+        return None
+    return can_id, extended, data, timestamp
+
+
+class TimestampUnwrapper:
+    """Turn the LAWICEL timestamps, which wrap every minute, into candump times.
+
+    The first frame is anchored to the host clock and every later one is placed by its distance from the previous
+    stamp. A stamp lower than the last one has wrapped. Whole minutes without any traffic can not be seen in the stamp,
+    so they are counted from the host clock instead.
+    """
+
+    def __init__(self):
+        self.start = None
+        self.elapsed_ms = 0
+        self.last_stamp = 0
+        self.last_host_time = 0
+
+    def unwrap(self, stamp, host_time):
+        if self.start is None:
+            self.start = host_time
+        else:
+            delta_ms = (stamp - self.last_stamp) % LAWICEL_TIMESTAMP_WRAP_MS
+            host_gap_ms = (host_time - self.last_host_time) * 1000
+            missed_wraps = max(0, round((host_gap_ms - delta_ms) / LAWICEL_TIMESTAMP_WRAP_MS))
+            self.elapsed_ms += delta_ms + missed_wraps * LAWICEL_TIMESTAMP_WRAP_MS
+        self.last_stamp = stamp
+        self.last_host_time = host_time
+        return self.start + self.elapsed_ms / 1000
+
+
+def format_candump(timestamp, interface, can_id, extended, data):
+    return "(%.6f) %s %s#%s" % (timestamp, interface, ("%08X" if extended else "%03X") % can_id, data.hex().upper())
+
+
+def stream(host, port, interface, output):
+    sock = socket.create_connection((host, port), timeout=5)
+    sock.settimeout(None)
+    # Close any open channel, the bit rate is fixed by the firmware so S6 is only acknowledged, timestamps on, then open
+    sock.sendall(b"C\rS6\rZ1\rO\r")
+
+    clock = TimestampUnwrapper()
+    pending = b""
+    while True:
+        received = sock.recv(4096)
+        if not received:
+            sock.close()
+            return
+        pending += received
+        *lines, pending = pending.split(b"\r")
+        now = time.time()
+        for line in lines:
+            frame = parse_frame(line.decode("ascii", "replace").strip("\a\n"))
+            if frame is None:
+                continue
+            can_id, extended, data, stamp = frame
+            timestamp = clock.unwrap(stamp, now) if stamp is not None else now
+            output.write(format_candump(timestamp, interface, can_id, extended, data) + "\n")
+        output.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="192.168.11.3", help="ethernetIp in the Arduino config")
+    parser.add_argument("--port", type=int, default=5010, help="5010 for BMW, 5011 for Nissan")
+    parser.add_argument("--interface", default="can0", help="interface name written in each line")
+    args = parser.parse_args()
+
+    try:
+        stream(args.host, args.port, args.interface, sys.stdout)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
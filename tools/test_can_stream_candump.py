@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Round trip for can_stream_candump.py against a fake Arduino speaking the firmware's slcan stream.
+
+The frames are test/test_can_stream/capture.slcan, the bytes the firmware wrote in test_can_stream, which checks its
+output against the same file.
+
+    python3 -m unittest tools/test_can_stream_candump.py
+"""
+
+import io
+import os
+import socket
+import sys
+import threading
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+import can_stream_candump  # noqa: E402
+
+
+CAPTURE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "test", "test_can_stream", "capture.slcan")
+
+
+class FakeStream:
+    """Accepts one connection, answers each command with \\r and sends the frames once the channel is opened."""
+
+    def __init__(self, stream):
+        self.stream = stream
+        self.commands = []
+        self.server = socket.socket()
+        self.server.bind(("127.0.0.1", 0))
+        self.server.listen(1)
+        self.port = self.server.getsockname()[1]
+        self.thread = threading.Thread(target=self.serve)
+        self.thread.start()
+
+    def serve(self):
+        client, _ = self.server.accept()
+        pending = b""
+        while "O" not in self.commands:
+            pending += client.recv(256)
+            *commands, pending = pending.split(b"\r")
+            for command in commands:
+                self.commands.append(command.decode())
+                client.sendall(b"\r")
+        # One segment for the lot, as the firmware batches frames before flushing
+        client.sendall(self.stream)
+        client.close()
+        self.server.close()
+
+
+class RoundTripTest(unittest.TestCase):
+    def test_frames_keep_the_arduino_spacing_across_the_minute_wrap(self):
+        # As received in test_can_stream, 10 ms before the Arduino's millis() passes a whole minute
+        sent = [("1F0", "1122334455667788"), ("153", "4006"), ("1F0", "090A0B0C0D0E0F10"), ("7E8", ""),
+                ("18DAF110", "021003")]
+        with open(CAPTURE, "rb") as capture:
+            arduino = FakeStream(capture.read())
+        output = io.StringIO()
+        can_stream_candump.stream("127.0.0.1", arduino.port, "bmw", output)
+        arduino.thread.join()
+
+        self.assertLess(arduino.commands.index("Z1"), arduino.commands.index("O"))
+
+        lines = output.getvalue().splitlines()
+        self.assertEqual(len(sent), len(lines))
+        times = []
+        for line, (can_id, data) in zip(lines, sent):
+            timestamp, interface, frame = line.split(" ")
+            times.append(float(timestamp.strip("()")))
+            self.assertEqual("bmw", interface)
+            self.assertEqual(can_id + "#" + data, frame)
+        gaps = [round(later - earlier, 3) for earlier, later in zip(times, times[1:])]
+        self.assertEqual([0.005, 0.010, 0.005, 0.0], gaps)
+
+
+class UnwrapTest(unittest.TestCase):
+    def test_wraps_are_counted_from_the_stamps(self):
+        clock = can_stream_candump.TimestampUnwrapper()
+        start = clock.unwrap(30000, 1000.0)
+        # Host receive times bunched up by batching, the stamps carry the real spacing
+        self.assertAlmostEqual(start + 40.0, clock.unwrap(10000, 1000.2))
+        self.assertAlmostEqual(start + 95.0, clock.unwrap(5000, 1055.3))
+
+    def test_silent_minutes_are_taken_from_the_host_clock(self):
+        clock = can_stream_candump.TimestampUnwrapper()
+        start = clock.unwrap(1000, 500.0)
+        # Two and a half minutes with nothing on the bus, the stamp alone would say 30 seconds
+        self.assertAlmostEqual(start + 150.0, clock.unwrap(31000, 650.05))
+
+    def test_frames_without_a_timestamp_still_parse(self):
+        self.assertEqual((0x316, False, bytes([1, 2]), None), can_stream_candump.parse_frame("t31620102"))
+        self.assertEqual((0x12345678, True, bytes([0xAA]), 59999),
+                         can_stream_candump.parse_frame("T123456781AAEA5F"))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""udp_telemetry_bridge.py against the firmware sources, a replayed link and a fake broker.
+
+    python3 -m unittest tools/test_udp_telemetry_bridge.py
+"""
+
+import os
+import shutil
+import socket
+import sys
+import tempfile
+import threading
+import unittest
+from argparse import Namespace
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+import udp_telemetry_bridge as bridge  # noqa: E402
+
+
+class FakeBroker:
+    """Accepts one PubSubClient style connection, acknowledges it and counts the QoS 0 publishes until a PINGREQ."""
+
+    def __init__(self):
+        self.publishes = []
+        self.server = socket.socket()
+        self.server.bind(("127.0.0.1", 0))
+        self.server.listen(1)
+        self.port = self.server.getsockname()[1]
+        self.thread = threading.Thread(target=self.serve)
+        self.thread.start()
+
+    def serve(self):
+        client, _ = self.server.accept()
+        while True:
+            try:
+                packet_type, body = bridge.read_mqtt_packet(client)
+            except (ConnectionError, IndexError):
+                break
+            if packet_type == 0x10:
+                client.sendall(b"\x20\x02\x00\x00")
+            elif packet_type == 0x30:
+                topic_length = int.from_bytes(body[:2], "big")
+                self.publishes.append((body[2:2 + topic_length].decode(), body[2 + topic_length:].decode()))
+            elif packet_type == 0xC0:
+                client.sendall(b"\xd0\x00")
+            elif packet_type == 0xE0:
+                break
+        client.close()
+        self.server.close()
+
+
+class PolicyTableTest(unittest.TestCase):
+    def test_store_backed_rows_are_read_from_main_cpp(self):
+        signals, policies = bridge.load_policies(bridge.DEFAULT_SRC)
+        self.assertEqual("ENGINE_TEMP", signals[0])
+        topics = {policy.topic: policy for policy in policies}
+
+        self.assertEqual(signals.index("RPM"), topics["rpm"].index)
+        self.assertTrue(topics["rpm"].windowed)
+        self.assertTrue(topics["oilPressure"].windowed)
+        self.assertFalse(topics["speed"].windowed)
+        fuel_pressure = topics["fuelPressure"]
+        self.assertEqual((2, 0.5, 200, 10000), (fuel_pressure.decimals, fuel_pressure.absolute_deadband,
+                                                fuel_pressure.min_interval_ms, fuel_pressure.heartbeat_ms))
+        # Computed values are published by the firmware itself and commented out rows are not in the table
+        self.assertNotIn("fuelRate", topics)
+        self.assertNotIn("batteryVoltage", topics)
+
+    def test_a_row_added_to_the_firmware_is_bridged(self):
+        src = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, src)
+        shutil.copy(os.path.join(bridge.DEFAULT_SRC, "functions_signals.h"), src)
+        with open(os.path.join(bridge.DEFAULT_SRC, "main.cpp"), newline="") as source:
+            main_cpp = source.read()
+        main_cpp = main_cpp.replace('    // {"batteryVoltage", SIGNAL_BATTERY_VOLTAGE',
+                                    '    {"batteryVoltage", SIGNAL_BATTERY_VOLTAGE')
+        with open(os.path.join(src, "main.cpp"), "w", newline="") as source:
+            source.write(main_cpp)
+
+        signals, policies = bridge.load_policies(src)
+        added = [policy for policy in policies if policy.topic == "batteryVoltage"]
+        self.assertEqual(1, len(added))
+        self.assertEqual(signals.index("BATTERY_VOLTAGE"), added[0].index)
+        self.assertEqual(2, added[0].decimals)
+
+
+class LinkStatsTest(unittest.TestCase):
+    def add(self, stats, *sequences):
+        for sequence in sequences:
+            stats.add(sequence, sequence * 20, sequence * 20 + 1, 100)
+
+    def test_late_datagram_fills_in_a_loss_but_a_duplicate_does_not(self):
+        stats = bridge.LinkStats()
+        self.add(stats, 1, 2, 5)
+        self.assertEqual(2, stats.lost)
+
+        self.add(stats, 3)
+        self.assertEqual((1, 1, 0), (stats.lost, stats.reordered, stats.duplicates))
+
+        # Repeats of a datagram already seen, in order or late, leave the loss alone
+        self.add(stats, 5, 3, 2)
+        self.assertEqual((1, 1, 3), (stats.lost, stats.reordered, stats.duplicates))
+
+        self.add(stats, 4)
+        self.assertEqual((0, 2, 3), (stats.lost, stats.reordered, stats.duplicates))
+
+    def test_losses_are_tracked_across_the_sequence_wrap(self):
+        stats = bridge.LinkStats()
+        self.add(stats, 0xFFFFFFFE, 1)
+        self.assertEqual(2, stats.lost)
+        self.add(stats, 0)
+        self.assertEqual((1, 1), (stats.lost, stats.reordered))
+
+    def test_a_burst_beyond_the_window_only_remembers_the_newest(self):
+        stats = bridge.LinkStats()
+        self.add(stats, 1, bridge.MISSING_SEQUENCE_WINDOW * 3)
+        self.assertEqual(bridge.MISSING_SEQUENCE_WINDOW, len(stats.missing))
+        self.add(stats, 2)
+        self.assertEqual((1, 0), (stats.duplicates, stats.reordered))
+
+
+class BenchmarkTest(unittest.TestCase):
+    def test_both_paths_carry_the_replayed_drive(self):
+        receiver = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        receiver.bind(("127.0.0.1", 0))
+        receiver.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 22)
+        self.addCleanup(receiver.close)
+        broker = FakeBroker()
+
+        args = Namespace(src=bridge.DEFAULT_SRC, benchmark=500, listen="127.0.0.1", port=receiver.getsockname()[1],
+                         mqtt_host="127.0.0.1", mqtt_port=broker.port)
+        results = bridge.run_benchmark(args)
+        broker.thread.join()
+
+        # Every publish reached the broker, and the windowed topics carry the count of samples they cover
+        self.assertEqual(results["mqtt"]["messages"], len(broker.publishes))
+        self.assertIsNotNone(results["mqtt"]["sendSeconds"])
+        rpm = [payload for topic, payload in broker.publishes if topic == "rpm"]
+        self.assertIn('"count":', rpm[-1])
+
+        # One datagram per 20 ms sample, each one decodes with the store's signal count and both windows
+        self.assertEqual(500, results["udp"]["messages"])
+        decoded = bridge.decode(receiver.recv(2048))
+        self.assertEqual(1, decoded[0])
+        self.assertEqual(len(bridge.load_signals(bridge.DEFAULT_SRC)), len(decoded[2]))
+        self.assertEqual(2, len(decoded[3]))
+
+        # Publishing by exception sends fewer, smaller messages than a datagram of every signal every sample
+        self.assertLess(results["mqtt"]["wireBytes"], results["udp"]["wireBytes"])
+        self.assertEqual(results["udp"]["payloadBytes"] + 28 * 500, results["udp"]["wireBytes"])
+
+    def test_timing_is_skipped_without_a_broker(self):
+        unused = socket.socket()
+        unused.bind(("127.0.0.1", 0))
+        port = unused.getsockname()[1]
+        unused.close()
+
+        args = Namespace(src=bridge.DEFAULT_SRC, benchmark=50, listen="127.0.0.1", port=port, mqtt_host="127.0.0.1",
+                         mqtt_port=port)
+        results = bridge.run_benchmark(args)
+        self.assertIsNone(results["mqtt"]["sendSeconds"])
+        self.assertIn("no broker", results["mqtt"]["skipped"])
+        self.assertGreater(results["mqtt"]["messages"], 0)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,452 @@
+#!/usr/bin/env python3
+"""Receive the binary UDP telemetry from the Arduino and republish it on the existing MQTT topics.
+
+Runs on the Orange Pi next to Mosquitto. The datagram layout matches udpTelemetryDatagram in
+src/functions_telemetry_udp.h and the signal order matches signalId in src/functions_signals.h.
+
+    python3 udp_telemetry_bridge.py                       # listen on 5005, publish to the local broker
+    python3 udp_telemetry_bridge.py --no-mqtt             # print loss / jitter only
+    python3 udp_telemetry_bridge.py --benchmark 20000     # UDP against MQTT for a replayed drive of 20000 samples
+
+Topics are published by exception with the deadband, minimum interval and heartbeat of the firmware's policy table,
+so the broker sees the same traffic it would over MQTT. Windowed topics carry min, max and count of every write on the
+Arduino, taken from the windows in each datagram rather than from the 20 ms samples. Loss, reordering and jitter
+(RFC 3550 style, on the Arduino timestamp) are printed and published on the "udpTelemetry" topic.
+
+The signal order and the policy table are read from the firmware sources, src/functions_signals.h and src/main.cpp,
+so a row added on the Arduino is bridged without touching this script.
+"""
+
+import argparse
+import json
+import math
+import os
+import re
+import socket
+import struct
+import time
+from collections import OrderedDict
+
+LAYOUT_VERSION = 2
+MAGIC = 0x5447
+HEADER = struct.Struct("<HBBB3xII")
+WINDOW = struct.Struct("<BxHfff")
+
+# Sequences counted as lost that a late datagram can still fill in, older ones stay lost
+MISSING_SEQUENCE_WINDOW = 4096
+
+DEFAULT_SRC = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src")
+
+
+def strip_comments(text):
+    return re.sub(r"//[^\n]*", "", text)
+
+
+def load_signals(src):
+    """signalId in functions_signals.h, in order up to SIGNAL_COUNT."""
+    with open(os.path.join(src, "functions_signals.h")) as header:
+        body = re.search(r"enum signalId \{(.*?)\};", strip_comments(header.read()), re.S).group(1)
+    names = re.findall(r"SIGNAL_(\w+)", body)
+    return names[:names.index("COUNT")]
+
+
+def load_topics(src):
+    """The store backed rows of telemetryPolicyTable in main.cpp, computed values are published by the firmware.
+
+    topic, signal, decimals, absolute deadband, relative deadband, min interval ms, heartbeat ms, windowed
+    """
+    with open(os.path.join(src, "main.cpp")) as source:
+        table = re.search(r"telemetryPolicy telemetryPolicyTable\[\] = \{(.*?)\n\};", strip_comments(source.read()),
+                          re.S).group(1)
+    topics = []
+    for row in re.findall(r"\{([^{}]*)\}", table):
+        fields = [field.strip() for field in row.split(",")]
+        topic, signal, source = fields[0].strip('"'), fields[1], fields[2]
+        if source != "NULL":
+            continue
+        windowed = len(fields) > 9 and fields[9] == "true"
+        topics.append((topic, signal[len("SIGNAL_"):], int(fields[3]), float(fields[4]), float(fields[5]),
+                       int(fields[6]), int(fields[7]), windowed))
+    return topics
+
+
+def load_policies(src):
+    signals = load_signals(src)
+    return signals, [TopicPolicy(topic, signals.index(signal), *rest) for topic, signal, *rest in load_topics(src)]
+
+
+def format_payload(value, decimals):
+    """Matches formatTelemetryValue in src/functions_telemetry.cpp, a whole number or a fixed number of decimals."""
+    return str(int(value)) if decimals == 0 else "%.*f" % (decimals, value)
+
+
+class LinkStats:
+    """Sequence loss / reordering / duplicates and interarrival jitter against the sender's timestamp."""
+
+    def __init__(self):
+        self.reset()
+        self.highest_sequence = None
+        self.missing = OrderedDict()
+        self.previous_transit = None
+        self.jitter_ms = 0.0
+
+    def reset(self):
+        self.received = 0
+        self.lost = 0
+        self.reordered = 0
+        self.duplicates = 0
+        self.bytes = 0
+
+    def add(self, sequence, timestamp_ms, arrival_ms, length):
+        self.received += 1
+        self.bytes += length
+
+        if self.highest_sequence is None:
+            self.highest_sequence = sequence
+        else:
+            gap = (sequence - self.highest_sequence) & 0xFFFFFFFF
+            if gap == 0 or gap >= 0x80000000:
+                if sequence in self.missing:
+                    # Late, it was counted as lost when the sequence moved past it
+                    del self.missing[sequence]
+                    self.reordered += 1
+                    self.lost = max(self.lost - 1, 0)
+                else:
+                    self.duplicates += 1
+            else:
+                self.lost += gap - 1
+                for skipped in range(max(1, gap - MISSING_SEQUENCE_WINDOW), gap):
+                    self.missing[(self.highest_sequence + skipped) & 0xFFFFFFFF] = None
+                while len(self.missing) > MISSING_SEQUENCE_WINDOW:
+                    self.missing.popitem(last=False)
+                self.highest_sequence = sequence
+
+        transit = arrival_ms - timestamp_ms
+        if self.previous_transit is not None:
+            self.jitter_ms += (abs(transit - self.previous_transit) - self.jitter_ms) / 16
+        self.previous_transit = transit
+
+    def summary(self, elapsed):
+        expected = self.received + self.lost
+        return {
+            "received": self.received,
+            "lost": self.lost,
+            "lossPercent": round(100.0 * self.lost / expected, 3) if expected else 0,
+            "reordered": self.reordered,
+            "duplicates": self.duplicates,
+            "datagramsPerSecond": round(self.received / elapsed, 1),
+            "bytesPerSecond": round(self.bytes / elapsed, 1),
+            "jitterMs": round(self.jitter_ms, 3),
+        }
+
+
+class TopicPolicy:
+    """One topic published by exception, the same decisions serviceTelemetry makes on the Arduino."""
+
+    def __init__(self, topic, index, decimals, absolute_deadband, relative_deadband, min_interval_ms, heartbeat_ms,
+                 windowed):
+        self.topic = topic
+        self.index = index
+        self.decimals = decimals
+        self.absolute_deadband = absolute_deadband
+        self.relative_deadband = relative_deadband
+        self.min_interval_ms = min_interval_ms
+        self.heartbeat_ms = heartbeat_ms
+        self.windowed = windowed
+        self.last_value = 0.0
+        self.last_published_ms = 0.0
+        self.ever_published = False
+        self.reset_window()
+
+    def reset_window(self):
+        self.min = 0.0
+        self.max = 0.0
+        self.sum = 0.0
+        self.count = 0
+
+    def add_window(self, count, minimum, maximum, total):
+        if count == 0:
+            return
+        self.min = minimum if self.count == 0 else min(self.min, minimum)
+        self.max = maximum if self.count == 0 else max(self.max, maximum)
+        self.sum += total
+        self.count += count
+
+    def poll(self, values, now_ms):
+        """Return the payload to publish now, or None while the value sits inside its deadband."""
+        since_last_publish = now_ms - self.last_published_ms
+        if self.ever_published and since_last_publish < self.min_interval_ms:
+            return None
+
+        deadband = max(self.absolute_deadband, self.relative_deadband * abs(self.last_value))
+        if self.windowed:
+            value = self.sum / self.count if self.count > 0 else values[self.index]
+            outside_deadband = self.count > 0 and (abs(self.min - self.last_value) > deadband or
+                                                   abs(self.max - self.last_value) > deadband)
+        else:
+            value = values[self.index]
+            outside_deadband = abs(value - self.last_value) > deadband
+
+        if self.ever_published and not outside_deadband and since_last_publish < self.heartbeat_ms:
+            return None
+
+        payload = '{"value":' + format_payload(value, self.decimals)
+        if self.windowed:
+            # A heartbeat with nothing written since the last publish repeats the value with a count of zero
+            payload += (',"min":' + format_payload(self.min if self.count else value, self.decimals) +
+                        ',"max":' + format_payload(self.max if self.count else value, self.decimals) +
+                        ',"count":' + str(self.count))
+            self.reset_window()
+        payload += "}"
+
+        self.last_value = value
+        self.last_published_ms = now_ms
+        self.ever_published = True
+        return payload
+
+
+def decode(datagram):
+    if len(datagram) < HEADER.size:
+        return None
+    magic, version, signal_count, window_count, sequence, timestamp = HEADER.unpack_from(datagram)
+    if magic != MAGIC or version != LAYOUT_VERSION:
+        return None
+    if len(datagram) != HEADER.size + 4 * signal_count + WINDOW.size * window_count:
+        return None
+    values = struct.unpack_from("<%df" % signal_count, datagram, HEADER.size)
+    windows = [WINDOW.unpack_from(datagram, HEADER.size + 4 * signal_count + WINDOW.size * i)
+               for i in range(window_count)]
+    return sequence, timestamp, values, windows
+
+
+def connect_mqtt(host, port, policies):
+    import paho.mqtt.client as mqtt  # Only needed when publishing
+
+    def on_connect(client, userdata, flags, rc):
+        # Nothing is retained by the broker, so after a reconnect every topic goes out again straight away
+        for policy in policies:
+            policy.ever_published = False
+
+    client = mqtt.Client()
+    client.on_connect = on_connect
+    client.connect(host, port)
+    client.loop_start()
+    return client
+
+
+def run_bridge(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.listen, args.port))
+    sock.settimeout(0.01)
+
+    _, policies = load_policies(args.src)
+    client = None if args.no_mqtt else connect_mqtt(args.mqtt_host, args.mqtt_port, policies)
+    stats = LinkStats()
+    latest = None
+    rejected = 0
+    report_start = time.monotonic()
+
+    while True:
+        try:
+            datagram, _ = sock.recvfrom(2048)
+            decoded = decode(datagram)
+            if decoded is None:
+                rejected += 1
+            else:
+                sequence, timestamp, values, windows = decoded
+                stats.add(sequence, timestamp, time.monotonic() * 1000, len(datagram))
+                latest = values
+                for signal, count, minimum, maximum, total in windows:
+                    for policy in policies:
+                        if policy.windowed and policy.index == signal:
+                            policy.add_window(count, minimum, maximum, total)
+        except socket.timeout:
+            pass
+
+        now = time.monotonic()
+        if latest is not None:
+            for policy in policies:
+                if policy.index >= len(latest):
+                    continue
+                payload = policy.poll(latest, now * 1000)
+                if payload is not None and client is not None:
+                    client.publish(policy.topic, payload)
+
+        if now - report_start >= args.report_s:
+            summary = stats.summary(now - report_start)
+            summary["rejected"] = rejected
+            print("udpTelemetry " + json.dumps(summary), flush=True)
+            if client is not None:
+                client.publish("udpTelemetry", json.dumps(summary, separators=(",", ":")))
+            stats.reset()
+            rejected = 0
+            report_start = now
+
+
+def encode_datagram(sequence, timestamp, values, windows):
+    datagram = HEADER.pack(MAGIC, LAYOUT_VERSION, len(values), len(windows), sequence, timestamp)
+    datagram += struct.pack("<%df" % len(values), *values)
+    for window in windows:
+        datagram += WINDOW.pack(*window)
+    return datagram
+
+
+def mqtt_remaining_length(length):
+    encoded = b""
+    while True:
+        digit, length = length % 128, length // 128
+        encoded += bytes([digit | (0x80 if length else 0)])
+        if not length:
+            return encoded
+
+
+def mqtt_string(text):
+    return struct.pack(">H", len(text)) + text.encode()
+
+
+def mqtt_connect_packet(client_id, keepalive_s=15):
+    """CONNECT as PubSubClient sends it, MQTT 3.1.1 with a clean session and its default 15 s keepalive."""
+    body = mqtt_string("MQTT") + bytes([4, 0x02]) + struct.pack(">H", keepalive_s) + mqtt_string(client_id)
+    return b"\x10" + mqtt_remaining_length(len(body)) + body
+
+
+def mqtt_publish_packet(topic, payload):
+    """QoS 0 PUBLISH, which PubSubClient writes to the Ethernet client in one call per message."""
+    body = mqtt_string(topic) + payload.encode()
+    return b"\x30" + mqtt_remaining_length(len(body)) + body
+
+
+def replay_drive(signals, policies, samples):
+    """Datagrams and MQTT publishes for the same replayed drive, sampled every 20 ms like the firmware.
+
+    RPM sweeps up and down through the gears, oil pressure follows it with a dip every few seconds and the slow
+    signals drift, so the policies publish by exception the way they do in the car.
+    """
+    rpm, oil_pressure = signals.index("RPM"), signals.index("OIL_PRESSURE")
+    windowed = [policy for policy in policies if policy.windowed]
+    datagrams, publishes = [], []
+    for sequence in range(1, samples + 1):
+        now_ms = sequence * 20
+        values = [20.0 + (now_ms / 60000.0) % 70] * len(signals)
+        values[rpm] = 3200 + 2400 * math.sin(now_ms / 4000.0)
+        values[oil_pressure] = (values[rpm] / 1000 + 0.5) * (0.4 if now_ms % 5000 < 100 else 1.0)
+
+        windows = [(policy.index, 1, values[policy.index], values[policy.index], values[policy.index])
+                   for policy in windowed]
+        datagrams.append(encode_datagram(sequence, now_ms, values, windows))
+        for index, count, minimum, maximum, total in windows:
+            for policy in windowed:
+                if policy.index == index:
+                    policy.add_window(count, minimum, maximum, total)
+        for policy in policies:
+            payload = policy.poll(values, now_ms)
+            if payload is not None:
+                publishes.append(mqtt_publish_packet(policy.topic, payload))
+    return datagrams, publishes
+
+
+def send_datagrams(datagrams, host, port):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    start = time.monotonic()
+    for datagram in datagrams:
+        sock.sendto(datagram, (host, port))
+    elapsed = time.monotonic() - start
+    sock.close()
+    return elapsed
+
+
+def read_mqtt_packet(sock):
+    header = sock.recv(1)
+    if not header:
+        raise ConnectionError("broker closed the connection")
+    length, shift = 0, 0
+    while True:
+        digit = sock.recv(1)[0]
+        length += (digit & 0x7F) << shift
+        shift += 7
+        if not digit & 0x80:
+            break
+    body = b""
+    while len(body) < length:
+        body += sock.recv(length - len(body))
+    return header[0], body
+
+
+def send_publishes(publishes, host, port):
+    """Connect like PubSubClient, publish every message then wait for a PINGRESP so the broker has read them all."""
+    sock = socket.create_connection((host, port), timeout=5)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    start = time.monotonic()
+    sock.sendall(mqtt_connect_packet("udpTelemetryBenchmark"))
+    packet_type, body = read_mqtt_packet(sock)
+    if packet_type != 0x20 or len(body) < 2 or body[1] != 0:
+        sock.close()
+        raise ConnectionError("broker refused the connection")
+    for publish in publishes:
+        sock.sendall(publish)
+    sock.sendall(b"\xc0\x00")
+    while read_mqtt_packet(sock)[0] != 0xD0:
+        pass
+    elapsed = time.monotonic() - start
+    sock.sendall(b"\xe0\x00")
+    sock.close()
+    return elapsed
+
+
+def run_benchmark(args):
+    """Carry the same replayed drive over UDP to the bridge and over MQTT the way PubSubClient does, side by side.
+
+    Wire bytes count the IPv4 and UDP or TCP headers per message, the PubSubClient path writes each publish as its
+    own segment on the W5500. Timing the MQTT path needs a broker at --mqtt-host, without one only the traffic is
+    compared.
+    """
+    signals, policies = load_policies(args.src)
+    datagrams, publishes = replay_drive(signals, policies, args.benchmark)
+    results = {}
+
+    udp_bytes = sum(len(datagram) for datagram in datagrams)
+    udp_elapsed = send_datagrams(datagrams, args.listen, args.port)
+    results["udp"] = {"messages": len(datagrams), "payloadBytes": udp_bytes,
+                      "wireBytes": udp_bytes + 28 * len(datagrams), "sendSeconds": round(udp_elapsed, 3)}
+
+    mqtt_bytes = sum(len(publish) for publish in publishes)
+    results["mqtt"] = {"messages": len(publishes), "payloadBytes": mqtt_bytes,
+                       "wireBytes": mqtt_bytes + 40 * len(publishes)}
+    try:
+        results["mqtt"]["sendSeconds"] = round(send_publishes(publishes, args.mqtt_host, args.mqtt_port), 3)
+    except OSError as error:
+        results["mqtt"]["sendSeconds"] = None
+        results["mqtt"]["skipped"] = "no broker at %s:%d, %s" % (args.mqtt_host, args.mqtt_port, error)
+
+    for path, result in results.items():
+        print("%-4s %d messages, %d payload bytes, %d bytes on the wire, %s"
+              % (path, result["messages"], result["payloadBytes"], result["wireBytes"],
+                 result.get("skipped") or "sent in %.3f s" % result["sendSeconds"]))
+    print("%d samples over %.0f s of driving, %d signals per datagram"
+          % (args.benchmark, args.benchmark * 0.02, len(signals)), flush=True)
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--listen", default="0.0.0.0", help="address to bind, or to send to with --benchmark")
+    parser.add_argument("--port", type=int, default=5005, help="udpTelemetryPort in the Arduino config")
+    parser.add_argument("--mqtt-host", default="localhost")
+    parser.add_argument("--mqtt-port", type=int, default=1883)
+    parser.add_argument("--no-mqtt", action="store_true", help="only report link statistics")
+    parser.add_argument("--report-s", type=float, default=5, help="link statistics interval")
+    parser.add_argument("--src", default=DEFAULT_SRC, help="firmware sources to read the signal and policy tables from")
+    parser.add_argument("--benchmark", type=int, metavar="N",
+                        help="replay N samples over UDP to --listen:--port and over MQTT to --mqtt-host, then exit")
+    args = parser.parse_args()
+
+    if args.benchmark:
+        if args.listen == "0.0.0.0":
+            args.listen = "127.0.0.1"
+        run_benchmark(args)
+    else:
+        run_bridge(args)
+
+
+if __name__ == "__main__":
+    main()